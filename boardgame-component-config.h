@@ -0,0 +1,924 @@
+// Config model and parsing shared by plugin and standalone tools. Depends
+// only on GLib and JSON-GLib.
+#ifndef BOARDGAME_COMPONENT_CONFIG_H
+#define BOARDGAME_COMPONENT_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+
+#include "boardgame-component-keywords.h"
+
+static const gchar* const OUT_EXTENSION = "png";
+
+typedef enum {
+  LAYER_TYPE_UNKNOWN = 0,
+  LAYER_TYPE_IMAGE = 1,
+  LAYER_TYPE_TEXT = 2,
+  LAYER_TYPE_BOOL = 3
+} LayerType;
+
+static const gchar* LAYER_TYPE_STR_UNKNOWN = "unknown";
+static const gchar* LAYER_TYPE_STR_IMAGE = "image";
+static const gchar* LAYER_TYPE_STR_TEXT = "text";
+static const gchar* LAYER_TYPE_STR_BOOL = "bool";
+
+static inline LayerType layer_type_from_str(const gchar* str) {
+  if (0 == g_strcmp0(str, LAYER_TYPE_STR_IMAGE)) return LAYER_TYPE_IMAGE;
+  if (0 == g_strcmp0(str, LAYER_TYPE_STR_TEXT)) return LAYER_TYPE_TEXT;
+  if (0 == g_strcmp0(str, LAYER_TYPE_STR_BOOL)) return LAYER_TYPE_BOOL;
+  return LAYER_TYPE_UNKNOWN;
+}
+
+static inline const gchar* str_from_layer_type(LayerType type) {
+  switch (type) {
+    case LAYER_TYPE_IMAGE: return LAYER_TYPE_STR_IMAGE;
+    case LAYER_TYPE_TEXT: return LAYER_TYPE_STR_TEXT;
+    case LAYER_TYPE_BOOL: return LAYER_TYPE_STR_BOOL;
+    default: return LAYER_TYPE_STR_UNKNOWN;
+  }
+}
+
+typedef struct {
+  LayerType type;
+  int vcenter;
+  gdouble rotate;
+} LayerConfig;
+
+typedef struct {
+  LayerConfig* config;
+  gchar* value;
+  // Spans of <<keyword>> occurrences in text value, found once on load
+  GArray* keywords;
+  // Value compiled against every XCF of template, by face, set by plugin
+  // before rendering. Faces not rendering layer have no compiled value.
+  GPtrArray* compiled;
+} LayerData;
+
+static inline LayerConfig* new_layer_config(LayerType type, int vcenter, gdouble rotate) {
+  LayerConfig* lc = malloc(sizeof(LayerConfig));
+  lc->type = type;
+  lc->vcenter = vcenter;
+  lc->rotate = rotate;
+  return lc;
+}
+
+static inline void del_layer_config(LayerConfig* lc) {
+  if (lc) free(lc);
+}
+
+static inline LayerData* new_layer_data(LayerConfig* config, gchar* value) {
+  LayerData* ld = malloc(sizeof(LayerData));
+  ld->config = config;
+  ld->value = value;
+  ld->keywords = config->type == LAYER_TYPE_TEXT && value ? find_keyword_spans(value) : NULL;
+  ld->compiled = NULL;
+  return ld;
+}
+
+static inline void del_layer_data(LayerData* ld) {
+  if (!ld) return;
+  g_free(ld->value);
+  if (ld->keywords) g_array_free(ld->keywords, TRUE);
+  if (ld->compiled) g_ptr_array_free(ld->compiled, TRUE);
+  free(ld);
+}
+
+static inline CompiledText* layer_data_compiled(LayerData* ld, guint face) {
+  if (!ld->compiled || face >= ld->compiled->len) return NULL;
+  return (CompiledText*)g_ptr_array_index(ld->compiled, face);
+}
+
+// Replaces compiled value of face, which takes compiled
+static inline void layer_data_set_compiled(LayerData* ld, guint face, CompiledText* compiled) {
+  if (!ld->compiled) ld->compiled = g_ptr_array_new_with_free_func((GDestroyNotify)&del_compiled_text);
+  if (face >= ld->compiled->len) g_ptr_array_set_size(ld->compiled, face + 1);
+  del_compiled_text((CompiledText*)g_ptr_array_index(ld->compiled, face));
+  g_ptr_array_index(ld->compiled, face) = compiled;
+}
+
+// Layer data of single data row. Rows with same hash render identical images.
+typedef struct {
+  GHashTable* layers;
+  gint count;
+  gchar* hash;
+} ComponentData;
+
+static inline ComponentData* new_component_data(GHashTable* layers, gint count, gchar* hash) {
+  ComponentData* cd = malloc(sizeof(ComponentData));
+  cd->layers = layers;
+  cd->count = count;
+  cd->hash = hash;
+  return cd;
+}
+
+static inline void del_component_data(ComponentData* cd) {
+  if (!cd) return;
+  g_hash_table_destroy(cd->layers);
+  g_free(cd->hash);
+  free(cd);
+}
+
+static inline gchar* component_layers_hash(GHashTable* layers) {
+  GList* names = g_list_sort(g_hash_table_get_keys(layers), (GCompareFunc)&g_strcmp0);
+  GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+  for (GList* n = names; n != NULL; n = n->next) {
+    LayerData* layer_data = (LayerData*)g_hash_table_lookup(layers, n->data);
+    gchar* config = g_strdup_printf("%d:%d:%.6f", layer_data->config->type, layer_data->config->vcenter, layer_data->config->rotate);
+    const gchar* value = layer_data->value ? layer_data->value : "";
+    // Hash terminating null characters too so fields cannot run into each other
+    g_checksum_update(checksum, (const guchar*)n->data, strlen(n->data) + 1);
+    g_checksum_update(checksum, (const guchar*)config, strlen(config) + 1);
+    g_checksum_update(checksum, (const guchar*)value, strlen(value) + 1);
+    g_free(config);
+  }
+  gchar* hash = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+  g_list_free(names);
+  return hash;
+}
+
+// Additional output derived from full size render by downscaling
+typedef struct {
+  gdouble scale;
+  gchar* format;
+  gchar* dir;
+  gchar* suffix;
+  gint quality;
+} OutputVariant;
+
+static inline OutputVariant* new_output_variant(gdouble scale, gchar* format, gchar* dir, gchar* suffix, gint quality) {
+  OutputVariant* ov = malloc(sizeof(OutputVariant));
+  ov->scale = scale;
+  ov->format = format;
+  ov->dir = dir;
+  ov->suffix = suffix;
+  ov->quality = quality;
+  return ov;
+}
+
+static inline void del_output_variant(OutputVariant* ov) {
+  if (!ov) return;
+  g_free(ov->format);
+  if (ov->dir) g_free(ov->dir);
+  if (ov->suffix) g_free(ov->suffix);
+  free(ov);
+}
+
+// Image rendered for every data row of template, e.g. front or back of card.
+// Suffix is appended to output name and may be NULL.
+typedef struct {
+  gchar* name;
+  gchar* suffix;
+} TemplateXcf;
+
+static inline TemplateXcf* new_template_xcf(gchar* name, gchar* suffix) {
+  TemplateXcf* tx = malloc(sizeof(TemplateXcf));
+  tx->name = name;
+  tx->suffix = suffix;
+  return tx;
+}
+
+static inline void del_template_xcf(TemplateXcf* tx) {
+  if (!tx) return;
+  g_free(tx->name);
+  if (tx->suffix) g_free(tx->suffix);
+  free(tx);
+}
+
+typedef struct {
+  GHashTable* layers;
+  GPtrArray* data;
+  gchar* out_key;
+  GPtrArray* variants;
+  GPtrArray* xcfs;
+} ComponentTemplate;
+
+static inline ComponentTemplate* new_component_template(GHashTable* layers, GPtrArray* data, gchar* out_key, GPtrArray* variants, GPtrArray* xcfs) {
+  ComponentTemplate *ct = malloc (sizeof (ComponentTemplate));
+  ct->layers = layers;
+  ct->data = data;
+  ct->out_key = out_key;
+  ct->variants = variants;
+  ct->xcfs = xcfs;
+  return ct;
+}
+
+static inline void del_component_template(ComponentTemplate* ct) {
+  if (!ct) return;
+  g_hash_table_destroy(ct->layers);
+  g_ptr_array_free(ct->data, TRUE);
+  if (ct->out_key) g_free(ct->out_key);
+  g_ptr_array_free(ct->variants, TRUE);
+  g_ptr_array_free(ct->xcfs, TRUE);
+  free(ct);
+}
+
+typedef gboolean (*HasLayerCallback)(gpointer image, const gchar* name);
+
+// Config layers rendered into one XCF of template. Template with single XCF
+// needs all of them there, so the whole table is shared. Every XCF of multi
+// XCF template gets layers it has, row data of other layers is skipped.
+static inline GHashTable* new_template_xcf_layers(ComponentTemplate* ct, HasLayerCallback has_layer, gpointer image) {
+  if (ct->xcfs->len == 1) return g_hash_table_ref(ct->layers);
+  GHashTable* layers = g_hash_table_new(g_str_hash, g_str_equal);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, ct->layers);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    if ((*has_layer)(image, key)) g_hash_table_insert(layers, key, value);
+  }
+  return layers;
+}
+
+// Returns number of config layers found in none of XCFs of template
+static inline guint check_template_layers_covered(const gchar* name, ComponentTemplate* ct, GPtrArray* xcf_layers) {
+  guint problems = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, ct->layers);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    gboolean found = FALSE;
+    for (guint i = 0; !found && i < xcf_layers->len; ++i) {
+      found = g_hash_table_contains((GHashTable*)g_ptr_array_index(xcf_layers, i), key);
+    }
+    if (!found) {
+      printf("%s: layer %s not found in any xcf of template\n", name, (gchar*)key);
+      ++problems;
+    }
+  }
+  return problems;
+}
+
+// Resolves keywords of text values of every row against icon layers of one
+// XCF of template once before any row is rendered. Only layers rendered by
+// the XCF, given by layers, are compiled for its face, so every XCF places
+// only icons it has. Keywords left as text are reported with their row,
+// returns their number.
+static inline guint compile_template_texts(const gchar* name, ComponentTemplate* ct, guint face, GHashTable* layers, GHashTable* icon_layers) {
+  guint problems = 0;
+  GPtrArray* unresolved = g_ptr_array_new_with_free_func(g_free);
+  for (guint i = 0; i < ct->data->len; ++i) {
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(ct->data, i);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, component_data->layers);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      LayerData* layer_data = (LayerData*)value;
+      if (layer_data->config->type != LAYER_TYPE_TEXT || !layer_data->value) continue;
+      if (!g_hash_table_contains(layers, key)) {
+        layer_data_set_compiled(layer_data, face, NULL);
+        continue;
+      }
+      layer_data_set_compiled(layer_data, face, compile_text(layer_data->value, layer_data->keywords, icon_layers, unresolved));
+      for (guint k = 0; k < unresolved->len; ++k) {
+        printf("%s row %u: icon <<%s>> in layer %s is not an image layer of its xcf\n", name, i,
+               (gchar*)g_ptr_array_index(unresolved, k), (gchar*)key);
+        ++problems;
+      }
+      g_ptr_array_set_size(unresolved, 0);
+    }
+  }
+  g_ptr_array_free(unresolved, TRUE);
+  return problems;
+}
+
+typedef gpointer (*NewHashTableElementCallback)(JsonReader *reader, gchar* key, void* user_data);
+
+static inline GHashTable* new_hashtable_from_json_object(JsonReader *reader, NewHashTableElementCallback callback, GDestroyNotify free_func, void* user_data, const gchar* skip_member) {
+  if (!json_reader_is_object(reader)) return NULL;
+
+  gchar** members_list = json_reader_list_members(reader);
+  GHashTable* hash_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_func);
+  for (gchar** m = members_list; *m != NULL; ++m) {
+    if (skip_member && 0 == g_strcmp0(*m, skip_member)) continue;
+    if (!json_reader_read_member(reader, *m)) {
+      json_reader_end_member(reader);
+      printf("%s is not a member\n", *m);
+      g_hash_table_destroy(hash_table);
+      g_strfreev(members_list);
+      return NULL;
+    }
+
+    gpointer data = (*callback)(reader, *m, user_data);
+    if (!data) {
+      printf("Failed to get data from %s\n", *m);
+      json_reader_end_member(reader);
+      g_hash_table_destroy(hash_table);
+      g_strfreev(members_list);
+      return NULL;
+    }
+    g_hash_table_insert(hash_table, g_strdup(*m), data);
+
+    json_reader_end_member(reader);
+  }
+  g_strfreev(members_list);
+  return hash_table;
+}
+
+typedef gpointer (*NewElementCallback)(JsonReader *reader, void* user_data);
+
+static inline GPtrArray* new_ptr_array_from_json_array(JsonReader *reader, NewElementCallback callback, GDestroyNotify free_func, void* user_data) {
+  if (!json_reader_is_array(reader)) return NULL;
+  gint elements_len = json_reader_count_elements(reader);
+  GPtrArray* ptr_array = g_ptr_array_sized_new(elements_len);
+  g_ptr_array_set_free_func(ptr_array, free_func);
+  for (gint i = 0; i < elements_len; ++i) {
+    if (!json_reader_read_element(reader, i)) {
+      g_ptr_array_free(ptr_array, TRUE);
+      return NULL;
+    }
+    gpointer data = (*callback)(reader, user_data);
+    if (!data) {
+      g_ptr_array_free(ptr_array, TRUE);
+      return NULL;
+    }
+    g_ptr_array_add(ptr_array, data);
+    json_reader_end_element(reader);
+  }
+  return ptr_array;
+}
+
+static inline gpointer new_layer_from_json(JsonReader *reader, gchar* key, void* user_data) {
+  LayerType type = LAYER_TYPE_UNKNOWN;
+  int vcenter = 0;
+  gdouble rotate = 0.0;
+
+  if (json_reader_is_value(reader)) {
+    // Simple string format: "layer_name": "text"
+    type = layer_type_from_str(json_reader_get_string_value(reader));
+    if (type == LAYER_TYPE_UNKNOWN) {
+      printf("Layer type unknown: %s\n", json_reader_get_string_value(reader));
+      return NULL;
+    }
+  } else if (json_reader_is_object(reader)) {
+    // Object format: "layer_name": {"value": "text", "vcenter": 1, "rotate": 90}
+    if (json_reader_read_member(reader, "value")) {
+      if (!json_reader_is_value(reader)) {
+        printf("%s value is not a value\n", key);
+        json_reader_end_member(reader);
+        return NULL;
+      }
+      type = layer_type_from_str(json_reader_get_string_value(reader));
+      if (type == LAYER_TYPE_UNKNOWN) {
+        printf("Layer type unknown: %s\n", json_reader_get_string_value(reader));
+        json_reader_end_member(reader);
+        return NULL;
+      }
+    } else {
+      printf("value not a member of %s\n", key);
+      json_reader_end_member(reader);
+      return NULL;
+    }
+    json_reader_end_member(reader);
+
+    // Read vcenter if present
+    if (json_reader_read_member(reader, "vcenter")) {
+      if (json_reader_is_value(reader)) {
+        vcenter = json_reader_get_boolean_value(reader) ? 1 : json_reader_get_int_value(reader);
+      }
+    }
+    json_reader_end_member(reader);
+
+    // Read rotate if present  
+    if (json_reader_read_member(reader, "rotate")) {
+      if (json_reader_is_value(reader)) {
+        rotate = json_reader_get_double_value(reader);
+      }
+    }
+    json_reader_end_member(reader);
+  } else {
+    printf("Layer definition is neither a value nor an object for key %s\n", key);
+    return NULL;
+  }
+
+  return new_layer_config(type, vcenter, rotate);
+}
+
+static inline gpointer new_layer_data_from_json(JsonReader *reader, gchar* key, void* user_data) {
+  LayerConfig* layer_config = (LayerConfig*)g_hash_table_lookup((GHashTable*)user_data, key);
+  if (!layer_config) {
+    printf("Layer config not found for key %s\n", key);
+    return NULL;
+  }
+
+  LayerType layer_type = layer_config->type;
+
+  switch (layer_type) {
+    case LAYER_TYPE_IMAGE:
+    case LAYER_TYPE_TEXT: {
+      if (!json_reader_is_value(reader)) {
+        printf("Layer data is not a value for key %s\n", key);
+        return NULL;
+      }
+      const gchar* data_value = json_reader_get_string_value(reader);
+      return new_layer_data(layer_config, g_strdup(data_value));
+    }
+    case LAYER_TYPE_BOOL: 
+      return new_layer_data(layer_config, NULL);
+    default:
+      printf("Invalid layer type for key %s\n", key);
+      return NULL;
+  }
+}
+
+static const gchar* COUNT_MEMBER = "count";
+
+static inline gpointer new_data_from_json(JsonReader *reader, void* user_data) {
+  // count is reserved for number of copies unless template has such layer
+  const gchar* skip_member = g_hash_table_contains((GHashTable*)user_data, COUNT_MEMBER) ? NULL : COUNT_MEMBER;
+  gint64 count = 1;
+  if (skip_member && json_reader_read_member(reader, COUNT_MEMBER)) {
+    if (json_reader_is_value(reader)) {
+      count = json_reader_get_int_value(reader);
+    } else {
+      count = 0;
+    }
+  }
+  json_reader_end_member(reader);
+  if (count < 1 || count > G_MAXINT) {
+    printf("Invalid %s of data row\n", COUNT_MEMBER);
+    return NULL;
+  }
+
+  GHashTable* layers = new_hashtable_from_json_object(reader, &new_layer_data_from_json, (GDestroyNotify)&del_layer_data, user_data, skip_member);
+  if (!layers) return NULL;
+  return new_component_data(layers, (gint)count, component_layers_hash(layers));
+}
+
+static inline gchar* read_string_member(JsonReader *reader, const gchar* member) {
+  gchar* ret = NULL;
+  if (json_reader_read_member(reader, member) && json_reader_is_value(reader)) {
+    ret = g_strdup(json_reader_get_string_value(reader));
+  }
+  json_reader_end_member(reader);
+  return ret;
+}
+
+// Variant format: {"scale": 0.33, "format": "jpeg", "dir": "screen", "suffix": "_small", "quality": 90}
+static inline gpointer new_variant_from_json(JsonReader *reader, void* user_data) {
+  if (!json_reader_is_object(reader)) {
+    printf("Output variant is not an object\n");
+    return NULL;
+  }
+
+  gdouble scale = 0.0;
+  if (json_reader_read_member(reader, "scale") && json_reader_is_value(reader)) {
+    scale = json_reader_get_double_value(reader);
+  }
+  json_reader_end_member(reader);
+  if (!(scale > 0.0 && scale <= 1.0)) {
+    printf("Output variant scale has to be in (0, 1] range\n");
+    return NULL;
+  }
+
+  gint64 quality = 90;
+  if (json_reader_read_member(reader, "quality") && json_reader_is_value(reader)) {
+    quality = json_reader_get_int_value(reader);
+  }
+  json_reader_end_member(reader);
+  if (quality < 0 || quality > 100) {
+    printf("Output variant quality has to be in [0, 100] range\n");
+    return NULL;
+  }
+
+  gchar* format = read_string_member(reader, "format");
+  if (!format) {
+    format = g_strdup(OUT_EXTENSION);
+  } else if (0 == g_strcmp0(format, "jpg")) {
+    g_free(format);
+    format = g_strdup("jpeg");
+  }
+  if (0 != g_strcmp0(format, "png") && 0 != g_strcmp0(format, "jpeg")) {
+    printf("Output variant format unknown: %s\n", format);
+    g_free(format);
+    return NULL;
+  }
+
+  gchar* dir = read_string_member(reader, "dir");
+  gchar* suffix = read_string_member(reader, "suffix");
+  if ((!dir || !*dir) && (!suffix || !*suffix) && 0 == g_strcmp0(format, OUT_EXTENSION)) {
+    printf("Output variant needs dir or suffix to not overwrite main output\n");
+    g_free(format);
+    if (dir) g_free(dir);
+    if (suffix) g_free(suffix);
+    return NULL;
+  }
+  if (dir && (g_path_is_absolute(dir) || strstr(dir, ".."))) {
+    printf("Output variant dir has to be relative to template output directory: %s\n", dir);
+    g_free(format);
+    g_free(dir);
+    if (suffix) g_free(suffix);
+    return NULL;
+  }
+
+  return new_output_variant(scale, format, dir, suffix, (gint)quality);
+}
+
+// Template xcf format: {"xcf": "card_back", "suffix": "_back"}
+static inline gpointer new_template_xcf_from_json(JsonReader *reader, void* user_data) {
+  if (!json_reader_is_object(reader)) {
+    printf("Template xcf is not an object\n");
+    return NULL;
+  }
+  gchar* name = read_string_member(reader, "xcf");
+  if (!name || !*name) {
+    printf("Template xcf needs xcf name\n");
+    if (name) g_free(name);
+    return NULL;
+  }
+  return new_template_xcf(name, read_string_member(reader, "suffix"));
+}
+
+// Outputs of template xcfs share directory, so their suffixes have to differ
+static inline gboolean check_template_xcf_suffixes(GPtrArray* xcfs, const gchar* key) {
+  gboolean ret = TRUE;
+  GHashTable* suffixes = g_hash_table_new(g_str_hash, g_str_equal);
+  for (guint i = 0; i < xcfs->len; ++i) {
+    TemplateXcf* xcf = (TemplateXcf*)g_ptr_array_index(xcfs, i);
+    if (!g_hash_table_add(suffixes, xcf->suffix ? xcf->suffix : "")) {
+      printf("Xcfs of %s need different suffixes\n", key);
+      ret = FALSE;
+      break;
+    }
+  }
+  g_hash_table_destroy(suffixes);
+  return ret;
+}
+
+static inline gpointer new_xcf_from_json(JsonReader *reader, gchar* key, void* user_data) {
+  if (!json_reader_is_object(reader)) {
+    printf("Not an object under key %s\n", key);
+    return NULL;
+  }
+
+  gchar* out_key = NULL;
+  if (json_reader_read_member(reader, "out")) {
+    if (json_reader_is_value(reader)) {
+      out_key = g_strdup(json_reader_get_string_value(reader));
+    }
+  }
+  json_reader_end_member(reader);
+
+  if (!json_reader_read_member(reader, "layers")) {
+    printf("layers not a member of %s\n", key);
+    return NULL;
+  }
+  GHashTable* layers = new_hashtable_from_json_object(reader, &new_layer_from_json, (GDestroyNotify)&del_layer_config, NULL, NULL);
+  if (!layers) {
+    printf("Failed to read layers from %s object\n", key);
+    if (out_key) g_free(out_key);
+    return NULL;
+  }
+  json_reader_end_member(reader);
+
+  if (!json_reader_read_member(reader, "data")) {
+    printf("data not a member of %s\n", key);
+    g_hash_table_destroy(layers);
+    if (out_key) g_free(out_key);
+    return NULL;
+  }
+
+  GPtrArray* data = new_ptr_array_from_json_array(reader, &new_data_from_json, (GDestroyNotify)&del_component_data, layers);
+  if (!data) {
+    printf("Failed to read data from %s object\n", key);
+    g_hash_table_destroy(layers);
+    if (out_key) g_free(out_key);
+    return NULL;
+  }
+
+  json_reader_end_member(reader);
+
+  GPtrArray* variants = NULL;
+  if (json_reader_read_member(reader, "variants")) {
+    variants = new_ptr_array_from_json_array(reader, &new_variant_from_json, (GDestroyNotify)&del_output_variant, NULL);
+    if (!variants) {
+      printf("Failed to read variants from %s object\n", key);
+      json_reader_end_member(reader);
+      g_hash_table_destroy(layers);
+      g_ptr_array_free(data, TRUE);
+      if (out_key) g_free(out_key);
+      return NULL;
+    }
+  } else {
+    variants = g_ptr_array_new_with_free_func((GDestroyNotify)&del_output_variant);
+  }
+  json_reader_end_member(reader);
+
+  // Template is rendered from XCF named after it unless it lists XCFs
+  // sharing its data
+  GPtrArray* xcfs = NULL;
+  if (json_reader_read_member(reader, "xcfs")) {
+    xcfs = new_ptr_array_from_json_array(reader, &new_template_xcf_from_json, (GDestroyNotify)&del_template_xcf, NULL);
+    if (xcfs && (xcfs->len == 0 || !check_template_xcf_suffixes(xcfs, key))) {
+      g_ptr_array_free(xcfs, TRUE);
+      xcfs = NULL;
+    }
+    if (!xcfs) {
+      printf("Failed to read xcfs from %s object\n", key);
+      json_reader_end_member(reader);
+      g_hash_table_destroy(layers);
+      g_ptr_array_free(data, TRUE);
+      if (out_key) g_free(out_key);
+      g_ptr_array_free(variants, TRUE);
+      return NULL;
+    }
+  } else {
+    xcfs = g_ptr_array_new_with_free_func((GDestroyNotify)&del_template_xcf);
+    g_ptr_array_add(xcfs, new_template_xcf(g_strdup(key), NULL));
+  }
+  json_reader_end_member(reader);
+
+  return new_component_template(layers, data, out_key, variants, xcfs);
+}
+
+static inline GHashTable* new_xcfs_from_json(JsonReader *reader) {
+  return new_hashtable_from_json_object(reader, &new_xcf_from_json, (GDestroyNotify)&del_component_template, NULL, NULL);
+}
+
+static inline GHashTable* parse_json_config(const gchar* config_path) {
+  JsonParser *parser = json_parser_new ();
+  GError *error = NULL;
+
+  json_parser_load_from_file (parser, config_path, &error);
+  if (error) {
+    printf("Unable to parse %s: %s\n", config_path, error->message);
+    g_error_free (error);
+    g_object_unref (parser);
+    return NULL;
+  }
+
+  JsonReader *reader = json_reader_new (json_parser_get_root (parser));
+  GHashTable* xcfs = new_xcfs_from_json(reader);
+  g_object_unref (reader);
+  g_object_unref (parser);
+
+  return xcfs;
+}
+
+// Parsed config serialised as GVariant, so unchanged configs are mapped
+// instead of parsed again. Cache file is named after hash of config contents
+// and format version, so edited configs never hit stale entries.
+#define CONFIG_CACHE_TYPE "a{s(msa{s(iid)}a(isa{sms})a(dsmsmsi)a(sms))}"
+static const gchar* CONFIG_CACHE_VERSION = "2";
+static const gchar* CONFIG_CACHE_EXTENSION = ".gvariant";
+
+static inline gchar* config_cache_path(const gchar* cache_dir, const gchar* config_path) {
+  GMappedFile* mapped_file = g_mapped_file_new(config_path, FALSE, NULL);
+  if (!mapped_file) return NULL;
+  GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+  g_checksum_update(checksum, (const guchar*)CONFIG_CACHE_VERSION, strlen(CONFIG_CACHE_VERSION) + 1);
+  g_checksum_update(checksum, (const guchar*)g_mapped_file_get_contents(mapped_file), g_mapped_file_get_length(mapped_file));
+  gchar* filename = g_strconcat(g_checksum_get_string(checksum), CONFIG_CACHE_EXTENSION, NULL);
+  gchar* cache_path = g_build_filename(cache_dir, filename, NULL);
+  g_free(filename);
+  g_checksum_free(checksum);
+  g_mapped_file_unref(mapped_file);
+  return cache_path;
+}
+
+static inline GVariant* config_to_variant(GHashTable* xcfs) {
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE(CONFIG_CACHE_TYPE));
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, xcfs);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    ComponentTemplate* ct = (ComponentTemplate*)value;
+    g_variant_builder_open(&builder, G_VARIANT_TYPE("{s(msa{s(iid)}a(isa{sms})a(dsmsmsi)a(sms))}"));
+    g_variant_builder_add(&builder, "s", (gchar*)key);
+    g_variant_builder_open(&builder, G_VARIANT_TYPE("(msa{s(iid)}a(isa{sms})a(dsmsmsi)a(sms))"));
+    g_variant_builder_add(&builder, "ms", ct->out_key);
+
+    GHashTableIter layers_iter;
+    gpointer layer_name, layer_config;
+    g_variant_builder_open(&builder, G_VARIANT_TYPE("a{s(iid)}"));
+    g_hash_table_iter_init(&layers_iter, ct->layers);
+    while (g_hash_table_iter_next(&layers_iter, &layer_name, &layer_config)) {
+      LayerConfig* lc = (LayerConfig*)layer_config;
+      g_variant_builder_add(&builder, "{s(iid)}", (gchar*)layer_name, (gint32)lc->type, (gint32)lc->vcenter, lc->rotate);
+    }
+    g_variant_builder_close(&builder);
+
+    g_variant_builder_open(&builder, G_VARIANT_TYPE("a(isa{sms})"));
+    for (guint i = 0; i < ct->data->len; ++i) {
+      ComponentData* component_data = (ComponentData*)g_ptr_array_index(ct->data, i);
+      g_variant_builder_open(&builder, G_VARIANT_TYPE("(isa{sms})"));
+      g_variant_builder_add(&builder, "i", (gint32)component_data->count);
+      g_variant_builder_add(&builder, "s", component_data->hash);
+      GHashTableIter data_iter;
+      gpointer data_name, layer_data;
+      g_variant_builder_open(&builder, G_VARIANT_TYPE("a{sms}"));
+      g_hash_table_iter_init(&data_iter, component_data->layers);
+      while (g_hash_table_iter_next(&data_iter, &data_name, &layer_data)) {
+        g_variant_builder_add(&builder, "{sms}", (gchar*)data_name, ((LayerData*)layer_data)->value);
+      }
+      g_variant_builder_close(&builder);
+      g_variant_builder_close(&builder);
+    }
+    g_variant_builder_close(&builder);
+
+    g_variant_builder_open(&builder, G_VARIANT_TYPE("a(dsmsmsi)"));
+    for (guint i = 0; i < ct->variants->len; ++i) {
+      OutputVariant* ov = (OutputVariant*)g_ptr_array_index(ct->variants, i);
+      g_variant_builder_add(&builder, "(dsmsmsi)", ov->scale, ov->format, ov->dir, ov->suffix, (gint32)ov->quality);
+    }
+    g_variant_builder_close(&builder);
+
+    g_variant_builder_open(&builder, G_VARIANT_TYPE("a(sms)"));
+    for (guint i = 0; i < ct->xcfs->len; ++i) {
+      TemplateXcf* xcf = (TemplateXcf*)g_ptr_array_index(ct->xcfs, i);
+      g_variant_builder_add(&builder, "(sms)", xcf->name, xcf->suffix);
+    }
+    g_variant_builder_close(&builder);
+
+    g_variant_builder_close(&builder);
+    g_variant_builder_close(&builder);
+  }
+  return g_variant_ref_sink(g_variant_builder_end(&builder));
+}
+
+static inline ComponentTemplate* new_component_template_from_variant(GVariant* template) {
+  const gchar* out_key;
+  GVariant* layers_variant;
+  GVariant* data_variant;
+  GVariant* variants_variant;
+  GVariant* xcfs_variant;
+  g_variant_get(template, "(m&s@a{s(iid)}@a(isa{sms})@a(dsmsmsi)@a(sms))", &out_key, &layers_variant, &data_variant, &variants_variant, &xcfs_variant);
+
+  GHashTable* layers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)&del_layer_config);
+  GVariantIter iter;
+  const gchar* name;
+  gint32 type, vcenter;
+  gdouble rotate;
+  g_variant_iter_init(&iter, layers_variant);
+  while (g_variant_iter_next(&iter, "{&s(iid)}", &name, &type, &vcenter, &rotate)) {
+    g_hash_table_insert(layers, g_strdup(name), new_layer_config((LayerType)type, vcenter, rotate));
+  }
+
+  gboolean ok = TRUE;
+  GPtrArray* data = g_ptr_array_new_with_free_func((GDestroyNotify)&del_component_data);
+  gint32 count;
+  const gchar* hash;
+  GVariant* row_variant;
+  g_variant_iter_init(&iter, data_variant);
+  while (ok && g_variant_iter_next(&iter, "(i&s@a{sms})", &count, &hash, &row_variant)) {
+    GHashTable* row = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)&del_layer_data);
+    GVariantIter row_iter;
+    const gchar* row_value;
+    g_variant_iter_init(&row_iter, row_variant);
+    while (g_variant_iter_next(&row_iter, "{&sm&s}", &name, &row_value)) {
+      LayerConfig* layer_config = (LayerConfig*)g_hash_table_lookup(layers, name);
+      if (!layer_config) {
+        ok = FALSE;
+        break;
+      }
+      g_hash_table_insert(row, g_strdup(name), new_layer_data(layer_config, g_strdup(row_value)));
+    }
+    g_ptr_array_add(data, new_component_data(row, count, g_strdup(hash)));
+    g_variant_unref(row_variant);
+  }
+
+  GPtrArray* variants = g_ptr_array_new_with_free_func((GDestroyNotify)&del_output_variant);
+  gdouble scale;
+  const gchar *format, *dir, *suffix;
+  gint32 quality;
+  g_variant_iter_init(&iter, variants_variant);
+  while (g_variant_iter_next(&iter, "(d&sm&sm&si)", &scale, &format, &dir, &suffix, &quality)) {
+    g_ptr_array_add(variants, new_output_variant(scale, g_strdup(format), g_strdup(dir), g_strdup(suffix), quality));
+  }
+
+  GPtrArray* xcfs = g_ptr_array_new_with_free_func((GDestroyNotify)&del_template_xcf);
+  g_variant_iter_init(&iter, xcfs_variant);
+  while (g_variant_iter_next(&iter, "(&sm&s)", &name, &suffix)) {
+    g_ptr_array_add(xcfs, new_template_xcf(g_strdup(name), g_strdup(suffix)));
+  }
+  ok = ok && xcfs->len > 0;
+
+  g_variant_unref(xcfs_variant);
+  g_variant_unref(variants_variant);
+  g_variant_unref(data_variant);
+  g_variant_unref(layers_variant);
+  ComponentTemplate* ct = new_component_template(layers, data, g_strdup(out_key), variants, xcfs);
+  if (!ok) {
+    del_component_template(ct);
+    return NULL;
+  }
+  return ct;
+}
+
+static inline GHashTable* load_config_cache(const gchar* cache_path) {
+  GMappedFile* mapped_file = g_mapped_file_new(cache_path, FALSE, NULL);
+  if (!mapped_file) return NULL;
+  GBytes* bytes = g_mapped_file_get_bytes(mapped_file);
+  // Not trusted, so damaged files only result in broken entries, which
+  // are rejected below
+  GVariant* variant = g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(CONFIG_CACHE_TYPE), bytes, FALSE));
+  GHashTable* xcfs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)&del_component_template);
+  GVariantIter iter;
+  const gchar* name;
+  GVariant* template;
+  g_variant_iter_init(&iter, variant);
+  while (g_variant_iter_next(&iter, "{&s@(msa{s(iid)}a(isa{sms})a(dsmsmsi)a(sms))}", &name, &template)) {
+    ComponentTemplate* ct = new_component_template_from_variant(template);
+    g_variant_unref(template);
+    if (!ct) {
+      g_hash_table_destroy(xcfs);
+      xcfs = NULL;
+      break;
+    }
+    g_hash_table_insert(xcfs, g_strdup(name), ct);
+  }
+  g_variant_unref(variant);
+  g_bytes_unref(bytes);
+  g_mapped_file_unref(mapped_file);
+  return xcfs;
+}
+
+static inline void store_config_cache(const gchar* cache_path, GHashTable* xcfs) {
+  gchar* cache_dir = g_path_get_dirname(cache_path);
+  if (g_mkdir_with_parents(cache_dir, 0755) != 0) {
+    printf("Unable to make directory %s\n", cache_dir);
+    g_free(cache_dir);
+    return;
+  }
+
+  // Entries of previous config versions are never used again
+  GDir* dir = g_dir_open(cache_dir, 0, NULL);
+  if (dir) {
+    const gchar* filename;
+    while ((filename = g_dir_read_name(dir)) != NULL) {
+      if (!g_str_has_suffix(filename, CONFIG_CACHE_EXTENSION)) continue;
+      gchar* path = g_build_filename(cache_dir, filename, NULL);
+      g_unlink(path);
+      g_free(path);
+    }
+    g_dir_close(dir);
+  }
+
+  GVariant* variant = config_to_variant(xcfs);
+  GError* error = NULL;
+  // Written to temporary file and renamed, so readers never map partial file
+  if (!g_file_set_contents(cache_path, g_variant_get_data(variant), g_variant_get_size(variant), &error)) {
+    printf("Unable to store config cache %s: %s\n", cache_path, error->message);
+    g_error_free(error);
+  }
+  g_variant_unref(variant);
+  g_free(cache_dir);
+}
+
+// Returns parsed config, from cache in cache_dir when config did not change.
+// cache_dir may be NULL to always parse config.
+static inline GHashTable* load_config(const gchar* config_path, const gchar* cache_dir) {
+  gchar* cache_path = cache_dir ? config_cache_path(cache_dir, config_path) : NULL;
+  GHashTable* xcfs = cache_path ? load_config_cache(cache_path) : NULL;
+  if (!xcfs) {
+    xcfs = parse_json_config(config_path);
+    if (xcfs && cache_path) {
+      store_config_cache(cache_path, xcfs);
+    }
+  }
+  g_free(cache_path);
+  return xcfs;
+}
+
+// Replaces characters unsafe in filenames with underscores in place
+static inline gchar* sanitize_out_name(gchar* name) {
+  for (char* p = name; *p; ++p) {
+    if (!(g_ascii_isalnum(*p) || *p == '-' || *p == '_')) {
+      *p = '_';
+    }
+  }
+  return name;
+}
+
+// Output file of data row. Suffix of template xcf, which may be NULL, goes
+// after name and copies beyond the first get -<copy> suffix.
+static inline gchar* new_component_out_file(int i, GHashTable* component_layers, gchar* out_dir, gchar* out_key, const gchar* suffix, gint copy) {
+  gchar* name = NULL;
+  if (out_key) {
+    LayerData* out_layer = (LayerData*)g_hash_table_lookup(component_layers, out_key);
+    if (out_layer && out_layer->value) {
+        name = g_strdup(out_layer->value);
+    }
+  }
+  if (!name) {
+    name = g_strdup_printf("%d", i);
+  }
+  if (suffix) {
+    gchar* suffixed = g_strconcat(name, suffix, NULL);
+    g_free(name);
+    name = suffixed;
+  }
+  sanitize_out_name(name);
+  gchar* filename = copy > 1 ? g_strdup_printf("%s-%d.%s", name, copy, OUT_EXTENSION) : g_strdup_printf("%s.%s", name, OUT_EXTENSION);
+  gchar* out_file = g_build_filename(out_dir, filename, NULL);
+  g_free(filename);
+  g_free(name);
+  return out_file;
+}
+
+#endif // BOARDGAME_COMPONENT_CONFIG_H
@@ -8,308 +8,2521 @@
 #include <pango/pango.h>
 #include <pango/pangocairo.h>
 #include <cairo.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <gio/gunixsocketaddress.h>
+#include <setjmp.h>
+#include <malloc.h>
+#include <jpeglib.h>
+#include <png.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "boardgame-component-config.h"
+#include "boardgame-component-keywords.h"
+#include "boardgame-component-pack.h"
+#include "boardgame-component-raw.h"
 
 #define PLUG_IN_PROC "boardgame-component-generator"
+#define SERVER_PROC "boardgame-component-generator-server"
 
-static const gchar* const OUT_EXTENSION = "png";
+typedef struct {
+  gint prefetch_rows;
+  gint64 prefetch_bytes;
+  gint prefetch_threads;
+  gboolean asset_cache;
+  gint64 asset_cache_bytes;
+  gint64 memory_budget;
+  gboolean dry_run;
+  gboolean config_cache;
+  gboolean text_prepass;
+  gchar* events;
+  gboolean verbose;
+  gint64 layer_cache_bytes;
+  // Working precision names by template name, "*" for all other templates
+  GHashTable* precision;
+  gboolean track_allocations;
+  gint64 track_allocations_rows;
+  gint64 max_row_growth;
+  gchar* asset_pack;
+  // "tar" or "zip" to stream outputs into archive, NULL for loose files
+  gchar* archive;
+  gboolean archive_project;
+  // Ring raw pixels are published into instead of output files
+  gchar* raw_output;
+  gint64 raw_output_slots;
+  gint64 raw_output_frame_bytes;
+  gboolean keep_going;
+  gchar* failure_report;
+} GeneratorOptions;
+
+static const gint DEFAULT_PREFETCH_ROWS = 4;
+static const gint64 DEFAULT_PREFETCH_BYTES = 256 * 1024 * 1024;
+static const gint64 DEFAULT_LAYER_CACHE_BYTES = 128 * 1024 * 1024;
+static const gint64 DEFAULT_ASSET_CACHE_BYTES = 512 * 1024 * 1024;
+static const gint64 DEFAULT_TRACK_ALLOCATIONS_ROWS = 10;
+static const gint64 DEFAULT_RAW_OUTPUT_SLOTS = 4;
+static const gint64 DEFAULT_RAW_OUTPUT_FRAME_BYTES = 64 * 1024 * 1024;
+
+GeneratorOptions* new_generator_options(void) {
+  GeneratorOptions* go = malloc(sizeof(GeneratorOptions));
+  go->prefetch_rows = DEFAULT_PREFETCH_ROWS;
+  go->prefetch_bytes = DEFAULT_PREFETCH_BYTES;
+  go->prefetch_threads = g_get_num_processors();
+  go->asset_cache = TRUE;
+  go->asset_cache_bytes = DEFAULT_ASSET_CACHE_BYTES;
+  go->memory_budget = 0;
+  go->dry_run = FALSE;
+  go->config_cache = TRUE;
+  go->text_prepass = FALSE;
+  go->events = NULL;
+  go->verbose = FALSE;
+  go->layer_cache_bytes = DEFAULT_LAYER_CACHE_BYTES;
+  go->precision = NULL;
+  go->track_allocations = FALSE;
+  go->track_allocations_rows = DEFAULT_TRACK_ALLOCATIONS_ROWS;
+  go->max_row_growth = 0;
+  go->asset_pack = NULL;
+  go->archive = NULL;
+  go->archive_project = FALSE;
+  go->raw_output = NULL;
+  go->raw_output_slots = DEFAULT_RAW_OUTPUT_SLOTS;
+  go->raw_output_frame_bytes = DEFAULT_RAW_OUTPUT_FRAME_BYTES;
+  go->keep_going = FALSE;
+  go->failure_report = g_strdup("failures.json");
+  return go;
+}
+
+void del_generator_options(GeneratorOptions* go) {
+  if (!go) return;
+  g_free(go->events);
+  g_free(go->asset_pack);
+  g_free(go->archive);
+  g_free(go->raw_output);
+  g_free(go->failure_report);
+  if (go->precision) g_hash_table_destroy(go->precision);
+  free(go);
+}
+
+static gboolean read_int_option(JsonReader *reader, const gchar* name, gint64* value) {
+  gboolean ret = TRUE;
+  if (json_reader_read_member(reader, name)) {
+    if (json_reader_is_value(reader)) {
+      *value = json_reader_get_int_value(reader);
+    } else {
+      printf("Option %s is not a value\n", name);
+      ret = FALSE;
+    }
+  }
+  json_reader_end_member(reader);
+  return ret;
+}
+
+static gboolean read_bool_option(JsonReader *reader, const gchar* name, gboolean* value) {
+  gboolean ret = TRUE;
+  if (json_reader_read_member(reader, name)) {
+    if (json_reader_is_value(reader)) {
+      *value = json_reader_get_boolean_value(reader);
+    } else {
+      printf("Option %s is not a value\n", name);
+      ret = FALSE;
+    }
+  }
+  json_reader_end_member(reader);
+  return ret;
+}
+
+// null unsets option, e.g. archive of project in job request
+static gboolean read_string_option(JsonReader *reader, const gchar* name, gchar** value) {
+  gboolean ret = TRUE;
+  if (json_reader_read_member(reader, name)) {
+    const gchar* str = json_reader_is_value(reader) ? json_reader_get_string_value(reader) : NULL;
+    if (json_reader_get_null_value(reader)) {
+      g_clear_pointer(value, g_free);
+    } else if (str) {
+      g_free(*value);
+      *value = g_strdup(str);
+    } else {
+      printf("Option %s is not a string\n", name);
+      ret = FALSE;
+    }
+  }
+  json_reader_end_member(reader);
+  return ret;
+}
+
+// Component precisions of working image, optionally followed by "-linear"
+static const gchar* const PRECISION_NAMES[] = {"u8", "u16", "u32", "half", "float", "double", NULL};
+
+// Returns index of precision in PRECISION_NAMES or -1 for unknown name
+static gint precision_index(const gchar* name, gboolean* linear) {
+  gsize len = strlen(name);
+  *linear = g_str_has_suffix(name, "-linear");
+  if (*linear) len -= strlen("-linear");
+  for (gint i = 0; PRECISION_NAMES[i]; ++i) {
+    if (strlen(PRECISION_NAMES[i]) == len && 0 == strncmp(PRECISION_NAMES[i], name, len)) return i;
+  }
+  return -1;
+}
+
+static gboolean add_template_precision(GeneratorOptions* options, const gchar* template_name, const gchar* name) {
+  gboolean linear;
+  if (!name || precision_index(name, &linear) < 0) {
+    printf("Unknown precision %s\n", name ? name : "");
+    return FALSE;
+  }
+  if (!options->precision) options->precision = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  g_hash_table_replace(options->precision, g_strdup(template_name), g_strdup(name));
+  return TRUE;
+}
+
+// Precision is either a single name for all templates or an object with
+// template names and "*" for the rest
+static gboolean read_precision_option(JsonReader *reader, GeneratorOptions* options) {
+  gboolean ret = TRUE;
+  if (json_reader_read_member(reader, "precision")) {
+    if (json_reader_is_value(reader)) {
+      ret = add_template_precision(options, "*", json_reader_get_string_value(reader));
+    } else if (json_reader_is_object(reader)) {
+      gchar** names = json_reader_list_members(reader);
+      for (gchar** name = names; ret && *name; ++name) {
+        json_reader_read_member(reader, *name);
+        ret = json_reader_is_value(reader) && add_template_precision(options, *name, json_reader_get_string_value(reader));
+        json_reader_end_member(reader);
+      }
+      g_strfreev(names);
+    } else {
+      ret = FALSE;
+    }
+    if (!ret) printf("Option precision is not valid\n");
+  }
+  json_reader_end_member(reader);
+  return ret;
+}
+
+// Returns precision name for template or NULL to keep precision of XCF
+static const gchar* template_precision(GeneratorOptions* options, const gchar* template_name) {
+  if (!options->precision) return NULL;
+  const gchar* name = (const gchar*)g_hash_table_lookup(options->precision, template_name);
+  return name ? name : (const gchar*)g_hash_table_lookup(options->precision, "*");
+}
+
+// Archive is "tar" or "zip", its scope "template" or "project"
+static gboolean read_archive_options(JsonReader *reader, GeneratorOptions* options) {
+  gchar* scope = NULL;
+  gboolean ret = read_string_option(reader, "archive", &options->archive) && read_string_option(reader, "archive_scope", &scope);
+  if (ret && options->archive && 0 != g_strcmp0(options->archive, "tar") && 0 != g_strcmp0(options->archive, "zip")) {
+    printf("Unknown archive format %s\n", options->archive);
+    ret = FALSE;
+  }
+  if (ret && scope && 0 != g_strcmp0(scope, "template") && 0 != g_strcmp0(scope, "project")) {
+    printf("Unknown archive scope %s\n", scope);
+    ret = FALSE;
+  }
+  if (scope) options->archive_project = 0 == g_strcmp0(scope, "project");
+  g_free(scope);
+  return ret;
+}
+
+// Options telling where and how outputs are written. Jobs of job server may
+// override them.
+static gboolean read_output_options(JsonReader *reader, GeneratorOptions* options) {
+  gboolean ok = read_archive_options(reader, options);
+  ok = ok && read_string_option(reader, "raw_output", &options->raw_output);
+  ok = ok && read_int_option(reader, "raw_output_slots", &options->raw_output_slots);
+  ok = ok && read_int_option(reader, "raw_output_frame_bytes", &options->raw_output_frame_bytes);
+  ok = ok && read_bool_option(reader, "keep_going", &options->keep_going);
+  ok = ok && read_string_option(reader, "failure_report", &options->failure_report);
+  if (ok && !options->failure_report) {
+    printf("Option failure_report can not be null\n");
+    ok = FALSE;
+  }
+  if (ok && options->raw_output && options->archive) {
+    printf("Options archive and raw_output can not be used together\n");
+    ok = FALSE;
+  }
+  if (ok && (options->raw_output_slots < 1 || options->raw_output_slots > G_MAXINT32 || options->raw_output_frame_bytes < 0)) {
+    printf("Options raw_output_slots and raw_output_frame_bytes are not valid\n");
+    ok = FALSE;
+  }
+  return ok;
+}
+
+// Applies output options of job, JSON object, over options of project
+static gboolean apply_job_options(GeneratorOptions* options, const gchar* job_options) {
+  JsonParser *parser = json_parser_new();
+  gboolean ok = json_parser_load_from_data(parser, job_options, -1, NULL);
+  JsonReader *reader = ok ? json_reader_new(json_parser_get_root(parser)) : NULL;
+  ok = ok && json_reader_is_object(reader) && read_output_options(reader, options);
+  if (!ok) printf("Invalid options of job: %s\n", job_options);
+  if (reader) g_object_unref(reader);
+  g_object_unref(parser);
+  return ok;
+}
+
+// Reads optional project wide options. Missing file means defaults.
+static GeneratorOptions* parse_json_options(const gchar* options_path) {
+  GeneratorOptions* options = new_generator_options();
+  if (!g_file_test(options_path, G_FILE_TEST_EXISTS)) {
+    return options;
+  }
+
+  JsonParser *parser = json_parser_new ();
+  GError *error = NULL;
+
+  json_parser_load_from_file (parser, options_path, &error);
+  if (error) {
+    printf("Unable to parse %s: %s\n", options_path, error->message);
+    g_error_free (error);
+    g_object_unref (parser);
+    del_generator_options(options);
+    return NULL;
+  }
+
+  JsonReader *reader = json_reader_new (json_parser_get_root (parser));
+  gboolean ok = json_reader_is_object(reader);
+  gint64 prefetch_rows = options->prefetch_rows;
+  gint64 prefetch_bytes = options->prefetch_bytes;
+  gint64 prefetch_threads = options->prefetch_threads;
+  ok = ok && read_int_option(reader, "prefetch_rows", &prefetch_rows);
+  ok = ok && read_int_option(reader, "prefetch_bytes", &prefetch_bytes);
+  ok = ok && read_int_option(reader, "prefetch_threads", &prefetch_threads);
+  ok = ok && read_bool_option(reader, "asset_cache", &options->asset_cache);
+  ok = ok && read_int_option(reader, "asset_cache_bytes", &options->asset_cache_bytes);
+  ok = ok && read_int_option(reader, "memory_budget", &options->memory_budget);
+  ok = ok && read_bool_option(reader, "dry_run", &options->dry_run);
+  ok = ok && read_bool_option(reader, "config_cache", &options->config_cache);
+  ok = ok && read_bool_option(reader, "text_prepass", &options->text_prepass);
+  ok = ok && read_string_option(reader, "events", &options->events);
+  ok = ok && read_bool_option(reader, "verbose", &options->verbose);
+  ok = ok && read_int_option(reader, "layer_cache_bytes", &options->layer_cache_bytes);
+  ok = ok && read_precision_option(reader, options);
+  ok = ok && read_bool_option(reader, "track_allocations", &options->track_allocations);
+  ok = ok && read_int_option(reader, "track_allocations_rows", &options->track_allocations_rows);
+  ok = ok && read_int_option(reader, "max_row_growth", &options->max_row_growth);
+  ok = ok && read_string_option(reader, "asset_pack", &options->asset_pack);
+  ok = ok && read_output_options(reader, options);
+  g_object_unref (reader);
+  g_object_unref (parser);
+
+  if (!ok || prefetch_rows < 0 || prefetch_bytes < 0 || prefetch_threads < 1 || options->asset_cache_bytes < 0 || options->memory_budget < 0 || options->layer_cache_bytes < 0 ||
+      options->track_allocations_rows < 1 || options->max_row_growth < 0) {
+    printf("Invalid options in %s\n", options_path);
+    del_generator_options(options);
+    return NULL;
+  }
+  options->prefetch_rows = (gint)prefetch_rows;
+  options->prefetch_bytes = prefetch_bytes;
+  options->prefetch_threads = (gint)prefetch_threads;
+  return options;
+}
+
+// Per layer details are printed only with verbose option. Arguments are not
+// evaluated otherwise, so disabled output costs a single branch.
+static gboolean verbose_output = FALSE;
+#define debug_printf(...) do { if (G_UNLIKELY(verbose_output)) printf(__VA_ARGS__); } while (0)
+
+// Bytes of asset file. With asset pack assets come from its mapping, unless
+// they are missing from pack or changed since it was built.
+static GBytes* read_asset_bytes(AssetPack* asset_pack, const gchar* path) {
+  if (asset_pack) {
+    GBytes* bytes = asset_pack_lookup_path(asset_pack, path);
+    if (bytes) return bytes;
+  }
+  GMappedFile* mapped_file = g_mapped_file_new(path, FALSE, NULL);
+  if (!mapped_file) return NULL;
+  GBytes* bytes = g_mapped_file_get_bytes(mapped_file);
+  g_mapped_file_unref(mapped_file);
+  return bytes;
+}
+
+// Decodes asset bytes at full size with generic loader
+static GdkPixbuf* new_pixbuf_from_asset_bytes(GBytes* bytes, gint width, gint height) {
+  GInputStream* stream = g_memory_input_stream_new_from_bytes(bytes);
+  GError* error = NULL;
+  GdkPixbuf* pixbuf = width > 0 ? gdk_pixbuf_new_from_stream_at_scale(stream, width, height, FALSE, NULL, &error)
+                                : gdk_pixbuf_new_from_stream(stream, NULL, &error);
+  g_object_unref(stream);
+  if (error) {
+    g_error_free(error);
+    return NULL;
+  }
+  return pixbuf;
+}
+
+// JSON lines describing progress of generation, written to file or to
+// inherited file descriptor given as "fd:N". Every line is flushed, so
+// orchestrating tools can follow it while generation runs.
+typedef struct {
+  FILE* file;
+  gint64 start;
+  gint64 template_start;
+  gint64 row_start;
+  gchar* template_name;
+  guint rows_done;
+  guint rows_total;
+} EventLog;
+
+EventLog* new_event_log(FILE* file, guint rows_total) {
+  EventLog* el = malloc(sizeof(EventLog));
+  el->file = file;
+  el->start = g_get_monotonic_time();
+  el->template_start = el->start;
+  el->row_start = el->start;
+  el->template_name = NULL;
+  el->rows_done = 0;
+  el->rows_total = rows_total;
+  return el;
+}
+
+void del_event_log(EventLog* el) {
+  if (!el) return;
+  fclose(el->file);
+  g_free(el->template_name);
+  free(el);
+}
+
+// Inherited descriptor is duplicated, so closing event log leaves the
+// caller's descriptor open
+static FILE* open_event_target(const gchar* target) {
+  FILE* file = NULL;
+  if (g_str_has_prefix(target, "fd:")) {
+    int fd = dup(atoi(target + 3));
+    file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!file && fd >= 0) close(fd);
+  } else {
+    file = fopen(target, "w");
+  }
+  if (!file) printf("Unable to open event stream %s\n", target);
+  return file;
+}
+
+static JsonBuilder* event_log_begin(EventLog* el, const gchar* event) {
+  JsonBuilder* builder = json_builder_new();
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "event");
+  json_builder_add_string_value(builder, event);
+  json_builder_set_member_name(builder, "time");
+  json_builder_add_double_value(builder, (g_get_monotonic_time() - el->start) / 1e6);
+  if (el->template_name) {
+    json_builder_set_member_name(builder, "template");
+    json_builder_add_string_value(builder, el->template_name);
+  }
+  return builder;
+}
+
+static void event_log_write(EventLog* el, JsonBuilder* builder) {
+  json_builder_end_object(builder);
+  JsonNode* root = json_builder_get_root(builder);
+  JsonGenerator* generator = json_generator_new();
+  json_generator_set_root(generator, root);
+  gchar* json = json_generator_to_data(generator, NULL);
+  fprintf(el->file, "%s\n", json);
+  fflush(el->file);
+  g_free(json);
+  g_object_unref(generator);
+  json_node_free(root);
+  g_object_unref(builder);
+}
+
+static void event_log_template_start(EventLog* el, const gchar* name, guint rows) {
+  if (!el) return;
+  g_free(el->template_name);
+  el->template_name = g_strdup(name);
+  el->template_start = g_get_monotonic_time();
+  JsonBuilder* builder = event_log_begin(el, "template_start");
+  json_builder_set_member_name(builder, "rows");
+  json_builder_add_int_value(builder, rows);
+  event_log_write(el, builder);
+}
+
+static void event_log_template_end(EventLog* el, gboolean ok) {
+  if (!el) return;
+  JsonBuilder* builder = event_log_begin(el, "template_end");
+  json_builder_set_member_name(builder, "ok");
+  json_builder_add_boolean_value(builder, ok);
+  json_builder_set_member_name(builder, "duration");
+  json_builder_add_double_value(builder, (g_get_monotonic_time() - el->template_start) / 1e6);
+  event_log_write(el, builder);
+  g_free(el->template_name);
+  el->template_name = NULL;
+}
+
+static void event_log_row_start(EventLog* el) {
+  if (el) el->row_start = g_get_monotonic_time();
+}
+
+// Throughput is averaged over whole run, ETA covers all remaining rows of
+// all templates
+static void event_log_row_done(EventLog* el, guint row, const gchar* out_file) {
+  if (!el) return;
+  gint64 now = g_get_monotonic_time();
+  ++el->rows_done;
+  gdouble elapsed = (now - el->start) / 1e6;
+  gdouble rate = elapsed > 0.0 ? el->rows_done / elapsed : 0.0;
+  JsonBuilder* builder = event_log_begin(el, "row_done");
+  json_builder_set_member_name(builder, "row");
+  json_builder_add_int_value(builder, row);
+  json_builder_set_member_name(builder, "output");
+  json_builder_add_string_value(builder, out_file);
+  json_builder_set_member_name(builder, "duration");
+  json_builder_add_double_value(builder, (now - el->row_start) / 1e6);
+  json_builder_set_member_name(builder, "done");
+  json_builder_add_int_value(builder, el->rows_done);
+  json_builder_set_member_name(builder, "total");
+  json_builder_add_int_value(builder, el->rows_total);
+  json_builder_set_member_name(builder, "cards_per_second");
+  json_builder_add_double_value(builder, rate);
+  json_builder_set_member_name(builder, "eta");
+  json_builder_add_double_value(builder, rate > 0.0 ? (el->rows_total - MIN(el->rows_done, el->rows_total)) / rate : 0.0);
+  event_log_write(el, builder);
+}
+
+// Row is -1 for errors not related to single row
+static void event_log_error(EventLog* el, gint row, const gchar* message) {
+  if (!el) return;
+  JsonBuilder* builder = event_log_begin(el, "error");
+  if (row >= 0) {
+    json_builder_set_member_name(builder, "row");
+    json_builder_add_int_value(builder, row);
+  }
+  json_builder_set_member_name(builder, "message");
+  json_builder_add_string_value(builder, message);
+  event_log_write(el, builder);
+}
+
+// Persistent cache of assets already scaled and rotated for a layer. Entries
+// are content addressed so edited source files or layer sizes never hit
+// stale pixels. Offsets of rotated pixels relative to the layer are kept in
+// PNG text chunks. Modification time of entry is refreshed whenever it is
+// used, so entries of old source versions and layer sizes are evicted first
+// when cache grows over its size limit.
+typedef struct {
+  gchar* dir;
+  gint interpolation;
+  // Size limit of entries on disk, 0 for no limit
+  gint64 max_bytes;
+  // Asset pack sources are read from, NULL for files, not owned
+  AssetPack* asset_pack;
+  GMutex mutex;
+  GHashTable* source_hashes;
+} DerivedAssetCache;
+
+DerivedAssetCache* new_derived_asset_cache(gchar* dir, gint interpolation, gint64 max_bytes, AssetPack* asset_pack) {
+  DerivedAssetCache* dac = malloc(sizeof(DerivedAssetCache));
+  dac->dir = dir;
+  dac->interpolation = interpolation;
+  dac->max_bytes = max_bytes;
+  dac->asset_pack = asset_pack;
+  g_mutex_init(&dac->mutex);
+  dac->source_hashes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  return dac;
+}
+
+void del_derived_asset_cache(DerivedAssetCache* dac) {
+  if (!dac) return;
+  g_hash_table_destroy(dac->source_hashes);
+  g_mutex_clear(&dac->mutex);
+  g_free(dac->dir);
+  free(dac);
+}
+
+static gchar* derived_asset_cache_source_hash(DerivedAssetCache* dac, const gchar* path) {
+  g_mutex_lock(&dac->mutex);
+  gchar* hash = g_strdup((gchar*)g_hash_table_lookup(dac->source_hashes, path));
+  g_mutex_unlock(&dac->mutex);
+  if (hash) return hash;
+
+  GBytes* bytes = read_asset_bytes(dac->asset_pack, path);
+  if (!bytes) return NULL;
+  gsize size;
+  gconstpointer data = g_bytes_get_data(bytes, &size);
+  hash = g_compute_checksum_for_data(G_CHECKSUM_SHA256, (const guchar*)data, size);
+  g_bytes_unref(bytes);
+
+  g_mutex_lock(&dac->mutex);
+  g_hash_table_replace(dac->source_hashes, g_strdup(path), g_strdup(hash));
+  g_mutex_unlock(&dac->mutex);
+  return hash;
+}
+
+static gchar* derived_asset_cache_path(DerivedAssetCache* dac, const gchar* path, gint width, gint height, gdouble rotate) {
+  gchar* source_hash = derived_asset_cache_source_hash(dac, path);
+  if (!source_hash) return NULL;
+  gchar* key = g_strdup_printf("%s:%dx%d:%d:%.6f", source_hash, width, height, dac->interpolation, rotate);
+  gchar* key_hash = g_compute_checksum_for_string(G_CHECKSUM_SHA256, key, -1);
+  gchar* filename = g_strdup_printf("%s.png", key_hash);
+  gchar* cache_path = g_build_filename(dac->dir, filename, NULL);
+  g_free(filename);
+  g_free(key_hash);
+  g_free(key);
+  g_free(source_hash);
+  return cache_path;
+}
+
+static GdkPixbuf* derived_asset_cache_load(DerivedAssetCache* dac, const gchar* path, gint width, gint height, gdouble rotate, gint* offset_x, gint* offset_y) {
+  if (!dac) return NULL;
+  gchar* cache_path = derived_asset_cache_path(dac, path, width, height, rotate);
+  if (!cache_path) return NULL;
+  GdkPixbuf* pixbuf = gdk_pixbuf_new_from_file(cache_path, NULL);
+  // Marks entry as recently used for eviction
+  if (pixbuf) g_utime(cache_path, NULL);
+  g_free(cache_path);
+  if (!pixbuf) return NULL;
+
+  const gchar* x = gdk_pixbuf_get_option(pixbuf, "tEXt::offset-x");
+  const gchar* y = gdk_pixbuf_get_option(pixbuf, "tEXt::offset-y");
+  if (!x || !y) {
+    g_object_unref(pixbuf);
+    return NULL;
+  }
+  *offset_x = (gint)g_ascii_strtoll(x, NULL, 10);
+  *offset_y = (gint)g_ascii_strtoll(y, NULL, 10);
+  return pixbuf;
+}
+
+static gboolean derived_asset_cache_store(DerivedAssetCache* dac, const gchar* path, gint width, gint height, gdouble rotate, GdkPixbuf* pixbuf, gint offset_x, gint offset_y) {
+  gchar* cache_path = derived_asset_cache_path(dac, path, width, height, rotate);
+  if (!cache_path) return FALSE;
+  if (g_mkdir_with_parents(dac->dir, 0755) != 0) {
+    printf("Unable to make directory %s\n", dac->dir);
+    g_free(cache_path);
+    return FALSE;
+  }
+
+  // Write under temporary name so concurrent runs never read partial files
+  gchar* tmp_path = g_strdup_printf("%s.%u.tmp", cache_path, g_random_int());
+  gchar* x = g_strdup_printf("%d", offset_x);
+  gchar* y = g_strdup_printf("%d", offset_y);
+  GError* error = NULL;
+  gboolean ret = gdk_pixbuf_save(pixbuf, tmp_path, "png", &error, "tEXt::offset-x", x, "tEXt::offset-y", y, "compression", "1", NULL);
+  if (ret && g_rename(tmp_path, cache_path) != 0) {
+    ret = FALSE;
+  }
+  if (!ret) {
+    printf("Unable to store %s in asset cache: %s\n", path, error ? error->message : "rename failed");
+    if (error) g_error_free(error);
+    g_unlink(tmp_path);
+  }
+  g_free(y);
+  g_free(x);
+  g_free(tmp_path);
+  g_free(cache_path);
+  return ret;
+}
+
+typedef struct {
+  gchar* path;
+  gint64 size;
+  gint64 mtime_ns;
+} DerivedAssetEntry;
+
+static gint compare_derived_asset_entries(gconstpointer a, gconstpointer b) {
+  const DerivedAssetEntry* ea = (const DerivedAssetEntry*)a;
+  const DerivedAssetEntry* eb = (const DerivedAssetEntry*)b;
+  return (ea->mtime_ns > eb->mtime_ns) - (ea->mtime_ns < eb->mtime_ns);
+}
+
+// Modification time in nanoseconds, so files saved twice within a second
+// differ too
+static gint64 stat_mtime_ns(const GStatBuf* st) {
+#ifdef G_OS_WIN32
+  return (gint64)st->st_mtime * G_GINT64_CONSTANT(1000000000);
+#else
+  return (gint64)st->st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st->st_mtim.tv_nsec;
+#endif
+}
+
+// Removes least recently used entries until cache fits its size limit
+static void derived_asset_cache_trim(DerivedAssetCache* dac) {
+  if (!dac || dac->max_bytes == 0) return;
+  GDir* dir = g_dir_open(dac->dir, 0, NULL);
+  if (!dir) return;
+  GArray* entries = g_array_new(FALSE, FALSE, sizeof(DerivedAssetEntry));
+  gint64 total = 0;
+  const gchar* name;
+  while ((name = g_dir_read_name(dir)) != NULL) {
+    if (!g_str_has_suffix(name, ".png")) continue;
+    DerivedAssetEntry entry = {g_build_filename(dac->dir, name, NULL), 0, 0};
+    GStatBuf st;
+    if (g_stat(entry.path, &st) != 0) {
+      g_free(entry.path);
+      continue;
+    }
+    entry.size = st.st_size;
+    entry.mtime_ns = stat_mtime_ns(&st);
+    total += entry.size;
+    g_array_append_val(entries, entry);
+  }
+  g_dir_close(dir);
+  g_array_sort(entries, &compare_derived_asset_entries);
+  guint removed = 0;
+  gint64 removed_bytes = 0;
+  for (guint i = 0; i < entries->len; ++i) {
+    DerivedAssetEntry* entry = &g_array_index(entries, DerivedAssetEntry, i);
+    if (total > dac->max_bytes && g_unlink(entry->path) == 0) {
+      total -= entry->size;
+      removed_bytes += entry->size;
+      ++removed;
+    }
+    g_free(entry->path);
+  }
+  g_array_free(entries, TRUE);
+  if (removed > 0) {
+    printf("Removed %u least recently used entries, %.1f MiB, from asset cache\n", removed, removed_bytes / 1048576.0);
+  }
+}
+
+// Pango objects are not thread safe, so every thread laying out text gets
+// its own font map and context
+static GPrivate thread_pango_context_key = G_PRIVATE_INIT(g_object_unref);
+
+static PangoContext* thread_pango_context(void) {
+  PangoContext* context = (PangoContext*)g_private_get(&thread_pango_context_key);
+  if (!context) {
+    PangoFontMap* font_map = pango_cairo_font_map_new();
+    context = pango_font_map_create_context(font_map);
+    g_object_unref(font_map);
+    g_private_set(&thread_pango_context_key, context);
+  }
+  return context;
+}
+
+// Layout of text wrapped in text layer of given width
+static PangoLayout* new_text_layout(PangoContext* context, const gchar* font_name, gdouble font_size_pixels, gdouble line_spacing, gint width, const gchar* text) {
+  PangoLayout *layout = pango_layout_new(context);
+  PangoFontDescription *font_desc = pango_font_description_from_string(font_name);
+  pango_font_description_set_absolute_size(font_desc, font_size_pixels * PANGO_SCALE);
+  pango_layout_set_font_description(layout, font_desc);
+  pango_font_description_free(font_desc);
+  if (line_spacing != 0.0) {
+    pango_layout_set_spacing(layout, (int)(line_spacing * PANGO_SCALE));
+  }
+  if (width > 0) {
+    pango_layout_set_width(layout, width * PANGO_SCALE);
+    pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
+  }
+  pango_layout_set_text(layout, text, -1);
+  return layout;
+}
+
+// Measures text the way rendering fits it with temporary text layer, which
+// has default line spacing: text fits when its ink ends within layer height.
+// Returns FALSE when text has no ink, which always fits.
+static gboolean measure_text_ink(PangoContext* context, const gchar* font_name, gdouble font_size_pixels, gint width, const gchar* text, gint* ink_top, gint* ink_bottom) {
+  PangoLayout* layout = new_text_layout(context, font_name, font_size_pixels, 0.0, width, text);
+  PangoRectangle ink;
+  pango_layout_get_pixel_extents(layout, &ink, NULL);
+  g_object_unref(layout);
+  *ink_top = ink.y;
+  *ink_bottom = ink.y + ink.height;
+  return ink.height > 0;
+}
+
+// Text layer properties text fitting depends on, read from template once
+typedef struct {
+  gchar* font_name;
+  gdouble font_size;
+  gdouble unit_pixels;
+  gdouble line_spacing;
+  gint width;
+  gint height;
+} TextLayerStyle;
+
+TextLayerStyle* new_text_layer_style(gchar* font_name, gdouble font_size, gdouble unit_pixels, gdouble line_spacing, gint width, gint height) {
+  TextLayerStyle* tls = malloc(sizeof(TextLayerStyle));
+  tls->font_name = font_name;
+  tls->font_size = font_size;
+  tls->unit_pixels = unit_pixels;
+  tls->line_spacing = line_spacing;
+  tls->width = width;
+  tls->height = height;
+  return tls;
+}
+
+void del_text_layer_style(TextLayerStyle* tls) {
+  if (!tls) return;
+  g_free(tls->font_name);
+  free(tls);
+}
+
+// Fitting of single text in text layer computed ahead of rendering. Font
+// size is in unit of text layer and is below 1 when text does not fit.
+// Anchors are x, y pairs of keyword centers relative to text layer.
+typedef struct {
+  TextLayerStyle* style;
+  gchar* text;
+  GArray* positions;
+  gdouble font_size;
+  gint ink_top;
+  gint ink_bottom;
+  GArray* anchors;
+} TextFit;
+
+TextFit* new_text_fit(TextLayerStyle* style, gchar* text, GArray* positions) {
+  TextFit* tf = malloc(sizeof(TextFit));
+  tf->style = style;
+  tf->text = text;
+  tf->positions = positions;
+  tf->font_size = 0.0;
+  tf->ink_top = 0;
+  tf->ink_bottom = 0;
+  tf->anchors = g_array_new(FALSE, FALSE, sizeof(gint));
+  return tf;
+}
+
+void del_text_fit(TextFit* tf) {
+  if (!tf) return;
+  g_free(tf->text);
+  g_array_free(tf->positions, TRUE);
+  g_array_free(tf->anchors, TRUE);
+  free(tf);
+}
+
+// Same search as rendering does with temporary text layer: font size is
+// reduced by 1 until ink of text ends within layer height
+static void fit_text(gpointer data, gpointer user_data) {
+  TextFit* fit = (TextFit*)data;
+  TextLayerStyle* style = fit->style;
+  PangoContext* context = thread_pango_context();
+  for (fit->font_size = style->font_size; fit->font_size >= 1.0; fit->font_size -= 1.0) {
+    if (!measure_text_ink(context, style->font_name, fit->font_size * style->unit_pixels, style->width, fit->text, &fit->ink_top, &fit->ink_bottom) ||
+        fit->ink_bottom <= style->height) break;
+  }
+  if (fit->font_size < 1.0) return;
+
+  for (guint i = 0; i < fit->positions->len; ++i) {
+    // Cursor after space standing in for keyword, like rendering measures it
+    gchar* text_up_to_keyword = g_strndup(fit->text, g_array_index(fit->positions, gsize, i) + 1);
+    PangoLayout* layout = new_text_layout(context, style->font_name, fit->font_size * style->unit_pixels, style->line_spacing, style->width, text_up_to_keyword);
+    PangoRectangle strong_pos, weak_pos;
+    pango_layout_get_cursor_pos(layout, strlen(text_up_to_keyword), &strong_pos, &weak_pos);
+    gint anchor[] = {PANGO_PIXELS(strong_pos.x + strong_pos.width / 2), PANGO_PIXELS(strong_pos.y + strong_pos.height / 2)};
+    g_array_append_vals(fit->anchors, anchor, G_N_ELEMENTS(anchor));
+    g_object_unref(layout);
+    g_free(text_up_to_keyword);
+  }
+}
+
+// Fits of all texts of template, computed on all cores before rendering.
+// Styles are tables of text layer styles by layer name, one per XCF of
+// template.
+typedef struct {
+  GPtrArray* styles;
+  GHashTable* fits;
+} TextPrepass;
+
+TextPrepass* new_text_prepass(GPtrArray* styles) {
+  TextPrepass* tp = malloc(sizeof(TextPrepass));
+  tp->styles = styles;
+  tp->fits = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)&del_text_fit);
+  return tp;
+}
+
+void del_text_prepass(TextPrepass* tp) {
+  if (!tp) return;
+  g_hash_table_destroy(tp->fits);
+  g_ptr_array_free(tp->styles, TRUE);
+  free(tp);
+}
+
+static TextLayerStyle* text_prepass_style(TextPrepass* tp, guint face, const gchar* layer_name) {
+  if (face >= tp->styles->len) return NULL;
+  return (TextLayerStyle*)g_hash_table_lookup((GHashTable*)g_ptr_array_index(tp->styles, face), layer_name);
+}
+
+// Fit depends only on style and text, so layers of the same style share
+// fits, also when they are in different XCFs of template
+static gchar* text_prepass_key(const TextLayerStyle* style, const gchar* text) {
+  return g_strdup_printf("%s\x1f%.6f\x1f%.6f\x1f%.6f\x1f%d\x1f%d\x1f%s", style->font_name, style->font_size,
+                         style->unit_pixels, style->line_spacing, style->width, style->height, text);
+}
+
+// Whether text of layer in XCF face of template still has to be fitted
+static gboolean text_prepass_needs(TextPrepass* tp, guint face, const gchar* layer_name, const gchar* text) {
+  TextLayerStyle* style = text_prepass_style(tp, face, layer_name);
+  if (!style) return FALSE;
+  gchar* key = text_prepass_key(style, text);
+  gboolean ret = !g_hash_table_contains(tp->fits, key);
+  g_free(key);
+  return ret;
+}
+
+static void text_prepass_add(TextPrepass* tp, guint face, const gchar* layer_name, const gchar* text, gchar* processed_text, GArray* positions) {
+  TextLayerStyle* style = text_prepass_style(tp, face, layer_name);
+  if (!style) {
+    g_free(processed_text);
+    g_array_free(positions, TRUE);
+    return;
+  }
+  g_hash_table_insert(tp->fits, text_prepass_key(style, text), new_text_fit(style, processed_text, positions));
+}
+
+static void text_prepass_run(TextPrepass* tp, gint threads) {
+  GThreadPool* pool = g_thread_pool_new(&fit_text, NULL, MAX(1, threads), TRUE, NULL);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, tp->fits);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    g_thread_pool_push(pool, value, NULL);
+  }
+  g_thread_pool_free(pool, FALSE, TRUE);
+}
+
+// Returns fit computed for text of layer in XCF face of template or NULL
+static TextFit* text_prepass_lookup(TextPrepass* tp, guint face, const gchar* layer_name, const gchar* text) {
+  if (!tp) return NULL;
+  TextLayerStyle* style = text_prepass_style(tp, face, layer_name);
+  if (!style) return NULL;
+  gchar* key = text_prepass_key(style, text);
+  TextFit* fit = (TextFit*)g_hash_table_lookup(tp->fits, key);
+  g_free(key);
+  return fit;
+}
+
+// Tracks resident memory of plugin and of GIMP core, which is parent of the
+// plugin process. Peaks are sampled between rows. Peak of plugin is also taken
+// from VmHWM, which is reset at start of every template when kernel allows it.
+// Peak counter of GIMP core is not plugin's to reset. Low memory mode lasts
+// until the end of template.
+typedef struct {
+  gint64 budget;
+  gint64 plugin_peak;
+  gint64 core_peak;
+  gboolean plugin_hwm_reset;
+  gboolean low_memory;
+} MemoryMonitor;
+
+// Fraction of budget at which generator switches to low memory strategies
+static const gdouble MEMORY_BUDGET_MARGIN = 0.9;
+
+MemoryMonitor* new_memory_monitor(gint64 budget) {
+  MemoryMonitor* mm = malloc(sizeof(MemoryMonitor));
+  mm->budget = budget;
+  mm->plugin_peak = 0;
+  mm->core_peak = 0;
+  mm->plugin_hwm_reset = FALSE;
+  mm->low_memory = FALSE;
+  return mm;
+}
+
+void del_memory_monitor(MemoryMonitor* mm) {
+  if (mm) free(mm);
+}
+
+// Returns value of field from /proc/<pid>/status in bytes or -1
+static gint64 process_status_bytes(const gchar* pid, const gchar* field) {
+  gchar* path = g_strdup_printf("/proc/%s/status", pid);
+  gchar* contents = NULL;
+  gint64 ret = -1;
+  if (g_file_get_contents(path, &contents, NULL, NULL)) {
+    gsize field_len = strlen(field);
+    for (gchar* line = contents; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+      if (0 == strncmp(line, field, field_len) && line[field_len] == ':') {
+        ret = g_ascii_strtoll(line + field_len + 1, NULL, 10) * 1024;
+        break;
+      }
+    }
+    g_free(contents);
+  }
+  g_free(path);
+  return ret;
+}
+
+static gboolean reset_plugin_peak(void) {
+  return g_file_set_contents("/proc/self/clear_refs", "5", 1, NULL);
+}
+
+static gchar* core_pid(void) {
+  return g_strdup_printf("%d", (int)getppid());
+}
+
+// Template starts with its template images kept open, first sample switches
+// to low memory mode again when memory is still close to budget
+static void memory_monitor_begin(MemoryMonitor* mm) {
+  gchar* core = core_pid();
+  mm->plugin_hwm_reset = reset_plugin_peak();
+  mm->low_memory = FALSE;
+  mm->plugin_peak = MAX(0, process_status_bytes("self", "VmRSS"));
+  mm->core_peak = MAX(0, process_status_bytes(core, "VmRSS"));
+  g_free(core);
+}
+
+// Samples memory usage. Returns TRUE when budget was approached for the first
+// time in template and generator should switch to low memory strategies.
+static gboolean memory_monitor_sample(MemoryMonitor* mm) {
+  gchar* core = core_pid();
+  gint64 plugin_rss = process_status_bytes("self", "VmRSS");
+  gint64 core_rss = process_status_bytes(core, "VmRSS");
+  g_free(core);
+  mm->plugin_peak = MAX(mm->plugin_peak, plugin_rss);
+  mm->core_peak = MAX(mm->core_peak, core_rss);
+
+  if (mm->budget == 0 || mm->low_memory) return FALSE;
+  if (MAX(0, plugin_rss) + MAX(0, core_rss) < mm->budget * MEMORY_BUDGET_MARGIN) return FALSE;
+  mm->low_memory = TRUE;
+  printf("Memory usage %.1f MiB is close to budget %.1f MiB, switching to low memory mode\n",
+         (MAX(0, plugin_rss) + MAX(0, core_rss)) / 1048576.0, mm->budget / 1048576.0);
+  return TRUE;
+}
+
+static void memory_monitor_report(MemoryMonitor* mm, const gchar* name) {
+  memory_monitor_sample(mm);
+  if (mm->plugin_hwm_reset) mm->plugin_peak = MAX(mm->plugin_peak, process_status_bytes("self", "VmHWM"));
+  printf("Peak memory of %s: plugin %.1f MiB%s, GIMP %.1f MiB (sampled between rows)\n", name,
+         mm->plugin_peak / 1048576.0, mm->plugin_hwm_reset ? "" : " (sampled between rows)", mm->core_peak / 1048576.0);
+}
+
+// Heap of plugin, live GObjects of plugin and memory of GIMP at one point
+typedef struct {
+  gint64 heap;
+  gint64 objects;
+  gint64 core;
+} AllocationSample;
+
+// Debug instrumentation of long runs. Samples are taken between stages of
+// every template and after every row, so leaks show up as growth between
+// first and last rows. Counting live GObjects needs GOBJECT_DEBUG=instance-count
+// in environment of GIMP.
+typedef struct {
+  guint window;
+  gint64 max_row_growth;
+  AllocationSample stage_start;
+  GArray* rows;
+} AllocationTracker;
+
+AllocationTracker* new_allocation_tracker(guint window, gint64 max_row_growth) {
+  AllocationTracker* at = malloc(sizeof(AllocationTracker));
+  at->window = window;
+  at->max_row_growth = max_row_growth;
+  memset(&at->stage_start, 0, sizeof(AllocationSample));
+  at->rows = g_array_new(FALSE, FALSE, sizeof(AllocationSample));
+  return at;
+}
+
+void del_allocation_tracker(AllocationTracker* at) {
+  if (!at) return;
+  g_array_free(at->rows, TRUE);
+  free(at);
+}
+
+static gint64 heap_bytes_in_use(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+  return (gint64)(info.uordblks + info.hblkhd);
+#else
+  return 0;
+#endif
+}
+
+static gint64 live_objects(GType type) {
+  gint64 count = g_type_get_instance_count(type);
+  guint n_children;
+  GType* children = g_type_children(type, &n_children);
+  for (guint i = 0; i < n_children; ++i) count += live_objects(children[i]);
+  g_free(children);
+  return count;
+}
 
+static void allocation_sample(AllocationSample* sample) {
+  gchar* core = core_pid();
+  sample->heap = heap_bytes_in_use();
+  sample->objects = live_objects(G_TYPE_OBJECT);
+  sample->core = MAX(0, process_status_bytes(core, "VmRSS"));
+  g_free(core);
+}
+
+static void allocation_tracker_begin(AllocationTracker* at) {
+  if (!at) return;
+  allocation_sample(&at->stage_start);
+  g_array_set_size(at->rows, 0);
+}
+
+// Prints growth since previous stage
+static void allocation_tracker_stage(AllocationTracker* at, const gchar* stage) {
+  if (!at) return;
+  AllocationSample sample;
+  allocation_sample(&sample);
+  printf("Allocations after %s: heap %+" G_GINT64_FORMAT " B, objects %+" G_GINT64_FORMAT ", GIMP %+.1f MiB\n", stage,
+         sample.heap - at->stage_start.heap, sample.objects - at->stage_start.objects,
+         (sample.core - at->stage_start.core) / 1048576.0);
+  at->stage_start = sample;
+}
+
+static void allocation_tracker_row(AllocationTracker* at) {
+  if (!at) return;
+  AllocationSample sample;
+  allocation_sample(&sample);
+  g_array_append_val(at->rows, sample);
+}
+
+static void allocation_window_mean(GArray* rows, guint first, guint count, gdouble mean[3]) {
+  mean[0] = mean[1] = mean[2] = 0.0;
+  for (guint i = first; i < first + count; ++i) {
+    AllocationSample* s = &g_array_index(rows, AllocationSample, i);
+    mean[0] += s->heap;
+    mean[1] += s->objects;
+    mean[2] += s->core;
+  }
+  for (gint k = 0; k < 3; ++k) mean[k] /= count;
+}
+
+// Compares mean of first and last rows of template. Returns FALSE when
+// heap or GIMP memory grows by more than the limit per row.
+static gboolean allocation_tracker_report(AllocationTracker* at, const gchar* name) {
+  if (!at) return TRUE;
+  guint window = MIN(at->window, at->rows->len / 2);
+  if (window == 0) {
+    printf("Too few rows of %s to measure growth per row\n", name);
+    return TRUE;
+  }
+  gdouble first[3], last[3];
+  allocation_window_mean(at->rows, 0, window, first);
+  allocation_window_mean(at->rows, at->rows->len - window, window, last);
+  gdouble rows = at->rows->len - window;
+  gdouble heap_growth = (last[0] - first[0]) / rows;
+  gdouble objects_growth = (last[1] - first[1]) / rows;
+  gdouble core_growth = (last[2] - first[2]) / rows;
+  printf("Growth per row of %s over %u rows: heap %.0f B, objects %.2f, GIMP %.0f B\n", name, at->rows->len,
+         heap_growth, objects_growth, core_growth);
+  if (at->max_row_growth > 0 && (heap_growth > at->max_row_growth || core_growth > at->max_row_growth)) {
+    printf("Memory grows by more than %" G_GINT64_FORMAT " B per row in %s\n", at->max_row_growth, name);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// Render request queued on job server. Clients sending identical request
+// while it is queued or running are attached to it and get its status too.
+typedef struct {
+  guint id;
+  gchar* key;
+  gchar* project_dir;
+  gchar** templates;
+  gint64 first_row;
+  gint64 last_row;
+  gboolean dry_run;
+  // Output options overriding options.json of project, JSON object or NULL
+  gchar* options;
+  // Templates loaded by earlier jobs, owned by server
+  GHashTable* warm_templates;
+  GMutex mutex;
+  // Queues of status lines of clients, written by their client threads
+  GPtrArray* subscribers;
+} RenderJob;
+
+// Last item of every status queue, pushed when job is deleted
+static gchar JOB_STATUS_END[] = "";
+
+static int compare_strv_items(const void* a, const void* b) {
+  return g_strcmp0(*(gchar* const*)a, *(gchar* const*)b);
+}
+
+RenderJob* new_render_job(gchar* project_dir, gchar** templates, gint64 first_row, gint64 last_row, gboolean dry_run, gchar* options) {
+  RenderJob* rj = malloc(sizeof(RenderJob));
+  rj->id = 0;
+  rj->project_dir = project_dir;
+  rj->templates = templates;
+  rj->first_row = first_row;
+  rj->last_row = last_row;
+  rj->dry_run = dry_run;
+  rj->options = options;
+  // Order of templates does not make requests different
+  if (templates) qsort(templates, g_strv_length(templates), sizeof(gchar*), &compare_strv_items);
+  gchar* joined = templates ? g_strjoinv("\n", templates) : g_strdup("");
+  rj->key = g_strdup_printf("%s\x1f%s\x1f%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT "\x1f%d\x1f%s",
+                            project_dir, joined, first_row, last_row, dry_run, options ? options : "");
+  g_free(joined);
+  rj->warm_templates = NULL;
+  g_mutex_init(&rj->mutex);
+  rj->subscribers = g_ptr_array_new_with_free_func((GDestroyNotify)&g_async_queue_unref);
+  return rj;
+}
+
+void del_render_job(RenderJob* rj) {
+  if (!rj) return;
+  for (guint i = 0; i < rj->subscribers->len; ++i) {
+    g_async_queue_push(g_ptr_array_index(rj->subscribers, i), JOB_STATUS_END);
+  }
+  g_ptr_array_free(rj->subscribers, TRUE);
+  g_mutex_clear(&rj->mutex);
+  g_free(rj->key);
+  g_free(rj->project_dir);
+  g_strfreev(rj->templates);
+  g_free(rj->options);
+  free(rj);
+}
+
+static gboolean render_job_includes_template(RenderJob* rj, const gchar* name) {
+  return !rj || !rj->templates || g_strv_contains((const gchar* const*)rj->templates, name);
+}
+
+static gboolean render_job_includes_row(RenderJob* rj, guint row) {
+  return !rj || (row >= rj->first_row && (rj->last_row < 0 || row <= rj->last_row));
+}
+
+static gchar* job_status_line(guint id, const gchar* status, const gchar* message) {
+  JsonBuilder* builder = json_builder_new();
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "job");
+  json_builder_add_int_value(builder, id);
+  json_builder_set_member_name(builder, "status");
+  json_builder_add_string_value(builder, status);
+  if (message) {
+    json_builder_set_member_name(builder, "message");
+    json_builder_add_string_value(builder, message);
+  }
+  json_builder_end_object(builder);
+  JsonNode* root = json_builder_get_root(builder);
+  JsonGenerator* generator = json_generator_new();
+  json_generator_set_root(generator, root);
+  gchar* json = json_generator_to_data(generator, NULL);
+  gchar* line = g_strconcat(json, "\n", NULL);
+  g_free(json);
+  g_object_unref(generator);
+  json_node_free(root);
+  g_object_unref(builder);
+  return line;
+}
+
+static gboolean send_status_line(GSocketConnection* connection, const gchar* line) {
+  GOutputStream* output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+  return g_output_stream_write_all(output, line, strlen(line), NULL, NULL, NULL);
+}
+
+// Writes status lines queued for client until its job is deleted. Lines of
+// client which went away are only dropped.
+static void write_job_status_lines(GSocketConnection* connection, GAsyncQueue* lines) {
+  gboolean connected = TRUE;
+  gchar* line;
+  while ((line = (gchar*)g_async_queue_pop(lines)) != JOB_STATUS_END) {
+    connected = connected && send_status_line(connection, line);
+    g_free(line);
+  }
+}
+
+// Queues status for every client of job. Client threads write it, so
+// rendering never waits for slow or stuck clients.
+static void job_report(RenderJob* job, const gchar* status, const gchar* format, ...) {
+  if (!job) return;
+  gchar* message = NULL;
+  if (format) {
+    va_list args;
+    va_start(args, format);
+    message = g_strdup_vprintf(format, args);
+    va_end(args);
+  }
+  gchar* line = job_status_line(job->id, status, message);
+  g_mutex_lock(&job->mutex);
+  for (guint i = 0; i < job->subscribers->len; ++i) {
+    g_async_queue_push(g_ptr_array_index(job->subscribers, i), g_strdup(line));
+  }
+  g_mutex_unlock(&job->mutex);
+  g_free(line);
+  g_free(message);
+}
+
+// Layer as rendered for a value: pixels and offsets in image coordinates
+// after text fitting, vertical centering and rotation
+typedef struct {
+  GdkPixbuf* pixbuf;
+  gint offset_x;
+  gint offset_y;
+  gdouble opacity;
+  gint mode;
+} RenderedLayer;
+
+RenderedLayer* new_rendered_layer(GdkPixbuf* pixbuf, gint offset_x, gint offset_y, gdouble opacity, gint mode) {
+  RenderedLayer* rl = malloc(sizeof(RenderedLayer));
+  rl->pixbuf = pixbuf;
+  rl->offset_x = offset_x;
+  rl->offset_y = offset_y;
+  rl->opacity = opacity;
+  rl->mode = mode;
+  return rl;
+}
+
+void del_rendered_layer(RenderedLayer* rl) {
+  if (!rl) return;
+  g_object_unref(rl->pixbuf);
+  free(rl);
+}
+
+// Values repeat heavily across rows of a template, so layers already
+// rendered for a value are pasted instead of fitting text or loading asset
+// again. Lives for a single template, entries past byte limit are not kept.
+typedef struct {
+  GHashTable* layers;
+  gsize bytes;
+  gsize byte_limit;
+  guint hits;
+  guint misses;
+} LayerCache;
+
+LayerCache* new_layer_cache(gsize byte_limit) {
+  LayerCache* lc = malloc(sizeof(LayerCache));
+  lc->layers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)&del_rendered_layer);
+  lc->bytes = 0;
+  lc->byte_limit = byte_limit;
+  lc->hits = 0;
+  lc->misses = 0;
+  return lc;
+}
+
+void del_layer_cache(LayerCache* lc) {
+  if (!lc) return;
+  g_hash_table_destroy(lc->layers);
+  free(lc);
+}
+
+// Texts with <<keyword>> icons render into several layers, so they are
+// never cached. Bool layers only change visibility.
+static gboolean layer_cache_accepts(LayerCache* lc, LayerData* layer_data) {
+  if (!lc || !layer_data->value) return FALSE;
+  if (layer_data->config->type == LAYER_TYPE_IMAGE) return TRUE;
+  return layer_data->config->type == LAYER_TYPE_TEXT && layer_data->keywords->len == 0;
+}
+
+// Layers of the same name in different XCFs of template may differ, so
+// face of template is part of key
+static gchar* layer_cache_key(guint face, const gchar* layer_name, LayerData* layer_data) {
+  return g_strdup_printf("%u:%s:%d:%d:%.6f:%s", face, layer_name, layer_data->config->type, layer_data->config->vcenter,
+                         layer_data->config->rotate, layer_data->value);
+}
+
+static RenderedLayer* layer_cache_lookup(LayerCache* lc, guint face, const gchar* layer_name, LayerData* layer_data) {
+  if (!layer_cache_accepts(lc, layer_data)) return NULL;
+  gchar* key = layer_cache_key(face, layer_name, layer_data);
+  RenderedLayer* rendered = (RenderedLayer*)g_hash_table_lookup(lc->layers, key);
+  g_free(key);
+  if (rendered) {
+    ++lc->hits;
+  } else {
+    ++lc->misses;
+  }
+  return rendered;
+}
+
+// Takes ownership of pixbuf
+static void layer_cache_store(LayerCache* lc, guint face, const gchar* layer_name, LayerData* layer_data, GdkPixbuf* pixbuf, gint offset_x, gint offset_y, gdouble opacity, gint mode) {
+  gsize bytes = (gsize)gdk_pixbuf_get_rowstride(pixbuf) * gdk_pixbuf_get_height(pixbuf);
+  if (lc->bytes + bytes > lc->byte_limit) {
+    g_object_unref(pixbuf);
+    return;
+  }
+  lc->bytes += bytes;
+  g_hash_table_replace(lc->layers, layer_cache_key(face, layer_name, layer_data), new_rendered_layer(pixbuf, offset_x, offset_y, opacity, mode));
+}
+
+static void layer_cache_clear(LayerCache* lc) {
+  if (!lc) return;
+  g_hash_table_remove_all(lc->layers);
+  lc->bytes = 0;
+}
+
+static void layer_cache_report(LayerCache* lc) {
+  if (!lc) return;
+  printf("Layer cache: %u hits, %u misses, %" G_GSIZE_FORMAT " bytes\n", lc->hits, lc->misses, lc->bytes);
+}
+
+// Outputs streamed into single uncompressed tar or store-only zip instead of
+// loose files. Members are appended as components finish and index.json
+// member mapping rows to members is added when archive is closed. Archive is
+// written to temporary file and renamed when closed, so readers never see
+// partial archive.
 typedef enum {
-  LAYER_TYPE_UNKNOWN = 0,
-  LAYER_TYPE_IMAGE = 1,
-  LAYER_TYPE_TEXT = 2,
-  LAYER_TYPE_BOOL = 3
-} LayerType;
+  ARCHIVE_TAR,
+  ARCHIVE_ZIP
+} ArchiveFormat;
+
+typedef struct {
+  gchar* name;
+  guint32 crc;
+  guint64 size;
+  guint64 offset;
+} ZipMember;
+
+typedef struct {
+  ArchiveFormat format;
+  gchar* path;
+  gchar* tmp_path;
+  FILE* file;
+  guint64 offset;
+  gboolean ok;
+  // Central directory of zip, written when archive is closed
+  GArray* zip_members;
+  guint16 dos_time;
+  guint16 dos_date;
+  gint64 mtime;
+  // Template whose outputs are being added, for index entries
+  gchar* template_name;
+  JsonBuilder* index;
+} OutputArchive;
+
+static const gchar* ARCHIVE_INDEX_MEMBER = "index.json";
+static const guint32 ZIP32_LIMIT = 0xffffffff;
+static const guint16 ZIP16_LIMIT = 0xffff;
+
+// Archive named after template or project in out directory, format is
+// "tar" or "zip" as in archive option
+OutputArchive* new_output_archive(const gchar* out_dir, const gchar* name, const gchar* format) {
+  g_mkdir_with_parents(out_dir, 0755);
+  gchar* filename = g_strdup_printf("%s.%s", name, format);
+  gchar* path = g_build_filename(out_dir, filename, NULL);
+  g_free(filename);
+  gchar* tmp_path = g_strdup_printf("%s.%u.tmp", path, g_random_int());
+  FILE* file = g_fopen(tmp_path, "wb");
+  if (!file) {
+    printf("Unable to create archive %s\n", path);
+    g_free(tmp_path);
+    g_free(path);
+    return NULL;
+  }
+  OutputArchive* oa = malloc(sizeof(OutputArchive));
+  oa->format = 0 == g_strcmp0(format, "zip") ? ARCHIVE_ZIP : ARCHIVE_TAR;
+  oa->path = path;
+  oa->tmp_path = tmp_path;
+  oa->file = file;
+  oa->offset = 0;
+  oa->ok = TRUE;
+  oa->zip_members = g_array_new(FALSE, FALSE, sizeof(ZipMember));
+  GDateTime* now = g_date_time_new_now_local();
+  oa->dos_time = (guint16)((g_date_time_get_hour(now) << 11) | (g_date_time_get_minute(now) << 5) | (g_date_time_get_second(now) / 2));
+  oa->dos_date = (guint16)(((MAX(g_date_time_get_year(now), 1980) - 1980) << 9) | (g_date_time_get_month(now) << 5) | g_date_time_get_day_of_month(now));
+  oa->mtime = g_date_time_to_unix(now);
+  g_date_time_unref(now);
+  oa->template_name = NULL;
+  oa->index = json_builder_new();
+  json_builder_begin_array(oa->index);
+  return oa;
+}
+
+// Archive not closed successfully is removed
+void del_output_archive(OutputArchive* oa) {
+  if (!oa) return;
+  if (oa->file) {
+    fclose(oa->file);
+    g_unlink(oa->tmp_path);
+  }
+  for (guint i = 0; i < oa->zip_members->len; ++i) {
+    g_free(g_array_index(oa->zip_members, ZipMember, i).name);
+  }
+  g_array_free(oa->zip_members, TRUE);
+  g_object_unref(oa->index);
+  g_free(oa->template_name);
+  g_free(oa->tmp_path);
+  g_free(oa->path);
+  free(oa);
+}
+
+static void output_archive_write(OutputArchive* oa, gconstpointer data, gsize size) {
+  if (!oa->ok || size == 0) return;
+  if (fwrite(data, 1, size, oa->file) != size) {
+    printf("Unable to write archive %s\n", oa->path);
+    oa->ok = FALSE;
+  }
+  oa->offset += size;
+}
+
+static guint32 archive_crc32(const guchar* data, gsize size) {
+  static guint32 table[256];
+  static gsize table_ready = 0;
+  if (g_once_init_enter(&table_ready)) {
+    for (guint32 i = 0; i < 256; ++i) {
+      guint32 c = i;
+      for (gint k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+    g_once_init_leave(&table_ready, 1);
+  }
+  guint32 crc = 0xffffffffu;
+  for (gsize i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return crc ^ 0xffffffffu;
+}
+
+static void put_le16(GByteArray* out, guint16 value) {
+  guint8 bytes[] = {value & 0xff, value >> 8};
+  g_byte_array_append(out, bytes, sizeof(bytes));
+}
+
+static void put_le32(GByteArray* out, guint32 value) {
+  put_le16(out, value & 0xffff);
+  put_le16(out, value >> 16);
+}
+
+static void put_le64(GByteArray* out, guint64 value) {
+  put_le32(out, value & 0xffffffffu);
+  put_le32(out, value >> 32);
+}
+
+static void tar_header_field(gchar* field, gsize width, guint64 value) {
+  g_snprintf(field, width, "%0*" G_GINT64_MODIFIER "o", (gint)width - 1, value);
+}
+
+static void tar_write_header(OutputArchive* oa, const gchar* name, gchar type, guint64 size) {
+  gchar header[512] = {0};
+  gsize name_length = strlen(name);
+  // Long names are split into prefix and name at a separator
+  const gchar* split = name_length > 100 ? strchr(name + name_length - 101, '/') : NULL;
+  if (split && split - name <= 155) {
+    memcpy(header + 345, name, split - name);
+    memcpy(header, split + 1, name_length - (split - name) - 1);
+  } else {
+    memcpy(header, name, MIN(name_length, 100));
+  }
+  tar_header_field(header + 100, 8, 0644);
+  tar_header_field(header + 108, 8, 0);
+  tar_header_field(header + 116, 8, 0);
+  tar_header_field(header + 124, 12, size);
+  tar_header_field(header + 136, 12, oa->mtime);
+  memset(header + 148, ' ', 8);
+  header[156] = type;
+  memcpy(header + 257, "ustar", 6);
+  memcpy(header + 263, "00", 2);
+  guint checksum = 0;
+  for (gint i = 0; i < 512; ++i) checksum += (guchar)header[i];
+  g_snprintf(header + 148, 8, "%06o", checksum);
+  output_archive_write(oa, header, sizeof(header));
+}
+
+static void tar_write_padded(OutputArchive* oa, gconstpointer data, gsize size) {
+  static const gchar padding[512] = {0};
+  output_archive_write(oa, data, size);
+  output_archive_write(oa, padding, (512 - size % 512) % 512);
+}
+
+static void tar_add(OutputArchive* oa, const gchar* name, gconstpointer data, gsize size) {
+  gsize name_length = strlen(name);
+  const gchar* split = name_length > 100 ? strchr(name + name_length - 101, '/') : NULL;
+  if (name_length > 100 && (!split || split - name > 155)) {
+    // Name does not fit ustar header, pax record carries it. Record length
+    // counts its own digits.
+    gsize record_length = name_length + strlen(" path=\n");
+    gsize digits = 1;
+    while (g_snprintf(NULL, 0, "%" G_GSIZE_FORMAT, record_length + digits) > (gint)digits) ++digits;
+    gchar* record = g_strdup_printf("%" G_GSIZE_FORMAT " path=%s\n", record_length + digits, name);
+    tar_write_header(oa, "././@PaxHeader", 'x', strlen(record));
+    tar_write_padded(oa, record, strlen(record));
+    g_free(record);
+  }
+  tar_write_header(oa, name, '0', size);
+  tar_write_padded(oa, data, size);
+}
+
+static void zip_add(OutputArchive* oa, const gchar* name, gconstpointer data, gsize size) {
+  if (size >= ZIP32_LIMIT) {
+    printf("Member %s is too large for zip archive %s\n", name, oa->path);
+    oa->ok = FALSE;
+    return;
+  }
+  ZipMember member = {g_strdup(name), archive_crc32((const guchar*)data, size), size, oa->offset};
+  GByteArray* header = g_byte_array_new();
+  put_le32(header, 0x04034b50);
+  put_le16(header, 20);
+  // Names are UTF-8
+  put_le16(header, 0x0800);
+  put_le16(header, 0);
+  put_le16(header, oa->dos_time);
+  put_le16(header, oa->dos_date);
+  put_le32(header, member.crc);
+  put_le32(header, (guint32)size);
+  put_le32(header, (guint32)size);
+  put_le16(header, (guint16)strlen(name));
+  put_le16(header, 0);
+  g_byte_array_append(header, (const guint8*)name, strlen(name));
+  output_archive_write(oa, header->data, header->len);
+  output_archive_write(oa, data, size);
+  g_byte_array_free(header, TRUE);
+  g_array_append_val(oa->zip_members, member);
+}
+
+// Central directory, with zip64 records once offsets or member count do
+// not fit classic fields
+static void zip_finish(OutputArchive* oa) {
+  GByteArray* out = g_byte_array_new();
+  guint64 directory_offset = oa->offset;
+  for (guint i = 0; i < oa->zip_members->len; ++i) {
+    ZipMember* member = &g_array_index(oa->zip_members, ZipMember, i);
+    gboolean zip64 = member->offset >= ZIP32_LIMIT;
+    put_le32(out, 0x02014b50);
+    put_le16(out, (3 << 8) | 45);
+    put_le16(out, zip64 ? 45 : 20);
+    put_le16(out, 0x0800);
+    put_le16(out, 0);
+    put_le16(out, oa->dos_time);
+    put_le16(out, oa->dos_date);
+    put_le32(out, member->crc);
+    put_le32(out, (guint32)member->size);
+    put_le32(out, (guint32)member->size);
+    put_le16(out, (guint16)strlen(member->name));
+    put_le16(out, zip64 ? 12 : 0);
+    put_le16(out, 0);
+    put_le16(out, 0);
+    put_le16(out, 0);
+    put_le32(out, 0100644u << 16);
+    put_le32(out, zip64 ? ZIP32_LIMIT : (guint32)member->offset);
+    g_byte_array_append(out, (const guint8*)member->name, strlen(member->name));
+    if (zip64) {
+      put_le16(out, 0x0001);
+      put_le16(out, 8);
+      put_le64(out, member->offset);
+    }
+  }
+  guint64 directory_size = out->len;
+  guint64 count = oa->zip_members->len;
+  if (count >= ZIP16_LIMIT || directory_offset >= ZIP32_LIMIT || directory_size >= ZIP32_LIMIT) {
+    guint64 record_offset = directory_offset + directory_size;
+    put_le32(out, 0x06064b50);
+    put_le64(out, 44);
+    put_le16(out, (3 << 8) | 45);
+    put_le16(out, 45);
+    put_le32(out, 0);
+    put_le32(out, 0);
+    put_le64(out, count);
+    put_le64(out, count);
+    put_le64(out, directory_size);
+    put_le64(out, directory_offset);
+    put_le32(out, 0x07064b50);
+    put_le32(out, 0);
+    put_le64(out, record_offset);
+    put_le32(out, 1);
+  }
+  put_le32(out, 0x06054b50);
+  put_le16(out, 0);
+  put_le16(out, 0);
+  put_le16(out, (guint16)MIN(count, ZIP16_LIMIT));
+  put_le16(out, (guint16)MIN(count, ZIP16_LIMIT));
+  put_le32(out, (guint32)MIN(directory_size, ZIP32_LIMIT));
+  put_le32(out, (guint32)MIN(directory_offset, ZIP32_LIMIT));
+  put_le16(out, 0);
+  output_archive_write(oa, out->data, out->len);
+  g_byte_array_free(out, TRUE);
+}
+
+// Members are named as outputs would be in out directory, relative to
+// archive, so leading "./" of outputs in its root is dropped
+static const gchar* archive_member_name(const gchar* name) {
+  return g_str_has_prefix(name, "./") ? name + 2 : name;
+}
+
+static gboolean output_archive_add(OutputArchive* oa, const gchar* name, gconstpointer data, gsize size) {
+  name = archive_member_name(name);
+  if (oa->format == ARCHIVE_TAR) {
+    tar_add(oa, name, data, size);
+  } else {
+    zip_add(oa, name, data, size);
+  }
+  return oa->ok;
+}
 
-static const gchar* LAYER_TYPE_STR_UNKNOWN = "unknown";
-static const gchar* LAYER_TYPE_STR_IMAGE = "image";
-static const gchar* LAYER_TYPE_STR_TEXT = "text";
-static const gchar* LAYER_TYPE_STR_BOOL = "bool";
+// Adds index and trailer of archive and moves it in place of previous one
+static gboolean close_output_archive(OutputArchive* oa) {
+  json_builder_end_array(oa->index);
+  JsonNode* root = json_builder_get_root(oa->index);
+  JsonGenerator* generator = json_generator_new();
+  json_generator_set_root(generator, root);
+  gsize length;
+  gchar* json = json_generator_to_data(generator, &length);
+  output_archive_add(oa, ARCHIVE_INDEX_MEMBER, json, length);
+  g_free(json);
+  g_object_unref(generator);
+  json_node_free(root);
+  if (oa->format == ARCHIVE_TAR) {
+    static const gchar end[1024] = {0};
+    output_archive_write(oa, end, sizeof(end));
+  } else {
+    zip_finish(oa);
+  }
+  gboolean ret = fclose(oa->file) == 0 && oa->ok;
+  oa->file = NULL;
+  if (!ret) {
+    printf("Unable to write archive %s\n", oa->path);
+    g_unlink(oa->tmp_path);
+    return FALSE;
+  }
+  if (g_rename(oa->tmp_path, oa->path) != 0) {
+    printf("Unable to replace %s\n", oa->path);
+    g_unlink(oa->tmp_path);
+    return FALSE;
+  }
+  printf("Wrote %s\n", oa->path);
+  return TRUE;
+}
+
+// Raw pixels of finished components published into memory mapped ring laid
+// out as in boardgame-component-raw.h
+typedef struct {
+  gchar* path;
+  gint fd;
+  guchar* map;
+  gsize map_size;
+  RawRingHeader* header;
+  gboolean waiting_reported;
+  // Consumer stopped releasing frames, nothing more is published
+  gboolean dead;
+} RawOutput;
+
+// Consumer which released no frame for this long is considered gone
+static const gint RAW_OUTPUT_WAIT_SECONDS = 60;
+
+// "shm:NAME" is POSIX shared memory object NAME, which is file in /dev/shm
+// on Linux, other targets are files relative to project directory
+static gchar* new_raw_output_path(const gchar* project_dir, const gchar* target) {
+  if (g_str_has_prefix(target, "shm:")) return g_build_filename("/dev/shm", target + 4, NULL);
+  if (g_path_is_absolute(target)) return g_strdup(target);
+  return g_build_filename(project_dir, target, NULL);
+}
+
+void del_raw_output(RawOutput* ro) {
+  if (!ro) return;
+  g_atomic_int_set(&ro->header->closed, 1);
+  munmap(ro->map, ro->map_size);
+  close(ro->fd);
+  g_free(ro->path);
+  free(ro);
+}
 
-static LayerType layer_type_from_str(const gchar* str) {
-  if (0 == g_strcmp0(str, LAYER_TYPE_STR_IMAGE)) return LAYER_TYPE_IMAGE;
-  if (0 == g_strcmp0(str, LAYER_TYPE_STR_TEXT)) return LAYER_TYPE_TEXT;
-  if (0 == g_strcmp0(str, LAYER_TYPE_STR_BOOL)) return LAYER_TYPE_BOOL;
-  return LAYER_TYPE_UNKNOWN;
+// Creates ring with given number of slots, each fitting frame of given size.
+// Previous ring is unlinked first, so consumers still mapping it never see
+// it shrink.
+RawOutput* new_raw_output(gchar* path, gint64 slot_count, gint64 frame_bytes) {
+  guint64 slot_size = (sizeof(RawFrameHeader) + (guint64)frame_bytes + 63) & ~(guint64)63;
+  gsize map_size = sizeof(RawRingHeader) + (gsize)slot_count * slot_size;
+  g_unlink(path);
+  gint fd = g_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0 || ftruncate(fd, map_size) != 0) {
+    printf("Unable to create raw output %s\n", path);
+    if (fd >= 0) close(fd);
+    g_free(path);
+    return NULL;
+  }
+  guchar* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    printf("Unable to map raw output %s\n", path);
+    close(fd);
+    g_free(path);
+    return NULL;
+  }
+  RawOutput* ro = malloc(sizeof(RawOutput));
+  ro->path = path;
+  ro->fd = fd;
+  ro->map = map;
+  ro->map_size = map_size;
+  ro->header = (RawRingHeader*)map;
+  ro->waiting_reported = FALSE;
+  ro->dead = FALSE;
+  ro->header->version = RAW_RING_VERSION;
+  ro->header->slot_count = (guint32)slot_count;
+  ro->header->slot_size = slot_size;
+  g_atomic_int_set(&ro->header->write_seq, 0);
+  g_atomic_int_set(&ro->header->read_seq, 0);
+  g_atomic_int_set(&ro->header->closed, 0);
+  memcpy(ro->header->magic, RAW_RING_MAGIC, sizeof(ro->header->magic));
+  return ro;
 }
 
-static const gchar* str_from_layer_type(LayerType type) {
-  switch (type) {
-    case LAYER_TYPE_IMAGE: return LAYER_TYPE_STR_IMAGE;
-    case LAYER_TYPE_TEXT: return LAYER_TYPE_STR_TEXT;
-    case LAYER_TYPE_BOOL: return LAYER_TYPE_STR_BOOL;
-    default: return LAYER_TYPE_STR_UNKNOWN;
+// Waits until consumer releases slot of next frame
+static gboolean raw_output_wait(RawOutput* ro, guint32 seq) {
+  if (ro->dead) return FALSE;
+  gint64 deadline = g_get_monotonic_time() + RAW_OUTPUT_WAIT_SECONDS * G_USEC_PER_SEC;
+  while (seq - (guint32)g_atomic_int_get(&ro->header->read_seq) >= ro->header->slot_count) {
+    if (!ro->waiting_reported) {
+      printf("Waiting for consumer of raw output %s\n", ro->path);
+      ro->waiting_reported = TRUE;
+    }
+    if (g_get_monotonic_time() > deadline) {
+      printf("Consumer of raw output %s released no frame for %d s\n", ro->path, RAW_OUTPUT_WAIT_SECONDS);
+      ro->dead = TRUE;
+      return FALSE;
+    }
+    g_usleep(1000);
   }
+  return TRUE;
 }
 
+// Publishes pixels of output, or alias of source output when pixbuf is NULL
+static gboolean raw_output_publish(RawOutput* ro, const gchar* name, GdkPixbuf* pixbuf, const gchar* source) {
+  RawFrameHeader* frame = NULL;
+  gsize bytes = pixbuf ? gdk_pixbuf_get_byte_length(pixbuf) : 0;
+  if (bytes > ro->header->slot_size - sizeof(RawFrameHeader)) {
+    printf("Raw output of %s needs %" G_GSIZE_FORMAT " bytes, more than raw_output_frame_bytes\n", name, bytes);
+    return FALSE;
+  }
+  if (strlen(name) >= sizeof(frame->name) || (source && strlen(source) >= sizeof(frame->source))) {
+    printf("Name %s is too long for raw output\n", name);
+    return FALSE;
+  }
+  guint32 seq = (guint32)g_atomic_int_get(&ro->header->write_seq);
+  if (!raw_output_wait(ro, seq)) return FALSE;
+  frame = (RawFrameHeader*)(ro->map + sizeof(RawRingHeader) + (gsize)(seq % ro->header->slot_count) * ro->header->slot_size);
+  memset(frame, 0, sizeof(RawFrameHeader));
+  g_strlcpy(frame->name, name, sizeof(frame->name));
+  if (pixbuf) {
+    frame->width = gdk_pixbuf_get_width(pixbuf);
+    frame->height = gdk_pixbuf_get_height(pixbuf);
+    frame->stride = gdk_pixbuf_get_rowstride(pixbuf);
+    frame->format = gdk_pixbuf_get_has_alpha(pixbuf) ? RAW_FRAME_RGBA8 : RAW_FRAME_RGB8;
+    memcpy((guchar*)frame + sizeof(RawFrameHeader), gdk_pixbuf_read_pixels(pixbuf), bytes);
+  } else {
+    frame->format = RAW_FRAME_ALIAS;
+    g_strlcpy(frame->source, source, sizeof(frame->source));
+  }
+  // Full barrier, consumer never sees sequence before frame
+  g_atomic_int_set(&ro->header->write_seq, (gint)(seq + 1));
+  return TRUE;
+}
+
+// Rows which failed to render in keep_going mode, written as JSON report
+// after all templates
 typedef struct {
-  LayerType type;
-  int vcenter;
-  gdouble rotate;
-} LayerConfig;
+  gchar* path;
+  JsonBuilder* builder;
+  guint count;
+  gchar* template_name;
+} FailureReport;
+
+FailureReport* new_failure_report(gchar* path) {
+  FailureReport* fr = malloc(sizeof(FailureReport));
+  fr->path = path;
+  fr->builder = json_builder_new();
+  json_builder_begin_array(fr->builder);
+  fr->count = 0;
+  fr->template_name = NULL;
+  return fr;
+}
+
+void del_failure_report(FailureReport* fr) {
+  if (!fr) return;
+  g_object_unref(fr->builder);
+  g_free(fr->template_name);
+  g_free(fr->path);
+  free(fr);
+}
+
+static void failure_report_template(FailureReport* fr, const gchar* name) {
+  if (!fr) return;
+  g_free(fr->template_name);
+  fr->template_name = g_strdup(name);
+}
+
+// Row is -1 and layer NULL for failures which do not concern single row or layer
+static void failure_report_add(FailureReport* fr, gint row, const gchar* layer, const gchar* reason) {
+  ++fr->count;
+  json_builder_begin_object(fr->builder);
+  json_builder_set_member_name(fr->builder, "template");
+  json_builder_add_string_value(fr->builder, fr->template_name);
+  json_builder_set_member_name(fr->builder, "row");
+  if (row >= 0) {
+    json_builder_add_int_value(fr->builder, row);
+  } else {
+    json_builder_add_null_value(fr->builder);
+  }
+  json_builder_set_member_name(fr->builder, "layer");
+  if (layer) {
+    json_builder_add_string_value(fr->builder, layer);
+  } else {
+    json_builder_add_null_value(fr->builder);
+  }
+  json_builder_set_member_name(fr->builder, "reason");
+  json_builder_add_string_value(fr->builder, reason);
+  json_builder_end_object(fr->builder);
+}
+
+// Report is written even without failures, so report of previous run never
+// stays behind
+static gboolean save_failure_report(FailureReport* fr) {
+  json_builder_end_array(fr->builder);
+  JsonNode* root = json_builder_get_root(fr->builder);
+  JsonGenerator* generator = json_generator_new();
+  json_generator_set_root(generator, root);
+  json_generator_set_pretty(generator, TRUE);
+  gchar* json = json_generator_to_data(generator, NULL);
+  GError* error = NULL;
+  gboolean ret = g_file_set_contents(fr->path, json, -1, &error);
+  if (!ret) {
+    printf("Unable to save %s: %s\n", fr->path, error->message);
+    g_error_free(error);
+  } else if (fr->count > 0) {
+    printf("%u failures, see %s\n", fr->count, fr->path);
+  }
+  g_free(json);
+  g_object_unref(generator);
+  json_node_free(root);
+  return ret;
+}
+
+typedef struct {
+  GeneratorOptions* options;
+  DerivedAssetCache* asset_cache;
+  MemoryMonitor* memory;
+  // Text fits of template being generated, NULL without text prepass
+  TextPrepass* text_prepass;
+  // Rendered layers of template being generated, NULL when disabled
+  LayerCache* layer_cache;
+  // Job server request being generated, NULL for single runs
+  RenderJob* job;
+  // Progress event stream, NULL without events option
+  EventLog* events;
+  // Allocation instrumentation, NULL without track_allocations option
+  AllocationTracker* allocations;
+  // Archive outputs are streamed into, NULL without archive option
+  OutputArchive* archive;
+  // Ring raw pixels are published into, NULL without raw_output option
+  RawOutput* raw_output;
+  // Failed rows, NULL without keep_going option
+  FailureReport* failures;
+  // Asset pack of project, NULL when assets are read from files. Set before
+  // anything is rendered, worker threads only read it.
+  AssetPack* asset_pack;
+  // Why component being rendered failed, NULL when reason is not known
+  gchar* failure_reason;
+  gchar* failed_layer;
+} GeneratorContext;
+
+GeneratorContext* new_generator_context(GeneratorOptions* options, DerivedAssetCache* asset_cache, AssetPack* asset_pack) {
+  GeneratorContext* gc = malloc(sizeof(GeneratorContext));
+  gc->options = options;
+  gc->asset_cache = asset_cache;
+  gc->asset_pack = asset_pack;
+  gc->memory = new_memory_monitor(options->memory_budget);
+  gc->text_prepass = NULL;
+  gc->layer_cache = NULL;
+  gc->job = NULL;
+  gc->events = NULL;
+  gc->archive = NULL;
+  gc->raw_output = NULL;
+  gc->failures = NULL;
+  gc->failure_reason = NULL;
+  gc->failed_layer = NULL;
+  gc->allocations = options->track_allocations ? new_allocation_tracker(options->track_allocations_rows, options->max_row_growth) : NULL;
+  return gc;
+}
+
+void del_generator_context(GeneratorContext* gc) {
+  if (!gc) return;
+  del_memory_monitor(gc->memory);
+  del_event_log(gc->events);
+  del_allocation_tracker(gc->allocations);
+  del_output_archive(gc->archive);
+  del_raw_output(gc->raw_output);
+  del_failure_report(gc->failures);
+  g_free(gc->failure_reason);
+  g_free(gc->failed_layer);
+  del_derived_asset_cache(gc->asset_cache);
+  del_asset_pack(gc->asset_pack);
+  del_generator_options(gc->options);
+  free(gc);
+}
+
+// Remembers why component being rendered failed, for failure report and
+// event stream
+static void set_row_failure(GeneratorContext* ctx, const gchar* layer, const gchar* format, ...) G_GNUC_PRINTF(3, 4);
+static void set_row_failure(GeneratorContext* ctx, const gchar* layer, const gchar* format, ...) {
+  va_list args;
+  va_start(args, format);
+  g_free(ctx->failure_reason);
+  ctx->failure_reason = g_strdup_vprintf(format, args);
+  va_end(args);
+  g_free(ctx->failed_layer);
+  ctx->failed_layer = g_strdup(layer);
+}
+
+static void clear_row_failure(GeneratorContext* ctx) {
+  g_clear_pointer(&ctx->failure_reason, g_free);
+  g_clear_pointer(&ctx->failed_layer, g_free);
+}
+
+// Reports row which failed to render to event stream and, in keep_going
+// mode, to failure report
+static void report_row_failure(GeneratorContext* ctx, guint row, const gchar* out_file) {
+  const gchar* reason = ctx->failure_reason ? ctx->failure_reason : "unable to write output";
+  gchar* message = g_strdup_printf("unable to render %s: %s", out_file, reason);
+  event_log_error(ctx->events, row, message);
+  if (ctx->failures) {
+    printf("Skipping row %u, %s\n", row, message);
+    failure_report_add(ctx->failures, row, ctx->failed_layer, reason);
+  }
+  g_free(message);
+}
+
+// Whether raw output or archive can take no more components, which fails
+// the run even in keep_going mode instead of every remaining row
+static gboolean output_broken(GeneratorContext* ctx) {
+  return (ctx->raw_output && ctx->raw_output->dead) || (ctx->archive && !ctx->archive->ok);
+}
+
+typedef struct {
+  gint width;
+  gint height;
+} LayerSize;
+
+LayerSize* new_layer_size(gint width, gint height) {
+  LayerSize* ls = malloc(sizeof(LayerSize));
+  ls->width = width;
+  ls->height = height;
+  return ls;
+}
+
+void del_layer_size(LayerSize* ls) {
+  if (ls) free(ls);
+}
+
+// Source pixels covered by every destination pixel when downscaling by area
+// averaging. Weights of every destination pixel sum up to 1.
+typedef struct {
+  gint* first;
+  gint* count;
+  gint* offset;
+  gfloat* weights;
+} BoxSpans;
+
+BoxSpans* new_box_spans(gint src_len, gint dst_len) {
+  BoxSpans* bs = malloc(sizeof(BoxSpans));
+  gdouble ratio = (gdouble)src_len / dst_len;
+  bs->first = g_new(gint, dst_len);
+  bs->count = g_new(gint, dst_len);
+  bs->offset = g_new(gint, dst_len);
+  bs->weights = g_new(gfloat, src_len + dst_len);
+  gint n = 0;
+  for (gint d = 0; d < dst_len; ++d) {
+    gdouble start = d * ratio;
+    gdouble end = MIN((d + 1) * ratio, (gdouble)src_len);
+    gint first = MIN((gint)start, src_len - 1);
+    gint last = MAX(first, MIN((gint)ceil(end) - 1, src_len - 1));
+    bs->first[d] = first;
+    bs->count[d] = last - first + 1;
+    bs->offset[d] = n;
+    for (gint s = first; s <= last; ++s) {
+      gdouble coverage = MIN(s + 1.0, end) - MAX((gdouble)s, start);
+      bs->weights[n++] = (gfloat)(coverage / ratio);
+    }
+  }
+  return bs;
+}
+
+void del_box_spans(BoxSpans* bs) {
+  if (!bs) return;
+  g_free(bs->first);
+  g_free(bs->count);
+  g_free(bs->offset);
+  g_free(bs->weights);
+  free(bs);
+}
+
+// Horizontal pass over single RGBA8 row. Colors are premultiplied by alpha,
+// so transparent pixels do not bleed into opaque ones.
+static void box_filter_row(const guchar* src, BoxSpans* xs, gint dst_width, gfloat* dst) {
+  for (gint d = 0; d < dst_width; ++d) {
+    const guchar* s = src + (gsize)xs->first[d] * 4;
+    const gfloat* w = xs->weights + xs->offset[d];
+    gfloat acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (gint k = 0; k < xs->count[d]; ++k, s += 4) {
+      gfloat a = s[3] * w[k];
+      acc[0] += s[0] * a;
+      acc[1] += s[1] * a;
+      acc[2] += s[2] * a;
+      acc[3] += a;
+    }
+    for (gint c = 0; c < 4; ++c) dst[d * 4 + c] = acc[c];
+  }
+}
+
+// Converts accumulated premultiplied row back to 8 bit pixels. Without alpha
+// result is composed over white.
+static void store_box_row(const gfloat* acc, gint width, guchar* out, gboolean with_alpha) {
+  gint channels = with_alpha ? 4 : 3;
+  for (gint x = 0; x < width; ++x, out += channels) {
+    const gfloat* p = acc + x * 4;
+    gfloat alpha = p[3] / 255.0f;
+    for (gint c = 0; c < 3; ++c) {
+      gfloat v = alpha > 0.0f ? p[c] / p[3] : 0.0f;
+      if (!with_alpha) v = v * alpha + 255.0f * (1.0f - alpha);
+      out[c] = (guchar)CLAMP(v + 0.5f, 0.0f, 255.0f);
+    }
+    if (with_alpha) out[3] = (guchar)CLAMP(p[3] + 0.5f, 0.0f, 255.0f);
+  }
+}
+
+// Area averaging downscale of image arriving row by row from the top. Only
+// single source row and single row of accumulated destination pixels are
+// kept, so decoders never hold full resolution image in memory.
+typedef struct {
+  BoxSpans* xs;
+  BoxSpans* ys;
+  gint src_y;
+  gint dst_y;
+  gfloat* row;
+  gfloat* acc;
+  GdkPixbuf* dst;
+} RowDownscaler;
+
+RowDownscaler* new_row_downscaler(gint src_width, gint src_height, gint dst_width, gint dst_height) {
+  RowDownscaler* rd = malloc(sizeof(RowDownscaler));
+  rd->xs = new_box_spans(src_width, dst_width);
+  rd->ys = new_box_spans(src_height, dst_height);
+  rd->src_y = 0;
+  rd->dst_y = 0;
+  rd->row = g_new(gfloat, (gsize)dst_width * 4);
+  rd->acc = g_new0(gfloat, (gsize)dst_width * 4);
+  rd->dst = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, dst_width, dst_height);
+  return rd;
+}
+
+void del_row_downscaler(RowDownscaler* rd) {
+  if (!rd) return;
+  del_box_spans(rd->xs);
+  del_box_spans(rd->ys);
+  g_free(rd->row);
+  g_free(rd->acc);
+  if (rd->dst) g_object_unref(rd->dst);
+  free(rd);
+}
+
+// Adds next RGBA8 source row. Destination rows are written as soon as all
+// source rows they cover arrived.
+static void row_downscaler_push(RowDownscaler* rd, const guchar* src) {
+  gint dst_width = gdk_pixbuf_get_width(rd->dst);
+  gint dst_height = gdk_pixbuf_get_height(rd->dst);
+  BoxSpans* ys = rd->ys;
+  gboolean filtered = FALSE;
+  while (rd->dst_y < dst_height && ys->first[rd->dst_y] <= rd->src_y) {
+    gint d = rd->dst_y;
+    if (!filtered) {
+      box_filter_row(src, rd->xs, dst_width, rd->row);
+      filtered = TRUE;
+    }
+    gfloat wy = ys->weights[ys->offset[d] + rd->src_y - ys->first[d]];
+    for (gint i = 0; i < dst_width * 4; ++i) rd->acc[i] += wy * rd->row[i];
+    if (rd->src_y < ys->first[d] + ys->count[d] - 1) break;
+    store_box_row(rd->acc, dst_width, gdk_pixbuf_get_pixels(rd->dst) + (gsize)d * gdk_pixbuf_get_rowstride(rd->dst), TRUE);
+    memset(rd->acc, 0, sizeof(gfloat) * dst_width * 4);
+    rd->dst_y++;
+  }
+  rd->src_y++;
+}
+
+// Returns new reference to destination pixels, NULL if source ended early
+static GdkPixbuf* row_downscaler_finish(RowDownscaler* rd) {
+  if (rd->dst_y < gdk_pixbuf_get_height(rd->dst)) return NULL;
+  return g_object_ref(rd->dst);
+}
+
+typedef struct {
+  struct jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+} AssetJpegError;
+
+static void asset_jpeg_error_exit(j_common_ptr cinfo) {
+  AssetJpegError* err = (AssetJpegError*)cinfo->err;
+  longjmp(err->setjmp_buffer, 1);
+}
+
+// Decodes jpeg at the smallest DCT scale still covering target size, so
+// only 1/64 of pixels are decoded for assets 8 times larger than layer.
+// Assets not larger than layer are left to generic loader.
+static GdkPixbuf* decode_downscaled_jpeg(const guchar* data, gsize size, gint width, gint height) {
+  struct jpeg_decompress_struct cinfo;
+  AssetJpegError jerr;
+  RowDownscaler* volatile rd = NULL;
+  guchar* volatile row = NULL;
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = asset_jpeg_error_exit;
+  if (setjmp(jerr.setjmp_buffer)) {
+    // Not fatal, caller falls back to generic loader
+    jpeg_destroy_decompress(&cinfo);
+    del_row_downscaler(rd);
+    g_free(row);
+    return NULL;
+  }
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, (unsigned char*)data, size);
+  jpeg_read_header(&cinfo, TRUE);
+  if (cinfo.image_width <= (JDIMENSION)width && cinfo.image_height <= (JDIMENSION)height) {
+    jpeg_destroy_decompress(&cinfo);
+    return NULL;
+  }
+  cinfo.out_color_space = JCS_RGB;
+  cinfo.scale_num = 1;
+  for (cinfo.scale_denom = 8; cinfo.scale_denom > 1; cinfo.scale_denom /= 2) {
+    jpeg_calc_output_dimensions(&cinfo);
+    if (cinfo.output_width >= (JDIMENSION)width && cinfo.output_height >= (JDIMENSION)height) break;
+  }
+  jpeg_start_decompress(&cinfo);
+  rd = new_row_downscaler(cinfo.output_width, cinfo.output_height, width, height);
+  row = g_malloc((gsize)cinfo.output_width * 4);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW rows[1] = {row};
+    jpeg_read_scanlines(&cinfo, rows, 1);
+    // Expand RGB to RGBA in place from the end
+    for (gint x = cinfo.output_width - 1; x >= 0; --x) {
+      row[x * 4 + 3] = 255;
+      row[x * 4 + 2] = row[x * 3 + 2];
+      row[x * 4 + 1] = row[x * 3 + 1];
+      row[x * 4] = row[x * 3];
+    }
+    row_downscaler_push(rd, row);
+  }
+  jpeg_finish_decompress(&cinfo);
+  GdkPixbuf* pixbuf = row_downscaler_finish(rd);
+  jpeg_destroy_decompress(&cinfo);
+  del_row_downscaler(rd);
+  g_free(row);
+  return pixbuf;
+}
+
+typedef struct {
+  const guchar* data;
+  gsize size;
+  gsize position;
+} AssetPngSource;
+
+static void asset_png_read(png_structp png, png_bytep out, png_size_t length) {
+  AssetPngSource* source = (AssetPngSource*)png_get_io_ptr(png);
+  if (length > source->size - source->position) png_error(png, "truncated png");
+  memcpy(out, source->data + source->position, length);
+  source->position += length;
+}
+
+// Streams png rows through downscaler. Interlaced images deliver rows in
+// passes, so they are left to generic loader, as are images not larger than
+// layer.
+static GdkPixbuf* decode_downscaled_png(const guchar* data, gsize size, gint width, gint height) {
+  AssetPngSource source = {data, size, 0};
+  png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_infop info = png ? png_create_info_struct(png) : NULL;
+  RowDownscaler* volatile rd = NULL;
+  guchar* volatile row = NULL;
+  GdkPixbuf* pixbuf = NULL;
+  if (!info || setjmp(png_jmpbuf(png))) {
+    // Not fatal, caller falls back to generic loader
+    png_destroy_read_struct(&png, info ? &info : NULL, NULL);
+    del_row_downscaler(rd);
+    g_free(row);
+    return NULL;
+  }
+  png_set_read_fn(png, &source, &asset_png_read);
+  png_read_info(png, info);
+  if (png_get_interlace_type(png, info) == PNG_INTERLACE_NONE &&
+      (png_get_image_width(png, info) > (png_uint_32)width || png_get_image_height(png, info) > (png_uint_32)height)) {
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_gray_to_rgb(png);
+    png_set_add_alpha(png, 0xff, PNG_FILLER_AFTER);
+    png_read_update_info(png, info);
+    png_uint_32 src_width = png_get_image_width(png, info);
+    png_uint_32 src_height = png_get_image_height(png, info);
+    if (png_get_channels(png, info) == 4 && png_get_bit_depth(png, info) == 8) {
+      rd = new_row_downscaler(src_width, src_height, width, height);
+      row = g_malloc(png_get_rowbytes(png, info));
+      for (png_uint_32 y = 0; y < src_height; ++y) {
+        png_read_row(png, row, NULL);
+        row_downscaler_push(rd, row);
+      }
+      png_read_end(png, NULL);
+      pixbuf = row_downscaler_finish(rd);
+    }
+  }
+  png_destroy_read_struct(&png, &info, NULL);
+  del_row_downscaler(rd);
+  g_free(row);
+  return pixbuf;
+}
 
 typedef struct {
-  LayerConfig* config;
-  gchar* value;
-} LayerData;
-
-LayerConfig* new_layer_config(LayerType type, int vcenter, gdouble rotate) {
-  LayerConfig* lc = malloc(sizeof(LayerConfig));
-  lc->type = type;
-  lc->vcenter = vcenter;
-  lc->rotate = rotate;
-  return lc;
+  gchar* path;
+  gint width;
+  gint height;
+  gdouble rotate;
+  gsize bytes;
+  guint pending_uses;
+  gboolean done;
+  GdkPixbuf* pixbuf;
+  gboolean transformed;
+  gint offset_x;
+  gint offset_y;
+} PrefetchedAsset;
+
+PrefetchedAsset* new_prefetched_asset(gchar* path, gint width, gint height, gdouble rotate) {
+  PrefetchedAsset* pa = malloc(sizeof(PrefetchedAsset));
+  pa->path = path;
+  pa->width = width;
+  pa->height = height;
+  pa->rotate = rotate;
+  pa->bytes = (gsize)width * height * 4;
+  pa->pending_uses = 0;
+  pa->done = FALSE;
+  pa->pixbuf = NULL;
+  pa->transformed = FALSE;
+  pa->offset_x = 0;
+  pa->offset_y = 0;
+  return pa;
 }
 
-void del_layer_config(LayerConfig* lc) {
-  if (lc) free(lc);
+void del_prefetched_asset(PrefetchedAsset* pa) {
+  if (!pa) return;
+  if (pa->pixbuf) g_object_unref(pa->pixbuf);
+  g_free(pa->path);
+  free(pa);
 }
 
-LayerData* new_layer_data(LayerConfig* config, gchar* value) {
-  LayerData* ld = malloc(sizeof(LayerData));
-  ld->config = config;
-  ld->value = value;
-  return ld;
+// Decodes assets referenced by upcoming rows on worker threads and keeps
+// them pre-scaled to their target layer size until the main thread uploads
+// them. Only pixel decoding happens off the main thread, all GIMP calls stay
+// on it. Layer sizes are tables of image layer sizes, one per XCF of
+// template, so asset used by several XCFs at the same size is decoded once.
+typedef struct {
+  GThreadPool* pool;
+  GMutex mutex;
+  GCond cond;
+  GHashTable* assets;
+  gsize bytes;
+  gsize byte_limit;
+  guint rows_ahead;
+  guint next_row;
+  GPtrArray* rows;
+  GPtrArray* layer_sizes;
+  gchar* assets_dir;
+  DerivedAssetCache* asset_cache;
+  AssetPack* asset_pack;
+} AssetPrefetcher;
+
+static gchar* prefetched_asset_key(const gchar* path, gint width, gint height, gdouble rotate) {
+  return g_strdup_printf("%dx%d:%.6f:%s", width, height, rotate, path);
 }
 
-void del_layer_data(LayerData* ld) {
-  if (!ld) return;
-  g_free(ld->value);
-  free(ld);
+static GdkPixbuf* decode_scaled_asset(AssetPack* asset_pack, const gchar* path, gint width, gint height) {
+  // Asset is read once, from pack or mapped file, and all decoders work on
+  // its bytes. Large jpeg and png assets are downscaled while decoding, full
+  // resolution never hits memory.
+  GBytes* bytes = read_asset_bytes(asset_pack, path);
+  if (!bytes) return NULL;
+  gsize size;
+  const guchar* data = (const guchar*)g_bytes_get_data(bytes, &size);
+  GdkPixbuf* pixbuf = NULL;
+  if (size >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff) {
+    pixbuf = decode_downscaled_jpeg(data, size, width, height);
+  } else if (size >= 8 && png_sig_cmp((png_const_bytep)data, 0, 8) == 0) {
+    pixbuf = decode_downscaled_png(data, size, width, height);
+  }
+  // Not fatal when it fails, caller falls back to loading the file through GIMP
+  if (!pixbuf) pixbuf = new_pixbuf_from_asset_bytes(bytes, width, height);
+  g_bytes_unref(bytes);
+  return pixbuf;
 }
 
-typedef struct {
-  GHashTable* layers;
-  GPtrArray* data;
-  gchar* out_key;
-} ComponentTemplate;
-
-ComponentTemplate* new_component_template(GHashTable* layers, GPtrArray* data, gchar* out_key) {
-  ComponentTemplate *ct = malloc (sizeof (ComponentTemplate));
-  ct->layers = layers;
-  ct->data = data;
-  ct->out_key = out_key;
-  return ct;
+// Prefers pixels already transformed for the layer, decodes and scales source otherwise
+static GdkPixbuf* load_asset(DerivedAssetCache* asset_cache, AssetPack* asset_pack, const gchar* path, gint width, gint height, gdouble rotate, gboolean* transformed, gint* offset_x, gint* offset_y) {
+  GdkPixbuf* pixbuf = derived_asset_cache_load(asset_cache, path, width, height, rotate, offset_x, offset_y);
+  *transformed = pixbuf != NULL;
+  if (pixbuf) return pixbuf;
+  return decode_scaled_asset(asset_pack, path, width, height);
 }
 
-void del_component_template(ComponentTemplate* ct) {
-  if (!ct) return;
-  g_hash_table_destroy(ct->layers);
-  g_ptr_array_free(ct->data, TRUE);
-  if (ct->out_key) g_free(ct->out_key);
-  free(ct);
+static void asset_prefetcher_decode(gpointer data, gpointer user_data) {
+  PrefetchedAsset* asset = (PrefetchedAsset*)data;
+  AssetPrefetcher* prefetcher = (AssetPrefetcher*)user_data;
+  gboolean transformed;
+  gint offset_x = 0, offset_y = 0;
+  GdkPixbuf* pixbuf = load_asset(prefetcher->asset_cache, prefetcher->asset_pack, asset->path, asset->width, asset->height, asset->rotate, &transformed, &offset_x, &offset_y);
+
+  g_mutex_lock(&prefetcher->mutex);
+  asset->pixbuf = pixbuf;
+  asset->transformed = transformed;
+  asset->offset_x = offset_x;
+  asset->offset_y = offset_y;
+  asset->done = TRUE;
+  if (asset->pending_uses == 0) {
+    // All uses were released while decoding
+    gchar* key = prefetched_asset_key(asset->path, asset->width, asset->height, asset->rotate);
+    prefetcher->bytes -= asset->bytes;
+    g_hash_table_remove(prefetcher->assets, key);
+    g_free(key);
+  }
+  g_cond_broadcast(&prefetcher->cond);
+  g_mutex_unlock(&prefetcher->mutex);
 }
 
-typedef gpointer (*NewHashTableElementCallback)(JsonReader *reader, gchar* key, void* user_data);
-
-static GHashTable* new_hashtable_from_json_object(JsonReader *reader, NewHashTableElementCallback callback, GDestroyNotify free_func, void* user_data) {
-  if (!json_reader_is_object(reader)) return NULL;
-
-  gchar** members_list = json_reader_list_members(reader);
-  GHashTable* hash_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_func);
-  for (gchar** m = members_list; *m != NULL; ++m) {
-    if (!json_reader_read_member(reader, *m)) {
-      json_reader_end_member(reader);
-      printf("%s is not a member", *m);
-      return NULL;
-    }
-
-    gpointer data = (*callback)(reader, *m, user_data);
-    if (!data) {
-      printf("Failed to get data from %s\n", *m);
-      json_reader_end_member(reader);
-      g_hash_table_destroy(hash_table);
-      g_strfreev(members_list);
-      return NULL;
-    }
-    g_hash_table_insert(hash_table, g_strdup(*m), data);
-
-    json_reader_end_member(reader);
+AssetPrefetcher* new_asset_prefetcher(GeneratorContext* ctx, GPtrArray* rows, GPtrArray* layer_sizes, gchar* assets_dir) {
+  GeneratorOptions* options = ctx->options;
+  AssetPrefetcher* ap = malloc(sizeof(AssetPrefetcher));
+  g_mutex_init(&ap->mutex);
+  g_cond_init(&ap->cond);
+  ap->assets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)&del_prefetched_asset);
+  ap->bytes = 0;
+  ap->byte_limit = options->prefetch_bytes;
+  ap->rows_ahead = options->prefetch_rows;
+  ap->next_row = 0;
+  ap->rows = rows;
+  ap->layer_sizes = layer_sizes;
+  ap->assets_dir = assets_dir;
+  ap->asset_cache = ctx->asset_cache;
+  ap->asset_pack = ctx->asset_pack;
+  ap->pool = NULL;
+  if (options->prefetch_rows > 0) {
+    ap->pool = g_thread_pool_new(&asset_prefetcher_decode, ap, options->prefetch_threads, FALSE, NULL);
   }
-  g_strfreev(members_list);
-  return hash_table;
+  return ap;
 }
 
-typedef gpointer (*NewElementCallback)(JsonReader *reader, void* user_data);
+void del_asset_prefetcher(AssetPrefetcher* ap) {
+  if (!ap) return;
+  if (ap->pool) g_thread_pool_free(ap->pool, FALSE, TRUE);
+  g_hash_table_destroy(ap->assets);
+  g_cond_clear(&ap->cond);
+  g_mutex_clear(&ap->mutex);
+  free(ap);
+}
 
-static GPtrArray* new_ptr_array_from_json_array(JsonReader *reader, NewElementCallback callback, GDestroyNotify free_func, void* user_data) {
-  if (!json_reader_is_array(reader)) return NULL;
-  gint elements_len = json_reader_count_elements(reader);
-  GPtrArray* ptr_array = g_ptr_array_sized_new(elements_len);
-  g_ptr_array_set_free_func(ptr_array, free_func);
-  for (gint i = 0; i < elements_len; ++i) {
-    if (!json_reader_read_element(reader, i)) {
-      g_ptr_array_free(ptr_array, TRUE);
-      return NULL;
-    }
-    gpointer data = (*callback)(reader, user_data);
-    if (!data) {
-      g_ptr_array_free(ptr_array, TRUE);
-      return NULL;
-    }
-    g_ptr_array_add(ptr_array, data);
-    json_reader_end_element(reader);
+// Reserves the asset for one more use and returns whether it still needs decoding.
+// Caller must hold the mutex.
+static PrefetchedAsset* asset_prefetcher_reserve(AssetPrefetcher* ap, const gchar* path, gint width, gint height, gdouble rotate, gboolean* is_new) {
+  gchar* key = prefetched_asset_key(path, width, height, rotate);
+  PrefetchedAsset* asset = (PrefetchedAsset*)g_hash_table_lookup(ap->assets, key);
+  *is_new = asset == NULL;
+  if (*is_new) {
+    asset = new_prefetched_asset(g_strdup(path), width, height, rotate);
+    g_hash_table_insert(ap->assets, key, asset);
+    ap->bytes += asset->bytes;
+  } else {
+    g_free(key);
   }
-  return ptr_array;
+  asset->pending_uses++;
+  return asset;
 }
 
-static gpointer new_layer_from_json(JsonReader *reader, gchar* key, void* user_data) {
-  LayerType type = LAYER_TYPE_UNKNOWN;
-  int vcenter = 0;
-  gdouble rotate = 0.0;
+// Schedules decoding of assets used by rows up to current_row + rows_ahead
+// as long as the reserved memory stays within the byte limit.
+static void asset_prefetcher_advance(AssetPrefetcher* ap, guint current_row) {
+  if (!ap->pool) return;
+  if (ap->next_row < current_row) ap->next_row = current_row;
 
-  if (json_reader_is_value(reader)) {
-    // Simple string format: "layer_name": "text"
-    type = layer_type_from_str(json_reader_get_string_value(reader));
-    if (type == LAYER_TYPE_UNKNOWN) {
-      printf("Layer type unknown: %s\n", json_reader_get_string_value(reader));
-      return NULL;
-    }
-  } else if (json_reader_is_object(reader)) {
-    // Object format: "layer_name": {"value": "text", "vcenter": 1, "rotate": 90}
-    if (json_reader_read_member(reader, "value")) {
-      if (!json_reader_is_value(reader)) {
-        printf("%s value is not a value\n", key);
-        json_reader_end_member(reader);
-        return NULL;
-      }
-      type = layer_type_from_str(json_reader_get_string_value(reader));
-      if (type == LAYER_TYPE_UNKNOWN) {
-        printf("Layer type unknown: %s\n", json_reader_get_string_value(reader));
-        json_reader_end_member(reader);
-        return NULL;
-      }
-    } else {
-      printf("value not a member of %s\n", key);
-      json_reader_end_member(reader);
-      return NULL;
-    }
-    json_reader_end_member(reader);
+  g_mutex_lock(&ap->mutex);
+  while (ap->next_row < ap->rows->len && ap->next_row <= current_row + ap->rows_ahead) {
+    GHashTable* component_layers = (GHashTable*)g_ptr_array_index(ap->rows, ap->next_row);
 
-    // Read vcenter if present
-    if (json_reader_read_member(reader, "vcenter")) {
-      if (json_reader_is_value(reader)) {
-        vcenter = json_reader_get_boolean_value(reader) ? 1 : json_reader_get_int_value(reader);
+    // Check whole row fits so rows are never half scheduled
+    gsize row_bytes = 0;
+    GHashTableIter iter;
+    gpointer key, value;
+    for (guint face = 0; face < ap->layer_sizes->len; ++face) {
+      GHashTable* layer_sizes = (GHashTable*)g_ptr_array_index(ap->layer_sizes, face);
+      g_hash_table_iter_init(&iter, component_layers);
+      while (g_hash_table_iter_next(&iter, &key, &value)) {
+        LayerData* layer_data = (LayerData*)value;
+        LayerSize* size = (LayerSize*)g_hash_table_lookup(layer_sizes, key);
+        if (layer_data->config->type != LAYER_TYPE_IMAGE || !size) continue;
+        row_bytes += (gsize)size->width * size->height * 4;
       }
     }
-    json_reader_end_member(reader);
-
-    // Read rotate if present  
-    if (json_reader_read_member(reader, "rotate")) {
-      if (json_reader_is_value(reader)) {
-        rotate = json_reader_get_double_value(reader);
+    if (ap->bytes > 0 && ap->bytes + row_bytes > ap->byte_limit) break;
+
+    // Every XCF rendering the layer takes its own use of the asset
+    for (guint face = 0; face < ap->layer_sizes->len; ++face) {
+      GHashTable* layer_sizes = (GHashTable*)g_ptr_array_index(ap->layer_sizes, face);
+      g_hash_table_iter_init(&iter, component_layers);
+      while (g_hash_table_iter_next(&iter, &key, &value)) {
+        LayerData* layer_data = (LayerData*)value;
+        LayerSize* size = (LayerSize*)g_hash_table_lookup(layer_sizes, key);
+        if (layer_data->config->type != LAYER_TYPE_IMAGE || !size) continue;
+        gchar* asset_file = g_build_filename(ap->assets_dir, layer_data->value, NULL);
+        gboolean is_new;
+        PrefetchedAsset* asset = asset_prefetcher_reserve(ap, asset_file, size->width, size->height, layer_data->config->rotate, &is_new);
+        if (is_new) g_thread_pool_push(ap->pool, asset, NULL);
+        g_free(asset_file);
       }
     }
-    json_reader_end_member(reader);
-  } else {
-    printf("Layer definition is neither a value nor an object for key %s\n", key);
-    return NULL;
+    ap->next_row++;
   }
-
-  return new_layer_config(type, vcenter, rotate);
+  g_mutex_unlock(&ap->mutex);
 }
 
-static gpointer new_layer_data_from_json(JsonReader *reader, gchar* key, void* user_data) {
-  LayerConfig* layer_config = (LayerConfig*)g_hash_table_lookup((GHashTable*)user_data, key);
-  if (!layer_config) {
-    printf("Layer config not found for key %s\n", key);
-    return NULL;
-  }
-
-  // Use layer configuration for vcenter and rotate
-  int vcenter = layer_config->vcenter;
-  gdouble rotate = layer_config->rotate;
-  LayerType layer_type = layer_config->type;
-
-  switch (layer_type) {
-    case LAYER_TYPE_IMAGE:
-    case LAYER_TYPE_TEXT: {
-      if (!json_reader_is_value(reader)) {
-        printf("Layer data is not a value for key %s\n", key);
-        return NULL;
+// Gives up uses of row which failed to render, so its assets do not stay
+// reserved. Uses taken before the failure are given up too, assets shared
+// with following rows are then decoded again on the main thread.
+static void asset_prefetcher_skip_row(AssetPrefetcher* ap, guint row) {
+  if (!ap->pool || row >= ap->next_row) return;
+  GHashTable* component_layers = (GHashTable*)g_ptr_array_index(ap->rows, row);
+  g_mutex_lock(&ap->mutex);
+  for (guint face = 0; face < ap->layer_sizes->len; ++face) {
+    GHashTable* layer_sizes = (GHashTable*)g_ptr_array_index(ap->layer_sizes, face);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, component_layers);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      LayerData* layer_data = (LayerData*)value;
+      LayerSize* size = (LayerSize*)g_hash_table_lookup(layer_sizes, key);
+      if (layer_data->config->type != LAYER_TYPE_IMAGE || !size) continue;
+      gchar* asset_file = g_build_filename(ap->assets_dir, layer_data->value, NULL);
+      gchar* asset_key = prefetched_asset_key(asset_file, size->width, size->height, layer_data->config->rotate);
+      PrefetchedAsset* asset = (PrefetchedAsset*)g_hash_table_lookup(ap->assets, asset_key);
+      if (asset && asset->pending_uses > 0 && --asset->pending_uses == 0 && asset->done) {
+        ap->bytes -= asset->bytes;
+        g_hash_table_remove(ap->assets, asset_key);
       }
-      const gchar* data_value = json_reader_get_string_value(reader);
-      return new_layer_data(layer_config, g_strdup(data_value));
+      g_free(asset_key);
+      g_free(asset_file);
     }
-    case LAYER_TYPE_BOOL: 
-      return new_layer_data(layer_config, NULL);
-    default:
-      printf("Invalid layer type for key %s\n", key);
-      return NULL;
   }
+  g_mutex_unlock(&ap->mutex);
 }
 
-static gpointer new_data_from_json(JsonReader *reader, void* user_data) {
-  return new_hashtable_from_json_object(reader, &new_layer_data_from_json, (GDestroyNotify)&del_layer_data, user_data);
-}
-
-static gpointer new_xcf_from_json(JsonReader *reader, gchar* key, void* user_data) {
-  if (!json_reader_is_object(reader)) {
-    printf("Not an object under key %s\n", key);
-    return NULL;
-  }
-
-  gchar* out_key = NULL;
-  if (json_reader_read_member(reader, "out")) {
-    if (json_reader_is_value(reader)) {
-      out_key = g_strdup(json_reader_get_string_value(reader));
-    }
+// Drops decoded assets waiting for upload and stops reading ahead. Assets
+// dropped are decoded again on the main thread when their row comes.
+static void asset_prefetcher_flush(AssetPrefetcher* ap) {
+  g_mutex_lock(&ap->mutex);
+  ap->rows_ahead = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, ap->assets);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    PrefetchedAsset* asset = (PrefetchedAsset*)value;
+    if (!asset->done) continue;
+    ap->bytes -= asset->bytes;
+    g_hash_table_iter_remove(&iter);
   }
-  json_reader_end_member(reader);
+  g_mutex_unlock(&ap->mutex);
+}
 
-  if (!json_reader_read_member(reader, "layers")) {
-    printf("layers not a member of %s\n", key);
-    return NULL;
-  }
-  GHashTable* layers = new_hashtable_from_json_object(reader, &new_layer_from_json, (GDestroyNotify)&del_layer_config, NULL);
-  if (!layers) {
-    printf("Failed to read layers from %s object\n", key);
-    if (out_key) g_free(out_key);
-    return NULL;
+// Returns new reference to decoded asset scaled to width x height or NULL if
+// it could not be decoded. Decodes on the calling thread if it was not prefetched.
+// When transformed is set pixels are already rotated and offset relative to layer.
+static GdkPixbuf* asset_prefetcher_take(AssetPrefetcher* ap, const gchar* path, gint width, gint height, gdouble rotate, gboolean* transformed, gint* offset_x, gint* offset_y) {
+  gchar* key = prefetched_asset_key(path, width, height, rotate);
+  g_mutex_lock(&ap->mutex);
+  PrefetchedAsset* asset = (PrefetchedAsset*)g_hash_table_lookup(ap->assets, key);
+  if (!asset) {
+    g_mutex_unlock(&ap->mutex);
+    g_free(key);
+    return load_asset(ap->asset_cache, ap->asset_pack, path, width, height, rotate, transformed, offset_x, offset_y);
   }
-  json_reader_end_member(reader);
-
-  if (!json_reader_read_member(reader, "data")) {
-    printf("data not a member of %s\n", key);
-    g_hash_table_destroy(layers);
-    if (out_key) g_free(out_key);
-    return NULL;
+  while (!asset->done) {
+    g_cond_wait(&ap->cond, &ap->mutex);
   }
-
-  GPtrArray* data = new_ptr_array_from_json_array(reader, &new_data_from_json, (GDestroyNotify)&g_hash_table_destroy, layers);
-  if (!data) {
-    printf("Failed to read data from %s object\n", key);
-    g_hash_table_destroy(layers);
-    if (out_key) g_free(out_key);
-    return NULL;
+  GdkPixbuf* pixbuf = asset->pixbuf ? g_object_ref(asset->pixbuf) : NULL;
+  *transformed = asset->transformed;
+  *offset_x = asset->offset_x;
+  *offset_y = asset->offset_y;
+  if (--asset->pending_uses == 0) {
+    ap->bytes -= asset->bytes;
+    g_hash_table_remove(ap->assets, key);
   }
-
-  json_reader_end_member(reader);
-
-  return new_component_template(layers, data, out_key);
-}
-
-GHashTable* new_xcfs_from_json(JsonReader *reader) {
-  return new_hashtable_from_json_object(reader, &new_xcf_from_json, (GDestroyNotify)&del_component_template, NULL);
+  g_mutex_unlock(&ap->mutex);
+  g_free(key);
+  return pixbuf;
 }
 
-static GHashTable* parse_json_config(const gchar* config_path) {
-  JsonParser *parser = json_parser_new ();
-  GError *error = NULL;
-
-  json_parser_load_from_file (parser, config_path, &error);
-  if (error) {
-    printf("Unable to parse %s: %s\n", config_path, error->message);
-    g_error_free (error);
-    g_object_unref (parser);
-    return NULL;
+// Gives up one use of asset reserved for a row which did not need it. Asset
+// still decoding is dropped by its worker.
+static void asset_prefetcher_release(AssetPrefetcher* ap, const gchar* path, gint width, gint height, gdouble rotate) {
+  gchar* key = prefetched_asset_key(path, width, height, rotate);
+  g_mutex_lock(&ap->mutex);
+  PrefetchedAsset* asset = (PrefetchedAsset*)g_hash_table_lookup(ap->assets, key);
+  if (asset && --asset->pending_uses == 0 && asset->done) {
+    ap->bytes -= asset->bytes;
+    g_hash_table_remove(ap->assets, key);
   }
-
-  JsonReader *reader = json_reader_new (json_parser_get_root (parser));
-  GHashTable* xcfs = new_xcfs_from_json(reader);
-  g_object_unref (reader);
-  g_object_unref (parser);
-
-  return xcfs;
+  g_mutex_unlock(&ap->mutex);
+  g_free(key);
 }
 
 void print_layer_mismatch(const gchar* name, LayerType layer_type, gboolean is_text_layer) {
@@ -324,7 +2537,7 @@ void print_layer_mismatch(const gchar* name, LayerType layer_type, gboolean is_t
 }
 
 typedef struct {
-  gchar* layer_name;
+  const gchar* layer_name;
 #if GIMP_MAJOR_VERSION >= 3
   GimpLayer* duplicate_layer_id;
 #else
@@ -333,7 +2546,7 @@ typedef struct {
   gsize position_in_text;
 } ImageKeyword;
 
-ImageKeyword* new_image_keyword(gchar* layer_name, gsize position_in_text) {
+ImageKeyword* new_image_keyword(const gchar* layer_name, gsize position_in_text) {
   ImageKeyword* ik = g_malloc(sizeof(ImageKeyword));
   ik->layer_name = layer_name;
 #if GIMP_MAJOR_VERSION >= 3
@@ -345,30 +2558,21 @@ ImageKeyword* new_image_keyword(gchar* layer_name, gsize position_in_text) {
   return ik;
 }
 
-static gchar* replace_keywords_with_spaces(const gchar* text, GPtrArray* keywords) {
-  GString* result = g_string_new("");
-  const gchar* current = text;
-  gsize last_pos = 0;
-  for (guint i = 0; i < keywords->len; i++) {
-    ImageKeyword* keyword = g_ptr_array_index(keywords, i);
-    // Find the keyword position in text
-    gchar* keyword_pattern = g_strdup_printf("<<%s>>", keyword->layer_name);
-    const gchar* found = strstr(current + last_pos, keyword_pattern);
-    if (found) {
-      // Append text before keyword
-      g_string_append_len(result, current + last_pos, found - (current + last_pos));
-      // Update the position in processed text (where the spaces will be)
-      keyword->position_in_text = result->len;
-      // Append two spaces instead of keyword
-      g_string_append(result, "  ");
-      // Move past the keyword
-      last_pos = (found + strlen(keyword_pattern)) - current;
-    }
-    g_free(keyword_pattern);
-  }
-  // Append remaining text
-  g_string_append(result, current + last_pos);
-  return g_string_free(result, FALSE);
+// Keywords of compiled text, layer names are borrowed from it
+static GPtrArray* image_keywords_from_compiled(const CompiledText* compiled) {
+  GPtrArray* keywords = g_ptr_array_new_full(compiled->layer_names->len, g_free);
+  for (guint i = 0; i < compiled->layer_names->len; ++i) {
+    g_ptr_array_add(keywords, new_image_keyword(g_ptr_array_index(compiled->layer_names, i),
+                                                g_array_index(compiled->positions, gsize, i)));
+  }
+  return keywords;
+}
+
+static gchar* new_template_xcf_path(gchar* xcfs_dir, TemplateXcf* template_xcf) {
+  gchar* xcf_filename = g_strconcat(template_xcf->name, ".xcf", NULL);
+  gchar* xcf_path = g_build_filename(xcfs_dir, xcf_filename, NULL);
+  g_free(xcf_filename);
+  return xcf_path;
 }
 
 static gchar* create_components_out_dir(gchar* out_dir, gchar* name) {
@@ -391,29 +2595,709 @@ static gchar* create_components_out_dir(gchar* out_dir, gchar* name) {
   return components_out_dir;
 }
 
-static gboolean generate_from_xcf(gchar* xcfs_dir, gchar* assets_dir, gchar* out_dir, gchar* name, ComponentTemplate* ct);
+// Digests of encoded outputs written by previous runs, stored next to outputs.
+// Each entry keeps modification time in nanoseconds and size of the file it
+// was computed for, so outputs changed by someone else are not trusted, even
+// within the same second.
+typedef struct {
+  gchar* path;
+  GKeyFile* key_file;
+  gboolean changed;
+} OutputDigests;
+
+static const gchar* DIGESTS_FILENAME = ".digests";
+static const gchar* DIGESTS_GROUP = "digests";
+static const gchar* DIGESTS_FORMAT_GROUP = "format";
+// Entries of version 1 kept modification time in whole seconds only
+static const gint DIGESTS_VERSION = 2;
+
+OutputDigests* new_output_digests(gchar* out_dir) {
+  OutputDigests* od = malloc(sizeof(OutputDigests));
+  od->path = g_build_filename(out_dir, DIGESTS_FILENAME, NULL);
+  od->key_file = g_key_file_new();
+  od->changed = FALSE;
+  // Missing, broken or older file only means all outputs get hashed again
+  if (!g_key_file_load_from_file(od->key_file, od->path, G_KEY_FILE_NONE, NULL) ||
+      g_key_file_get_integer(od->key_file, DIGESTS_FORMAT_GROUP, "version", NULL) != DIGESTS_VERSION) {
+    g_key_file_free(od->key_file);
+    od->key_file = g_key_file_new();
+    g_key_file_set_integer(od->key_file, DIGESTS_FORMAT_GROUP, "version", DIGESTS_VERSION);
+  }
+  return od;
+}
+
+void del_output_digests(OutputDigests* od) {
+  if (!od) return;
+  g_key_file_free(od->key_file);
+  g_free(od->path);
+  free(od);
+}
+
+static gboolean save_output_digests(OutputDigests* od) {
+  if (!od || !od->changed) return TRUE;
+  GError* error = NULL;
+  if (!g_key_file_save_to_file(od->key_file, od->path, &error)) {
+    printf("Unable to save %s: %s\n", od->path, error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+  od->changed = FALSE;
+  return TRUE;
+}
+
+// Modification time and size of output as stored in digests file, NULL when
+// output is missing
+static gchar** new_output_stamp(const gchar* path) {
+  GStatBuf st;
+  if (g_stat(path, &st) != 0) return NULL;
+  gchar** stamp = g_new0(gchar*, 3);
+  stamp[0] = g_strdup_printf("%" G_GINT64_FORMAT, stat_mtime_ns(&st));
+  stamp[1] = g_strdup_printf("%" G_GINT64_FORMAT, (gint64)st.st_size);
+  return stamp;
+}
+
+// Outputs are identified by path relative to directory of digests file
+static gchar* output_digest_key(OutputDigests* od, const gchar* out_file) {
+  gchar* dir = g_path_get_dirname(od->path);
+  gsize dir_len = strlen(dir);
+  gchar* key = NULL;
+  if (0 == strncmp(out_file, dir, dir_len) && out_file[dir_len] == G_DIR_SEPARATOR) {
+    key = g_strdup(out_file + dir_len + 1);
+  } else {
+    key = g_path_get_basename(out_file);
+  }
+  g_free(dir);
+  return key;
+}
+
+static gchar* lookup_output_digest(OutputDigests* od, const gchar* out_file) {
+  gchar* name = output_digest_key(od, out_file);
+  gchar** entry = g_key_file_get_string_list(od->key_file, DIGESTS_GROUP, name, NULL, NULL);
+  g_free(name);
+  if (!entry) return NULL;
+  gchar** stamp = new_output_stamp(out_file);
+  gchar* digest = NULL;
+  if (stamp && g_strv_length(entry) == 3 && 0 == g_strcmp0(entry[1], stamp[0]) && 0 == g_strcmp0(entry[2], stamp[1])) {
+    digest = g_strdup(entry[0]);
+  }
+  g_strfreev(stamp);
+  g_strfreev(entry);
+  return digest;
+}
+
+static void set_output_digest(OutputDigests* od, const gchar* out_file, const gchar* digest) {
+  gchar** stamp = new_output_stamp(out_file);
+  if (!stamp) return;
+  gchar* name = output_digest_key(od, out_file);
+  const gchar* entry[] = {digest, stamp[0], stamp[1]};
+  g_key_file_set_string_list(od->key_file, DIGESTS_GROUP, name, entry, G_N_ELEMENTS(entry));
+  od->changed = TRUE;
+  g_strfreev(stamp);
+  g_free(name);
+}
+
+static gboolean png_metadata_chunk(const guchar* type) {
+  static const gchar* METADATA_CHUNKS[] = {"tIME", "tEXt", "zTXt", "iTXt", "eXIf"};
+  for (guint i = 0; i < G_N_ELEMENTS(METADATA_CHUNKS); ++i) {
+    if (0 == memcmp(type, METADATA_CHUNKS[i], 4)) return TRUE;
+  }
+  return FALSE;
+}
+
+// Digest of encoded output, NULL when it can not be read. Metadata chunks of
+// PNG, e.g. time of saving, are left out, so output saved again with the same
+// pixels has the same digest.
+static gchar* encoded_output_digest(const gchar* path) {
+  static const guchar PNG_SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  GMappedFile* file = g_mapped_file_new(path, FALSE, NULL);
+  if (!file) return NULL;
+  const guchar* data = (const guchar*)g_mapped_file_get_contents(file);
+  gsize size = g_mapped_file_get_length(file);
+  GChecksum* checksum = g_checksum_new(G_CHECKSUM_SHA256);
+  gsize pos = 0;
+  if (size >= sizeof(PNG_SIGNATURE) && 0 == memcmp(data, PNG_SIGNATURE, sizeof(PNG_SIGNATURE))) {
+    pos = sizeof(PNG_SIGNATURE);
+    g_checksum_update(checksum, data, pos);
+    // Chunk is length, type, data and CRC
+    while (size - pos >= 12) {
+      guint32 length;
+      memcpy(&length, data + pos, sizeof(length));
+      length = GUINT32_FROM_BE(length);
+      if (length > size - pos - 12) break;
+      if (!png_metadata_chunk(data + pos + 4)) {
+        g_checksum_update(checksum, data + pos, length + 12);
+      }
+      pos += length + 12;
+    }
+  }
+  g_checksum_update(checksum, data + pos, size - pos);
+  gchar* digest = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+  g_mapped_file_unref(file);
+  return digest;
+}
+
+// Checks whether existing output already has given encoded pixels
+static gboolean output_unchanged(OutputDigests* od, const gchar* out_file, const gchar* digest) {
+  if (!g_file_test(out_file, G_FILE_TEST_IS_REGULAR)) return FALSE;
+  gchar* existing_digest = lookup_output_digest(od, out_file);
+  if (!existing_digest) {
+    // No digest from previous runs, hash existing file
+    existing_digest = encoded_output_digest(out_file);
+    if (!existing_digest) return FALSE;
+  }
+  gboolean ret = 0 == g_strcmp0(existing_digest, digest);
+  g_free(existing_digest);
+  return ret;
+}
+
+// Temporary file in the same directory, so it can be renamed over output
+// atomically. Keeps output extension as it selects file format.
+static gchar* new_temporary_out_file(const gchar* out_file) {
+  gchar* dir = g_path_get_dirname(out_file);
+  gchar* name = g_path_get_basename(out_file);
+  gchar* tmp_name = g_strdup_printf(".tmp-%u-%s", g_random_int(), name);
+  gchar* tmp_file = g_build_filename(dir, tmp_name, NULL);
+  g_free(tmp_name);
+  g_free(name);
+  g_free(dir);
+  return tmp_file;
+}
+
+static gboolean replace_output(const gchar* tmp_file, const gchar* out_file) {
+  if (g_rename(tmp_file, out_file) != 0) {
+    printf("Unable to replace %s\n", out_file);
+    g_unlink(tmp_file);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// Output file of variant, e.g. out/screen/name_small.jpg for out/name.png
+static gchar* new_variant_out_file(const gchar* out_file, OutputVariant* variant) {
+  gchar* dir = g_path_get_dirname(out_file);
+  gchar* name = g_path_get_basename(out_file);
+  gchar* ext = strrchr(name, '.');
+  if (ext) *ext = '\0';
+  gchar* filename = g_strdup_printf("%s%s.%s", name, variant->suffix ? variant->suffix : "",
+                                    0 == g_strcmp0(variant->format, "jpeg") ? "jpg" : variant->format);
+  gchar* variant_file = g_build_filename(dir, variant->dir ? variant->dir : "", filename, NULL);
+  g_free(filename);
+  g_free(name);
+  g_free(dir);
+  return variant_file;
+}
+
+static gboolean create_variant_dirs(const gchar* out_dir, GPtrArray* variants) {
+  for (guint i = 0; i < variants->len; ++i) {
+    OutputVariant* variant = (OutputVariant*)g_ptr_array_index(variants, i);
+    if (!variant->dir) continue;
+    gchar* variant_dir = g_build_filename(out_dir, variant->dir, NULL);
+    gint res = g_mkdir_with_parents(variant_dir, 0755);
+    if (res != 0) {
+      printf("Unable to create output directory %s\n", variant_dir);
+    }
+    g_free(variant_dir);
+    if (res != 0) return FALSE;
+  }
+  return TRUE;
+}
+
+// Area averaging downscale of final pixels. Without alpha result is composed
+// over white, as formats like jpeg drop it.
+static GdkPixbuf* downscale_pixbuf(GdkPixbuf* pixbuf, gdouble scale, gboolean with_alpha) {
+  GdkPixbuf* src = gdk_pixbuf_get_has_alpha(pixbuf) ? g_object_ref(pixbuf) : gdk_pixbuf_add_alpha(pixbuf, FALSE, 0, 0, 0);
+  gint src_width = gdk_pixbuf_get_width(src);
+  gint src_height = gdk_pixbuf_get_height(src);
+  gint src_rowstride = gdk_pixbuf_get_rowstride(src);
+  const guchar* src_pixels = gdk_pixbuf_read_pixels(src);
+  gint dst_width = MAX(1, (gint)round(src_width * scale));
+  gint dst_height = MAX(1, (gint)round(src_height * scale));
+  GdkPixbuf* dst = gdk_pixbuf_new(GDK_COLORSPACE_RGB, with_alpha, 8, dst_width, dst_height);
+  gint dst_rowstride = gdk_pixbuf_get_rowstride(dst);
+  guchar* dst_pixels = gdk_pixbuf_get_pixels(dst);
+
+  BoxSpans* xs = new_box_spans(src_width, dst_width);
+  BoxSpans* ys = new_box_spans(src_height, dst_height);
+  gfloat* row = g_new(gfloat, (gsize)dst_width * 4);
+  gfloat* acc = g_new(gfloat, (gsize)dst_width * 4);
+  for (gint y = 0; y < dst_height; ++y) {
+    memset(acc, 0, sizeof(gfloat) * dst_width * 4);
+    for (gint k = 0; k < ys->count[y]; ++k) {
+      gfloat wy = ys->weights[ys->offset[y] + k];
+      box_filter_row(src_pixels + (gsize)(ys->first[y] + k) * src_rowstride, xs, dst_width, row);
+      for (gint i = 0; i < dst_width * 4; ++i) acc[i] += wy * row[i];
+    }
+    store_box_row(acc, dst_width, dst_pixels + (gsize)y * dst_rowstride, with_alpha);
+  }
+  g_free(acc);
+  g_free(row);
+  del_box_spans(ys);
+  del_box_spans(xs);
+  g_object_unref(src);
+  return dst;
+}
+
+// Writes all variants of output from its final pixels. Variant is rewritten
+// only when full size output or variant settings changed, output is decoded
+// only then.
+static gboolean write_output_variants(OutputDigests* od, const gchar* digest, const gchar* out_file, GPtrArray* variants) {
+  GdkPixbuf* pixbuf = NULL;
+  gboolean ret = TRUE;
+  for (guint i = 0; ret && i < variants->len; ++i) {
+    OutputVariant* variant = (OutputVariant*)g_ptr_array_index(variants, i);
+    gchar* variant_file = new_variant_out_file(out_file, variant);
+    gchar* spec = g_strdup_printf("%s:%.6f:%s:%d", digest, variant->scale, variant->format, variant->quality);
+    gchar* variant_digest = g_compute_checksum_for_string(G_CHECKSUM_SHA256, spec, -1);
+    g_free(spec);
+    gchar* existing_digest = lookup_output_digest(od, variant_file);
+    gboolean stale = 0 != g_strcmp0(existing_digest, variant_digest) || !g_file_test(variant_file, G_FILE_TEST_IS_REGULAR);
+    if (stale && !pixbuf) {
+      GError* error = NULL;
+      pixbuf = gdk_pixbuf_new_from_file(out_file, &error);
+      if (!pixbuf) {
+        printf("Unable to read %s for its variants: %s\n", out_file, error->message);
+        g_error_free(error);
+        ret = FALSE;
+      }
+    }
+    if (stale && pixbuf) {
+      gboolean jpeg = 0 == g_strcmp0(variant->format, "jpeg");
+      GdkPixbuf* scaled = downscale_pixbuf(pixbuf, variant->scale, !jpeg);
+      gchar* tmp_file = new_temporary_out_file(variant_file);
+      gchar* quality = g_strdup_printf("%d", variant->quality);
+      GError* error = NULL;
+      ret = jpeg ? gdk_pixbuf_save(scaled, tmp_file, variant->format, &error, "quality", quality, NULL)
+                 : gdk_pixbuf_save(scaled, tmp_file, variant->format, &error, NULL);
+      if (!ret) {
+        printf("Failed to save image to %s: %s\n", variant_file, error->message);
+        g_error_free(error);
+        g_unlink(tmp_file);
+      } else {
+        ret = replace_output(tmp_file, variant_file);
+      }
+      if (ret) {
+        set_output_digest(od, variant_file, variant_digest);
+      }
+      g_free(quality);
+      g_free(tmp_file);
+      g_object_unref(scaled);
+    }
+    g_free(existing_digest);
+    g_free(variant_digest);
+    g_free(variant_file);
+  }
+  if (pixbuf) g_object_unref(pixbuf);
+  return ret;
+}
+
+// Moves output saved to temporary file in place, unless existing output has
+// the same encoded pixels, and writes its variants. Readers never see
+// partially written output, and outputs hard linked to this one keep their
+// content.
+static gboolean finish_saved_output(OutputDigests* od, const gchar* tmp_file, const gchar* out_file, GPtrArray* variants) {
+  gchar* digest = encoded_output_digest(tmp_file);
+  if (!digest) {
+    printf("Unable to read %s\n", tmp_file);
+    g_unlink(tmp_file);
+    return FALSE;
+  }
+  gboolean ret = TRUE;
+  if (output_unchanged(od, out_file, digest)) {
+    printf("Skipping unchanged %s\n", out_file);
+    g_unlink(tmp_file);
+  } else {
+    ret = replace_output(tmp_file, out_file);
+  }
+  if (ret) {
+    set_output_digest(od, out_file, digest);
+    ret = write_output_variants(od, digest, out_file, variants);
+  }
+  g_free(digest);
+  return ret;
+}
+
+static gboolean same_file(const gchar* a, const gchar* b) {
+  GStatBuf st_a, st_b;
+  if (g_stat(a, &st_a) != 0 || g_stat(b, &st_b) != 0) return FALSE;
+  return st_a.st_dev == st_b.st_dev && st_a.st_ino == st_b.st_ino;
+}
+
+static gboolean link_component_output(OutputDigests* od, const gchar* rendered_file, const gchar* out_file) {
+  if (0 == g_strcmp0(rendered_file, out_file) || same_file(rendered_file, out_file)) return TRUE;
+  gchar* digest = lookup_output_digest(od, rendered_file);
+  if (digest && output_unchanged(od, out_file, digest)) {
+    g_free(digest);
+    return TRUE;
+  }
+
+  gchar* tmp_file = new_temporary_out_file(out_file);
+  gboolean ret = link(rendered_file, tmp_file) == 0;
+  if (!ret) {
+    // Hard links are not possible across file systems, fall back to copy
+    GFile* rendered_gfile = g_file_new_for_path(rendered_file);
+    GFile* tmp_gfile = g_file_new_for_path(tmp_file);
+    GError* error = NULL;
+    ret = g_file_copy(rendered_gfile, tmp_gfile, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, &error);
+    if (!ret) {
+      printf("Unable to copy %s to %s: %s\n", rendered_file, out_file, error->message);
+      g_error_free(error);
+    }
+    g_object_unref(tmp_gfile);
+    g_object_unref(rendered_gfile);
+  }
+  ret = ret && replace_output(tmp_file, out_file);
+  if (ret && digest) {
+    set_output_digest(od, out_file, digest);
+  }
+  g_free(tmp_file);
+  g_free(digest);
+  return ret;
+}
+
+// Produces outputs of duplicated rows and extra copies from already rendered
+// files of one XCF of template. Rows outside of job row range are left as
+// they are.
+static gboolean link_component_outputs(OutputDigests* od, RenderJob* job, GPtrArray* components_data, GHashTable* rendered_files, gchar* out_dir, gchar* out_key, const gchar* suffix, GPtrArray* variants) {
+  for (guint i = 0; i < components_data->len; ++i) {
+    if (!render_job_includes_row(job, i)) continue;
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(components_data, i);
+    const gchar* rendered_file = (const gchar*)g_hash_table_lookup(rendered_files, component_data->hash);
+    if (!rendered_file) continue;
+    for (gint copy = 1; copy <= component_data->count; ++copy) {
+      gchar* out_file = new_component_out_file(i, component_data->layers, out_dir, out_key, suffix, copy);
+      gboolean ret = link_component_output(od, rendered_file, out_file);
+      for (guint v = 0; ret && v < variants->len; ++v) {
+        OutputVariant* variant = (OutputVariant*)g_ptr_array_index(variants, v);
+        gchar* rendered_variant = new_variant_out_file(rendered_file, variant);
+        gchar* out_variant = new_variant_out_file(out_file, variant);
+        ret = link_component_output(od, rendered_variant, out_variant);
+        g_free(out_variant);
+        g_free(rendered_variant);
+      }
+      g_free(out_file);
+      if (!ret) return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static gboolean archive_pixbuf(OutputArchive* oa, GdkPixbuf* pixbuf, const gchar* member, const gchar* format, gint quality) {
+  gchar* buffer = NULL;
+  gsize size = 0;
+  GError* error = NULL;
+  gchar* quality_value = g_strdup_printf("%d", quality);
+  gboolean ret = quality > 0 ? gdk_pixbuf_save_to_buffer(pixbuf, &buffer, &size, format, &error, "quality", quality_value, NULL)
+                             : gdk_pixbuf_save_to_buffer(pixbuf, &buffer, &size, format, &error, NULL);
+  g_free(quality_value);
+  if (!ret) {
+    printf("Failed to encode %s: %s\n", member, error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+  ret = output_archive_add(oa, member, buffer, size);
+  g_free(buffer);
+  return ret;
+}
 
-static gboolean generate_from_project(gchar* project_dir) {
+// Encodes output and all its variants straight into archive, nothing is
+// written to out directory
+static gboolean archive_component_output(OutputArchive* oa, GdkPixbuf* pixbuf, const gchar* member, GPtrArray* variants) {
+  gboolean ret = archive_pixbuf(oa, pixbuf, member, OUT_EXTENSION, 0);
+  for (guint i = 0; ret && i < variants->len; ++i) {
+    OutputVariant* variant = (OutputVariant*)g_ptr_array_index(variants, i);
+    gboolean jpeg = 0 == g_strcmp0(variant->format, "jpeg");
+    GdkPixbuf* scaled = downscale_pixbuf(pixbuf, variant->scale, !jpeg);
+    gchar* variant_member = new_variant_out_file(member, variant);
+    ret = archive_pixbuf(oa, scaled, variant_member, variant->format, jpeg ? variant->quality : 0);
+    g_free(variant_member);
+    g_object_unref(scaled);
+  }
+  return ret;
+}
+
+// Index entries of every row and copy of one XCF of template. Duplicated
+// rows and extra copies point to member of the row rendered for them, so
+// archive holds every distinct output once. Rows outside of job row range are
+// left out.
+static void archive_index_outputs(OutputArchive* oa, RenderJob* job, GPtrArray* components_data, GHashTable* rendered_files, gchar* out_dir, gchar* out_key, const gchar* suffix, GPtrArray* variants) {
+  for (guint i = 0; i < components_data->len; ++i) {
+    if (!render_job_includes_row(job, i)) continue;
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(components_data, i);
+    const gchar* rendered_file = (const gchar*)g_hash_table_lookup(rendered_files, component_data->hash);
+    if (!rendered_file) continue;
+    LayerData* out_layer = out_key ? (LayerData*)g_hash_table_lookup(component_data->layers, out_key) : NULL;
+    for (gint copy = 1; copy <= component_data->count; ++copy) {
+      gchar* out_file = new_component_out_file(i, component_data->layers, out_dir, out_key, suffix, copy);
+      json_builder_begin_object(oa->index);
+      json_builder_set_member_name(oa->index, "template");
+      json_builder_add_string_value(oa->index, oa->template_name);
+      json_builder_set_member_name(oa->index, "row");
+      json_builder_add_int_value(oa->index, i);
+      json_builder_set_member_name(oa->index, "copy");
+      json_builder_add_int_value(oa->index, copy);
+      json_builder_set_member_name(oa->index, "out_key");
+      if (out_layer && out_layer->value) {
+        json_builder_add_string_value(oa->index, out_layer->value);
+      } else {
+        json_builder_add_null_value(oa->index);
+      }
+      json_builder_set_member_name(oa->index, "file");
+      json_builder_add_string_value(oa->index, archive_member_name(out_file));
+      json_builder_set_member_name(oa->index, "member");
+      json_builder_add_string_value(oa->index, archive_member_name(rendered_file));
+      json_builder_set_member_name(oa->index, "variants");
+      json_builder_begin_array(oa->index);
+      for (guint v = 0; v < variants->len; ++v) {
+        gchar* variant_member = new_variant_out_file(rendered_file, (OutputVariant*)g_ptr_array_index(variants, v));
+        json_builder_add_string_value(oa->index, archive_member_name(variant_member));
+        g_free(variant_member);
+      }
+      json_builder_end_array(oa->index);
+      json_builder_end_object(oa->index);
+      g_free(out_file);
+    }
+  }
+}
+
+// Opens archive of template unless archive of whole project is open. Returns
+// directory of template outputs within archive, NULL on failure.
+static gchar* open_template_archive(GeneratorContext* ctx, gchar* out_dir, gchar* name) {
+  if (!ctx->archive) {
+    ctx->archive = new_output_archive(out_dir, name, ctx->options->archive);
+    if (!ctx->archive) return NULL;
+  }
+  g_free(ctx->archive->template_name);
+  ctx->archive->template_name = g_strdup(name);
+  return g_strdup(ctx->options->archive_project ? name : "");
+}
+
+// Closes archive of template, archive of project stays open for following
+// templates
+static gboolean close_template_archive(GeneratorContext* ctx, gboolean ret) {
+  if (!ctx->archive || ctx->options->archive_project) return ret;
+  ret = ret && close_output_archive(ctx->archive);
+  del_output_archive(ctx->archive);
+  ctx->archive = NULL;
+  return ret;
+}
+
+// Alias frames of duplicated rows and extra copies of one XCF of template,
+// which point consumer to frame of the row rendered for them. Rows outside of
+// job row range get none.
+static gboolean raw_output_aliases(RawOutput* ro, RenderJob* job, GPtrArray* components_data, GHashTable* rendered_files, gchar* out_dir, gchar* out_key, const gchar* suffix) {
+  for (guint i = 0; i < components_data->len; ++i) {
+    if (!render_job_includes_row(job, i)) continue;
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(components_data, i);
+    const gchar* rendered_file = (const gchar*)g_hash_table_lookup(rendered_files, component_data->hash);
+    if (!rendered_file) continue;
+    for (gint copy = 1; copy <= component_data->count; ++copy) {
+      gchar* out_file = new_component_out_file(i, component_data->layers, out_dir, out_key, suffix, copy);
+      gboolean ret = 0 == g_strcmp0(out_file, rendered_file) || raw_output_publish(ro, out_file, NULL, rendered_file);
+      g_free(out_file);
+      if (!ret) return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// Picks first row of every set of identical rows. Only those are rendered.
+// Rows outside of job row range are skipped.
+static GArray* unique_component_rows(GPtrArray* components_data, RenderJob* job) {
+  GArray* rows = g_array_new(FALSE, FALSE, sizeof(guint));
+  GHashTable* seen = g_hash_table_new(g_str_hash, g_str_equal);
+  for (guint i = 0; i < components_data->len; ++i) {
+    if (!render_job_includes_row(job, i)) continue;
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(components_data, i);
+    if (g_hash_table_add(seen, component_data->hash)) {
+      g_array_append_val(rows, i);
+    }
+  }
+  g_hash_table_destroy(seen);
+  return rows;
+}
+
+// Whether any pixbuf loader recognizes format of asset from its first bytes
+static gboolean asset_bytes_supported(GBytes* bytes) {
+  gsize size;
+  const guchar* data = (const guchar*)g_bytes_get_data(bytes, &size);
+  GdkPixbufLoader* loader = gdk_pixbuf_loader_new();
+  gboolean ret = gdk_pixbuf_loader_write(loader, data, MIN(size, 4096), NULL) && gdk_pixbuf_loader_get_format(loader) != NULL;
+  gdk_pixbuf_loader_close(loader, NULL);
+  g_object_unref(loader);
+  return ret;
+}
+
+// Checks of template data which do not need template image. Returns number
+// of problems found.
+static guint dry_run_check_data(AssetPack* asset_pack, gchar* assets_dir, gchar* name, ComponentTemplate* ct) {
+  guint problems = 0;
+  if (ct->out_key && !g_hash_table_contains(ct->layers, ct->out_key)) {
+    printf("%s: out layer %s is not configured\n", name, ct->out_key);
+    ++problems;
+  }
+  for (guint i = 0; i < ct->data->len; ++i) {
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(ct->data, i);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, component_data->layers);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      LayerData* layer_data = (LayerData*)value;
+      if (layer_data->config->type != LAYER_TYPE_IMAGE) continue;
+      if (!layer_data->value) {
+        printf("%s row %u: layer %s has no asset\n", name, i, (gchar*)key);
+        ++problems;
+        continue;
+      }
+      gchar* asset_file = g_build_filename(assets_dir, layer_data->value, NULL);
+      GBytes* bytes = read_asset_bytes(asset_pack, asset_file);
+      if (!bytes) {
+        printf("%s row %u: asset %s of layer %s not found%s\n", name, i, layer_data->value, (gchar*)key,
+               asset_pack ? " in asset pack" : "");
+        ++problems;
+      } else if (!asset_bytes_supported(bytes)) {
+        printf("%s row %u: asset %s of layer %s is not a supported image\n", name, i, layer_data->value, (gchar*)key);
+        ++problems;
+      }
+      if (bytes) g_bytes_unref(bytes);
+      g_free(asset_file);
+    }
+  }
+  return problems;
+}
+
+static guint dry_run_xcf(AssetPack* asset_pack, gchar* xcfs_dir, gchar* assets_dir, gchar* name, ComponentTemplate* ct);
+static gboolean generate_from_xcf(gchar* xcfs_dir, gchar* assets_dir, gchar* out_dir, gchar* name, ComponentTemplate* ct, GeneratorContext* ctx);
+
+// Templates job server keeps open, least recently used are closed beyond it
+static const guint MAX_WARM_TEMPLATES = 16;
+
+static GHashTable* new_warm_templates(void);
+
+static gboolean generate_from_project(gchar* project_dir, RenderJob* job) {
   gchar* config_path = g_build_filename(project_dir, "config.json", NULL);
   gchar* xcfs_dir = g_build_filename(project_dir, "xcfs", NULL);
   gchar* assets_dir = g_build_filename(project_dir, "assets", NULL);
   gchar* out_dir = g_build_filename(project_dir, "out", NULL);
+  gchar* options_path = g_build_filename(project_dir, "options.json", NULL);
   gboolean ret = TRUE;
 
-  GHashTable* xcfs = parse_json_config(config_path);
-  if (!xcfs) {
+  GeneratorOptions* options = parse_json_options(options_path);
+  if (options && job && job->dry_run) options->dry_run = TRUE;
+  if (options && job && job->options && !apply_job_options(options, job->options)) {
+    del_generator_options(options);
+    options = NULL;
+  }
+  gchar* config_cache_dir = options && options->config_cache ? g_build_filename(project_dir, ".cache", "config", NULL) : NULL;
+  GHashTable* xcfs = options ? load_config(config_path, config_cache_dir) : NULL;
+  g_free(config_cache_dir);
+  GeneratorContext* ctx = NULL;
+  if (options) {
+    AssetPack* asset_pack = NULL;
+    if (options->asset_pack) {
+      gchar* pack_path = g_path_is_absolute(options->asset_pack) ? g_strdup(options->asset_pack)
+                                                                 : g_build_filename(project_dir, options->asset_pack, NULL);
+      asset_pack = new_asset_pack(pack_path, assets_dir);
+      if (!asset_pack) ret = FALSE;
+      g_free(pack_path);
+    }
+    DerivedAssetCache* asset_cache = NULL;
+    if (options->asset_cache) {
+      asset_cache = new_derived_asset_cache(g_build_filename(project_dir, ".cache", "assets", NULL), gimp_context_get_interpolation(),
+                                            options->asset_cache_bytes, asset_pack);
+    }
+    ctx = new_generator_context(options, asset_cache, asset_pack);
+    ctx->job = job;
+    verbose_output = options->verbose;
+  }
+  if (!options) {
+    printf("Failed to read %s options\n", options_path);
+    ret = FALSE;
+  } else if (!xcfs) {
     printf("Failed to read %s config\n", config_path);
-  } else {
+    ret = FALSE;
+  } else if (!ret) {
+    g_hash_table_destroy(xcfs);
+  } else if (options->dry_run) {
+    // Checks everything up front without rendering, reporting all problems
+    guint problems = 0;
     GHashTableIter iter;
     gpointer key, value;
     g_hash_table_iter_init(&iter, xcfs);
     while (g_hash_table_iter_next(&iter, &key, &value)) {
-      ret = generate_from_xcf(xcfs_dir, assets_dir, out_dir, (gchar*)key, (ComponentTemplate*)value);
+      if (!render_job_includes_template(job, key)) continue;
+      problems += dry_run_xcf(ctx->asset_pack, xcfs_dir, assets_dir, (gchar*)key, (ComponentTemplate*)value);
+    }
+    job_report(job, "progress", "dry run found %u problems", problems);
+    printf("Dry run found %u problems\n", problems);
+    ret = problems == 0;
+    g_hash_table_destroy(xcfs);
+  } else {
+    GHashTableIter iter;
+    gpointer key, value;
+    FILE* events_file = options->events ? open_event_target(options->events) : NULL;
+    if (events_file) {
+      guint rows_total = 0;
+      g_hash_table_iter_init(&iter, xcfs);
+      while (g_hash_table_iter_next(&iter, &key, &value)) {
+        if (!render_job_includes_template(job, key)) continue;
+        GArray* rows = unique_component_rows(((ComponentTemplate*)value)->data, job);
+        rows_total += rows->len;
+        g_array_free(rows, TRUE);
+      }
+      ctx->events = new_event_log(events_file, rows_total);
+    }
+    if (options->archive && options->archive_project) {
+      ctx->archive = new_output_archive(out_dir, "components", options->archive);
+      ret = ctx->archive != NULL;
+    }
+    if (options->keep_going) {
+      ctx->failures = new_failure_report(g_path_is_absolute(options->failure_report) ? g_strdup(options->failure_report)
+                                                                                     : g_build_filename(project_dir, options->failure_report, NULL));
+    }
+    if (options->raw_output) {
+      ctx->raw_output = new_raw_output(new_raw_output_path(project_dir, options->raw_output), options->raw_output_slots, options->raw_output_frame_bytes);
+      ret = ctx->raw_output != NULL;
+    }
+    g_hash_table_iter_init(&iter, xcfs);
+    while (ret && g_hash_table_iter_next(&iter, &key, &value)) {
+      if (!render_job_includes_template(job, key)) continue;
+      job_report(job, "progress", "template %s", (gchar*)key);
+      if (ctx->events) {
+        GArray* rows = unique_component_rows(((ComponentTemplate*)value)->data, job);
+        event_log_template_start(ctx->events, key, rows->len);
+        g_array_free(rows, TRUE);
+      }
+      failure_report_template(ctx->failures, key);
+      clear_row_failure(ctx);
+      ret = generate_from_xcf(xcfs_dir, assets_dir, out_dir, (gchar*)key, (ComponentTemplate*)value, ctx);
+      if (!ret && ctx->failure_reason) {
+        event_log_error(ctx->events, -1, ctx->failure_reason);
+      }
+      event_log_template_end(ctx->events, ret);
+      if (!ret && ctx->failures && !output_broken(ctx)) {
+        // Failed rows do not fail template in keep_going mode, so this is
+        // failure of whole template, e.g. missing XCF
+        const gchar* reason = ctx->failure_reason ? ctx->failure_reason : "template could not be rendered";
+        printf("Skipping template %s, %s\n", (gchar*)key, reason);
+        failure_report_add(ctx->failures, -1, ctx->failed_layer, reason);
+        ret = TRUE;
+        continue;
+      }
       if (!ret) break;
     }
+    if (ret && ctx->archive) {
+      ret = close_output_archive(ctx->archive);
+    }
+    if (ctx->failures) {
+      ret = save_failure_report(ctx->failures) && ret && ctx->failures->count == 0;
+    }
     g_hash_table_destroy(xcfs);
+    derived_asset_cache_trim(ctx->asset_cache);
   }
+  del_generator_context(ctx);
 
+  g_free(options_path);
   g_free(out_dir);
   g_free(assets_dir);
   g_free(xcfs_dir);
@@ -422,12 +3306,254 @@ static gboolean generate_from_project(gchar* project_dir) {
   return ret;
 }
 
+// Long lived server rendering jobs in warm GIMP. Client connects to UNIX
+// socket, sends one JSON request line and receives JSON status lines until its
+// job finishes. Jobs run one by one on plugin main thread, as PDB calls must.
+typedef struct {
+  GSocketListener* listener;
+  GCancellable* cancellable;
+  GAsyncQueue* queue;
+  GMutex mutex;
+  // Request key -> RenderJob* queued or running
+  GHashTable* jobs;
+  guint next_id;
+  GHashTable* warm_templates;
+  // Client threads still running, server waits for them on shutdown
+  guint clients;
+  GCond clients_done;
+} JobServer;
+
+// Socket operations of clients time out, so stuck client cannot keep its
+// thread forever
+static const gint JOB_CLIENT_TIMEOUT_SECONDS = 30;
+
+typedef struct {
+  JobServer* server;
+  GSocketConnection* connection;
+} JobClient;
+
+// Request: {"project_dir": "/project_dir", "templates": ["card"], "first_row": 0,
+// "last_row": 9, "dry_run": false, "options": {"archive": "zip"}} or
+// {"shutdown": true}. Options override output options of options.json. Shutdown
+// job has no project directory.
+static RenderJob* parse_job_request(const gchar* line) {
+  JsonParser* parser = json_parser_new();
+  GError* error = NULL;
+  if (!json_parser_load_from_data(parser, line, -1, &error)) {
+    printf("Unable to parse job request: %s\n", error->message);
+    g_error_free(error);
+    g_object_unref(parser);
+    return NULL;
+  }
+  JsonReader* reader = json_reader_new(json_parser_get_root(parser));
+  gboolean ok = json_reader_is_object(reader);
+  gboolean shutdown = FALSE;
+  gboolean dry_run = FALSE;
+  gint64 first_row = 0;
+  gint64 last_row = -1;
+  ok = ok && read_bool_option(reader, "shutdown", &shutdown);
+  ok = ok && read_bool_option(reader, "dry_run", &dry_run);
+  ok = ok && read_int_option(reader, "first_row", &first_row);
+  ok = ok && read_int_option(reader, "last_row", &last_row);
+  gchar* project_dir = ok ? read_string_member(reader, "project_dir") : NULL;
+  GPtrArray* templates = NULL;
+  if (ok && json_reader_read_member(reader, "templates")) {
+    ok = json_reader_is_array(reader);
+    templates = g_ptr_array_new();
+    for (gint i = 0; ok && i < json_reader_count_elements(reader); ++i) {
+      json_reader_read_element(reader, i);
+      const gchar* name = json_reader_get_string_value(reader);
+      if (name) g_ptr_array_add(templates, g_strdup(name));
+      else ok = FALSE;
+      json_reader_end_element(reader);
+    }
+    g_ptr_array_add(templates, NULL);
+  }
+  json_reader_end_member(reader);
+  // Options are kept as JSON and read over options of project when job runs
+  gchar* options = NULL;
+  JsonNode* options_node = ok ? json_object_get_member(json_node_get_object(json_parser_get_root(parser)), "options") : NULL;
+  if (options_node) {
+    ok = JSON_NODE_HOLDS_OBJECT(options_node);
+    options = ok ? json_to_string(options_node, FALSE) : NULL;
+  }
+  g_object_unref(reader);
+  g_object_unref(parser);
+
+  gchar** template_names = templates ? (gchar**)g_ptr_array_free(templates, FALSE) : NULL;
+  if (!ok || first_row < 0 || (!shutdown && (!project_dir || !g_path_is_absolute(project_dir)))) {
+    printf("Invalid job request: %s\n", line);
+    g_strfreev(template_names);
+    g_free(project_dir);
+    g_free(options);
+    return NULL;
+  }
+  if (shutdown) {
+    g_free(project_dir);
+    project_dir = NULL;
+  }
+  return new_render_job(project_dir, template_names, first_row, last_row, dry_run, options);
+}
+
+// Reads request of client and queues it or attaches client to identical job
+static gpointer handle_job_client(gpointer data) {
+  JobClient* client = (JobClient*)data;
+  JobServer* server = client->server;
+  GDataInputStream* input = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(client->connection)));
+  gchar* line = g_data_input_stream_read_line(input, NULL, NULL, NULL);
+  RenderJob* job = line ? parse_job_request(line) : NULL;
+  if (!job) {
+    gchar* status = job_status_line(0, "failed", "invalid request");
+    send_status_line(client->connection, status);
+    g_free(status);
+  } else {
+    g_mutex_lock(&server->mutex);
+    RenderJob* existing = job->project_dir ? (RenderJob*)g_hash_table_lookup(server->jobs, job->key) : NULL;
+    RenderJob* target = existing ? existing : job;
+    if (!existing) {
+      job->id = ++server->next_id;
+      job->warm_templates = server->warm_templates;
+      if (job->project_dir) g_hash_table_insert(server->jobs, job->key, job);
+    }
+    // Subscriber is added while server lock is held, so job cannot finish
+    // without telling this client
+    GAsyncQueue* lines = g_async_queue_new();
+    g_async_queue_push(lines, job_status_line(target->id, existing ? "attached" : "queued", NULL));
+    g_mutex_lock(&target->mutex);
+    g_ptr_array_add(target->subscribers, g_async_queue_ref(lines));
+    g_mutex_unlock(&target->mutex);
+    if (!existing) g_async_queue_push(server->queue, job);
+    g_mutex_unlock(&server->mutex);
+    if (existing) del_render_job(job);
+    write_job_status_lines(client->connection, lines);
+    g_async_queue_unref(lines);
+  }
+  g_free(line);
+  g_object_unref(input);
+  g_object_unref(client->connection);
+  free(client);
+  g_mutex_lock(&server->mutex);
+  --server->clients;
+  g_cond_broadcast(&server->clients_done);
+  g_mutex_unlock(&server->mutex);
+  return NULL;
+}
+
+static gpointer accept_job_clients(gpointer data) {
+  JobServer* server = (JobServer*)data;
+  GError* error = NULL;
+  GSocketConnection* connection;
+  while ((connection = g_socket_listener_accept(server->listener, NULL, server->cancellable, &error)) != NULL) {
+    g_socket_set_timeout(g_socket_connection_get_socket(connection), JOB_CLIENT_TIMEOUT_SECONDS);
+    JobClient* client = malloc(sizeof(JobClient));
+    client->server = server;
+    client->connection = connection;
+    g_mutex_lock(&server->mutex);
+    ++server->clients;
+    g_mutex_unlock(&server->mutex);
+    g_thread_unref(g_thread_new("job-client", &handle_job_client, client));
+  }
+  if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    printf("Job server stopped accepting clients: %s\n", error->message);
+  }
+  g_error_free(error);
+  return NULL;
+}
+
+static gboolean run_job_server(const gchar* socket_path) {
+  JobServer server;
+  GError* error = NULL;
+  g_unlink(socket_path);
+  GSocketAddress* address = g_unix_socket_address_new(socket_path);
+  server.listener = g_socket_listener_new();
+  if (!g_socket_listener_add_address(server.listener, address, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &error)) {
+    printf("Unable to listen on %s: %s\n", socket_path, error->message);
+    g_error_free(error);
+    g_object_unref(address);
+    g_object_unref(server.listener);
+    return FALSE;
+  }
+  g_object_unref(address);
+  server.cancellable = g_cancellable_new();
+  server.queue = g_async_queue_new();
+  g_mutex_init(&server.mutex);
+  server.jobs = g_hash_table_new(g_str_hash, g_str_equal);
+  server.next_id = 0;
+  server.warm_templates = new_warm_templates();
+  server.clients = 0;
+  g_cond_init(&server.clients_done);
+  GThread* acceptor = g_thread_new("job-server", &accept_job_clients, &server);
+  printf("Job server listening on %s\n", socket_path);
+
+  for (;;) {
+    RenderJob* job = (RenderJob*)g_async_queue_pop(server.queue);
+    if (!job->project_dir) {
+      job_report(job, "done", "server shutting down");
+      del_render_job(job);
+      break;
+    }
+    printf("Job %u: %s\n", job->id, job->project_dir);
+    job_report(job, "started", NULL);
+    gboolean ret = generate_from_project(job->project_dir, job);
+    // Removed before final status, so clients attaching later start new job
+    g_mutex_lock(&server.mutex);
+    g_hash_table_remove(server.jobs, job->key);
+    g_mutex_unlock(&server.mutex);
+    job_report(job, ret ? "done" : "failed", NULL);
+    del_render_job(job);
+  }
+
+  g_cancellable_cancel(server.cancellable);
+  g_socket_listener_close(server.listener);
+  g_thread_join(acceptor);
+  // Jobs queued after shutdown request are dropped with their clients, also
+  // ones queued by clients still reading their request
+  g_mutex_lock(&server.mutex);
+  for (;;) {
+    RenderJob* job;
+    while ((job = (RenderJob*)g_async_queue_try_pop(server.queue)) != NULL) {
+      g_hash_table_remove(server.jobs, job->key);
+      job_report(job, "failed", "server shut down");
+      del_render_job(job);
+    }
+    if (server.clients == 0) break;
+    g_cond_wait_until(&server.clients_done, &server.mutex, g_get_monotonic_time() + G_TIME_SPAN_SECOND / 10);
+  }
+  g_mutex_unlock(&server.mutex);
+  g_cond_clear(&server.clients_done);
+  g_hash_table_destroy(server.warm_templates);
+  g_hash_table_destroy(server.jobs);
+  g_mutex_clear(&server.mutex);
+  g_async_queue_unref(server.queue);
+  g_object_unref(server.cancellable);
+  g_object_unref(server.listener);
+  g_unlink(socket_path);
+  return TRUE;
+}
+
 #if GIMP_MAJOR_VERSION >= 3
 
-GimpLayer* insert_image_layer(GimpImage* image_ID, GimpLayer* layer_ID, LayerData* layer_data, gchar* assets_dir) {
+GimpLayer* insert_image_layer(GimpImage* image_ID, GimpLayer* layer_ID, LayerData* layer_data, gchar* assets_dir, AssetPrefetcher* prefetcher, gboolean* transformed) {
   gchar* asset_file = g_build_filename(assets_dir, layer_data->value, NULL);
-  GFile* asset_gfile = g_file_new_for_path(asset_file);
-  GimpLayer* new_layer_ID = gimp_file_load_layer(GIMP_RUN_NONINTERACTIVE, image_ID, asset_gfile);
+  gint width = gimp_drawable_get_width(GIMP_DRAWABLE(layer_ID));
+  gint height = gimp_drawable_get_height(GIMP_DRAWABLE(layer_ID));
+  GimpLayer* new_layer_ID = NULL;
+  gboolean scaled = FALSE;
+  gint transform_x = 0, transform_y = 0;
+  GdkPixbuf* pixbuf = asset_prefetcher_take(prefetcher, asset_file, width, height, layer_data->config->rotate, transformed, &transform_x, &transform_y);
+  if (pixbuf) {
+    gchar* layer_name = g_path_get_basename(asset_file);
+    new_layer_ID = gimp_layer_new_from_pixbuf(image_ID, layer_name, pixbuf, 100.0, GIMP_LAYER_MODE_NORMAL, 0.0, 0.0);
+    scaled = new_layer_ID != NULL;
+    g_free(layer_name);
+    g_object_unref(pixbuf);
+  }
+  if (new_layer_ID == NULL) {
+    GFile* asset_gfile = g_file_new_for_path(asset_file);
+    new_layer_ID = gimp_file_load_layer(GIMP_RUN_NONINTERACTIVE, image_ID, asset_gfile);
+    g_object_unref(asset_gfile);
+    *transformed = FALSE;
+  }
   if (new_layer_ID == NULL) {
     printf("Unable to load %s as layer\n", asset_file);
     g_free(asset_file);
@@ -440,13 +3566,17 @@ GimpLayer* insert_image_layer(GimpImage* image_ID, GimpLayer* layer_ID, LayerDat
     gimp_image_remove_layer(image_ID, new_layer_ID);
     return NULL;
   }
-  if (!gimp_layer_scale(new_layer_ID, gimp_drawable_get_width(GIMP_DRAWABLE(layer_ID)), gimp_drawable_get_height(GIMP_DRAWABLE(layer_ID)), FALSE)) {
+  if (!scaled && !gimp_layer_scale(new_layer_ID, width, height, FALSE)) {
     printf("Unable to scale layer\n");
     gimp_image_remove_layer(image_ID, new_layer_ID);
     return NULL;
   }
   gint offset_x, offset_y;
   gimp_drawable_get_offsets(GIMP_DRAWABLE(layer_ID), &offset_x, &offset_y);
+  if (*transformed) {
+    offset_x += transform_x;
+    offset_y += transform_y;
+  }
   if (!gimp_layer_set_offsets(new_layer_ID, offset_x, offset_y)) {
     printf("Unable to set offset of layer\n");
     gimp_image_remove_layer(image_ID, new_layer_ID);
@@ -455,7 +3585,83 @@ GimpLayer* insert_image_layer(GimpImage* image_ID, GimpLayer* layer_ID, LayerDat
   return new_layer_ID;
 }
 
-static gboolean prepare_config_layers(GimpImage* image_ID, GHashTable* layers) {
+static GdkPixbuf* drawable_to_pixbuf(GimpDrawable* drawable_ID) {
+  gint width = gimp_drawable_get_width(drawable_ID);
+  gint height = gimp_drawable_get_height(drawable_ID);
+  GdkPixbuf* pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+  GeglBuffer* buffer = gimp_drawable_get_buffer(drawable_ID);
+  gegl_buffer_get(buffer, GEGL_RECTANGLE(0, 0, width, height), 1.0, babl_format("R'G'B'A u8"),
+                  gdk_pixbuf_get_pixels(pixbuf), gdk_pixbuf_get_rowstride(pixbuf), GEGL_ABYSS_NONE);
+  g_object_unref(buffer);
+  return pixbuf;
+}
+
+// Image sized pixels as they get exported. Read from projection of image
+// into layer which is never inserted, so layers of image are left as they are.
+static GdkPixbuf* image_to_pixbuf(GimpImage* image_ID) {
+  GimpLayer* visible_ID = gimp_layer_new_from_visible(image_ID, image_ID, "visible");
+  if (visible_ID == NULL) {
+    GdkPixbuf* pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, gimp_image_get_width(image_ID), gimp_image_get_height(image_ID));
+    gdk_pixbuf_fill(pixbuf, 0);
+    return pixbuf;
+  }
+  GdkPixbuf* pixbuf = drawable_to_pixbuf(GIMP_DRAWABLE(visible_ID));
+  gimp_item_delete(GIMP_ITEM(visible_ID));
+  return pixbuf;
+}
+
+// Stores scaled and rotated asset layer so next runs can skip the transforms
+static void store_derived_asset(DerivedAssetCache* asset_cache, GimpLayer* layer_ID, GimpLayer* placeholder_ID, LayerData* layer_data, gchar* assets_dir) {
+  gchar* asset_file = g_build_filename(assets_dir, layer_data->value, NULL);
+  gint x, y, base_x, base_y;
+  gimp_drawable_get_offsets(GIMP_DRAWABLE(layer_ID), &x, &y);
+  gimp_drawable_get_offsets(GIMP_DRAWABLE(placeholder_ID), &base_x, &base_y);
+  GdkPixbuf* pixbuf = drawable_to_pixbuf(GIMP_DRAWABLE(layer_ID));
+  derived_asset_cache_store(asset_cache, asset_file,
+                            gimp_drawable_get_width(GIMP_DRAWABLE(placeholder_ID)), gimp_drawable_get_height(GIMP_DRAWABLE(placeholder_ID)),
+                            layer_data->config->rotate, pixbuf, x - base_x, y - base_y);
+  g_object_unref(pixbuf);
+  g_free(asset_file);
+}
+
+// Keeps layer as rendered for the row so rows with the same value paste it
+static void store_rendered_layer(LayerCache* layer_cache, guint face, const gchar* layer_name, LayerData* layer_data, GimpLayer* layer_ID) {
+  gint offset_x, offset_y;
+  gimp_drawable_get_offsets(GIMP_DRAWABLE(layer_ID), &offset_x, &offset_y);
+  layer_cache_store(layer_cache, face, layer_name, layer_data, drawable_to_pixbuf(GIMP_DRAWABLE(layer_ID)), offset_x, offset_y,
+                    gimp_layer_get_opacity(layer_ID), gimp_layer_get_mode(layer_ID));
+}
+
+// Inserts cached pixels in place of placeholder layer, which stays hidden
+static GimpLayer* insert_rendered_layer(GimpImage* image_ID, GimpLayer* placeholder_ID, const gchar* layer_name, RenderedLayer* rendered) {
+  GimpLayer* new_layer_ID = gimp_layer_new_from_pixbuf(image_ID, layer_name, rendered->pixbuf, rendered->opacity, rendered->mode, 0.0, 0.0);
+  if (new_layer_ID == NULL) {
+    printf("Unable to create layer from cached pixels of %s\n", layer_name);
+    return NULL;
+  }
+  gint layer_position = gimp_image_get_item_position(image_ID, GIMP_ITEM(placeholder_ID));
+  if (!gimp_image_insert_layer(image_ID, new_layer_ID, GIMP_LAYER(gimp_item_get_parent(GIMP_ITEM(placeholder_ID))), layer_position)) {
+    printf("Unable to add layer to image\n");
+    gimp_item_delete(GIMP_ITEM(new_layer_ID));
+    return NULL;
+  }
+  if (!gimp_layer_set_offsets(new_layer_ID, rendered->offset_x, rendered->offset_y)) {
+    printf("Unable to set offset of layer\n");
+    gimp_image_remove_layer(image_ID, new_layer_ID);
+    return NULL;
+  }
+  gimp_item_set_visible(GIMP_ITEM(placeholder_ID), FALSE);
+  gimp_item_set_visible(GIMP_ITEM(new_layer_ID), TRUE);
+  return new_layer_ID;
+}
+
+static gboolean image_has_layer(gpointer image, const gchar* name) {
+  return gimp_image_get_layer_by_name(GIMP_IMAGE(image), name) != NULL;
+}
+
+// Returns number of config layers missing in image or of wrong type
+static guint check_config_layers(GimpImage* image_ID, GHashTable* layers) {
+  guint problems = 0;
   GHashTableIter iter;
   gpointer key, value;
   g_hash_table_iter_init(&iter, layers);
@@ -463,7 +3669,8 @@ static gboolean prepare_config_layers(GimpImage* image_ID, GHashTable* layers) {
     GimpLayer* layer_ID = gimp_image_get_layer_by_name(image_ID, key);
     if (layer_ID == NULL) {
       printf("Failed to find %s layer in image\n", (gchar*)key);
-      return FALSE;
+      ++problems;
+      continue;
     }
     LayerConfig* layer_config = (LayerConfig*)value;
     LayerType layer_type = layer_config->type;
@@ -471,13 +3678,369 @@ static gboolean prepare_config_layers(GimpImage* image_ID, GHashTable* layers) {
         || (layer_type == LAYER_TYPE_TEXT && GIMP_IS_TEXT_LAYER(layer_ID))
         || layer_type == LAYER_TYPE_BOOL)) {
       print_layer_mismatch((gchar*)key, layer_type, GIMP_IS_TEXT_LAYER(layer_ID));
-      return FALSE;
+      ++problems;
     }
+  }
+  return problems;
+}
+
+static gboolean prepare_config_layers(GimpImage* image_ID, GHashTable* layers) {
+  if (check_config_layers(image_ID, layers) > 0) return FALSE;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, layers);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    GimpLayer* layer_ID = gimp_image_get_layer_by_name(image_ID, key);
     gimp_item_set_visible(GIMP_ITEM(layer_ID), FALSE);
   }
   return TRUE;
 }
 
+// Text layer shrinks font size down to 1 unit, so text does not fit only
+// when it overflows the layer already at that size, measured as rendering
+// measures it
+static gboolean text_fits_at_min_size(GimpTextLayer* layer_ID, const gchar* text) {
+  GimpUnit* font_unit;
+  gimp_text_layer_get_font_size(layer_ID, &font_unit);
+  GimpFont* font = gimp_text_layer_get_font(layer_ID);
+  gint ink_top, ink_bottom;
+  gboolean has_ink = measure_text_ink(thread_pango_context(), gimp_resource_get_name(GIMP_RESOURCE(font)),
+                                      gimp_units_to_pixels(1.0, font_unit, 72.0),
+                                      gimp_drawable_get_width(GIMP_DRAWABLE(layer_ID)), text, &ink_top, &ink_bottom);
+  return !has_ink || ink_bottom <= gimp_drawable_get_height(GIMP_DRAWABLE(layer_ID));
+}
+
+// Non text layers by name, which text keywords place as icons
+static void collect_icon_layers(GimpItem** items, GHashTable* icons) {
+  for (gint i = 0; items && items[i]; ++i) {
+    if (gimp_item_is_group(items[i])) {
+      GimpItem** children = gimp_item_get_children(items[i]);
+      collect_icon_layers(children, icons);
+      g_free(children);
+    }
+    gchar* layer_name = gimp_item_get_name(items[i]);
+    if (GIMP_IS_TEXT_LAYER(items[i])) {
+      g_free(layer_name);
+    } else {
+      g_hash_table_insert(icons, layer_name, items[i]);
+    }
+  }
+}
+
+// Icons of one XCF of template, texts of every XCF are compiled against its
+// own icons
+static void add_icon_layers(GimpImage* image_ID, GHashTable* icons) {
+  GimpLayer** layers = gimp_image_get_layers(image_ID);
+  collect_icon_layers((GimpItem**)layers, icons);
+  g_free(layers);
+}
+
+// Checks compiled text layers of every data row against template image
+// rendering given config layers
+static guint dry_run_check_texts(GimpImage* image_ID, guint face, gchar* name, ComponentTemplate* ct, GHashTable* layers) {
+  guint problems = 0;
+  for (guint i = 0; i < ct->data->len; ++i) {
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(ct->data, i);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, component_data->layers);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      LayerData* layer_data = (LayerData*)value;
+      CompiledText* compiled = layer_data_compiled(layer_data, face);
+      if (layer_data->config->type != LAYER_TYPE_TEXT || !compiled) continue;
+      if (!g_hash_table_contains(layers, key)) continue;
+      GimpLayer* layer_ID = gimp_image_get_layer_by_name(image_ID, key);
+      if (!text_fits_at_min_size(GIMP_TEXT_LAYER(layer_ID), compiled->text)) {
+        printf("%s row %u: text of layer %s does not fit even at smallest font size\n", name, i, (gchar*)key);
+        ++problems;
+      }
+    }
+  }
+  return problems;
+}
+
+// Reports all problems which would stop generation of template without
+// duplicating or exporting any image. Returns number of problems found.
+static guint dry_run_xcf(AssetPack* asset_pack, gchar* xcfs_dir, gchar* assets_dir, gchar* name, ComponentTemplate* ct) {
+  guint problems = dry_run_check_data(asset_pack, assets_dir, name, ct);
+  guint layer_problems = 0;
+  GPtrArray* images = g_ptr_array_new();
+  GPtrArray* xcf_layers = g_ptr_array_new_with_free_func((GDestroyNotify)&g_hash_table_unref);
+  for (guint x = 0; x < ct->xcfs->len; ++x) {
+    gchar* xcf_path = new_template_xcf_path(xcfs_dir, (TemplateXcf*)g_ptr_array_index(ct->xcfs, x));
+    GFile* xcf_gfile = g_file_new_for_path(xcf_path);
+    GimpImage* image_ID = gimp_file_load(GIMP_RUN_NONINTERACTIVE, xcf_gfile);
+    g_object_unref(xcf_gfile);
+    if (image_ID == NULL) {
+      printf("Input file %s not found\n", xcf_path);
+      g_free(xcf_path);
+      ++layer_problems;
+      continue;
+    }
+    g_free(xcf_path);
+    GHashTable* layers = new_template_xcf_layers(ct, &image_has_layer, image_ID);
+    layer_problems += check_config_layers(image_ID, layers);
+    g_ptr_array_add(images, image_ID);
+    g_ptr_array_add(xcf_layers, layers);
+  }
+  if (layer_problems == 0) {
+    layer_problems = check_template_layers_covered(name, ct, xcf_layers);
+  }
+  problems += layer_problems;
+  if (layer_problems == 0) {
+    for (guint x = 0; x < images->len; ++x) {
+      GHashTable* icon_layers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+      add_icon_layers(g_ptr_array_index(images, x), icon_layers);
+      problems += compile_template_texts(name, ct, x, g_ptr_array_index(xcf_layers, x), icon_layers);
+      g_hash_table_destroy(icon_layers);
+      problems += dry_run_check_texts(g_ptr_array_index(images, x), x, name, ct, g_ptr_array_index(xcf_layers, x));
+    }
+  }
+  for (guint x = 0; x < images->len; ++x) {
+    gimp_image_delete(g_ptr_array_index(images, x));
+  }
+  g_ptr_array_free(xcf_layers, TRUE);
+  g_ptr_array_free(images, TRUE);
+  return problems;
+}
+
+static GHashTable* collect_image_layer_sizes(GimpImage* image_ID, GHashTable* layers) {
+  GHashTable* layer_sizes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)&del_layer_size);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, layers);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    if (((LayerConfig*)value)->type != LAYER_TYPE_IMAGE) continue;
+    GimpLayer* layer_ID = gimp_image_get_layer_by_name(image_ID, key);
+    if (layer_ID == NULL) continue;
+    LayerSize* size = new_layer_size(gimp_drawable_get_width(GIMP_DRAWABLE(layer_ID)), gimp_drawable_get_height(GIMP_DRAWABLE(layer_ID)));
+    g_hash_table_insert(layer_sizes, g_strdup(key), size);
+  }
+  return layer_sizes;
+}
+
+// Template loaded by job server, kept open between jobs until file changes
+// or it is the least recently used one of too many
+typedef struct {
+  GimpImage* image_ID;
+  gint64 mtime_ns;
+  gint64 size;
+  gint64 used;
+} WarmTemplate;
+
+WarmTemplate* new_warm_template(GimpImage* image_ID, gint64 mtime_ns, gint64 size) {
+  WarmTemplate* wt = malloc(sizeof(WarmTemplate));
+  wt->image_ID = image_ID;
+  wt->mtime_ns = mtime_ns;
+  wt->size = size;
+  wt->used = g_get_monotonic_time();
+  return wt;
+}
+
+void del_warm_template(WarmTemplate* wt) {
+  if (!wt) return;
+  gimp_image_delete(wt->image_ID);
+  free(wt);
+}
+
+static GHashTable* new_warm_templates(void) {
+  return g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)&del_warm_template);
+}
+
+// Closes least recently used warm templates until there is room for one more
+static void evict_warm_templates(GHashTable* warm_templates) {
+  while (g_hash_table_size(warm_templates) >= MAX_WARM_TEMPLATES) {
+    GHashTableIter iter;
+    gpointer key, value;
+    gpointer oldest = NULL;
+    gint64 oldest_used = G_MAXINT64;
+    g_hash_table_iter_init(&iter, warm_templates);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      if (((WarmTemplate*)value)->used < oldest_used) {
+        oldest = key;
+        oldest_used = ((WarmTemplate*)value)->used;
+      }
+    }
+    g_hash_table_remove(warm_templates, oldest);
+  }
+}
+
+// Duplicates warm template or loads it when file changed since last job.
+// Changed or removed template is closed before loading, so it is never kept
+// twice.
+static GimpImage* load_warm_template(GHashTable* warm_templates, const gchar* xcf_path) {
+  GStatBuf st;
+  if (g_stat(xcf_path, &st) != 0) {
+    g_hash_table_remove(warm_templates, xcf_path);
+    return NULL;
+  }
+  gint64 mtime_ns = stat_mtime_ns(&st);
+  WarmTemplate* wt = (WarmTemplate*)g_hash_table_lookup(warm_templates, xcf_path);
+  if (!wt || wt->mtime_ns != mtime_ns || wt->size != (gint64)st.st_size) {
+    g_hash_table_remove(warm_templates, xcf_path);
+    GFile* xcf_gfile = g_file_new_for_path(xcf_path);
+    GimpImage* image_ID = gimp_file_load(GIMP_RUN_NONINTERACTIVE, xcf_gfile);
+    g_object_unref(xcf_gfile);
+    if (image_ID == NULL) return NULL;
+    evict_warm_templates(warm_templates);
+    wt = new_warm_template(image_ID, mtime_ns, st.st_size);
+    g_hash_table_insert(warm_templates, g_strdup(xcf_path), wt);
+  }
+  wt->used = g_get_monotonic_time();
+  return gimp_image_duplicate(wt->image_ID);
+}
+
+// Same order as PRECISION_NAMES, perceptual and linear
+static const GimpPrecision TEMPLATE_PRECISIONS[][2] = {
+  {GIMP_PRECISION_U8_NON_LINEAR, GIMP_PRECISION_U8_LINEAR},
+  {GIMP_PRECISION_U16_NON_LINEAR, GIMP_PRECISION_U16_LINEAR},
+  {GIMP_PRECISION_U32_NON_LINEAR, GIMP_PRECISION_U32_LINEAR},
+  {GIMP_PRECISION_HALF_NON_LINEAR, GIMP_PRECISION_HALF_LINEAR},
+  {GIMP_PRECISION_FLOAT_NON_LINEAR, GIMP_PRECISION_FLOAT_LINEAR},
+  {GIMP_PRECISION_DOUBLE_NON_LINEAR, GIMP_PRECISION_DOUBLE_LINEAR}
+};
+
+static gint64 items_pixel_bytes(GimpItem** items) {
+  gint64 bytes = 0;
+  for (gint i = 0; items && items[i]; ++i) {
+    GimpDrawable* drawable_ID = GIMP_DRAWABLE(items[i]);
+    bytes += (gint64)gimp_drawable_get_width(drawable_ID) * gimp_drawable_get_height(drawable_ID) * gimp_drawable_get_bpp(drawable_ID);
+    if (gimp_item_is_group(items[i])) {
+      GimpItem** children = gimp_item_get_children(items[i]);
+      bytes += items_pixel_bytes(children);
+      g_free(children);
+    }
+  }
+  return bytes;
+}
+
+// Bytes of pixels of all layers, copied by every image duplicate
+static gint64 image_pixel_bytes(GimpImage* image_ID) {
+  GimpLayer** layers = gimp_image_get_layers(image_ID);
+  gint64 bytes = items_pixel_bytes((GimpItem**)layers);
+  g_free(layers);
+  return bytes;
+}
+
+// Converts template to working precision before any row is rendered.
+// Returns bytes saved by every duplicate of template.
+static gint64 convert_template_precision(GimpImage* image_ID, const gchar* name) {
+  gboolean linear;
+  if (!name) return 0;
+  GimpPrecision precision = TEMPLATE_PRECISIONS[precision_index(name, &linear)][linear ? 1 : 0];
+  if (gimp_image_get_precision(image_ID) == precision) return 0;
+  gint64 bytes = image_pixel_bytes(image_ID);
+  if (!gimp_image_convert_precision(image_ID, precision)) {
+    printf("Unable to convert template to %s precision\n", name);
+    return 0;
+  }
+  return bytes - image_pixel_bytes(image_ID);
+}
+
+// Saved bytes are optional. Config layers are prepared unless layers are
+// NULL, when caller picks layers of image first.
+static GimpImage* load_template_image(const gchar* xcf_path, GHashTable* layers, GHashTable* warm_templates, const gchar* precision, gint64* saved_bytes) {
+  GimpImage* image_ID = NULL;
+  if (warm_templates) {
+    image_ID = load_warm_template(warm_templates, xcf_path);
+  } else {
+    GFile* xcf_gfile = g_file_new_for_path(xcf_path);
+    image_ID = gimp_file_load(GIMP_RUN_NONINTERACTIVE, xcf_gfile);
+    g_object_unref(xcf_gfile);
+  }
+  if (image_ID == NULL) {
+    printf("Input file %s not found\n", xcf_path);
+    return NULL;
+  }
+  gint64 saved = convert_template_precision(image_ID, precision);
+  if (saved_bytes) *saved_bytes = saved;
+  if (layers && !prepare_config_layers(image_ID, layers)) {
+    gimp_image_delete(image_ID);
+    return NULL;
+  }
+  return image_ID;
+}
+
+// Template loaded once and duplicated for every row. In low memory mode it
+// is released and every row loads template from disk instead, so only one
+// image stays in memory. Icons placed by texts are copied into separate
+// image, which stays loaded. Face is index of XCF in template, layers are
+// config layers it renders.
+typedef struct {
+  GimpImage* image_ID;
+  GimpImage* icons_ID;
+  gchar* xcf_path;
+  GHashTable* layers;
+  const gchar* precision;
+  const gchar* suffix;
+  guint face;
+} TemplateImage;
+
+TemplateImage* new_template_image(GimpImage* image_ID, gchar* xcf_path, GHashTable* layers, const gchar* precision, const gchar* suffix, guint face) {
+  TemplateImage* ti = malloc(sizeof(TemplateImage));
+  ti->image_ID = image_ID;
+  ti->icons_ID = NULL;
+  ti->xcf_path = xcf_path;
+  ti->layers = layers;
+  ti->precision = precision;
+  ti->suffix = suffix;
+  ti->face = face;
+  return ti;
+}
+
+void del_template_image(TemplateImage* ti) {
+  if (!ti) return;
+  if (ti->image_ID) gimp_image_delete(ti->image_ID);
+  if (ti->icons_ID) gimp_image_delete(ti->icons_ID);
+  g_free(ti->xcf_path);
+  g_hash_table_unref(ti->layers);
+  free(ti);
+}
+
+static void template_image_release(TemplateImage* ti) {
+  if (!ti->image_ID) return;
+  gimp_image_delete(ti->image_ID);
+  ti->image_ID = NULL;
+}
+
+// Returns image for single row to work on
+static GimpImage* template_image_instance(TemplateImage* ti) {
+  if (!ti->image_ID) return load_template_image(ti->xcf_path, ti->layers, NULL, ti->precision, NULL);
+  return gimp_image_duplicate(ti->image_ID);
+}
+
+// Copies icons placed by compiled texts of face into icon image, which stays
+// loaded in low memory mode too, and points compiled texts at the copies, so
+// rows copy icons from there without looking them up
+static void store_template_icons(TemplateImage* ti, ComponentTemplate* ct) {
+  GHashTable* copies = g_hash_table_new(g_direct_hash, g_direct_equal);
+  for (guint i = 0; i < ct->data->len; ++i) {
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(ct->data, i);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, component_data->layers);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      CompiledText* compiled = layer_data_compiled((LayerData*)value, ti->face);
+      for (guint k = 0; compiled && k < compiled->icons->len; ++k) {
+        gpointer source = g_ptr_array_index(compiled->icons, k);
+        gpointer copy = g_hash_table_lookup(copies, source);
+        if (!copy) {
+          if (!ti->icons_ID) {
+            ti->icons_ID = gimp_image_new_with_precision(gimp_image_get_width(ti->image_ID), gimp_image_get_height(ti->image_ID),
+                                                         gimp_image_get_base_type(ti->image_ID), gimp_image_get_precision(ti->image_ID));
+          }
+          GimpLayer* icon_ID = gimp_layer_new_from_drawable(GIMP_DRAWABLE(source), ti->icons_ID);
+          gimp_image_insert_layer(ti->icons_ID, icon_ID, NULL, 0);
+          copy = icon_ID;
+          g_hash_table_insert(copies, source, copy);
+        }
+        g_ptr_array_index(compiled->icons, k) = copy;
+      }
+    }
+  }
+  g_hash_table_destroy(copies);
+}
+
 static gboolean fit_text_in_bounds(GimpTextLayer* layer_ID, gint width, gint height, const gchar* text) {
   // Set text
   if (!gimp_text_layer_set_text(layer_ID, text)) {
@@ -511,39 +4074,40 @@ static gboolean fit_text_in_bounds(GimpTextLayer* layer_ID, gint width, gint hei
   return TRUE;
 }
 
-static GPtrArray* find_image_keywords(const gchar* text, GimpImage* image_ID) {
-  GPtrArray* keywords = g_ptr_array_new_with_free_func(g_free);
-  const gchar* current = text;
-  gint position = 0;
-  while (*current) {
-    if (*current == '<' && *(current + 1) == '<') {
-      const gchar* start = current + 2;
-      const gchar* end = strstr(start, ">>");
-      if (end && end > start) {
-        gchar* layer_name = g_strndup(start, end - start);
-        GimpLayer* found_layer = gimp_image_get_layer_by_name(image_ID, layer_name);
-        if (found_layer != NULL && !GIMP_IS_TEXT_LAYER(found_layer)) {
-          ImageKeyword* keyword = new_image_keyword(layer_name, position);
-          g_ptr_array_add(keywords, keyword);
-        } else {
-          g_free(layer_name);
-        }
-        current = end + 2;
-        position = (end + 2) - text;
-      } else {
-        current++;
-        position++;
-      }
-    } else {
-      current++;
-      position++;
-    }
+// Scales keyword icon proportionally to font size and centers it at position
+static void place_keyword_layer(GimpLayer* icon_ID, gdouble font_size, gint center_x, gint center_y) {
+  // Resize image to match font size (make it proportional to font size)
+  gint image_size = (gint)(font_size * 0.9); // 90% of font size for better fit
+  gint original_width = gimp_drawable_get_width(GIMP_DRAWABLE(icon_ID));
+  gint original_height = gimp_drawable_get_height(GIMP_DRAWABLE(icon_ID));
+
+  // Maintain aspect ratio
+  gdouble aspect_ratio = (gdouble)original_width / original_height;
+  gint final_width, final_height;
+
+  if (aspect_ratio > 1.0) {
+    // Wider than tall
+    final_width = image_size;
+    final_height = (gint)(image_size / aspect_ratio);
+  } else {
+    // Taller than wide or square
+    final_height = image_size;
+    final_width = (gint)(image_size * aspect_ratio);
   }
-  return keywords;
+
+  gimp_layer_scale(icon_ID, final_width, final_height, FALSE);
+
+  // Set final position (center the image at calculated position)
+  gint final_x = center_x - final_width / 2;
+  gint final_y = center_y - final_height / 2;
+
+  // Position calculated successfully
+
+  gimp_layer_set_offsets(icon_ID, final_x, final_y);
 }
 
-static gboolean fit_text_in_layer(GimpTextLayer* layer_ID, const gchar* text, int vcenter) {
-  if (strlen(text) == 0) {
+static gboolean fit_text_in_layer(GimpTextLayer* layer_ID, const CompiledText* compiled, int vcenter, const TextFit* fit) {
+  if (!compiled || strlen(compiled->text) == 0) {
     return TRUE;
   }
 
@@ -552,41 +4116,19 @@ static gboolean fit_text_in_layer(GimpTextLayer* layer_ID, const gchar* text, in
   gint text_width = gimp_drawable_get_width(GIMP_DRAWABLE(layer_ID));
   gint text_height = gimp_drawable_get_height(GIMP_DRAWABLE(layer_ID));
 
-  // Find and process image keywords
-  GPtrArray* keywords = find_image_keywords(text, original_image_ID);
-  gchar* processed_text = replace_keywords_with_spaces(text, keywords);
+  // Image keywords were resolved and their icons stored when template was
+  // loaded
+  GPtrArray* keywords = image_keywords_from_compiled(compiled);
+  const gchar* processed_text = compiled->text;
   
-  // Create duplicates of image layers for each keyword
+  // Copy icon of every keyword into row image
   for (guint i = 0; i < keywords->len; i++) {
     ImageKeyword* keyword = g_ptr_array_index(keywords, i);
-    GimpLayer* source_layer = gimp_image_get_layer_by_name(original_image_ID, keyword->layer_name);
-    if (source_layer != NULL) {
-      keyword->duplicate_layer_id = gimp_layer_copy(source_layer);
-      gimp_image_insert_layer(original_image_ID, keyword->duplicate_layer_id, 
-                             GIMP_LAYER(gimp_item_get_parent(GIMP_ITEM(layer_ID))), 0);
-      gimp_item_set_visible(GIMP_ITEM(keyword->duplicate_layer_id), TRUE);
-    } else {
-      // Try to load asset image file if no layer is found
-      gchar* asset_file = g_build_filename("assets", keyword->layer_name, NULL);
-      GFile* asset_gfile = g_file_new_for_path(asset_file);
-      GimpLayer* asset_layer = gimp_file_load_layer(GIMP_RUN_NONINTERACTIVE, original_image_ID, asset_gfile);
-      if (asset_layer == NULL) {
-        g_object_unref(asset_gfile);
-        g_free(asset_file);
-        asset_file = g_build_filename("out", keyword->layer_name, NULL);
-        asset_gfile = g_file_new_for_path(asset_file);
-        asset_layer = gimp_file_load_layer(GIMP_RUN_NONINTERACTIVE, original_image_ID, asset_gfile);
-      }
-      g_object_unref(asset_gfile);
-      g_free(asset_file);
-      if (asset_layer != NULL) {
-        keyword->duplicate_layer_id = asset_layer;
-        gimp_image_insert_layer(original_image_ID, asset_layer, GIMP_LAYER(gimp_item_get_parent(GIMP_ITEM(layer_ID))), 0);
-        gimp_item_set_visible(GIMP_ITEM(asset_layer), TRUE);
-      } else {
-        keyword->duplicate_layer_id = NULL;
-      }
-    }
+    GimpLayer* icon_ID = GIMP_LAYER(g_ptr_array_index(compiled->icons, i));
+    keyword->duplicate_layer_id = gimp_layer_new_from_drawable(GIMP_DRAWABLE(icon_ID), original_image_ID);
+    gimp_image_insert_layer(original_image_ID, keyword->duplicate_layer_id,
+                            GIMP_LAYER(gimp_item_get_parent(GIMP_ITEM(layer_ID))), 0);
+    gimp_item_set_visible(GIMP_ITEM(keyword->duplicate_layer_id), TRUE);
   }
   
   GimpUnit* font_unit;
@@ -594,68 +4136,74 @@ static gboolean fit_text_in_layer(GimpTextLayer* layer_ID, const gchar* text, in
   GimpFont* font = gimp_text_layer_get_font(layer_ID);
   GeglColor* text_color = gimp_text_layer_get_color(layer_ID);
   
-  // Create new image with text layer width and twice the height
-  GimpImage* temp_image_ID = gimp_image_new(text_width, text_height * 2, GIMP_RGB);
+  gdouble current_font_size = font_size;
+  gint y1 = 0, y2 = 0;
+  if (fit) {
+    // Fitted ahead of rendering by text prepass
+    current_font_size = fit->font_size;
+    y1 = fit->ink_top;
+    y2 = fit->ink_bottom;
+  } else {
+    // Create new image with text layer width and twice the height
+    GimpImage* temp_image_ID = gimp_image_new(text_width, text_height * 2, GIMP_RGB);
   
-  // Create text layer that takes whole image size
-  GimpTextLayer* temp_text_layer_ID = gimp_text_layer_new(temp_image_ID, processed_text, font, font_size, font_unit);
-  if (temp_text_layer_ID == NULL) {
-    printf("Failed to create temporary text layer\n");
-    gimp_image_delete(temp_image_ID);
-    g_free(processed_text);
-    g_ptr_array_free(keywords, TRUE);
-    return FALSE;
-  }
+    // Create text layer that takes whole image size
+    GimpTextLayer* temp_text_layer_ID = gimp_text_layer_new(temp_image_ID, processed_text, font, font_size, font_unit);
+    if (temp_text_layer_ID == NULL) {
+      printf("Failed to create temporary text layer\n");
+      gimp_image_delete(temp_image_ID);
+      g_object_unref(text_color);
+      g_ptr_array_free(keywords, TRUE);
+      return FALSE;
+    }
   
-  gimp_image_insert_layer(temp_image_ID, GIMP_LAYER(temp_text_layer_ID), NULL, 0);
-  gimp_text_layer_set_color(temp_text_layer_ID, text_color);
+    gimp_image_insert_layer(temp_image_ID, GIMP_LAYER(temp_text_layer_ID), NULL, 0);
+    gimp_text_layer_set_color(temp_text_layer_ID, text_color);
   
-  // Resize text layer to fill the whole image
-  gimp_text_layer_resize(temp_text_layer_ID, text_width, text_height * 2);
+    // Resize text layer to fill the whole image
+    gimp_text_layer_resize(temp_text_layer_ID, text_width, text_height * 2);
   
-  gdouble current_font_size = font_size;
-  gboolean text_fits = FALSE;
+    gboolean text_fits = FALSE;
 
-  gint y1, y2;
-
-  // Check if visible text exceeds half image size and adjust font size
-  while (!text_fits && current_font_size >= 1.0) {
-    // Set current font size
-    gimp_text_layer_set_font_size(temp_text_layer_ID, current_font_size, font_unit);
-    gimp_text_layer_set_text(temp_text_layer_ID, processed_text);
+    // Check if visible text exceeds half image size and adjust font size
+    while (!text_fits && current_font_size >= 1.0) {
+      // Set current font size
+      gimp_text_layer_set_font_size(temp_text_layer_ID, current_font_size, font_unit);
+      gimp_text_layer_set_text(temp_text_layer_ID, processed_text);
     
-    // Create alpha selection to find text bounds
-    gimp_image_select_item(temp_image_ID, GIMP_CHANNEL_OP_REPLACE, GIMP_ITEM(temp_text_layer_ID));
+      // Create alpha selection to find text bounds
+      gimp_image_select_item(temp_image_ID, GIMP_CHANNEL_OP_REPLACE, GIMP_ITEM(temp_text_layer_ID));
     
-    // Check if selection exists (text is visible)
-    gint x1, x2;
-    gboolean has_selection;
-    gimp_selection_bounds(temp_image_ID, &has_selection, &x1, &y1, &x2, &y2);
-
-    if (!has_selection) {
-      // No visible text, font size might be too small or text is empty
-      text_fits = TRUE;
-    } else {
-      // Check if the lowest point of selection (y2) exceeds half image height
-      gint half_height = text_height; // Since image height is 2 * text_height, half is text_height
-      if (y2 <= half_height) {
+      // Check if selection exists (text is visible)
+      gint x1, x2;
+      gboolean has_selection;
+      gimp_selection_bounds(temp_image_ID, &has_selection, &x1, &y1, &x2, &y2);
+
+      if (!has_selection) {
+        // No visible text, font size might be too small or text is empty
         text_fits = TRUE;
       } else {
-        // Text exceeds half height, reduce font size
-        current_font_size -= 1.0;
+        // Check if the lowest point of selection (y2) exceeds half image height
+        gint half_height = text_height; // Since image height is 2 * text_height, half is text_height
+        if (y2 <= half_height) {
+          text_fits = TRUE;
+        } else {
+          // Text exceeds half height, reduce font size
+          current_font_size -= 1.0;
+        }
       }
-    }
     
-    // Clear selection
-    gimp_selection_none(temp_image_ID);
-  }
+      // Clear selection
+      gimp_selection_none(temp_image_ID);
+    }
 
-  // Remove temporary image
-  gimp_image_delete(temp_image_ID);
+    // Remove temporary image
+    gimp_image_delete(temp_image_ID);
+  }
   
   if (current_font_size < 1.0) {
     printf("Could not fit text within bounds: %s\n", processed_text);
-    g_free(processed_text);
+    g_object_unref(text_color);
     g_ptr_array_free(keywords, TRUE);
     return FALSE;
   }
@@ -673,7 +4221,17 @@ static gboolean fit_text_in_layer(GimpTextLayer* layer_ID, const gchar* text, in
   }
   
   // Position image layers at the locations of the spaces
-  if (keywords->len > 0) {
+  if (keywords->len > 0 && fit) {
+    gint text_x, text_y;
+    gimp_drawable_get_offsets(GIMP_DRAWABLE(layer_ID), &text_x, &text_y);
+    for (guint i = 0; i < keywords->len && 2 * i + 1 < fit->anchors->len; i++) {
+      ImageKeyword* keyword = g_ptr_array_index(keywords, i);
+      if (keyword->duplicate_layer_id == NULL) continue;
+      place_keyword_layer(keyword->duplicate_layer_id, current_font_size,
+                          text_x + g_array_index(fit->anchors, gint, 2 * i),
+                          text_y + g_array_index(fit->anchors, gint, 2 * i + 1));
+    }
+  } else if (keywords->len > 0) {
     // Get font name again (the previous one was freed)
     GimpFont* current_font = gimp_text_layer_get_font(layer_ID);
     
@@ -714,6 +4272,8 @@ static gboolean fit_text_in_layer(GimpTextLayer* layer_ID, const gchar* text, in
         GimpFont* font = gimp_text_layer_get_font(layer_ID);
         if (!font) {
             printf("Failed to get font for positioning\n");
+            gimp_image_remove_layer(original_image_ID, GIMP_LAYER(measure_layer));
+            g_free(text_up_to_keyword);
             continue;
         }
         
@@ -774,34 +4334,7 @@ static gboolean fit_text_in_layer(GimpTextLayer* layer_ID, const gchar* text, in
         cairo_destroy(cr);
         cairo_surface_destroy(surface);
         
-        // Resize image to match font size (make it proportional to font size)
-        gint image_size = (gint)(current_font_size * 0.9); // 90% of font size for better fit
-        gint original_width = gimp_drawable_get_width(GIMP_DRAWABLE(keyword->duplicate_layer_id));
-        gint original_height = gimp_drawable_get_height(GIMP_DRAWABLE(keyword->duplicate_layer_id));
-        
-        // Maintain aspect ratio
-        gdouble aspect_ratio = (gdouble)original_width / original_height;
-        gint final_width, final_height;
-        
-        if (aspect_ratio > 1.0) {
-          // Wider than tall
-          final_width = image_size;
-          final_height = (gint)(image_size / aspect_ratio);
-        } else {
-          // Taller than wide or square
-          final_height = image_size;
-          final_width = (gint)(image_size * aspect_ratio);
-        }
-        
-        gimp_layer_scale(keyword->duplicate_layer_id, final_width, final_height, FALSE);
-        
-        // Set final position (center the image at calculated position)
-        gint final_x = final_image_x - final_width / 2;
-        gint final_y = final_image_y - final_height / 2;
-        
-        // Position calculated successfully
-        
-        gimp_layer_set_offsets(keyword->duplicate_layer_id, final_x, final_y);
+        place_keyword_layer(keyword->duplicate_layer_id, current_font_size, final_image_x, final_image_y);
         
         // Clean up
         gimp_image_remove_layer(original_image_ID, GIMP_LAYER(measure_layer));
@@ -814,26 +4347,102 @@ static gboolean fit_text_in_layer(GimpTextLayer* layer_ID, const gchar* text, in
   }
   
   // Clean up
-  g_free(processed_text);
+  g_object_unref(text_color);
   g_ptr_array_free(keywords, TRUE);
 
   return TRUE;
 }
 
-static gboolean generate_component(int i, GimpImage* image_ID, GHashTable* component_layers, gchar* assets_dir, gchar* out_dir, gchar* out_key) {
+static GHashTable* collect_text_layer_styles(GimpImage* image_ID, GHashTable* layers) {
+  GHashTable* styles = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)&del_text_layer_style);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, layers);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    if (((LayerConfig*)value)->type != LAYER_TYPE_TEXT) continue;
+    GimpLayer* layer_ID = gimp_image_get_layer_by_name(image_ID, key);
+    if (layer_ID == NULL || !GIMP_IS_TEXT_LAYER(layer_ID)) continue;
+    GimpTextLayer* text_layer_ID = GIMP_TEXT_LAYER(layer_ID);
+    GimpUnit* font_unit;
+    gdouble font_size = gimp_text_layer_get_font_size(text_layer_ID, &font_unit);
+    GimpFont* font = gimp_text_layer_get_font(text_layer_ID);
+    TextLayerStyle* style = new_text_layer_style(g_strdup(gimp_resource_get_name(GIMP_RESOURCE(font))), font_size,
+                                                 gimp_units_to_pixels(1.0, font_unit, 72.0),
+                                                 gimp_text_layer_get_line_spacing(text_layer_ID),
+                                                 gimp_drawable_get_width(GIMP_DRAWABLE(layer_ID)),
+                                                 gimp_drawable_get_height(GIMP_DRAWABLE(layer_ID)));
+    g_hash_table_insert(styles, g_strdup(key), style);
+  }
+  return styles;
+}
+
+// Fits all texts of template rows in all its XCFs on all cores before rendering
+static TextPrepass* run_text_prepass(GPtrArray* template_images, ComponentTemplate* ct, GeneratorContext* ctx) {
+  GPtrArray* styles = g_ptr_array_new_with_free_func((GDestroyNotify)&g_hash_table_destroy);
+  for (guint face = 0; face < template_images->len; ++face) {
+    TemplateImage* template_image = (TemplateImage*)g_ptr_array_index(template_images, face);
+    g_ptr_array_add(styles, collect_text_layer_styles(template_image->image_ID, template_image->layers));
+  }
+  TextPrepass* tp = new_text_prepass(styles);
+  for (guint i = 0; i < ct->data->len; ++i) {
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(ct->data, i);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, component_data->layers);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      LayerData* layer_data = (LayerData*)value;
+      if (layer_data->config->type != LAYER_TYPE_TEXT || !layer_data->value || !*layer_data->value) continue;
+      for (guint face = 0; face < template_images->len; ++face) {
+        CompiledText* compiled = layer_data_compiled(layer_data, face);
+        if (!compiled || !text_prepass_needs(tp, face, key, layer_data->value)) continue;
+        GArray* positions = g_array_sized_new(FALSE, FALSE, sizeof(gsize), compiled->positions->len);
+        g_array_append_vals(positions, compiled->positions->data, compiled->positions->len);
+        text_prepass_add(tp, face, key, layer_data->value, g_strdup(compiled->text), positions);
+      }
+    }
+  }
+  text_prepass_run(tp, ctx->options->prefetch_threads);
+  printf("Fitted %u texts ahead of rendering\n", g_hash_table_size(tp->fits));
+  return tp;
+}
+
+static gboolean generate_component(TemplateImage* template_image, GHashTable* component_layers, const gchar* out_file, gchar* assets_dir, AssetPrefetcher* prefetcher, OutputDigests* digests, GPtrArray* variants, GeneratorContext* ctx) {
   GHashTableIter iter;
   gpointer key, value;
-  GimpImage* new_image_ID = gimp_image_duplicate(image_ID);
+  GimpImage* new_image_ID = template_image_instance(template_image);
+  if (new_image_ID == NULL) {
+    set_row_failure(ctx, NULL, "unable to create component image");
+    return FALSE;
+  }
   g_hash_table_iter_init(&iter, component_layers);
   while (g_hash_table_iter_next(&iter, &key, &value)) {
+    // Layer of other XCF of template
+    if (!g_hash_table_contains(template_image->layers, key)) continue;
     gchar* layer_name = (gchar*)key;
     LayerData* layer_data = (LayerData*)value;
     GimpLayer* layer_ID = gimp_image_get_layer_by_name(new_image_ID, key);
-    printf("Processing layer %s of type %s\n", layer_name, str_from_layer_type(layer_data->config->type));
+    GimpLayer* placeholder_ID = layer_ID;
+    gboolean transformed = FALSE;
+    debug_printf("Processing layer %s of type %s\n", layer_name, str_from_layer_type(layer_data->config->type));
+    RenderedLayer* rendered = layer_cache_lookup(ctx->layer_cache, template_image->face, layer_name, layer_data);
+    if (rendered) {
+      if (layer_data->config->type == LAYER_TYPE_IMAGE) {
+        gchar* asset_file = g_build_filename(assets_dir, layer_data->value, NULL);
+        asset_prefetcher_release(prefetcher, asset_file, gimp_drawable_get_width(GIMP_DRAWABLE(layer_ID)), gimp_drawable_get_height(GIMP_DRAWABLE(layer_ID)), layer_data->config->rotate);
+        g_free(asset_file);
+      }
+      if (insert_rendered_layer(new_image_ID, layer_ID, layer_name, rendered) == NULL) {
+        set_row_failure(ctx, layer_name, "unable to insert cached layer");
+        gimp_image_delete(new_image_ID);
+        return FALSE;
+      }
+      continue;
+    }
     switch (layer_data->config->type) {
       case LAYER_TYPE_IMAGE:
-        layer_ID = insert_image_layer(new_image_ID, layer_ID, layer_data, assets_dir);
+        layer_ID = insert_image_layer(new_image_ID, layer_ID, layer_data, assets_dir, prefetcher, &transformed);
         if (layer_ID == NULL) {
+          set_row_failure(ctx, layer_name, "unable to load asset %s", layer_data->value);
           gimp_image_delete(new_image_ID);
           return FALSE;
         }
@@ -841,8 +4450,10 @@ static gboolean generate_component(int i, GimpImage* image_ID, GHashTable* compo
         break;
       case LAYER_TYPE_TEXT:
         gimp_item_set_visible(GIMP_ITEM(layer_ID), TRUE);
-        if (!fit_text_in_layer(GIMP_TEXT_LAYER(layer_ID), layer_data->value, layer_data->config->vcenter)) {
+        if (!fit_text_in_layer(GIMP_TEXT_LAYER(layer_ID), layer_data_compiled(layer_data, template_image->face), layer_data->config->vcenter,
+                               text_prepass_lookup(ctx->text_prepass, template_image->face, layer_name, layer_data->value))) {
             printf("Couldn't fit text in layer: %s\n", layer_data->value);
+            set_row_failure(ctx, layer_name, "text does not fit: %s", layer_data->value);
             gimp_image_delete(new_image_ID);
             return FALSE;
         }
@@ -853,89 +4464,260 @@ static gboolean generate_component(int i, GimpImage* image_ID, GHashTable* compo
       default:
         gimp_image_delete(new_image_ID);
         printf("Invalid layer type. Something went wrong\n");
+        set_row_failure(ctx, layer_name, "invalid layer type");
         return FALSE;
     }
 
-    if (layer_data->config->rotate != 0.0) {
+    if (layer_data->config->rotate != 0.0 && !transformed) {
       gdouble angle_rad = layer_data->config->rotate * G_PI / 180.0;
       gimp_item_transform_rotate(GIMP_ITEM(layer_ID), angle_rad, TRUE, 0.0, 0.0);
     }
-  }
 
-  gchar* filename = NULL;
-  if (out_key) {
-    LayerData* out_layer = (LayerData*)g_hash_table_lookup(component_layers, out_key);
-    if (out_layer && out_layer->value) {
-        filename = g_strdup_printf("%s.%s", out_layer->value, OUT_EXTENSION);
+    if (layer_data->config->type == LAYER_TYPE_IMAGE && !transformed && ctx->asset_cache) {
+      store_derived_asset(ctx->asset_cache, layer_ID, placeholder_ID, layer_data, assets_dir);
+    }
+
+    if (layer_cache_accepts(ctx->layer_cache, layer_data)) {
+      store_rendered_layer(ctx->layer_cache, template_image->face, layer_name, layer_data, layer_ID);
     }
   }
-  if (!filename) {
-    filename = g_strdup_printf("%d.%s", i, OUT_EXTENSION);
+
+  // Raw output and archive take final pixels, variants of archived outputs
+  // are derived from them, so template is rendered once
+  GdkPixbuf* pixbuf = ctx->raw_output || ctx->archive ? image_to_pixbuf(new_image_ID) : NULL;
+  if (ctx->raw_output) {
+    // Consumer takes pixels as they are, nothing is encoded or written
+    gboolean ret = raw_output_publish(ctx->raw_output, out_file, pixbuf, NULL);
+    if (!ret) set_row_failure(ctx, NULL, "unable to publish raw output");
+    g_object_unref(pixbuf);
+    gimp_image_delete(new_image_ID);
+    return ret;
   }
-  const size_t to_sanitize_len = strlen(filename)-strlen(OUT_EXTENSION)-1;
-  for (char* p = filename; p < filename + to_sanitize_len; ++p) {
-    if (!(g_ascii_isalnum(*p) || *p == '-' || *p == '_')) {
-      *p = '_';
-    }
+  if (ctx->archive) {
+    gboolean ret = archive_component_output(ctx->archive, pixbuf, out_file, variants);
+    if (!ret) set_row_failure(ctx, NULL, "unable to add output to archive");
+    g_object_unref(pixbuf);
+    gimp_image_delete(new_image_ID);
+    return ret;
   }
-  gchar* out_file = g_build_filename(out_dir, filename, NULL);
-  GFile* out_gfile = g_file_new_for_path(out_file);
+  // Output is hashed as saved, so its pixels are never read back, and
+  // variants decode it only when they changed
+  gchar* tmp_file = new_temporary_out_file(out_file);
+  GFile* tmp_gfile = g_file_new_for_path(tmp_file);
   gboolean ret = gimp_file_save(
       GIMP_RUN_NONINTERACTIVE,
       new_image_ID,
-      out_gfile,
+      tmp_gfile,
       NULL);
   if (!ret) {
     printf("Failed to save image to %s\n", out_file);
+    g_unlink(tmp_file);
+  } else {
+    ret = finish_saved_output(digests, tmp_file, out_file, variants);
   }
-  g_free(filename);
-  g_object_unref(out_gfile);
-  g_free(out_file);
+  g_object_unref(tmp_gfile);
+  g_free(tmp_file);
   gimp_image_delete(new_image_ID);
   return ret;
 }
 
-static gboolean generate_components(GimpImage* image_ID, GPtrArray* components_layers, gchar* assets_dir, gchar* out_dir, gchar* out_key) {
-  int i;
-  for (i = 0; i < components_layers->len; ++i) {
-    GHashTable *component_layers = (GHashTable*)(g_ptr_array_index(components_layers, i));
-    if (!generate_component(i, image_ID, component_layers, assets_dir, out_dir, out_key)) {
-      return FALSE;
+// Renders every row into all XCFs of template back-to-back, so assets
+// prefetched for the row serve all of them
+static gboolean generate_components(GPtrArray* template_images, GPtrArray* components_data, GPtrArray* layer_sizes, gchar* assets_dir, gchar* out_dir, gchar* out_key, GPtrArray* variants, GeneratorContext* ctx) {
+  gboolean ret = TRUE;
+  GArray* rows = unique_component_rows(components_data, ctx->job);
+  GPtrArray* rows_layers = g_ptr_array_sized_new(rows->len);
+  for (guint j = 0; j < rows->len; ++j) {
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(components_data, g_array_index(rows, guint, j));
+    g_ptr_array_add(rows_layers, component_data->layers);
+  }
+
+  // Rendered files of every XCF by row hash
+  GPtrArray* rendered_files = g_ptr_array_new_with_free_func((GDestroyNotify)&g_hash_table_destroy);
+  for (guint face = 0; face < template_images->len; ++face) {
+    g_ptr_array_add(rendered_files, g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free));
+  }
+  // Digests only skip rewriting output files
+  OutputDigests* digests = ctx->archive || ctx->raw_output ? NULL : new_output_digests(out_dir);
+  AssetPrefetcher* prefetcher = new_asset_prefetcher(ctx, rows_layers, layer_sizes, assets_dir);
+  for (guint j = 0; j < rows->len; ++j) {
+    guint i = g_array_index(rows, guint, j);
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(components_data, i);
+    if (memory_monitor_sample(ctx->memory)) {
+      asset_prefetcher_flush(prefetcher);
+      g_ptr_array_foreach(template_images, (GFunc)&template_image_release, NULL);
+      layer_cache_clear(ctx->layer_cache);
     }
+    asset_prefetcher_advance(prefetcher, j);
+    event_log_row_start(ctx->events);
+    const gchar* first_out_file = NULL;
+    gboolean row_ok = TRUE;
+    for (guint face = 0; face < template_images->len; ++face) {
+      TemplateImage* template_image = (TemplateImage*)g_ptr_array_index(template_images, face);
+      gchar* out_file = new_component_out_file(i, component_data->layers, out_dir, out_key, template_image->suffix, 1);
+      clear_row_failure(ctx);
+      if (!generate_component(template_image, component_data->layers, out_file, assets_dir, prefetcher, digests, variants, ctx)) {
+        report_row_failure(ctx, i, out_file);
+        g_free(out_file);
+        row_ok = FALSE;
+        break;
+      }
+      g_hash_table_insert((GHashTable*)g_ptr_array_index(rendered_files, face), component_data->hash, out_file);
+      if (!first_out_file) first_out_file = out_file;
+    }
+    if (!row_ok && (!ctx->failures || output_broken(ctx))) {
+      ret = FALSE;
+      break;
+    }
+    if (!row_ok) {
+      // Keep going with following rows. Failed row gets no copies, not even
+      // of XCFs rendered before the failure.
+      for (guint face = 0; face < rendered_files->len; ++face) {
+        g_hash_table_remove((GHashTable*)g_ptr_array_index(rendered_files, face), component_data->hash);
+      }
+      asset_prefetcher_skip_row(prefetcher, j);
+      continue;
+    }
+    event_log_row_done(ctx->events, i, first_out_file);
+    allocation_tracker_row(ctx->allocations);
+    job_report(ctx->job, "progress", "row %u, %u of %u rendered", i, j + 1, rows->len);
   }
-  return TRUE;
+  del_asset_prefetcher(prefetcher);
+  // Failed rows are reported already, what follows fails whole template
+  clear_row_failure(ctx);
+
+  for (guint face = 0; ret && face < template_images->len; ++face) {
+    TemplateImage* template_image = (TemplateImage*)g_ptr_array_index(template_images, face);
+    GHashTable* face_files = (GHashTable*)g_ptr_array_index(rendered_files, face);
+    if (ctx->raw_output) {
+      ret = raw_output_aliases(ctx->raw_output, ctx->job, components_data, face_files, out_dir, out_key, template_image->suffix);
+      if (!ret) set_row_failure(ctx, NULL, "unable to publish raw output aliases");
+    } else if (ctx->archive) {
+      archive_index_outputs(ctx->archive, ctx->job, components_data, face_files, out_dir, out_key, template_image->suffix, variants);
+    } else {
+      ret = link_component_outputs(digests, ctx->job, components_data, face_files, out_dir, out_key, template_image->suffix, variants);
+      if (!ret) set_row_failure(ctx, NULL, "unable to link outputs of duplicated rows");
+    }
+  }
+  if (ret) {
+    printf("Rendered %u of %u components\n", rows->len, components_data->len);
+  }
+  // Keep digests of outputs written before failure too
+  if (!save_output_digests(digests)) {
+    set_row_failure(ctx, NULL, "unable to save output digests");
+    ret = FALSE;
+  }
+  del_output_digests(digests);
+  g_ptr_array_free(rendered_files, TRUE);
+  g_ptr_array_free(rows_layers, TRUE);
+  g_array_free(rows, TRUE);
+  return ret;
 }
 
-static gboolean generate_from_xcf(gchar* xcfs_dir, gchar* assets_dir, gchar* out_dir, gchar* name, ComponentTemplate* ct) {
-  gchar* xcf_filename = g_strconcat(name, ".xcf", NULL);
-  gchar* xcf_path = g_build_filename(xcfs_dir, xcf_filename, NULL);
-  GFile* xcf_gfile = g_file_new_for_path(xcf_path);
-
-  GimpImage* image_ID = gimp_file_load(GIMP_RUN_NONINTERACTIVE, xcf_gfile);
-  g_object_unref(xcf_gfile);
-  g_free(xcf_filename);
-  if (image_ID == NULL) {
-    g_free(xcf_path);
-    printf("Input file %s not found\n", xcf_path);
-    return FALSE;
+// Loads all XCFs of template. Each of them renders config layers it has and
+// every config layer has to be in at least one of them.
+static GPtrArray* load_template_images(gchar* xcfs_dir, gchar* name, ComponentTemplate* ct, GeneratorContext* ctx, const gchar* precision, gint64* precision_saved) {
+  GPtrArray* template_images = g_ptr_array_new_with_free_func((GDestroyNotify)&del_template_image);
+  GPtrArray* xcf_layers = g_ptr_array_new();
+  gboolean ret = TRUE;
+  for (guint face = 0; ret && face < ct->xcfs->len; ++face) {
+    TemplateXcf* template_xcf = (TemplateXcf*)g_ptr_array_index(ct->xcfs, face);
+    gchar* xcf_path = new_template_xcf_path(xcfs_dir, template_xcf);
+    gint64 saved = 0;
+    GimpImage* image_ID = load_template_image(xcf_path, NULL, ctx->job ? ctx->job->warm_templates : NULL, precision, &saved);
+    if (image_ID == NULL) {
+      set_row_failure(ctx, NULL, "unable to load %s", xcf_path);
+      g_free(xcf_path);
+      ret = FALSE;
+      break;
+    }
+    *precision_saved += saved;
+    GHashTable* layers = new_template_xcf_layers(ct, &image_has_layer, image_ID);
+    g_ptr_array_add(template_images, new_template_image(image_ID, xcf_path, layers, precision, template_xcf->suffix, face));
+    g_ptr_array_add(xcf_layers, layers);
+    ret = prepare_config_layers(image_ID, layers);
+    if (!ret) set_row_failure(ctx, NULL, "unable to prepare config layers of %s", xcf_path);
   }
-  g_free(xcf_path);
-
-  if (!prepare_config_layers(image_ID, ct->layers)) {
-    gimp_image_delete(image_ID);
-    return FALSE;
+  guint uncovered = ret ? check_template_layers_covered(name, ct, xcf_layers) : 0;
+  if (uncovered > 0) {
+    set_row_failure(ctx, NULL, "%u configured layers are in no XCF", uncovered);
+    ret = FALSE;
+  }
+  g_ptr_array_free(xcf_layers, TRUE);
+  if (!ret) {
+    g_ptr_array_free(template_images, TRUE);
+    return NULL;
   }
+  return template_images;
+}
 
-  gchar* components_out_dir = create_components_out_dir(out_dir, name);
+static gboolean generate_from_xcf(gchar* xcfs_dir, gchar* assets_dir, gchar* out_dir, gchar* name, ComponentTemplate* ct, GeneratorContext* ctx) {
+  memory_monitor_begin(ctx->memory);
+  allocation_tracker_begin(ctx->allocations);
+  const gchar* precision = template_precision(ctx->options, name);
+  gint64 precision_saved = 0;
+  GPtrArray* template_images = load_template_images(xcfs_dir, name, ct, ctx, precision, &precision_saved);
+  if (!template_images) return FALSE;
+
+  // Archived outputs are named relative to archive, raw outputs relative to
+  // out directory
+  gchar* components_out_dir = ctx->raw_output ? g_strdup(name)
+                            : ctx->options->archive ? open_template_archive(ctx, out_dir, name)
+                            : create_components_out_dir(out_dir, name);
+  if (components_out_dir && !ctx->archive && !ctx->raw_output && !create_variant_dirs(components_out_dir, ct->variants)) {
+    g_free(components_out_dir);
+    components_out_dir = NULL;
+  }
   if (!components_out_dir) {
-    gimp_image_delete(image_ID);
+    set_row_failure(ctx, NULL, "%s", ctx->options->archive ? "unable to open output archive" : "unable to create output directories");
+    g_ptr_array_free(template_images, TRUE);
     return FALSE;
   }
 
-  gboolean ret = generate_components(image_ID, ct->data, assets_dir, components_out_dir, ct->out_key);
-
+  // Keywords resolve against icons of the XCF rendering the text, so texts
+  // are compiled for every XCF
+  GPtrArray* layer_sizes = g_ptr_array_new_with_free_func((GDestroyNotify)&g_hash_table_destroy);
+  for (guint face = 0; face < template_images->len; ++face) {
+    TemplateImage* template_image = (TemplateImage*)g_ptr_array_index(template_images, face);
+    g_ptr_array_add(layer_sizes, collect_image_layer_sizes(template_image->image_ID, template_image->layers));
+    GHashTable* icon_layers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    add_icon_layers(template_image->image_ID, icon_layers);
+    compile_template_texts(name, ct, face, template_image->layers, icon_layers);
+    g_hash_table_destroy(icon_layers);
+    store_template_icons(template_image, ct);
+  }
+  allocation_tracker_stage(ctx->allocations, "template load");
+  if (ctx->options->text_prepass) {
+    ctx->text_prepass = run_text_prepass(template_images, ct, ctx);
+    allocation_tracker_stage(ctx->allocations, "text prepass");
+  }
+  if (ctx->options->layer_cache_bytes > 0) {
+    ctx->layer_cache = new_layer_cache(ctx->options->layer_cache_bytes);
+  }
+  gboolean ret = generate_components(template_images, ct->data, layer_sizes, assets_dir, components_out_dir, ct->out_key, ct->variants, ctx);
+  allocation_tracker_stage(ctx->allocations, "rows");
+
+  del_text_prepass(ctx->text_prepass);
+  ctx->text_prepass = NULL;
+  layer_cache_report(ctx->layer_cache);
+  del_layer_cache(ctx->layer_cache);
+  ctx->layer_cache = NULL;
+  g_ptr_array_free(template_images, TRUE);
+  g_ptr_array_free(layer_sizes, TRUE);
   g_free(components_out_dir);
-  gimp_image_delete(image_ID);
+  memory_monitor_report(ctx->memory, name);
+  allocation_tracker_stage(ctx->allocations, "cleanup");
+  if (!allocation_tracker_report(ctx->allocations, name)) {
+    set_row_failure(ctx, NULL, "memory grows by more than %" G_GINT64_FORMAT " B per row", ctx->allocations->max_row_growth);
+    ret = FALSE;
+  }
+  if (!close_template_archive(ctx, ret) && ret) {
+    set_row_failure(ctx, NULL, "unable to close output archive");
+    ret = FALSE;
+  }
+  if (precision_saved > 0) {
+    printf("Working precision %s saved %.1f MiB in component images of every row of %s\n", precision, precision_saved / 1048576.0, name);
+  }
 
   return ret;
 }
@@ -960,6 +4742,13 @@ static GimpValueArray * boardgame_component_generator_run              (GimpProc
                                                       GimpProcedureConfig  *config,
                                                       gpointer              run_data);
 
+static GimpValueArray * boardgame_component_generator_run_server       (GimpProcedure        *procedure,
+                                                      GimpRunMode           run_mode,
+                                                      GimpImage            *image,
+                                                      GimpDrawable        **drawables,
+                                                      GimpProcedureConfig  *config,
+                                                      gpointer              run_data);
+
 static void
 boardgame_component_generator_class_init (BoardgameComponentGeneratorClass *klass)
 {
@@ -977,7 +4766,8 @@ boardgame_component_generator_init (BoardgameComponentGenerator *boardgame_compo
 static GList *
 boardgame_component_generator_query_procedures (GimpPlugIn *plug_in)
 {
-  return g_list_append (NULL, g_strdup (PLUG_IN_PROC));
+  GList *procedures = g_list_append (NULL, g_strdup (PLUG_IN_PROC));
+  return g_list_append (procedures, g_strdup (SERVER_PROC));
 }
 
 static GimpProcedure *
@@ -1008,103 +4798,585 @@ boardgame_component_generator_create_procedure (GimpPlugIn  *plug_in,
       gimp_procedure_add_string_argument (procedure, "project_dir", "Project directory", NULL,
                                           FALSE, G_PARAM_READWRITE);
     }
+  else if (g_strcmp0 (name, SERVER_PROC) == 0)
+    {
+      procedure = gimp_image_procedure_new (plug_in, name,
+                                            GIMP_PDB_PROC_TYPE_PLUGIN,
+                                            boardgame_component_generator_run_server, NULL, NULL);
+
+      gimp_procedure_set_sensitivity_mask (procedure, GIMP_PROCEDURE_SENSITIVE_ALWAYS);
+
+      gimp_procedure_set_documentation (procedure,
+                                        "Boardgame component generator job server",
+                                        "Renders jobs received on UNIX socket until shut down",
+                                        NULL);
+      gimp_procedure_set_attribution (procedure, "Marcin Niesluchowski",
+                                      "Marcin Niesluchowski",
+                                      "2025");
+
+      gimp_procedure_add_string_argument (procedure, "socket_path", "Socket path", NULL,
+                                          FALSE, G_PARAM_READWRITE);
+    }
+
+  return procedure;
+}
+
+static GimpValueArray *
+boardgame_component_generator_run (GimpProcedure        *procedure,
+                 GimpRunMode           run_mode,
+                 GimpImage            *image,
+                 GimpDrawable        **drawables,
+                 GimpProcedureConfig  *config,
+                 gpointer              run_data)
+{
+  gchar* project_dir = NULL;
+
+  g_object_get (config,
+    "project_dir", &project_dir,
+    NULL);
+
+  if (project_dir == NULL || project_dir[0] == '\0') {
+    g_free(project_dir);
+    g_message("Project directory not specified");
+    return gimp_procedure_new_return_values (procedure, GIMP_PDB_CALLING_ERROR, NULL);
+  }
+
+  if (run_mode != GIMP_RUN_NONINTERACTIVE) {
+    g_free(project_dir);
+    g_message("Only non interactive mode supported!\n");
+    return gimp_procedure_new_return_values (procedure, GIMP_PDB_CALLING_ERROR, NULL);
+  }
+
+  if (!generate_from_project(project_dir, NULL)) {
+    g_free(project_dir);
+    return gimp_procedure_new_return_values (procedure, GIMP_PDB_EXECUTION_ERROR, NULL);
+  }
+  g_free(project_dir);
+
+  return gimp_procedure_new_return_values (procedure, GIMP_PDB_SUCCESS, NULL);
+}
+
+static GimpValueArray *
+boardgame_component_generator_run_server (GimpProcedure        *procedure,
+                        GimpRunMode           run_mode,
+                        GimpImage            *image,
+                        GimpDrawable        **drawables,
+                        GimpProcedureConfig  *config,
+                        gpointer              run_data)
+{
+  gchar* socket_path = NULL;
+
+  g_object_get (config,
+    "socket_path", &socket_path,
+    NULL);
+
+  if (socket_path == NULL || socket_path[0] == '\0' || run_mode != GIMP_RUN_NONINTERACTIVE) {
+    g_free(socket_path);
+    g_message("Socket path has to be specified in non interactive mode");
+    return gimp_procedure_new_return_values (procedure, GIMP_PDB_CALLING_ERROR, NULL);
+  }
+
+  if (!run_job_server(socket_path)) {
+    g_free(socket_path);
+    return gimp_procedure_new_return_values (procedure, GIMP_PDB_EXECUTION_ERROR, NULL);
+  }
+  g_free(socket_path);
+
+  return gimp_procedure_new_return_values (procedure, GIMP_PDB_SUCCESS, NULL);
+}
+
+GIMP_MAIN (BOARDGAME_COMPONENT_GENERATOR_TYPE)
+
+#else // GIMP2
+
+#define PLUG_IN_BINARY "boardgame-component-generator-bin"
+
+gint32 insert_image_layer(gint32 image_ID, gint32 layer_ID, LayerData* layer_data, gchar* assets_dir, AssetPrefetcher* prefetcher, gboolean* transformed) {
+  gchar* asset_file = g_build_filename(assets_dir, layer_data->value, NULL);
+  gint width = gimp_drawable_width(layer_ID);
+  gint height = gimp_drawable_height(layer_ID);
+  gint32 new_layer_ID = -1;
+  gboolean scaled = FALSE;
+  gint transform_x = 0, transform_y = 0;
+  GdkPixbuf* pixbuf = asset_prefetcher_take(prefetcher, asset_file, width, height, layer_data->config->rotate, transformed, &transform_x, &transform_y);
+  if (pixbuf) {
+    gchar* layer_name = g_path_get_basename(asset_file);
+    new_layer_ID = gimp_layer_new_from_pixbuf(image_ID, layer_name, pixbuf, 100.0, GIMP_LAYER_MODE_NORMAL, 0.0, 0.0);
+    scaled = new_layer_ID != -1;
+    g_free(layer_name);
+    g_object_unref(pixbuf);
+  }
+  if (new_layer_ID == -1) {
+    new_layer_ID = gimp_file_load_layer(GIMP_RUN_NONINTERACTIVE, image_ID, asset_file);
+    *transformed = FALSE;
+  }
+  if (new_layer_ID == -1) {
+     printf("Unable to load %s as layer\n", asset_file);
+     g_free(asset_file);
+     return -1;
+  }
+  g_free(asset_file);
+  gint32 parent_ID = gimp_item_get_parent(layer_ID);
+  gint layer_position = gimp_image_get_item_position(image_ID, layer_ID);
+  if (!gimp_image_insert_layer(image_ID, new_layer_ID, parent_ID, layer_position)) {
+    printf("Unable to add layer to image\n");
+    gimp_item_delete(new_layer_ID);
+    return -1;
+  }
+  if (!scaled && !gimp_layer_scale(new_layer_ID, width, height, FALSE)) {
+    printf("Unable to scale layer\n");
+    gimp_image_remove_layer(image_ID, new_layer_ID);
+    return -1;
+  }
+  gint offset_x, offset_y;
+  gimp_drawable_offsets(layer_ID, &offset_x, &offset_y);
+  if (*transformed) {
+    offset_x += transform_x;
+    offset_y += transform_y;
+  }
+  if (!gimp_layer_set_offsets(new_layer_ID, offset_x, offset_y)) {
+    printf("Unable to set offset of layer\n");
+    gimp_image_remove_layer(image_ID, new_layer_ID);
+    return -1;
+  }
+  return new_layer_ID;
+}
+
+static GdkPixbuf* drawable_to_pixbuf(gint32 drawable_ID) {
+  gint width = gimp_drawable_width(drawable_ID);
+  gint height = gimp_drawable_height(drawable_ID);
+  GdkPixbuf* pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+  GeglBuffer* buffer = gimp_drawable_get_buffer(drawable_ID);
+  gegl_buffer_get(buffer, GEGL_RECTANGLE(0, 0, width, height), 1.0, babl_format("R'G'B'A u8"),
+                  gdk_pixbuf_get_pixels(pixbuf), gdk_pixbuf_get_rowstride(pixbuf), GEGL_ABYSS_NONE);
+  g_object_unref(buffer);
+  return pixbuf;
+}
+
+// Stores scaled and rotated asset layer so next runs can skip the transforms
+static void store_derived_asset(DerivedAssetCache* asset_cache, gint32 layer_ID, gint32 placeholder_ID, LayerData* layer_data, gchar* assets_dir) {
+  gchar* asset_file = g_build_filename(assets_dir, layer_data->value, NULL);
+  gint x, y, base_x, base_y;
+  gimp_drawable_offsets(layer_ID, &x, &y);
+  gimp_drawable_offsets(placeholder_ID, &base_x, &base_y);
+  GdkPixbuf* pixbuf = drawable_to_pixbuf(layer_ID);
+  derived_asset_cache_store(asset_cache, asset_file,
+                            gimp_drawable_width(placeholder_ID), gimp_drawable_height(placeholder_ID),
+                            layer_data->config->rotate, pixbuf, x - base_x, y - base_y);
+  g_object_unref(pixbuf);
+  g_free(asset_file);
+}
+
+// Keeps layer as rendered for the row so rows with the same value paste it
+static void store_rendered_layer(LayerCache* layer_cache, guint face, const gchar* layer_name, LayerData* layer_data, gint32 layer_ID) {
+  gint offset_x, offset_y;
+  gimp_drawable_offsets(layer_ID, &offset_x, &offset_y);
+  layer_cache_store(layer_cache, face, layer_name, layer_data, drawable_to_pixbuf(layer_ID), offset_x, offset_y,
+                    gimp_layer_get_opacity(layer_ID), gimp_layer_get_mode(layer_ID));
+}
+
+// Inserts cached pixels in place of placeholder layer, which stays hidden
+static gint32 insert_rendered_layer(gint32 image_ID, gint32 placeholder_ID, const gchar* layer_name, RenderedLayer* rendered) {
+  gint32 new_layer_ID = gimp_layer_new_from_pixbuf(image_ID, layer_name, rendered->pixbuf, rendered->opacity, rendered->mode, 0.0, 0.0);
+  if (new_layer_ID == -1) {
+    printf("Unable to create layer from cached pixels of %s\n", layer_name);
+    return -1;
+  }
+  gint32 parent_ID = gimp_item_get_parent(placeholder_ID);
+  gint layer_position = gimp_image_get_item_position(image_ID, placeholder_ID);
+  if (!gimp_image_insert_layer(image_ID, new_layer_ID, parent_ID, layer_position)) {
+    printf("Unable to add layer to image\n");
+    gimp_item_delete(new_layer_ID);
+    return -1;
+  }
+  if (!gimp_layer_set_offsets(new_layer_ID, rendered->offset_x, rendered->offset_y)) {
+    printf("Unable to set offset of layer\n");
+    gimp_image_remove_layer(image_ID, new_layer_ID);
+    return -1;
+  }
+  gimp_item_set_visible(placeholder_ID, FALSE);
+  gimp_item_set_visible(new_layer_ID, TRUE);
+  return new_layer_ID;
+}
+
+static gboolean image_has_layer(gpointer image, const gchar* name) {
+  return gimp_image_get_layer_by_name(GPOINTER_TO_INT(image), name) != -1;
+}
+
+// Returns number of config layers missing in image or of wrong type
+static guint check_config_layers(gint32 image_ID, GHashTable* layers) {
+  guint problems = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, layers);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    gint32 layer_ID = gimp_image_get_layer_by_name(image_ID, key);
+    if (layer_ID == -1) {
+      printf("Failed to find %s layer in image\n", (gchar*)key);
+      ++problems;
+      continue;
+    }
+    LayerConfig* layer_config = (LayerConfig*)value;
+    LayerType layer_type = layer_config->type;
+    if (!((layer_type == LAYER_TYPE_IMAGE && !gimp_item_is_text_layer(layer_ID))
+        || (layer_type == LAYER_TYPE_TEXT && gimp_item_is_text_layer(layer_ID))
+        || layer_type == LAYER_TYPE_BOOL)) {
+      print_layer_mismatch((gchar*)key, layer_type, gimp_item_is_text_layer(layer_ID));
+      ++problems;
+    }
+  }
+  return problems;
+}
+
+static gboolean prepare_config_layers(gint32 image_ID, GHashTable* layers) {
+  if (check_config_layers(image_ID, layers) > 0) return FALSE;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, layers);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    gint32 layer_ID = gimp_image_get_layer_by_name(image_ID, key);
+    gimp_item_set_visible(layer_ID, FALSE);
+  }
+  return TRUE;
+}
+
+// Text layer shrinks font size down to 1 unit, so text does not fit only
+// when it overflows the layer already at that size, measured as rendering
+// measures it
+static gboolean text_fits_at_min_size(gint32 layer_ID, const gchar* text) {
+  GimpUnit font_unit;
+  gimp_text_layer_get_font_size(layer_ID, &font_unit);
+  gchar* font_name = gimp_text_layer_get_font(layer_ID);
+  gint ink_top, ink_bottom;
+  gboolean has_ink = measure_text_ink(thread_pango_context(), font_name,
+                                      gimp_units_to_pixels(1.0, font_unit, 72.0),
+                                      gimp_drawable_width(layer_ID), text, &ink_top, &ink_bottom);
+  g_free(font_name);
+  return !has_ink || ink_bottom <= gimp_drawable_height(layer_ID);
+}
+
+// Non text layers by name, which text keywords place as icons
+static void collect_icon_layers(const gint* items, gint count, GHashTable* icons) {
+  for (gint i = 0; i < count; ++i) {
+    if (gimp_item_is_group(items[i])) {
+      gint num_children;
+      gint* children = gimp_item_get_children(items[i], &num_children);
+      collect_icon_layers(children, num_children, icons);
+      g_free(children);
+    }
+    gchar* layer_name = gimp_item_get_name(items[i]);
+    if (gimp_item_is_text_layer(items[i])) {
+      g_free(layer_name);
+    } else {
+      g_hash_table_insert(icons, layer_name, GINT_TO_POINTER(items[i]));
+    }
+  }
+}
+
+// Icons of one XCF of template, texts of every XCF are compiled against its
+// own icons
+static void add_icon_layers(gint32 image_ID, GHashTable* icons) {
+  gint num_layers;
+  gint* layers = gimp_image_get_layers(image_ID, &num_layers);
+  collect_icon_layers(layers, num_layers, icons);
+  g_free(layers);
+}
+
+// Checks compiled text layers of every data row against template image
+// rendering given config layers
+static guint dry_run_check_texts(gint32 image_ID, guint face, gchar* name, ComponentTemplate* ct, GHashTable* layers) {
+  guint problems = 0;
+  for (guint i = 0; i < ct->data->len; ++i) {
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(ct->data, i);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, component_data->layers);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      LayerData* layer_data = (LayerData*)value;
+      CompiledText* compiled = layer_data_compiled(layer_data, face);
+      if (layer_data->config->type != LAYER_TYPE_TEXT || !compiled) continue;
+      if (!g_hash_table_contains(layers, key)) continue;
+      gint32 layer_ID = gimp_image_get_layer_by_name(image_ID, key);
+      if (!text_fits_at_min_size(layer_ID, compiled->text)) {
+        printf("%s row %u: text of layer %s does not fit even at smallest font size\n", name, i, (gchar*)key);
+        ++problems;
+      }
+    }
+  }
+  return problems;
+}
+
+// Reports all problems which would stop generation of template without
+// duplicating or exporting any image. Returns number of problems found.
+static guint dry_run_xcf(AssetPack* asset_pack, gchar* xcfs_dir, gchar* assets_dir, gchar* name, ComponentTemplate* ct) {
+  guint problems = dry_run_check_data(asset_pack, assets_dir, name, ct);
+  guint layer_problems = 0;
+  GArray* images = g_array_new(FALSE, FALSE, sizeof(gint32));
+  GPtrArray* xcf_layers = g_ptr_array_new_with_free_func((GDestroyNotify)&g_hash_table_unref);
+  for (guint x = 0; x < ct->xcfs->len; ++x) {
+    gchar* xcf_path = new_template_xcf_path(xcfs_dir, (TemplateXcf*)g_ptr_array_index(ct->xcfs, x));
+    gint32 image_ID = gimp_file_load(GIMP_RUN_NONINTERACTIVE, xcf_path, xcf_path);
+    if (image_ID == -1) {
+      printf("Input file %s not found\n", xcf_path);
+      g_free(xcf_path);
+      ++layer_problems;
+      continue;
+    }
+    g_free(xcf_path);
+    GHashTable* layers = new_template_xcf_layers(ct, &image_has_layer, GINT_TO_POINTER(image_ID));
+    layer_problems += check_config_layers(image_ID, layers);
+    g_array_append_val(images, image_ID);
+    g_ptr_array_add(xcf_layers, layers);
+  }
+  if (layer_problems == 0) {
+    layer_problems = check_template_layers_covered(name, ct, xcf_layers);
+  }
+  problems += layer_problems;
+  if (layer_problems == 0) {
+    for (guint x = 0; x < images->len; ++x) {
+      GHashTable* icon_layers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+      add_icon_layers(g_array_index(images, gint32, x), icon_layers);
+      problems += compile_template_texts(name, ct, x, g_ptr_array_index(xcf_layers, x), icon_layers);
+      g_hash_table_destroy(icon_layers);
+      problems += dry_run_check_texts(g_array_index(images, gint32, x), x, name, ct, g_ptr_array_index(xcf_layers, x));
+    }
+  }
+  for (guint x = 0; x < images->len; ++x) {
+    gimp_image_delete(g_array_index(images, gint32, x));
+  }
+  g_ptr_array_free(xcf_layers, TRUE);
+  g_array_free(images, TRUE);
+  return problems;
+}
+
+static GHashTable* collect_image_layer_sizes(gint32 image_ID, GHashTable* layers) {
+  GHashTable* layer_sizes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)&del_layer_size);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, layers);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    if (((LayerConfig*)value)->type != LAYER_TYPE_IMAGE) continue;
+    gint32 layer_ID = gimp_image_get_layer_by_name(image_ID, key);
+    if (layer_ID == -1) continue;
+    LayerSize* size = new_layer_size(gimp_drawable_width(layer_ID), gimp_drawable_height(layer_ID));
+    g_hash_table_insert(layer_sizes, g_strdup(key), size);
+  }
+  return layer_sizes;
+}
 
-  return procedure;
+// Template loaded by job server, kept open between jobs until file changes
+// or it is the least recently used one of too many
+typedef struct {
+  gint32 image_ID;
+  gint64 mtime_ns;
+  gint64 size;
+  gint64 used;
+} WarmTemplate;
+
+WarmTemplate* new_warm_template(gint32 image_ID, gint64 mtime_ns, gint64 size) {
+  WarmTemplate* wt = malloc(sizeof(WarmTemplate));
+  wt->image_ID = image_ID;
+  wt->mtime_ns = mtime_ns;
+  wt->size = size;
+  wt->used = g_get_monotonic_time();
+  return wt;
 }
 
-static GimpValueArray *
-boardgame_component_generator_run (GimpProcedure        *procedure,
-                 GimpRunMode           run_mode,
-                 GimpImage            *image,
-                 GimpDrawable        **drawables,
-                 GimpProcedureConfig  *config,
-                 gpointer              run_data)
-{
-  gchar* project_dir = NULL;
+void del_warm_template(WarmTemplate* wt) {
+  if (!wt) return;
+  gimp_image_delete(wt->image_ID);
+  free(wt);
+}
 
-  g_object_get (config,
-    "project_dir", &project_dir,
-    NULL);
+static GHashTable* new_warm_templates(void) {
+  return g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)&del_warm_template);
+}
 
-  if (project_dir == NULL || project_dir[0] == '\0') {
-    g_free(project_dir);
-    g_message("Project directory not specified");
-    return gimp_procedure_new_return_values (procedure, GIMP_PDB_CALLING_ERROR, NULL);
+// Closes least recently used warm templates until there is room for one more
+static void evict_warm_templates(GHashTable* warm_templates) {
+  while (g_hash_table_size(warm_templates) >= MAX_WARM_TEMPLATES) {
+    GHashTableIter iter;
+    gpointer key, value;
+    gpointer oldest = NULL;
+    gint64 oldest_used = G_MAXINT64;
+    g_hash_table_iter_init(&iter, warm_templates);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      if (((WarmTemplate*)value)->used < oldest_used) {
+        oldest = key;
+        oldest_used = ((WarmTemplate*)value)->used;
+      }
+    }
+    g_hash_table_remove(warm_templates, oldest);
   }
+}
 
-  if (run_mode != GIMP_RUN_NONINTERACTIVE) {
-    g_free(project_dir);
-    g_message("Only non interactive mode supported!\n");
-    return gimp_procedure_new_return_values (procedure, GIMP_PDB_CALLING_ERROR, NULL);
+// Duplicates warm template or loads it when file changed since last job.
+// Changed or removed template is closed before loading, so it is never kept
+// twice.
+static gint32 load_warm_template(GHashTable* warm_templates, const gchar* xcf_path) {
+  GStatBuf st;
+  if (g_stat(xcf_path, &st) != 0) {
+    g_hash_table_remove(warm_templates, xcf_path);
+    return -1;
   }
-
-  if (!generate_from_project(project_dir)) {
-    g_free(project_dir);
-    return gimp_procedure_new_return_values (procedure, GIMP_PDB_EXECUTION_ERROR, NULL);
+  gint64 mtime_ns = stat_mtime_ns(&st);
+  WarmTemplate* wt = (WarmTemplate*)g_hash_table_lookup(warm_templates, xcf_path);
+  if (!wt || wt->mtime_ns != mtime_ns || wt->size != (gint64)st.st_size) {
+    g_hash_table_remove(warm_templates, xcf_path);
+    gint32 image_ID = gimp_file_load(GIMP_RUN_NONINTERACTIVE, xcf_path, xcf_path);
+    if (image_ID == -1) return -1;
+    evict_warm_templates(warm_templates);
+    wt = new_warm_template(image_ID, mtime_ns, st.st_size);
+    g_hash_table_insert(warm_templates, g_strdup(xcf_path), wt);
   }
-  g_free(project_dir);
-
-  return gimp_procedure_new_return_values (procedure, GIMP_PDB_SUCCESS, NULL);
+  wt->used = g_get_monotonic_time();
+  return gimp_image_duplicate(wt->image_ID);
 }
 
-GIMP_MAIN (BOARDGAME_COMPONENT_GENERATOR_TYPE)
+// Same order as PRECISION_NAMES, perceptual and linear
+static const GimpPrecision TEMPLATE_PRECISIONS[][2] = {
+  {GIMP_PRECISION_U8_GAMMA, GIMP_PRECISION_U8_LINEAR},
+  {GIMP_PRECISION_U16_GAMMA, GIMP_PRECISION_U16_LINEAR},
+  {GIMP_PRECISION_U32_GAMMA, GIMP_PRECISION_U32_LINEAR},
+  {GIMP_PRECISION_HALF_GAMMA, GIMP_PRECISION_HALF_LINEAR},
+  {GIMP_PRECISION_FLOAT_GAMMA, GIMP_PRECISION_FLOAT_LINEAR},
+  {GIMP_PRECISION_DOUBLE_GAMMA, GIMP_PRECISION_DOUBLE_LINEAR}
+};
 
-#else // GIMP2
+static gint64 items_pixel_bytes(const gint* items, gint count) {
+  gint64 bytes = 0;
+  for (gint i = 0; i < count; ++i) {
+    bytes += (gint64)gimp_drawable_width(items[i]) * gimp_drawable_height(items[i]) * gimp_drawable_bpp(items[i]);
+    if (gimp_item_is_group(items[i])) {
+      gint num_children;
+      gint* children = gimp_item_get_children(items[i], &num_children);
+      bytes += items_pixel_bytes(children, num_children);
+      g_free(children);
+    }
+  }
+  return bytes;
+}
 
-#define PLUG_IN_BINARY "boardgame-component-generator-bin"
+// Bytes of pixels of all layers, copied by every image duplicate
+static gint64 image_pixel_bytes(gint32 image_ID) {
+  gint num_layers;
+  gint* layers = gimp_image_get_layers(image_ID, &num_layers);
+  gint64 bytes = items_pixel_bytes(layers, num_layers);
+  g_free(layers);
+  return bytes;
+}
 
-gint32 insert_image_layer(gint32 image_ID, gint32 layer_ID, LayerData* layer_data, gchar* assets_dir) {
-  gchar* asset_file = g_build_filename(assets_dir, layer_data->value, NULL);
-  gint32 new_layer_ID = gimp_file_load_layer(GIMP_RUN_NONINTERACTIVE, image_ID, asset_file);
-  if (new_layer_ID == -1) {
-     printf("Unable to load %s as layer\n", asset_file);
-     g_free(asset_file);
-     return -1;
-  }
-  g_free(asset_file);
-  gint32 parent_ID = gimp_item_get_parent(layer_ID);
-  gint layer_position = gimp_image_get_item_position(image_ID, layer_ID);
-  if (!gimp_image_insert_layer(image_ID, new_layer_ID, parent_ID, layer_position)) {
-    printf("Unable to add layer to image\n");
-    gimp_item_delete(new_layer_ID);
-    return -1;
+// Converts template to working precision before any row is rendered.
+// Returns bytes saved by every duplicate of template.
+static gint64 convert_template_precision(gint32 image_ID, const gchar* name) {
+  gboolean linear;
+  if (!name) return 0;
+  GimpPrecision precision = TEMPLATE_PRECISIONS[precision_index(name, &linear)][linear ? 1 : 0];
+  if (gimp_image_get_precision(image_ID) == precision) return 0;
+  gint64 bytes = image_pixel_bytes(image_ID);
+  if (!gimp_image_convert_precision(image_ID, precision)) {
+    printf("Unable to convert template to %s precision\n", name);
+    return 0;
   }
-  if (!gimp_layer_scale(new_layer_ID, gimp_drawable_width(layer_ID), gimp_drawable_height(layer_ID), FALSE)) {
-    printf("Unable to scale layer\n");
-    gimp_image_remove_layer(image_ID, new_layer_ID);
+  return bytes - image_pixel_bytes(image_ID);
+}
+
+// Saved bytes are optional. Config layers are prepared unless layers are
+// NULL, when caller picks layers of image first.
+static gint32 load_template_image(const gchar* xcf_path, GHashTable* layers, GHashTable* warm_templates, const gchar* precision, gint64* saved_bytes) {
+  gint32 image_ID = warm_templates ? load_warm_template(warm_templates, xcf_path)
+                                   : gimp_file_load(GIMP_RUN_NONINTERACTIVE, xcf_path, xcf_path);
+  if (image_ID == -1) {
+    printf("Input file %s not found\n", xcf_path);
     return -1;
   }
-  gint offset_x, offset_y;
-  gimp_drawable_offsets(layer_ID, &offset_x, &offset_y);
-  if (!gimp_layer_set_offsets(new_layer_ID, offset_x, offset_y)) {
-    printf("Unable to set offset of layer\n");
-    gimp_image_remove_layer(image_ID, new_layer_ID);
+  gint64 saved = convert_template_precision(image_ID, precision);
+  if (saved_bytes) *saved_bytes = saved;
+  if (layers && !prepare_config_layers(image_ID, layers)) {
+    gimp_image_delete(image_ID);
     return -1;
   }
-  return new_layer_ID;
+  return image_ID;
 }
 
-static gboolean prepare_config_layers(gint32 image_ID, GHashTable* layers) {
-  GHashTableIter iter;
-  gpointer key, value;
-  g_hash_table_iter_init(&iter, layers);
-  while (g_hash_table_iter_next(&iter, &key, &value)) {
-    gint32 layer_ID = gimp_image_get_layer_by_name(image_ID, key);
-    if (layer_ID == -1) {
-      printf("Failed to find %s layer in image\n", (gchar*)key);
-      return FALSE;
-    }
-    LayerConfig* layer_config = (LayerConfig*)value;
-    LayerType layer_type = layer_config->type;
-    if (!((layer_type == LAYER_TYPE_IMAGE && !gimp_item_is_text_layer(layer_ID))
-        || (layer_type == LAYER_TYPE_TEXT && gimp_item_is_text_layer(layer_ID))
-        || layer_type == LAYER_TYPE_BOOL)) {
-      print_layer_mismatch((gchar*)key, layer_type, gimp_item_is_text_layer(layer_ID));
-      return FALSE;
+// Template loaded once and duplicated for every row. In low memory mode it
+// is released and every row loads template from disk instead, so only one
+// image stays in memory. Icons placed by texts are copied into separate
+// image, which stays loaded. Face is index of XCF in template, layers are
+// config layers it renders.
+typedef struct {
+  gint32 image_ID;
+  gint32 icons_ID;
+  gchar* xcf_path;
+  GHashTable* layers;
+  const gchar* precision;
+  const gchar* suffix;
+  guint face;
+} TemplateImage;
+
+TemplateImage* new_template_image(gint32 image_ID, gchar* xcf_path, GHashTable* layers, const gchar* precision, const gchar* suffix, guint face) {
+  TemplateImage* ti = malloc(sizeof(TemplateImage));
+  ti->image_ID = image_ID;
+  ti->icons_ID = -1;
+  ti->xcf_path = xcf_path;
+  ti->layers = layers;
+  ti->precision = precision;
+  ti->suffix = suffix;
+  ti->face = face;
+  return ti;
+}
+
+void del_template_image(TemplateImage* ti) {
+  if (!ti) return;
+  if (ti->image_ID != -1) gimp_image_delete(ti->image_ID);
+  if (ti->icons_ID != -1) gimp_image_delete(ti->icons_ID);
+  g_free(ti->xcf_path);
+  g_hash_table_unref(ti->layers);
+  free(ti);
+}
+
+static void template_image_release(TemplateImage* ti) {
+  if (ti->image_ID == -1) return;
+  gimp_image_delete(ti->image_ID);
+  ti->image_ID = -1;
+}
+
+// Returns image for single row to work on
+static gint32 template_image_instance(TemplateImage* ti) {
+  if (ti->image_ID == -1) return load_template_image(ti->xcf_path, ti->layers, NULL, ti->precision, NULL);
+  return gimp_image_duplicate(ti->image_ID);
+}
+
+// Copies icons placed by compiled texts of face into icon image, which stays
+// loaded in low memory mode too, and points compiled texts at the copies, so
+// rows copy icons from there without looking them up
+static void store_template_icons(TemplateImage* ti, ComponentTemplate* ct) {
+  GHashTable* copies = g_hash_table_new(g_direct_hash, g_direct_equal);
+  for (guint i = 0; i < ct->data->len; ++i) {
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(ct->data, i);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, component_data->layers);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      CompiledText* compiled = layer_data_compiled((LayerData*)value, ti->face);
+      for (guint k = 0; compiled && k < compiled->icons->len; ++k) {
+        gpointer source = g_ptr_array_index(compiled->icons, k);
+        gpointer copy = g_hash_table_lookup(copies, source);
+        if (!copy) {
+          if (ti->icons_ID == -1) {
+            ti->icons_ID = gimp_image_new_with_precision(gimp_image_width(ti->image_ID), gimp_image_height(ti->image_ID),
+                                                         gimp_image_base_type(ti->image_ID), gimp_image_get_precision(ti->image_ID));
+          }
+          gint32 icon_ID = gimp_layer_new_from_drawable(GPOINTER_TO_INT(source), ti->icons_ID);
+          gimp_image_insert_layer(ti->icons_ID, icon_ID, -1, 0);
+          copy = GINT_TO_POINTER(icon_ID);
+          g_hash_table_insert(copies, source, copy);
+        }
+        g_ptr_array_index(compiled->icons, k) = copy;
+      }
     }
-    gimp_item_set_visible(layer_ID, FALSE);
   }
-  return TRUE;
+  g_hash_table_destroy(copies);
 }
 
 static gboolean fit_text_in_bounds(gint32 layer_ID, gint width, gint height, const gchar* text) {
@@ -1140,39 +5412,40 @@ static gboolean fit_text_in_bounds(gint32 layer_ID, gint width, gint height, con
   return TRUE;
 }
 
-static GPtrArray* find_image_keywords(const gchar* text, gint32 image_ID) {
-  GPtrArray* keywords = g_ptr_array_new_with_free_func(g_free);
-  const gchar* current = text;
-  gint position = 0;
-  while (*current) {
-    if (*current == '<' && *(current + 1) == '<') {
-      const gchar* start = current + 2;
-      const gchar* end = strstr(start, ">>");
-      if (end && end > start) {
-        gchar* layer_name = g_strndup(start, end - start);
-        gint32 found_layer = gimp_image_get_layer_by_name(image_ID, layer_name);
-        if (found_layer != -1 && !gimp_item_is_text_layer(found_layer)) {
-          ImageKeyword* keyword = new_image_keyword(layer_name, position);
-          g_ptr_array_add(keywords, keyword);
-        } else {
-          g_free(layer_name);
-        }
-        current = end + 2;
-        position = (end + 2) - text;
-      } else {
-        current++;
-        position++;
-      }
-    } else {
-      current++;
-      position++;
-    }
+// Scales keyword icon proportionally to font size and centers it at position
+static void place_keyword_layer(gint32 icon_ID, gdouble font_size, gint center_x, gint center_y) {
+  // Resize image to match font size (make it proportional to font size)
+  gint image_size = (gint)(font_size * 0.9); // 90% of font size for better fit
+  gint original_width = gimp_drawable_width(icon_ID);
+  gint original_height = gimp_drawable_height(icon_ID);
+
+  // Maintain aspect ratio
+  gdouble aspect_ratio = (gdouble)original_width / original_height;
+  gint final_width, final_height;
+
+  if (aspect_ratio > 1.0) {
+    // Wider than tall
+    final_width = image_size;
+    final_height = (gint)(image_size / aspect_ratio);
+  } else {
+    // Taller than wide or square
+    final_height = image_size;
+    final_width = (gint)(image_size * aspect_ratio);
   }
-  return keywords;
+
+  gimp_layer_scale(icon_ID, final_width, final_height, FALSE);
+
+  // Set final position (center the image at calculated position)
+  gint final_x = center_x - final_width / 2;
+  gint final_y = center_y - final_height / 2;
+
+  // Position calculated successfully
+
+  gimp_layer_set_offsets(icon_ID, final_x, final_y);
 }
 
-static gboolean fit_text_in_layer(gint32 layer_ID, const gchar* text, int vcenter) {
-  if (strlen(text) == 0) {
+static gboolean fit_text_in_layer(gint32 layer_ID, const CompiledText* compiled, int vcenter, const TextFit* fit) {
+  if (!compiled || strlen(compiled->text) == 0) {
     return TRUE;
   }
 
@@ -1181,37 +5454,18 @@ static gboolean fit_text_in_layer(gint32 layer_ID, const gchar* text, int vcente
   gint text_width = gimp_drawable_width(layer_ID);
   gint text_height = gimp_drawable_height(layer_ID);
 
-  // Find and process image keywords
-  GPtrArray* keywords = find_image_keywords(text, original_image_ID);
-  gchar* processed_text = replace_keywords_with_spaces(text, keywords);
+  // Image keywords were resolved and their icons stored when template was
+  // loaded
+  GPtrArray* keywords = image_keywords_from_compiled(compiled);
+  const gchar* processed_text = compiled->text;
    
-  // Create duplicates of image layers for each keyword
+  // Copy icon of every keyword into row image
   for (guint i = 0; i < keywords->len; i++) {
     ImageKeyword* keyword = g_ptr_array_index(keywords, i);
-    gint32 source_layer = gimp_image_get_layer_by_name(original_image_ID, keyword->layer_name);
-    if (source_layer != -1) {
-      keyword->duplicate_layer_id = gimp_layer_copy(source_layer);
-      gimp_image_insert_layer(original_image_ID, keyword->duplicate_layer_id, 
-                             gimp_item_get_parent(layer_ID), 0);
-      gimp_item_set_visible(keyword->duplicate_layer_id, TRUE);
-    } else {
-      // Try to load asset image file if no layer is found
-      gchar* asset_file = g_build_filename("assets", keyword->layer_name, NULL);
-      gint32 asset_layer = gimp_file_load_layer(GIMP_RUN_NONINTERACTIVE, original_image_ID, asset_file);
-      if (asset_layer == -1) {
-        g_free(asset_file);
-        asset_file = g_build_filename("out", keyword->layer_name, NULL);
-        asset_layer = gimp_file_load_layer(GIMP_RUN_NONINTERACTIVE, original_image_ID, asset_file);
-      }
-      g_free(asset_file);
-      if (asset_layer != -1) {
-        keyword->duplicate_layer_id = asset_layer;
-        gimp_image_insert_layer(original_image_ID, asset_layer, gimp_item_get_parent(layer_ID), 0);
-        gimp_item_set_visible(asset_layer, TRUE);
-      } else {
-        keyword->duplicate_layer_id = -1;
-      }
-    }
+    keyword->duplicate_layer_id = gimp_layer_new_from_drawable(GPOINTER_TO_INT(g_ptr_array_index(compiled->icons, i)), original_image_ID);
+    gimp_image_insert_layer(original_image_ID, keyword->duplicate_layer_id,
+                            gimp_item_get_parent(layer_ID), 0);
+    gimp_item_set_visible(keyword->duplicate_layer_id, TRUE);
   }
 
   GimpUnit font_unit;
@@ -1220,70 +5474,74 @@ static gboolean fit_text_in_layer(gint32 layer_ID, const gchar* text, int vcente
   GimpRGB text_color;
   gimp_text_layer_get_color(layer_ID, &text_color);
   
-  // Create new image with text layer width and twice the height
-  gint32 temp_image_ID = gimp_image_new(text_width, text_height * 2, GIMP_RGB);
-
-  // Create text layer that takes whole image size
-  gint32 temp_text_layer_ID = gimp_text_layer_new(temp_image_ID, processed_text, font_name, font_size, font_unit);
-  if (temp_text_layer_ID == -1) {
-    printf("Failed to create temporary text layer\n");
-    gimp_image_delete(temp_image_ID);
-    g_free(font_name);
-    g_free(processed_text);
-    g_ptr_array_free(keywords, TRUE);
-    return FALSE;
-  }
+  gdouble current_font_size = font_size;
+  gint y1 = 0, y2 = 0;
+  if (fit) {
+    // Fitted ahead of rendering by text prepass
+    current_font_size = fit->font_size;
+    y1 = fit->ink_top;
+    y2 = fit->ink_bottom;
+  } else {
+    // Create new image with text layer width and twice the height
+    gint32 temp_image_ID = gimp_image_new(text_width, text_height * 2, GIMP_RGB);
+
+    // Create text layer that takes whole image size
+    gint32 temp_text_layer_ID = gimp_text_layer_new(temp_image_ID, processed_text, font_name, font_size, font_unit);
+    if (temp_text_layer_ID == -1) {
+      printf("Failed to create temporary text layer\n");
+      gimp_image_delete(temp_image_ID);
+      g_free(font_name);
+      g_ptr_array_free(keywords, TRUE);
+      return FALSE;
+    }
   
-  gimp_image_insert_layer(temp_image_ID, temp_text_layer_ID, -1, 0);
-  gimp_text_layer_set_color(temp_text_layer_ID, &text_color);
+    gimp_image_insert_layer(temp_image_ID, temp_text_layer_ID, -1, 0);
+    gimp_text_layer_set_color(temp_text_layer_ID, &text_color);
 
-  // Resize text layer to fill the whole image
-  gimp_text_layer_resize(temp_text_layer_ID, text_width, text_height * 2);
+    // Resize text layer to fill the whole image
+    gimp_text_layer_resize(temp_text_layer_ID, text_width, text_height * 2);
   
-  gdouble current_font_size = font_size;
-  gboolean text_fits = FALSE;
+    gboolean text_fits = FALSE;
 
-  gint y1, y2;
-
-  // Check if visible text exceeds half image size and adjust font size
-  while (!text_fits && current_font_size >= 1.0) {
-    // Set current font size
-    gimp_text_layer_set_font_size(temp_text_layer_ID, current_font_size, font_unit);
-    gimp_text_layer_set_text(temp_text_layer_ID, processed_text);
+    // Check if visible text exceeds half image size and adjust font size
+    while (!text_fits && current_font_size >= 1.0) {
+      // Set current font size
+      gimp_text_layer_set_font_size(temp_text_layer_ID, current_font_size, font_unit);
+      gimp_text_layer_set_text(temp_text_layer_ID, processed_text);
     
-    // Create alpha selection to find text bounds
-    gimp_image_select_item(temp_image_ID, GIMP_CHANNEL_OP_REPLACE, temp_text_layer_ID);
+      // Create alpha selection to find text bounds
+      gimp_image_select_item(temp_image_ID, GIMP_CHANNEL_OP_REPLACE, temp_text_layer_ID);
     
-    // Check if selection exists (text is visible)
-    gint x1, x2;
-    gboolean has_selection;
-    gimp_selection_bounds(temp_image_ID, &has_selection, &x1, &y1, &x2, &y2);
-
-    if (!has_selection) {
-      // No visible text, font size might be too small or text is empty
-      text_fits = TRUE;
-    } else {
-      // Check if the lowest point of selection (y2) exceeds half image height
-      gint half_height = text_height; // Since image height is 2 * text_height, half is text_height
-      if (y2 <= half_height) {
+      // Check if selection exists (text is visible)
+      gint x1, x2;
+      gboolean has_selection;
+      gimp_selection_bounds(temp_image_ID, &has_selection, &x1, &y1, &x2, &y2);
+
+      if (!has_selection) {
+        // No visible text, font size might be too small or text is empty
         text_fits = TRUE;
       } else {
-        // Text exceeds half height, reduce font size
-        current_font_size -= 1.0;
+        // Check if the lowest point of selection (y2) exceeds half image height
+        gint half_height = text_height; // Since image height is 2 * text_height, half is text_height
+        if (y2 <= half_height) {
+          text_fits = TRUE;
+        } else {
+          // Text exceeds half height, reduce font size
+          current_font_size -= 1.0;
+        }
       }
+
+      // Clear selection
+      gimp_selection_none(temp_image_ID);
     }
 
-    // Clear selection
-    gimp_selection_none(temp_image_ID);
+    // Remove temporary image
+    gimp_image_delete(temp_image_ID);
   }
-
-  // Remove temporary image
-  gimp_image_delete(temp_image_ID);
   g_free(font_name);
 
   if (current_font_size < 1.0) {
     printf("Could not fit text within bounds: %s\n", processed_text);
-    g_free(processed_text);
     g_ptr_array_free(keywords, TRUE);
     return FALSE;
   }
@@ -1301,7 +5559,17 @@ static gboolean fit_text_in_layer(gint32 layer_ID, const gchar* text, int vcente
   }
 
   // Position image layers at the locations of the spaces
-  if (keywords->len > 0) {
+  if (keywords->len > 0 && fit) {
+    gint text_x, text_y;
+    gimp_drawable_offsets(layer_ID, &text_x, &text_y);
+    for (guint i = 0; i < keywords->len && 2 * i + 1 < fit->anchors->len; i++) {
+      ImageKeyword* keyword = g_ptr_array_index(keywords, i);
+      if (keyword->duplicate_layer_id == -1) continue;
+      place_keyword_layer(keyword->duplicate_layer_id, current_font_size,
+                          text_x + g_array_index(fit->anchors, gint, 2 * i),
+                          text_y + g_array_index(fit->anchors, gint, 2 * i + 1));
+    }
+  } else if (keywords->len > 0) {
     // Get font name again (the previous one was freed)
     gchar* current_font_name = gimp_text_layer_get_font(layer_ID);
 
@@ -1338,6 +5606,8 @@ static gboolean fit_text_in_layer(gint32 layer_ID, const gchar* text, int vcente
         gchar *font_name = gimp_text_layer_get_font(layer_ID);
         if (!font_name) {
             printf("Failed to get font name for positioning\n");
+            gimp_image_remove_layer(original_image_ID, measure_layer);
+            g_free(text_up_to_keyword);
             continue;
         }
 
@@ -1399,34 +5669,7 @@ static gboolean fit_text_in_layer(gint32 layer_ID, const gchar* text, int vcente
         cairo_surface_destroy(surface);
         g_free(font_name);
          
-        // Resize image to match font size (make it proportional to font size)
-        gint image_size = (gint)(current_font_size * 0.9); // 90% of font size for better fit
-        gint original_width = gimp_drawable_width(keyword->duplicate_layer_id);
-        gint original_height = gimp_drawable_height(keyword->duplicate_layer_id);
-
-        // Maintain aspect ratio
-        gdouble aspect_ratio = (gdouble)original_width / original_height;
-        gint final_width, final_height;
-         
-        if (aspect_ratio > 1.0) {
-          // Wider than tall
-          final_width = image_size;
-          final_height = (gint)(image_size / aspect_ratio);
-        } else {
-          // Taller than wide or square
-          final_height = image_size;
-          final_width = (gint)(image_size * aspect_ratio);
-        }
-         
-        gimp_layer_scale(keyword->duplicate_layer_id, final_width, final_height, FALSE);
-         
-        // Set final position (center the image at calculated position)
-        gint final_x = final_image_x - final_width / 2;
-        gint final_y = final_image_y - final_height / 2;
-         
-        // Position calculated successfully
-         
-        gimp_layer_set_offsets(keyword->duplicate_layer_id, final_x, final_y);
+        place_keyword_layer(keyword->duplicate_layer_id, current_font_size, final_image_x, final_image_y);
          
         // Clean up
         gimp_image_remove_layer(original_image_ID, measure_layer);
@@ -1440,26 +5683,99 @@ static gboolean fit_text_in_layer(gint32 layer_ID, const gchar* text, int vcente
   }
 
   // Clean up
-  g_free(processed_text);
   g_ptr_array_free(keywords, TRUE);
  
   return TRUE;
 }
 
-static gboolean generate_component(int i, gint32 image_ID, GHashTable* component_layers, gchar* assets_dir, gchar* out_dir, gchar* out_key) {
+static GHashTable* collect_text_layer_styles(gint32 image_ID, GHashTable* layers) {
+  GHashTable* styles = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)&del_text_layer_style);
   GHashTableIter iter;
   gpointer key, value;
-  gint32 new_image_ID = gimp_image_duplicate(image_ID);
+  g_hash_table_iter_init(&iter, layers);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    if (((LayerConfig*)value)->type != LAYER_TYPE_TEXT) continue;
+    gint32 layer_ID = gimp_image_get_layer_by_name(image_ID, key);
+    if (layer_ID == -1 || !gimp_item_is_text_layer(layer_ID)) continue;
+    GimpUnit font_unit;
+    gdouble font_size = gimp_text_layer_get_font_size(layer_ID, &font_unit);
+    TextLayerStyle* style = new_text_layer_style(gimp_text_layer_get_font(layer_ID), font_size,
+                                                 gimp_units_to_pixels(1.0, font_unit, 72.0),
+                                                 gimp_text_layer_get_line_spacing(layer_ID),
+                                                 gimp_drawable_width(layer_ID),
+                                                 gimp_drawable_height(layer_ID));
+    g_hash_table_insert(styles, g_strdup(key), style);
+  }
+  return styles;
+}
+
+// Fits all texts of template rows in all its XCFs on all cores before rendering
+static TextPrepass* run_text_prepass(GPtrArray* template_images, ComponentTemplate* ct, GeneratorContext* ctx) {
+  GPtrArray* styles = g_ptr_array_new_with_free_func((GDestroyNotify)&g_hash_table_destroy);
+  for (guint face = 0; face < template_images->len; ++face) {
+    TemplateImage* template_image = (TemplateImage*)g_ptr_array_index(template_images, face);
+    g_ptr_array_add(styles, collect_text_layer_styles(template_image->image_ID, template_image->layers));
+  }
+  TextPrepass* tp = new_text_prepass(styles);
+  for (guint i = 0; i < ct->data->len; ++i) {
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(ct->data, i);
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, component_data->layers);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      LayerData* layer_data = (LayerData*)value;
+      if (layer_data->config->type != LAYER_TYPE_TEXT || !layer_data->value || !*layer_data->value) continue;
+      for (guint face = 0; face < template_images->len; ++face) {
+        CompiledText* compiled = layer_data_compiled(layer_data, face);
+        if (!compiled || !text_prepass_needs(tp, face, key, layer_data->value)) continue;
+        GArray* positions = g_array_sized_new(FALSE, FALSE, sizeof(gsize), compiled->positions->len);
+        g_array_append_vals(positions, compiled->positions->data, compiled->positions->len);
+        text_prepass_add(tp, face, key, layer_data->value, g_strdup(compiled->text), positions);
+      }
+    }
+  }
+  text_prepass_run(tp, ctx->options->prefetch_threads);
+  printf("Fitted %u texts ahead of rendering\n", g_hash_table_size(tp->fits));
+  return tp;
+}
+
+static gboolean generate_component(TemplateImage* template_image, GHashTable* component_layers, const gchar* out_file, gchar* assets_dir, AssetPrefetcher* prefetcher, OutputDigests* digests, GPtrArray* variants, GeneratorContext* ctx) {
+  GHashTableIter iter;
+  gpointer key, value;
+  gint32 new_image_ID = template_image_instance(template_image);
+  if (new_image_ID == -1) {
+    set_row_failure(ctx, NULL, "unable to create component image");
+    return FALSE;
+  }
   g_hash_table_iter_init(&iter, component_layers);
   while (g_hash_table_iter_next(&iter, &key, &value)) {
+    // Layer of other XCF of template
+    if (!g_hash_table_contains(template_image->layers, key)) continue;
     gchar* layer_name = (gchar*)key;
     LayerData* layer_data = (LayerData*)value;
     gint32 layer_ID = gimp_image_get_layer_by_name(new_image_ID, key);
-    printf("Processing layer %s of type %s\n", layer_name, str_from_layer_type(layer_data->config->type));
+    gint32 placeholder_ID = layer_ID;
+    gboolean transformed = FALSE;
+    debug_printf("Processing layer %s of type %s\n", layer_name, str_from_layer_type(layer_data->config->type));
+    RenderedLayer* rendered = layer_cache_lookup(ctx->layer_cache, template_image->face, layer_name, layer_data);
+    if (rendered) {
+      if (layer_data->config->type == LAYER_TYPE_IMAGE) {
+        gchar* asset_file = g_build_filename(assets_dir, layer_data->value, NULL);
+        asset_prefetcher_release(prefetcher, asset_file, gimp_drawable_width(layer_ID), gimp_drawable_height(layer_ID), layer_data->config->rotate);
+        g_free(asset_file);
+      }
+      if (insert_rendered_layer(new_image_ID, layer_ID, layer_name, rendered) == -1) {
+        set_row_failure(ctx, layer_name, "unable to insert cached layer");
+        gimp_image_delete(new_image_ID);
+        return FALSE;
+      }
+      continue;
+    }
     switch (layer_data->config->type) {
       case LAYER_TYPE_IMAGE:
-        layer_ID = insert_image_layer(new_image_ID, layer_ID, layer_data, assets_dir);
+        layer_ID = insert_image_layer(new_image_ID, layer_ID, layer_data, assets_dir, prefetcher, &transformed);
         if (layer_ID == -1) {
+          set_row_failure(ctx, layer_name, "unable to load asset %s", layer_data->value);
           gimp_image_delete(new_image_ID);
           return FALSE;
         }
@@ -1467,8 +5783,10 @@ static gboolean generate_component(int i, gint32 image_ID, GHashTable* component
         break;
       case LAYER_TYPE_TEXT:
         gimp_item_set_visible(layer_ID, TRUE);
-        if (!fit_text_in_layer(layer_ID, layer_data->value, layer_data->config->vcenter)) {
+        if (!fit_text_in_layer(layer_ID, layer_data_compiled(layer_data, template_image->face), layer_data->config->vcenter,
+                               text_prepass_lookup(ctx->text_prepass, template_image->face, layer_name, layer_data->value))) {
             printf("Couldn't fit text in layer: %s\n", layer_data->value);
+            set_row_failure(ctx, layer_name, "text does not fit: %s", layer_data->value);
             gimp_image_delete(new_image_ID);
             return FALSE;
         }
@@ -1479,87 +5797,260 @@ static gboolean generate_component(int i, gint32 image_ID, GHashTable* component
       default:
         gimp_image_delete(new_image_ID);
         printf("Invalid layer type. Something went wrong\n");
+        set_row_failure(ctx, layer_name, "invalid layer type");
         return FALSE;
     }
 
-    if (layer_data->config->rotate != 0.0) {
+    if (layer_data->config->rotate != 0.0 && !transformed) {
       gdouble angle_rad = layer_data->config->rotate * G_PI / 180.0;
       gimp_item_transform_rotate(layer_ID, angle_rad, TRUE, 0.0, 0.0);
     }
-  }
 
-  gint32 final_layer = gimp_image_flatten(new_image_ID);
-  gchar* filename = NULL;
-  if (out_key) {
-    LayerData* out_layer = (LayerData*)g_hash_table_lookup(component_layers, out_key);
-    if (out_layer && out_layer->value) {
-        filename = g_strdup_printf("%s.%s", out_layer->value, OUT_EXTENSION);
+    if (layer_data->config->type == LAYER_TYPE_IMAGE && !transformed && ctx->asset_cache) {
+      store_derived_asset(ctx->asset_cache, layer_ID, placeholder_ID, layer_data, assets_dir);
+    }
+
+    if (layer_cache_accepts(ctx->layer_cache, layer_data)) {
+      store_rendered_layer(ctx->layer_cache, template_image->face, layer_name, layer_data, layer_ID);
     }
   }
-  if (!filename) {
-    filename = g_strdup_printf("%d.%s", i, OUT_EXTENSION);
+
+  gint32 final_layer = gimp_image_flatten(new_image_ID);
+  // Raw output and archive take final pixels, variants of archived outputs
+  // are derived from them, so template is rendered once
+  GdkPixbuf* pixbuf = ctx->raw_output || ctx->archive ? drawable_to_pixbuf(final_layer) : NULL;
+  if (ctx->raw_output) {
+    // Consumer takes pixels as they are, nothing is encoded or written
+    gboolean ret = raw_output_publish(ctx->raw_output, out_file, pixbuf, NULL);
+    if (!ret) set_row_failure(ctx, NULL, "unable to publish raw output");
+    g_object_unref(pixbuf);
+    gimp_image_delete(new_image_ID);
+    return ret;
   }
-  const size_t to_sanitize_len = strlen(filename)-strlen(OUT_EXTENSION)-1;
-  for (char* p = filename; p < filename + to_sanitize_len; ++p) {
-    if (!(g_ascii_isalnum(*p) || *p == '-' || *p == '_')) {
-      *p = '_';
-    }
+  if (ctx->archive) {
+    gboolean ret = archive_component_output(ctx->archive, pixbuf, out_file, variants);
+    if (!ret) set_row_failure(ctx, NULL, "unable to add output to archive");
+    g_object_unref(pixbuf);
+    gimp_image_delete(new_image_ID);
+    return ret;
   }
-  gchar* out_file = g_build_filename(out_dir, filename, NULL);
+  // Output is hashed as saved, so its pixels are never read back, and
+  // variants decode it only when they changed
+  gchar* tmp_file = new_temporary_out_file(out_file);
   gboolean ret = gimp_file_save(
       GIMP_RUN_NONINTERACTIVE,
       new_image_ID,
       final_layer,
-      out_file,
-      filename);
+      tmp_file,
+      tmp_file);
   if (!ret) {
     printf("Failed to save image to %s\n", out_file);
+    g_unlink(tmp_file);
+  } else {
+    ret = finish_saved_output(digests, tmp_file, out_file, variants);
   }
-  g_free(filename);
-  g_free(out_file);
+  g_free(tmp_file);
   gimp_image_delete(new_image_ID);
   return ret;
 }
 
-static gboolean generate_components(gint32 image_ID, GPtrArray* components_layers, gchar* assets_dir, gchar* out_dir, gchar* out_key) {
-  int i;
-  for (i = 0; i < components_layers->len; ++i) {
-    GHashTable *component_layers = (GHashTable*)(g_ptr_array_index(components_layers, i));
-    if (!generate_component(i, image_ID, component_layers, assets_dir, out_dir, out_key)) {
-      return FALSE;
+// Renders every row into all XCFs of template back-to-back, so assets
+// prefetched for the row serve all of them
+static gboolean generate_components(GPtrArray* template_images, GPtrArray* components_data, GPtrArray* layer_sizes, gchar* assets_dir, gchar* out_dir, gchar* out_key, GPtrArray* variants, GeneratorContext* ctx) {
+  gboolean ret = TRUE;
+  GArray* rows = unique_component_rows(components_data, ctx->job);
+  GPtrArray* rows_layers = g_ptr_array_sized_new(rows->len);
+  for (guint j = 0; j < rows->len; ++j) {
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(components_data, g_array_index(rows, guint, j));
+    g_ptr_array_add(rows_layers, component_data->layers);
+  }
+
+  // Rendered files of every XCF by row hash
+  GPtrArray* rendered_files = g_ptr_array_new_with_free_func((GDestroyNotify)&g_hash_table_destroy);
+  for (guint face = 0; face < template_images->len; ++face) {
+    g_ptr_array_add(rendered_files, g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free));
+  }
+  // Digests only skip rewriting output files
+  OutputDigests* digests = ctx->archive || ctx->raw_output ? NULL : new_output_digests(out_dir);
+  AssetPrefetcher* prefetcher = new_asset_prefetcher(ctx, rows_layers, layer_sizes, assets_dir);
+  for (guint j = 0; j < rows->len; ++j) {
+    guint i = g_array_index(rows, guint, j);
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(components_data, i);
+    if (memory_monitor_sample(ctx->memory)) {
+      asset_prefetcher_flush(prefetcher);
+      g_ptr_array_foreach(template_images, (GFunc)&template_image_release, NULL);
+      layer_cache_clear(ctx->layer_cache);
+    }
+    asset_prefetcher_advance(prefetcher, j);
+    event_log_row_start(ctx->events);
+    const gchar* first_out_file = NULL;
+    gboolean row_ok = TRUE;
+    for (guint face = 0; face < template_images->len; ++face) {
+      TemplateImage* template_image = (TemplateImage*)g_ptr_array_index(template_images, face);
+      gchar* out_file = new_component_out_file(i, component_data->layers, out_dir, out_key, template_image->suffix, 1);
+      clear_row_failure(ctx);
+      if (!generate_component(template_image, component_data->layers, out_file, assets_dir, prefetcher, digests, variants, ctx)) {
+        report_row_failure(ctx, i, out_file);
+        g_free(out_file);
+        row_ok = FALSE;
+        break;
+      }
+      g_hash_table_insert((GHashTable*)g_ptr_array_index(rendered_files, face), component_data->hash, out_file);
+      if (!first_out_file) first_out_file = out_file;
+    }
+    if (!row_ok && (!ctx->failures || output_broken(ctx))) {
+      ret = FALSE;
+      break;
     }
+    if (!row_ok) {
+      // Keep going with following rows. Failed row gets no copies, not even
+      // of XCFs rendered before the failure.
+      for (guint face = 0; face < rendered_files->len; ++face) {
+        g_hash_table_remove((GHashTable*)g_ptr_array_index(rendered_files, face), component_data->hash);
+      }
+      asset_prefetcher_skip_row(prefetcher, j);
+      continue;
+    }
+    event_log_row_done(ctx->events, i, first_out_file);
+    allocation_tracker_row(ctx->allocations);
+    job_report(ctx->job, "progress", "row %u, %u of %u rendered", i, j + 1, rows->len);
   }
-  return TRUE;
+  del_asset_prefetcher(prefetcher);
+  // Failed rows are reported already, what follows fails whole template
+  clear_row_failure(ctx);
+
+  for (guint face = 0; ret && face < template_images->len; ++face) {
+    TemplateImage* template_image = (TemplateImage*)g_ptr_array_index(template_images, face);
+    GHashTable* face_files = (GHashTable*)g_ptr_array_index(rendered_files, face);
+    if (ctx->raw_output) {
+      ret = raw_output_aliases(ctx->raw_output, ctx->job, components_data, face_files, out_dir, out_key, template_image->suffix);
+      if (!ret) set_row_failure(ctx, NULL, "unable to publish raw output aliases");
+    } else if (ctx->archive) {
+      archive_index_outputs(ctx->archive, ctx->job, components_data, face_files, out_dir, out_key, template_image->suffix, variants);
+    } else {
+      ret = link_component_outputs(digests, ctx->job, components_data, face_files, out_dir, out_key, template_image->suffix, variants);
+      if (!ret) set_row_failure(ctx, NULL, "unable to link outputs of duplicated rows");
+    }
+  }
+  if (ret) {
+    printf("Rendered %u of %u components\n", rows->len, components_data->len);
+  }
+  // Keep digests of outputs written before failure too
+  if (!save_output_digests(digests)) {
+    set_row_failure(ctx, NULL, "unable to save output digests");
+    ret = FALSE;
+  }
+  del_output_digests(digests);
+  g_ptr_array_free(rendered_files, TRUE);
+  g_ptr_array_free(rows_layers, TRUE);
+  g_array_free(rows, TRUE);
+  return ret;
 }
 
-static gboolean generate_from_xcf(gchar* xcfs_dir, gchar* assets_dir, gchar* out_dir, gchar* name, ComponentTemplate* ct) {
-  gchar* xcf_filename = g_strconcat(name, ".xcf", NULL);
-  gchar* xcf_path = g_build_filename(xcfs_dir, xcf_filename, NULL);
-
-  gint32 image_ID = gimp_file_load(GIMP_RUN_NONINTERACTIVE, xcf_path, xcf_path);
-  g_free(xcf_filename);
-  if (image_ID == -1) {
-    g_free(xcf_path);
-    printf("Input file %s not found\n", xcf_path);
-    return FALSE;
+// Loads all XCFs of template. Each of them renders config layers it has and
+// every config layer has to be in at least one of them.
+static GPtrArray* load_template_images(gchar* xcfs_dir, gchar* name, ComponentTemplate* ct, GeneratorContext* ctx, const gchar* precision, gint64* precision_saved) {
+  GPtrArray* template_images = g_ptr_array_new_with_free_func((GDestroyNotify)&del_template_image);
+  GPtrArray* xcf_layers = g_ptr_array_new();
+  gboolean ret = TRUE;
+  for (guint face = 0; ret && face < ct->xcfs->len; ++face) {
+    TemplateXcf* template_xcf = (TemplateXcf*)g_ptr_array_index(ct->xcfs, face);
+    gchar* xcf_path = new_template_xcf_path(xcfs_dir, template_xcf);
+    gint64 saved = 0;
+    gint32 image_ID = load_template_image(xcf_path, NULL, ctx->job ? ctx->job->warm_templates : NULL, precision, &saved);
+    if (image_ID == -1) {
+      set_row_failure(ctx, NULL, "unable to load %s", xcf_path);
+      g_free(xcf_path);
+      ret = FALSE;
+      break;
+    }
+    *precision_saved += saved;
+    GHashTable* layers = new_template_xcf_layers(ct, &image_has_layer, GINT_TO_POINTER(image_ID));
+    g_ptr_array_add(template_images, new_template_image(image_ID, xcf_path, layers, precision, template_xcf->suffix, face));
+    g_ptr_array_add(xcf_layers, layers);
+    ret = prepare_config_layers(image_ID, layers);
+    if (!ret) set_row_failure(ctx, NULL, "unable to prepare config layers of %s", xcf_path);
   }
-  g_free(xcf_path);
-
-  if (!prepare_config_layers(image_ID, ct->layers)) {
-    gimp_image_delete(image_ID);
-    return FALSE;
+  guint uncovered = ret ? check_template_layers_covered(name, ct, xcf_layers) : 0;
+  if (uncovered > 0) {
+    set_row_failure(ctx, NULL, "%u configured layers are in no XCF", uncovered);
+    ret = FALSE;
+  }
+  g_ptr_array_free(xcf_layers, TRUE);
+  if (!ret) {
+    g_ptr_array_free(template_images, TRUE);
+    return NULL;
   }
+  return template_images;
+}
 
-  gchar* components_out_dir = create_components_out_dir(out_dir, name);
+static gboolean generate_from_xcf(gchar* xcfs_dir, gchar* assets_dir, gchar* out_dir, gchar* name, ComponentTemplate* ct, GeneratorContext* ctx) {
+  memory_monitor_begin(ctx->memory);
+  allocation_tracker_begin(ctx->allocations);
+  const gchar* precision = template_precision(ctx->options, name);
+  gint64 precision_saved = 0;
+  GPtrArray* template_images = load_template_images(xcfs_dir, name, ct, ctx, precision, &precision_saved);
+  if (!template_images) return FALSE;
+
+  // Archived outputs are named relative to archive, raw outputs relative to
+  // out directory
+  gchar* components_out_dir = ctx->raw_output ? g_strdup(name)
+                            : ctx->options->archive ? open_template_archive(ctx, out_dir, name)
+                            : create_components_out_dir(out_dir, name);
+  if (components_out_dir && !ctx->archive && !ctx->raw_output && !create_variant_dirs(components_out_dir, ct->variants)) {
+    g_free(components_out_dir);
+    components_out_dir = NULL;
+  }
   if (!components_out_dir) {
-    gimp_image_delete(image_ID);
+    set_row_failure(ctx, NULL, "%s", ctx->options->archive ? "unable to open output archive" : "unable to create output directories");
+    g_ptr_array_free(template_images, TRUE);
     return FALSE;
   }
 
-  gboolean ret = generate_components(image_ID, ct->data, assets_dir, components_out_dir, ct->out_key);
-
+  // Keywords resolve against icons of the XCF rendering the text, so texts
+  // are compiled for every XCF
+  GPtrArray* layer_sizes = g_ptr_array_new_with_free_func((GDestroyNotify)&g_hash_table_destroy);
+  for (guint face = 0; face < template_images->len; ++face) {
+    TemplateImage* template_image = (TemplateImage*)g_ptr_array_index(template_images, face);
+    g_ptr_array_add(layer_sizes, collect_image_layer_sizes(template_image->image_ID, template_image->layers));
+    GHashTable* icon_layers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    add_icon_layers(template_image->image_ID, icon_layers);
+    compile_template_texts(name, ct, face, template_image->layers, icon_layers);
+    g_hash_table_destroy(icon_layers);
+    store_template_icons(template_image, ct);
+  }
+  allocation_tracker_stage(ctx->allocations, "template load");
+  if (ctx->options->text_prepass) {
+    ctx->text_prepass = run_text_prepass(template_images, ct, ctx);
+    allocation_tracker_stage(ctx->allocations, "text prepass");
+  }
+  if (ctx->options->layer_cache_bytes > 0) {
+    ctx->layer_cache = new_layer_cache(ctx->options->layer_cache_bytes);
+  }
+  gboolean ret = generate_components(template_images, ct->data, layer_sizes, assets_dir, components_out_dir, ct->out_key, ct->variants, ctx);
+  allocation_tracker_stage(ctx->allocations, "rows");
+
+  del_text_prepass(ctx->text_prepass);
+  ctx->text_prepass = NULL;
+  layer_cache_report(ctx->layer_cache);
+  del_layer_cache(ctx->layer_cache);
+  ctx->layer_cache = NULL;
+  g_ptr_array_free(template_images, TRUE);
+  g_ptr_array_free(layer_sizes, TRUE);
   g_free(components_out_dir);
-  gimp_image_delete(image_ID);
+  memory_monitor_report(ctx->memory, name);
+  allocation_tracker_stage(ctx->allocations, "cleanup");
+  if (!allocation_tracker_report(ctx->allocations, name)) {
+    set_row_failure(ctx, NULL, "memory grows by more than %" G_GINT64_FORMAT " B per row", ctx->allocations->max_row_growth);
+    ret = FALSE;
+  }
+  if (!close_template_archive(ctx, ret) && ret) {
+    set_row_failure(ctx, NULL, "unable to close output archive");
+    ret = FALSE;
+  }
+  if (precision_saved > 0) {
+    printf("Working precision %s saved %.1f MiB in component images of every row of %s\n", precision, precision_saved / 1048576.0, name);
+  }
 
   return ret;
 }
@@ -1613,6 +6104,32 @@ static void query (void)
 
   gimp_plugin_menu_register (PLUG_IN_PROC,
                              "<Image>/File/Export");
+
+  static GimpParamDef server_args[] = {
+    {
+      GIMP_PDB_INT32,
+      "run-mode",
+      "Run mode"
+    },
+    {
+      GIMP_PDB_STRING,
+      "socket_path",
+      "Socket path"
+    }
+  };
+
+  gimp_install_procedure (
+    SERVER_PROC,
+    "Boardgame component generator job server",
+    "Renders jobs received on UNIX socket until shut down",
+    "Marcin Niesluchowski",
+    "Marcin Niesluchowski",
+    "2025",
+    NULL,
+    NULL,
+    GIMP_PLUGIN,
+    G_N_ELEMENTS (server_args), 0,
+    server_args, NULL);
 }
 
 static void run (
@@ -1633,9 +6150,13 @@ static void run (
 
   run_mode = param[0].data.d_int32;
 
+  gegl_init(NULL, NULL);
+
+  gboolean server = g_strcmp0(name, SERVER_PROC) == 0;
+
   switch (run_mode) {
     case GIMP_RUN_NONINTERACTIVE:
-      if (generate_from_project(param[1].data.d_string)) {
+      if (server ? run_job_server(param[1].data.d_string) : generate_from_project(param[1].data.d_string, NULL)) {
         values[0].data.d_status = GIMP_PDB_SUCCESS;
       } else {
         values[0].data.d_status = GIMP_PDB_EXECUTION_ERROR;
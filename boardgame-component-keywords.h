@@ -0,0 +1,119 @@
+// Keyword scanning of text layer values shared by plugin and standalone tools.
+// Keywords are layer names in double angle brackets, e.g. <<coin>>, which
+// plugin replaces with icons inline in text. Depends only on GLib.
+#ifndef BOARDGAME_COMPONENT_KEYWORDS_H
+#define BOARDGAME_COMPONENT_KEYWORDS_H
+
+#include <string.h>
+#include <glib.h>
+
+typedef struct {
+  // Offset and length of whole <<name>> in original text
+  gsize start;
+  gsize length;
+  // Offset of spaces replacing keyword in processed text
+  gsize position;
+} KeywordSpan;
+
+// Spans of all <<keyword>> occurrences in text, in order
+static inline GArray* find_keyword_spans(const gchar* text) {
+  GArray* spans = g_array_new(FALSE, FALSE, sizeof(KeywordSpan));
+  const gchar* current = text;
+  while ((current = strstr(current, "<<")) != NULL) {
+    const gchar* start = current + 2;
+    const gchar* end = strstr(start, ">>");
+    if (!end) break;
+    if (end > start) {
+      KeywordSpan span = {current - text, end + 2 - current, 0};
+      g_array_append_val(spans, span);
+      current = end + 2;
+    } else {
+      current = start;
+    }
+  }
+  return spans;
+}
+
+static inline gchar* keyword_span_name(const gchar* text, const KeywordSpan* span) {
+  return g_strndup(text + span->start + 2, span->length - 4);
+}
+
+// Replaces keywords of spans, which have to be ordered and not overlapping,
+// with two spaces each and stores where the spaces are in returned text.
+static inline gchar* replace_keyword_spans_with_spaces(const gchar* text, GArray* spans) {
+  GString* result = g_string_sized_new(strlen(text));
+  gsize last_pos = 0;
+  for (guint i = 0; i < spans->len; ++i) {
+    KeywordSpan* span = &g_array_index(spans, KeywordSpan, i);
+    g_string_append_len(result, text + last_pos, span->start - last_pos);
+    span->position = result->len;
+    g_string_append(result, "  ");
+    last_pos = span->start + span->length;
+  }
+  g_string_append(result, text + last_pos);
+  return g_string_free(result, FALSE);
+}
+
+// Text value with keywords resolved against layers of template, compiled
+// once per template so rendering rows never scans text again
+typedef struct {
+  // Value with every resolved keyword replaced by two spaces
+  gchar* text;
+  // Layer names of resolved keywords and offsets of their spaces in text
+  GPtrArray* layer_names;
+  GArray* positions;
+  // Icons of resolved keywords, values of icon_layers they were resolved
+  // against, not owned
+  GPtrArray* icons;
+} CompiledText;
+
+static inline CompiledText* new_compiled_text(gchar* text, GPtrArray* layer_names, GArray* positions, GPtrArray* icons) {
+  CompiledText* ct = g_malloc(sizeof(CompiledText));
+  ct->text = text;
+  ct->layer_names = layer_names;
+  ct->positions = positions;
+  ct->icons = icons;
+  return ct;
+}
+
+static inline void del_compiled_text(CompiledText* ct) {
+  if (!ct) return;
+  g_free(ct->text);
+  g_ptr_array_free(ct->layer_names, TRUE);
+  g_array_free(ct->positions, TRUE);
+  g_ptr_array_free(ct->icons, TRUE);
+  g_free(ct);
+}
+
+// Compiles value with keyword spans found when config was loaded. Keywords
+// resolve to values of icon_layers under their names, keywords whose names
+// are not in icon_layers stay in text and their names are added to
+// unresolved, when given.
+static inline CompiledText* compile_text(const gchar* value, GArray* spans, GHashTable* icon_layers, GPtrArray* unresolved) {
+  GArray* resolved = g_array_sized_new(FALSE, FALSE, sizeof(KeywordSpan), spans ? spans->len : 0);
+  GPtrArray* layer_names = g_ptr_array_new_with_free_func(g_free);
+  GPtrArray* icons = g_ptr_array_new();
+  for (guint i = 0; spans && i < spans->len; ++i) {
+    KeywordSpan* span = &g_array_index(spans, KeywordSpan, i);
+    gchar* layer_name = keyword_span_name(value, span);
+    gpointer icon;
+    if (g_hash_table_lookup_extended(icon_layers, layer_name, NULL, &icon)) {
+      g_array_append_val(resolved, *span);
+      g_ptr_array_add(layer_names, layer_name);
+      g_ptr_array_add(icons, icon);
+    } else if (unresolved) {
+      g_ptr_array_add(unresolved, layer_name);
+    } else {
+      g_free(layer_name);
+    }
+  }
+  gchar* text = replace_keyword_spans_with_spaces(value, resolved);
+  GArray* positions = g_array_sized_new(FALSE, FALSE, sizeof(gsize), resolved->len);
+  for (guint i = 0; i < resolved->len; ++i) {
+    g_array_append_val(positions, g_array_index(resolved, KeywordSpan, i).position);
+  }
+  g_array_free(resolved, TRUE);
+  return new_compiled_text(text, layer_names, positions, icons);
+}
+
+#endif // BOARDGAME_COMPONENT_KEYWORDS_H
@@ -0,0 +1,196 @@
+// Asset pack, single file holding all assets of project, shared by plugin and
+// tools/pack-assets. Plugin maps it once instead of opening thousands of
+// small files and hands asset bytes to decoders straight from the mapping.
+// Depends only on GLib.
+//
+// Layout: 8 bytes magic, index size as little endian 64 bit integer, index
+// and padding to 8 bytes, then data of all assets. Index is GVariant in
+// little endian byte order mapping asset path relative to assets directory,
+// always with '/' separators, to offset from start of data, length and
+// modification time of source file in nanoseconds. Assets whose source file
+// changed since packing are read from the file instead.
+#ifndef BOARDGAME_COMPONENT_PACK_H
+#define BOARDGAME_COMPONENT_PACK_H
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#define ASSET_PACK_MAGIC "BGCPACK2"
+#define ASSET_PACK_INDEX_TYPE "a{s(ttx)}"
+#define ASSET_PACK_HEADER_SIZE 16
+
+// Offset of data following index of given size
+static inline guint64 asset_pack_data_offset(guint64 index_size) {
+  return (ASSET_PACK_HEADER_SIZE + index_size + 7) & ~(guint64)7;
+}
+
+// Modification time of file in nanoseconds, as stored in index
+static inline gint64 asset_pack_mtime_ns(const GStatBuf* st) {
+#ifdef G_OS_WIN32
+  return (gint64)st->st_mtime * G_GINT64_CONSTANT(1000000000);
+#else
+  return (gint64)st->st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) + st->st_mtim.tv_nsec;
+#endif
+}
+
+typedef struct {
+  guint64 offset;
+  guint64 length;
+  gint64 mtime_ns;
+} AssetPackEntry;
+
+typedef struct {
+  GMappedFile* file;
+  const gchar* data;
+  GVariant* index;
+  AssetPackEntry* entries;
+  // Asset name -> AssetPackEntry*, names point into index
+  GHashTable* names;
+  // Assets directory pack replaces, for lookups by full path
+  gchar* root;
+  // Names of assets already reported as changed since packing, lookups may
+  // come from several threads
+  GHashTable* reported;
+  GMutex mutex;
+} AssetPack;
+
+static inline void del_asset_pack(AssetPack* pack) {
+  if (!pack) return;
+  g_hash_table_destroy(pack->names);
+  g_hash_table_destroy(pack->reported);
+  g_mutex_clear(&pack->mutex);
+  g_free(pack->entries);
+  g_variant_unref(pack->index);
+  g_mapped_file_unref(pack->file);
+  g_free(pack->root);
+  g_free(pack);
+}
+
+// Maps pack and reads its index. Returns NULL when pack is missing or
+// damaged, reason is printed.
+static inline AssetPack* new_asset_pack(const gchar* pack_path, const gchar* root) {
+  GError* error = NULL;
+  GMappedFile* file = g_mapped_file_new(pack_path, FALSE, &error);
+  if (!file) {
+    printf("Unable to open asset pack %s: %s\n", pack_path, error->message);
+    g_error_free(error);
+    return NULL;
+  }
+  gsize size = g_mapped_file_get_length(file);
+  const gchar* contents = g_mapped_file_get_contents(file);
+  guint64 index_size = 0;
+  if (size >= ASSET_PACK_HEADER_SIZE && memcmp(contents, ASSET_PACK_MAGIC, 8) == 0) {
+    memcpy(&index_size, contents + 8, sizeof(index_size));
+    index_size = GUINT64_FROM_LE(index_size);
+  }
+  if (size >= ASSET_PACK_HEADER_SIZE && memcmp(contents, "BGCPACK", 7) == 0 && memcmp(contents, ASSET_PACK_MAGIC, 8) != 0) {
+    printf("Asset pack %s was built by older version of pack-assets, rebuild it\n", pack_path);
+    g_mapped_file_unref(file);
+    return NULL;
+  }
+  if (size < ASSET_PACK_HEADER_SIZE || memcmp(contents, ASSET_PACK_MAGIC, 8) != 0 ||
+      index_size > size - ASSET_PACK_HEADER_SIZE || asset_pack_data_offset(index_size) > size) {
+    printf("%s is not an asset pack\n", pack_path);
+    g_mapped_file_unref(file);
+    return NULL;
+  }
+
+  AssetPack* pack = g_malloc(sizeof(AssetPack));
+  pack->file = file;
+  pack->data = contents + asset_pack_data_offset(index_size);
+  GBytes* index_bytes = g_bytes_new_with_free_func(contents + ASSET_PACK_HEADER_SIZE, index_size,
+                                                   (GDestroyNotify)&g_mapped_file_unref, g_mapped_file_ref(file));
+  pack->index = g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE(ASSET_PACK_INDEX_TYPE), index_bytes, FALSE));
+  g_bytes_unref(index_bytes);
+  if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+    GVariant* swapped = g_variant_ref_sink(g_variant_byteswap(pack->index));
+    g_variant_unref(pack->index);
+    pack->index = swapped;
+  }
+  pack->root = g_strdup(root);
+  pack->reported = g_hash_table_new_full(g_str_hash, g_str_equal, &g_free, NULL);
+  g_mutex_init(&pack->mutex);
+
+  // Entries outside of data are damaged and left out, so lookups never read
+  // past the mapping
+  guint64 data_size = size - asset_pack_data_offset(index_size);
+  gsize n_entries = g_variant_n_children(pack->index);
+  pack->entries = g_new(AssetPackEntry, MAX(n_entries, 1));
+  pack->names = g_hash_table_new(g_str_hash, g_str_equal);
+  GVariantIter iter;
+  const gchar* name;
+  guint64 offset, length;
+  gint64 mtime_ns;
+  guint damaged = 0;
+  gsize i = 0;
+  g_variant_iter_init(&iter, pack->index);
+  while (g_variant_iter_next(&iter, "{&s(ttx)}", &name, &offset, &length, &mtime_ns)) {
+    if (offset > data_size || length > data_size - offset) {
+      ++damaged;
+      continue;
+    }
+    pack->entries[i].offset = offset;
+    pack->entries[i].length = length;
+    pack->entries[i].mtime_ns = mtime_ns;
+    g_hash_table_insert(pack->names, (gpointer)name, &pack->entries[i]);
+    ++i;
+  }
+  if (damaged > 0) {
+    printf("Asset pack %s has %u damaged entries\n", pack_path, damaged);
+  }
+  return pack;
+}
+
+// Bytes of asset stored under name, referencing mapping of pack, or NULL
+// when pack has no such asset
+static inline GBytes* asset_pack_lookup(AssetPack* pack, const gchar* name) {
+  AssetPackEntry* entry = (AssetPackEntry*)g_hash_table_lookup(pack->names, name);
+  if (!entry) return NULL;
+  return g_bytes_new_with_free_func(pack->data + entry->offset, entry->length,
+                                    (GDestroyNotify)&g_mapped_file_unref, g_mapped_file_ref(pack->file));
+}
+
+// Name in pack of asset file path under root, NULL for other paths
+static inline gchar* asset_pack_name(AssetPack* pack, const gchar* path) {
+  gsize root_length = strlen(pack->root);
+  if (strncmp(path, pack->root, root_length) != 0 || !G_IS_DIR_SEPARATOR(path[root_length])) return NULL;
+  gchar* name = g_strdup(path + root_length + 1);
+  if (G_DIR_SEPARATOR != '/') g_strdelimit(name, G_DIR_SEPARATOR_S, '/');
+  return name;
+}
+
+// Prints reason once per asset
+static inline void asset_pack_report(AssetPack* pack, const gchar* name, const gchar* reason) {
+  g_mutex_lock(&pack->mutex);
+  if (!g_hash_table_contains(pack->reported, name)) {
+    g_hash_table_add(pack->reported, g_strdup(name));
+    printf("Warning: asset %s %s, reading it from assets directory, rebuild asset pack\n", name, reason);
+  }
+  g_mutex_unlock(&pack->mutex);
+}
+
+// Bytes of asset file path under root. NULL when pack has no such asset or
+// source file changed since packing, so caller reads the file instead.
+// Assets whose source file is gone are still served from pack, so pack can
+// be shipped without assets directory.
+static inline GBytes* asset_pack_lookup_path(AssetPack* pack, const gchar* path) {
+  gchar* name = asset_pack_name(pack, path);
+  if (!name) return NULL;
+  AssetPackEntry* entry = (AssetPackEntry*)g_hash_table_lookup(pack->names, name);
+  GStatBuf st;
+  gboolean source_exists = g_stat(path, &st) == 0;
+  GBytes* bytes = NULL;
+  if (!entry) {
+    if (source_exists) asset_pack_report(pack, name, "is missing from asset pack");
+  } else if (source_exists && ((guint64)st.st_size != entry->length || asset_pack_mtime_ns(&st) != entry->mtime_ns)) {
+    asset_pack_report(pack, name, "changed since asset pack was built");
+  } else {
+    bytes = asset_pack_lookup(pack, name);
+  }
+  g_free(name);
+  return bytes;
+}
+
+#endif // BOARDGAME_COMPONENT_PACK_H
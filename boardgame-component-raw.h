@@ -0,0 +1,56 @@
+// Layout of raw output ring, memory mapped file into which plugin publishes
+// raw pixels of finished components for local consumers, e.g. importers
+// uploading them as textures, instead of encoding PNG files they would
+// decode right away. Depends only on GLib.
+//
+// File starts with RawRingHeader followed by slot_count slots of slot_size
+// bytes. Frame n is in slot n % slot_count, RawFrameHeader followed by
+// pixels. Plugin publishes frame n by setting write_seq to n + 1 and reuses
+// its slot only after consumer releases it by setting read_seq to n + 1, so
+// slow consumer slows generation down instead of losing frames. Sequences
+// are 32 bit counters which wrap around, compare their differences. Plugin
+// sets closed after its last frame. Plugin writes magic last when creating
+// ring, so consumers wait for it before reading other fields.
+#ifndef BOARDGAME_COMPONENT_RAW_H
+#define BOARDGAME_COMPONENT_RAW_H
+
+#include <glib.h>
+
+#define RAW_RING_MAGIC "BGCRAW01"
+#define RAW_RING_VERSION 1
+
+typedef enum {
+  // No pixels, output has the same pixels as output named in source, e.g.
+  // duplicated row or extra copy
+  RAW_FRAME_ALIAS = 0,
+  RAW_FRAME_RGBA8 = 1,
+  RAW_FRAME_RGB8 = 2
+} RawFrameFormat;
+
+typedef struct {
+  gchar magic[8];
+  guint32 version;
+  guint32 slot_count;
+  guint64 slot_size;
+  volatile gint write_seq;
+  volatile gint read_seq;
+  volatile gint closed;
+  guint32 reserved[7];
+} RawRingHeader;
+
+typedef struct {
+  guint32 width;
+  guint32 height;
+  // Bytes between starts of rows, last row is not padded
+  guint32 stride;
+  guint32 format;
+  // Name output would have in out directory, e.g. card/name.png
+  gchar name[504];
+  // Name of output with the same pixels for alias frames, empty otherwise
+  gchar source[504];
+} RawFrameHeader;
+
+G_STATIC_ASSERT(sizeof(RawRingHeader) == 64);
+G_STATIC_ASSERT(sizeof(RawFrameHeader) == 1024);
+
+#endif // BOARDGAME_COMPONENT_RAW_H
@@ -0,0 +1,35 @@
+#!/bin/bash
+
+SOURCE="${BASH_SOURCE[0]}"
+while [ -h "$SOURCE" ]; do # resolve $SOURCE until the file is no longer a symlink
+  DIR="$( cd -P "$( dirname "$SOURCE" )" >/dev/null 2>&1 && pwd )"
+  SOURCE="$(readlink "$SOURCE")"
+  [[ $SOURCE != /* ]] && SOURCE="$DIR/$SOURCE" # if $SOURCE was a relative symlink, we need to resolve it relative to the path where the symlink file was located
+done
+SCRIPT_DIR="$( cd -P "$( dirname "$SOURCE" )" >/dev/null 2>&1 && pwd )"
+
+SOCKET_PATH="${1:-/tmp/boardgame-component-generator.sock}"
+
+GIMP_MAJOR_VERSION="$(gimp --version | awk '{print $NF}' | cut -d. -f1)"
+GIMPTOOL_BIN="gimptool-$GIMP_MAJOR_VERSION.0"
+
+if ! command -v $GIMPTOOL_BIN >/dev/null 2>&1 ; then
+  echo "Installing $GIMPTOOL_BIN"
+  sudo apt install -y libgimp$GIMP_MAJOR_VERSION.0-dev
+fi
+
+# Large assets are downscaled while decoding with libjpeg and libpng
+ASSET_PACKAGES="libjpeg libpng"
+if ! pkg-config --exists $ASSET_PACKAGES ; then
+  echo "Installing libjpeg and libpng development packages"
+  sudo apt install -y libjpeg-dev libpng-dev
+fi
+
+CFLAGS="$CFLAGS $(pkg-config --cflags $ASSET_PACKAGES)" LIBS="$LIBS $(pkg-config --libs $ASSET_PACKAGES)" \
+  $GIMPTOOL_BIN --install "$SCRIPT_DIR/boardgame-component-generator.c"
+if [ $GIMP_MAJOR_VERSION -lt 3 ] ; then
+  gimp -i -b "(boardgame-component-generator-server RUN-NONINTERACTIVE \"$SOCKET_PATH\")" -b '(gimp-quit 0)'
+else
+  gimp --batch-interpreter=plug-in-script-fu-eval -i -b "(boardgame-component-generator-server #:run_mode 1 #:socket-path \"$SOCKET_PATH\")" -b '(gimp-quit 0)'
+fi
+$GIMPTOOL_BIN --uninstall-bin boardgame-component-generator
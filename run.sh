@@ -21,7 +21,15 @@ if ! command -v $GIMPTOOL_BIN >/dev/null 2>&1 ; then
   sudo apt install -y libgimp$GIMP_MAJOR_VERSION.0-dev
 fi
 
-$GIMPTOOL_BIN --install "$SCRIPT_DIR/boardgame-component-generator.c"
+# Large assets are downscaled while decoding with libjpeg and libpng
+ASSET_PACKAGES="libjpeg libpng"
+if ! pkg-config --exists $ASSET_PACKAGES ; then
+  echo "Installing libjpeg and libpng development packages"
+  sudo apt install -y libjpeg-dev libpng-dev
+fi
+
+CFLAGS="$CFLAGS $(pkg-config --cflags $ASSET_PACKAGES)" LIBS="$LIBS $(pkg-config --libs $ASSET_PACKAGES)" \
+  $GIMPTOOL_BIN --install "$SCRIPT_DIR/boardgame-component-generator.c"
 if [ $GIMP_MAJOR_VERSION -lt 3 ] ; then
   gimp -i -b "(boardgame-component-generator RUN-NONINTERACTIVE \"$1\")" -b '(gimp-quit 0)'
 else
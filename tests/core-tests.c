@@ -0,0 +1,368 @@
+// Unit tests of GIMP independent core of plugin: config parsing, keyword
+// scanning and compiling, output names, layer types and asset packs. Built
+// and run by tools/build.sh, needs neither GIMP nor project.
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "boardgame-component-config.h"
+#include "boardgame-component-keywords.h"
+#include "boardgame-component-pack.h"
+
+// Writes contents into config file in new temporary directory and parses it
+static GHashTable* parse_config_string(const gchar* contents) {
+  gchar* dir = g_dir_make_tmp("core-tests-XXXXXX", NULL);
+  g_assert_nonnull(dir);
+  gchar* config_path = g_build_filename(dir, "config.json", NULL);
+  g_assert_true(g_file_set_contents(config_path, contents, -1, NULL));
+  GHashTable* xcfs = parse_json_config(config_path);
+  g_unlink(config_path);
+  g_rmdir(dir);
+  g_free(config_path);
+  g_free(dir);
+  return xcfs;
+}
+
+static void test_config_valid(void) {
+  GHashTable* xcfs = parse_config_string(
+    "{\"card\": {"
+    "  \"out\": \"name\","
+    "  \"layers\": {\"name\": \"text\", \"art\": \"image\", \"gold\": \"bool\","
+    "             \"rules\": {\"value\": \"text\", \"vcenter\": 1, \"rotate\": 90}},"
+    "  \"data\": ["
+    "    {\"name\": \"Farm\", \"art\": \"farm.png\", \"rules\": \"Gain <<coin>>\"},"
+    "    {\"name\": \"Mine\", \"gold\": \"true\", \"count\": 3}"
+    "  ],"
+    "  \"variants\": [{\"scale\": 0.5, \"format\": \"jpg\", \"dir\": \"small\"}],"
+    "  \"xcfs\": [{\"xcf\": \"card_front\"}, {\"xcf\": \"card_back\", \"suffix\": \"_back\"}]"
+    "}}");
+  g_assert_nonnull(xcfs);
+  g_assert_cmpuint(g_hash_table_size(xcfs), ==, 1);
+  ComponentTemplate* ct = (ComponentTemplate*)g_hash_table_lookup(xcfs, "card");
+  g_assert_nonnull(ct);
+  g_assert_cmpstr(ct->out_key, ==, "name");
+
+  LayerConfig* rules = (LayerConfig*)g_hash_table_lookup(ct->layers, "rules");
+  g_assert_nonnull(rules);
+  g_assert_cmpint(rules->type, ==, LAYER_TYPE_TEXT);
+  g_assert_cmpint(rules->vcenter, ==, 1);
+  g_assert_cmpfloat(rules->rotate, ==, 90.0);
+  g_assert_cmpint(((LayerConfig*)g_hash_table_lookup(ct->layers, "gold"))->type, ==, LAYER_TYPE_BOOL);
+
+  g_assert_cmpuint(ct->data->len, ==, 2);
+  ComponentData* farm = (ComponentData*)g_ptr_array_index(ct->data, 0);
+  ComponentData* mine = (ComponentData*)g_ptr_array_index(ct->data, 1);
+  g_assert_cmpint(farm->count, ==, 1);
+  g_assert_cmpint(mine->count, ==, 3);
+  g_assert_false(g_hash_table_contains(mine->layers, "count"));
+  g_assert_cmpstr(farm->hash, !=, mine->hash);
+  LayerData* farm_rules = (LayerData*)g_hash_table_lookup(farm->layers, "rules");
+  g_assert_cmpstr(farm_rules->value, ==, "Gain <<coin>>");
+  g_assert_cmpuint(farm_rules->keywords->len, ==, 1);
+  g_assert_null(((LayerData*)g_hash_table_lookup(farm->layers, "art"))->keywords);
+
+  g_assert_cmpuint(ct->variants->len, ==, 1);
+  OutputVariant* variant = (OutputVariant*)g_ptr_array_index(ct->variants, 0);
+  g_assert_cmpstr(variant->format, ==, "jpeg");
+  g_assert_cmpint(variant->quality, ==, 90);
+
+  g_assert_cmpuint(ct->xcfs->len, ==, 2);
+  g_assert_cmpstr(((TemplateXcf*)g_ptr_array_index(ct->xcfs, 1))->suffix, ==, "_back");
+  g_hash_table_destroy(xcfs);
+}
+
+static void test_config_default_xcf(void) {
+  GHashTable* xcfs = parse_config_string("{\"token\": {\"layers\": {\"label\": \"text\"}, \"data\": []}}");
+  g_assert_nonnull(xcfs);
+  ComponentTemplate* ct = (ComponentTemplate*)g_hash_table_lookup(xcfs, "token");
+  g_assert_cmpuint(ct->data->len, ==, 0);
+  g_assert_cmpuint(ct->xcfs->len, ==, 1);
+  TemplateXcf* xcf = (TemplateXcf*)g_ptr_array_index(ct->xcfs, 0);
+  g_assert_cmpstr(xcf->name, ==, "token");
+  g_assert_null(xcf->suffix);
+  g_hash_table_destroy(xcfs);
+}
+
+static void test_config_invalid(void) {
+  static const gchar* configs[] = {
+    // Not JSON
+    "{\"card\": {\"layers\": ",
+    // Unknown layer type
+    "{\"card\": {\"layers\": {\"name\": \"sound\"}, \"data\": []}}",
+    // Missing data
+    "{\"card\": {\"layers\": {\"name\": \"text\"}}}",
+    // Data of layer not in layers
+    "{\"card\": {\"layers\": {\"name\": \"text\"}, \"data\": [{\"title\": \"Farm\"}]}}",
+    // Copy count out of range
+    "{\"card\": {\"layers\": {\"name\": \"text\"}, \"data\": [{\"name\": \"Farm\", \"count\": 0}]}}",
+    // Variant scale out of range
+    "{\"card\": {\"layers\": {\"name\": \"text\"}, \"data\": [], \"variants\": [{\"scale\": 2, \"dir\": \"big\"}]}}",
+    // Variant overwriting main output
+    "{\"card\": {\"layers\": {\"name\": \"text\"}, \"data\": [], \"variants\": [{\"scale\": 0.5}]}}",
+    // Xcfs with the same suffix
+    "{\"card\": {\"layers\": {\"name\": \"text\"}, \"data\": [], \"xcfs\": [{\"xcf\": \"a\"}, {\"xcf\": \"b\"}]}}",
+    NULL
+  };
+  for (const gchar** config = configs; *config; ++config) {
+    GHashTable* xcfs = parse_config_string(*config);
+    if (xcfs) g_error("Config accepted: %s", *config);
+  }
+}
+
+static void test_keyword_spans(void) {
+  const gchar* text = "Pay <<coin>> to draw <<card>>.";
+  GArray* spans = find_keyword_spans(text);
+  g_assert_cmpuint(spans->len, ==, 2);
+  KeywordSpan* first = &g_array_index(spans, KeywordSpan, 0);
+  KeywordSpan* second = &g_array_index(spans, KeywordSpan, 1);
+  g_assert_cmpuint(first->start, ==, 4);
+  g_assert_cmpuint(first->length, ==, 8);
+  g_assert_cmpuint(second->start, ==, 21);
+  gchar* name = keyword_span_name(text, second);
+  g_assert_cmpstr(name, ==, "card");
+  g_free(name);
+
+  gchar* replaced = replace_keyword_spans_with_spaces(text, spans);
+  g_assert_cmpstr(replaced, ==, "Pay    to draw  .");
+  g_assert_cmpuint(first->position, ==, 4);
+  g_assert_cmpuint(second->position, ==, 15);
+  g_free(replaced);
+  g_array_free(spans, TRUE);
+}
+
+static void test_keyword_spans_adjacent(void) {
+  const gchar* text = "<<coin>><<coin>>x";
+  GArray* spans = find_keyword_spans(text);
+  g_assert_cmpuint(spans->len, ==, 2);
+  g_assert_cmpuint(g_array_index(spans, KeywordSpan, 0).start, ==, 0);
+  g_assert_cmpuint(g_array_index(spans, KeywordSpan, 1).start, ==, 8);
+  gchar* replaced = replace_keyword_spans_with_spaces(text, spans);
+  g_assert_cmpstr(replaced, ==, "    x");
+  g_assert_cmpuint(g_array_index(spans, KeywordSpan, 1).position, ==, 2);
+  g_free(replaced);
+  g_array_free(spans, TRUE);
+}
+
+static void test_keyword_spans_unterminated(void) {
+  // Keyword without closing brackets and empty keyword stay text
+  const gchar* text = "Gain <<coin>>, <<>> and <<gem";
+  GArray* spans = find_keyword_spans(text);
+  g_assert_cmpuint(spans->len, ==, 1);
+  gchar* replaced = replace_keyword_spans_with_spaces(text, spans);
+  g_assert_cmpstr(replaced, ==, "Gain   , <<>> and <<gem");
+  g_free(replaced);
+  g_array_free(spans, TRUE);
+
+  spans = find_keyword_spans("<<coin");
+  g_assert_cmpuint(spans->len, ==, 0);
+  g_array_free(spans, TRUE);
+  spans = find_keyword_spans("");
+  g_assert_cmpuint(spans->len, ==, 0);
+  g_array_free(spans, TRUE);
+}
+
+static void test_compile_text(void) {
+  const gchar* value = "Pay <<coin>> for <<gem>>";
+  GArray* spans = find_keyword_spans(value);
+  GHashTable* icon_layers = g_hash_table_new(g_str_hash, g_str_equal);
+  gint coin_icon = 0;
+  g_hash_table_insert(icon_layers, "coin", &coin_icon);
+  GPtrArray* unresolved = g_ptr_array_new_with_free_func(g_free);
+
+  CompiledText* compiled = compile_text(value, spans, icon_layers, unresolved);
+  g_assert_cmpstr(compiled->text, ==, "Pay    for <<gem>>");
+  g_assert_cmpuint(compiled->layer_names->len, ==, 1);
+  g_assert_cmpstr(g_ptr_array_index(compiled->layer_names, 0), ==, "coin");
+  g_assert_cmpuint(compiled->positions->len, ==, 1);
+  g_assert_cmpuint(g_array_index(compiled->positions, gsize, 0), ==, 4);
+  g_assert_true(g_ptr_array_index(compiled->icons, 0) == &coin_icon);
+  g_assert_cmpuint(unresolved->len, ==, 1);
+  g_assert_cmpstr(g_ptr_array_index(unresolved, 0), ==, "gem");
+  del_compiled_text(compiled);
+
+  // Without icons nothing resolves and unresolved names are optional
+  g_hash_table_remove_all(icon_layers);
+  compiled = compile_text(value, spans, icon_layers, NULL);
+  g_assert_cmpstr(compiled->text, ==, value);
+  g_assert_cmpuint(compiled->layer_names->len, ==, 0);
+  del_compiled_text(compiled);
+
+  // Value without keywords has no spans
+  compiled = compile_text("Plain", NULL, icon_layers, unresolved);
+  g_assert_cmpstr(compiled->text, ==, "Plain");
+  g_assert_cmpuint(compiled->positions->len, ==, 0);
+  del_compiled_text(compiled);
+
+  g_ptr_array_free(unresolved, TRUE);
+  g_hash_table_destroy(icon_layers);
+  g_array_free(spans, TRUE);
+}
+
+// Front and back of card both render rules, but only front has coin icon
+static void test_compile_template_faces(void) {
+  GHashTable* xcfs = parse_config_string(
+    "{\"card\": {"
+    "  \"layers\": {\"rules\": \"text\", \"flavor\": \"text\", \"coin\": \"image\"},"
+    "  \"data\": [{\"rules\": \"Gain <<coin>>\", \"flavor\": \"Shiny <<coin>>\"}],"
+    "  \"xcfs\": [{\"xcf\": \"card_front\"}, {\"xcf\": \"card_back\", \"suffix\": \"_back\"}]"
+    "}}");
+  g_assert_nonnull(xcfs);
+  ComponentTemplate* ct = (ComponentTemplate*)g_hash_table_lookup(xcfs, "card");
+  GHashTable* front_layers = g_hash_table_new(g_str_hash, g_str_equal);
+  g_hash_table_add(front_layers, "rules");
+  g_hash_table_add(front_layers, "flavor");
+  g_hash_table_add(front_layers, "coin");
+  GHashTable* back_layers = g_hash_table_new(g_str_hash, g_str_equal);
+  g_hash_table_add(back_layers, "rules");
+  GHashTable* front_icons = g_hash_table_new(g_str_hash, g_str_equal);
+  g_hash_table_add(front_icons, "coin");
+  GHashTable* back_icons = g_hash_table_new(g_str_hash, g_str_equal);
+
+  g_assert_cmpuint(compile_template_texts("card", ct, 0, front_layers, front_icons), ==, 0);
+  g_assert_cmpuint(compile_template_texts("card", ct, 1, back_layers, back_icons), ==, 1);
+
+  ComponentData* row = (ComponentData*)g_ptr_array_index(ct->data, 0);
+  LayerData* rules = (LayerData*)g_hash_table_lookup(row->layers, "rules");
+  LayerData* flavor = (LayerData*)g_hash_table_lookup(row->layers, "flavor");
+  CompiledText* front = layer_data_compiled(rules, 0);
+  g_assert_cmpstr(front->text, ==, "Gain   ");
+  g_assert_cmpuint(front->layer_names->len, ==, 1);
+  // Back has no coin to copy, so keyword stays text instead of leaving gap
+  CompiledText* back = layer_data_compiled(rules, 1);
+  g_assert_cmpstr(back->text, ==, "Gain <<coin>>");
+  g_assert_cmpuint(back->layer_names->len, ==, 0);
+  // Back does not render flavor at all
+  g_assert_nonnull(layer_data_compiled(flavor, 0));
+  g_assert_null(layer_data_compiled(flavor, 1));
+  g_assert_null(layer_data_compiled(flavor, 2));
+
+  g_hash_table_destroy(back_icons);
+  g_hash_table_destroy(front_icons);
+  g_hash_table_destroy(back_layers);
+  g_hash_table_destroy(front_layers);
+  g_hash_table_destroy(xcfs);
+}
+
+static void test_sanitize_out_name(void) {
+  gchar* name = g_strdup("Sky Tower/2.v-1_a");
+  g_assert_cmpstr(sanitize_out_name(name), ==, "Sky_Tower_2_v-1_a");
+  g_free(name);
+  name = g_strdup("..");
+  g_assert_cmpstr(sanitize_out_name(name), ==, "__");
+  g_free(name);
+  name = g_strdup("");
+  g_assert_cmpstr(sanitize_out_name(name), ==, "");
+  g_free(name);
+
+  LayerConfig config = {LAYER_TYPE_TEXT, 0, 0.0};
+  GHashTable* layers = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)&del_layer_data);
+  g_hash_table_insert(layers, "name", new_layer_data(&config, g_strdup("Sky Tower")));
+  gchar* out_file = new_component_out_file(3, layers, "out", "name", "_back", 2);
+  g_assert_cmpstr(out_file, ==, "out" G_DIR_SEPARATOR_S "Sky_Tower_back-2.png");
+  g_free(out_file);
+  out_file = new_component_out_file(3, layers, "out", "missing", NULL, 1);
+  g_assert_cmpstr(out_file, ==, "out" G_DIR_SEPARATOR_S "3.png");
+  g_free(out_file);
+  g_hash_table_destroy(layers);
+}
+
+static void test_layer_types(void) {
+  g_assert_cmpint(layer_type_from_str("image"), ==, LAYER_TYPE_IMAGE);
+  g_assert_cmpint(layer_type_from_str("text"), ==, LAYER_TYPE_TEXT);
+  g_assert_cmpint(layer_type_from_str("bool"), ==, LAYER_TYPE_BOOL);
+  g_assert_cmpint(layer_type_from_str("Text"), ==, LAYER_TYPE_UNKNOWN);
+  g_assert_cmpint(layer_type_from_str(NULL), ==, LAYER_TYPE_UNKNOWN);
+  for (LayerType type = LAYER_TYPE_IMAGE; type <= LAYER_TYPE_BOOL; ++type) {
+    g_assert_cmpint(layer_type_from_str(str_from_layer_type(type)), ==, type);
+  }
+  g_assert_cmpstr(str_from_layer_type(LAYER_TYPE_UNKNOWN), ==, "unknown");
+}
+
+// Writes pack of single asset of assets directory, stamped with its current
+// size and modification time
+static void write_single_asset_pack(const gchar* pack_path, const gchar* asset_path, const gchar* name,
+                                    const gchar* contents) {
+  GStatBuf st;
+  g_assert_cmpint(g_stat(asset_path, &st), ==, 0);
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE(ASSET_PACK_INDEX_TYPE));
+  g_variant_builder_add(&builder, "{s(ttx)}", name, (guint64)0, (guint64)strlen(contents), asset_pack_mtime_ns(&st));
+  GVariant* index = g_variant_ref_sink(g_variant_builder_end(&builder));
+  if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+    GVariant* swapped = g_variant_ref_sink(g_variant_byteswap(index));
+    g_variant_unref(index);
+    index = swapped;
+  }
+  guint64 index_size = g_variant_get_size(index);
+  guint64 index_size_le = GUINT64_TO_LE(index_size);
+  GString* pack = g_string_new_len(ASSET_PACK_MAGIC, 8);
+  g_string_append_len(pack, (const gchar*)&index_size_le, sizeof(index_size_le));
+  g_string_append_len(pack, g_variant_get_data(index), index_size);
+  while (pack->len < asset_pack_data_offset(index_size)) g_string_append_c(pack, '\0');
+  g_string_append(pack, contents);
+  g_assert_true(g_file_set_contents(pack_path, pack->str, pack->len, NULL));
+  g_string_free(pack, TRUE);
+  g_variant_unref(index);
+}
+
+static gboolean bytes_equal_str(GBytes* bytes, const gchar* str) {
+  gsize size;
+  const gchar* data = g_bytes_get_data(bytes, &size);
+  return size == strlen(str) && memcmp(data, str, size) == 0;
+}
+
+static void test_asset_pack_stale(void) {
+  gchar* dir = g_dir_make_tmp("core-tests-XXXXXX", NULL);
+  g_assert_nonnull(dir);
+  gchar* asset_path = g_build_filename(dir, "art.png", NULL);
+  gchar* new_asset_path = g_build_filename(dir, "new.png", NULL);
+  gchar* pack_path = g_build_filename(dir, "assets.pack", NULL);
+  g_assert_true(g_file_set_contents(asset_path, "packed", -1, NULL));
+  write_single_asset_pack(pack_path, asset_path, "art.png", "packed");
+
+  AssetPack* pack = new_asset_pack(pack_path, dir);
+  g_assert_nonnull(pack);
+  GBytes* bytes = asset_pack_lookup_path(pack, asset_path);
+  g_assert_nonnull(bytes);
+  g_assert_true(bytes_equal_str(bytes, "packed"));
+  g_bytes_unref(bytes);
+
+  // Edited source and assets added after packing are left to the files
+  g_assert_true(g_file_set_contents(asset_path, "edited asset", -1, NULL));
+  g_assert_null(asset_pack_lookup_path(pack, asset_path));
+  g_assert_true(g_file_set_contents(new_asset_path, "new", -1, NULL));
+  g_assert_null(asset_pack_lookup_path(pack, new_asset_path));
+
+  // Pack alone still serves its assets
+  g_unlink(asset_path);
+  bytes = asset_pack_lookup_path(pack, asset_path);
+  g_assert_nonnull(bytes);
+  g_assert_true(bytes_equal_str(bytes, "packed"));
+  g_bytes_unref(bytes);
+  del_asset_pack(pack);
+
+  g_unlink(new_asset_path);
+  g_unlink(pack_path);
+  g_rmdir(dir);
+  g_free(pack_path);
+  g_free(new_asset_path);
+  g_free(asset_path);
+  g_free(dir);
+}
+
+int main(int argc, char** argv) {
+  g_test_init(&argc, &argv, NULL);
+  g_test_add_func("/config/valid", &test_config_valid);
+  g_test_add_func("/config/default-xcf", &test_config_default_xcf);
+  g_test_add_func("/config/invalid", &test_config_invalid);
+  g_test_add_func("/keywords/spans", &test_keyword_spans);
+  g_test_add_func("/keywords/adjacent", &test_keyword_spans_adjacent);
+  g_test_add_func("/keywords/unterminated", &test_keyword_spans_unterminated);
+  g_test_add_func("/keywords/compile", &test_compile_text);
+  g_test_add_func("/keywords/compile-template-faces", &test_compile_template_faces);
+  g_test_add_func("/out-name/sanitize", &test_sanitize_out_name);
+  g_test_add_func("/layer-type/names", &test_layer_types);
+  g_test_add_func("/asset-pack/stale", &test_asset_pack_stale);
+  return g_test_run();
+}
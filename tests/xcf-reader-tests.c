@@ -0,0 +1,103 @@
+// Unit tests of XCF reader of standalone tools on XCF files built in memory.
+// Built and run by tools/build.sh, needs neither GIMP nor project.
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "tools/xcf-reader.h"
+
+// XCF precisions of version 7 and later
+static const guint32 PRECISION_U8_NON_LINEAR = 150;
+static const guint32 PRECISION_U16_NON_LINEAR = 250;
+
+static void put_u32(GByteArray* out, guint32 value) {
+  guint32 be = GUINT32_TO_BE(value);
+  g_byte_array_append(out, (const guint8*)&be, sizeof(be));
+}
+
+// Pointers of version 11 files are 64 bit
+static void put_pointer(GByteArray* out, guint64 value) {
+  put_u32(out, (guint32)(value >> 32));
+  put_u32(out, (guint32)value);
+}
+
+// Version 11 RGB image of given precision with single RGBA layer "art",
+// whose hierarchy points past end of file, so its pixels can not be decoded
+static GByteArray* new_xcf_bytes(guint32 precision) {
+  GByteArray* out = g_byte_array_new();
+  g_byte_array_append(out, (const guint8*)"gimp xcf v011", 14);
+  put_u32(out, 4);
+  put_u32(out, 4);
+  put_u32(out, 0);
+  put_u32(out, precision);
+  // Image properties end
+  put_u32(out, 0);
+  put_u32(out, 0);
+  guint64 layer_offset = out->len + 3 * 8;
+  put_pointer(out, layer_offset);
+  put_pointer(out, 0);
+  // No channels
+  put_pointer(out, 0);
+  g_assert_cmpuint(out->len, ==, layer_offset);
+  put_u32(out, 4);
+  put_u32(out, 4);
+  put_u32(out, 1);
+  put_u32(out, 4);
+  g_byte_array_append(out, (const guint8*)"art", 4);
+  // Layer properties end
+  put_u32(out, 0);
+  put_u32(out, 0);
+  put_pointer(out, 1 << 20);
+  put_pointer(out, 0);
+  return out;
+}
+
+// Writes XCF of given precision into new temporary directory and opens it
+static XcfImage* open_xcf(guint32 precision) {
+  gchar* dir = g_dir_make_tmp("xcf-reader-tests-XXXXXX", NULL);
+  g_assert_nonnull(dir);
+  gchar* path = g_build_filename(dir, "template.xcf", NULL);
+  GByteArray* bytes = new_xcf_bytes(precision);
+  g_assert_true(g_file_set_contents(path, (const gchar*)bytes->data, bytes->len, NULL));
+  g_byte_array_free(bytes, TRUE);
+  XcfImage* image = xcf_image_open(path);
+  g_unlink(path);
+  g_rmdir(dir);
+  g_free(path);
+  g_free(dir);
+  return image;
+}
+
+static void test_open_8bit(void) {
+  XcfImage* image = open_xcf(PRECISION_U8_NON_LINEAR);
+  g_assert_nonnull(image);
+  g_assert_cmpint(image->version, ==, 11);
+  g_assert_cmpuint(image->precision, ==, PRECISION_U8_NON_LINEAR);
+  g_assert_cmpuint(image->layers->len, ==, 1);
+  xcf_image_free(image);
+}
+
+static void test_open_high_precision(void) {
+  XcfImage* image = open_xcf(PRECISION_U16_NON_LINEAR);
+  g_assert_nonnull(image);
+  g_assert_cmpint(image->width, ==, 4);
+  g_assert_cmpint(image->height, ==, 4);
+  g_assert_cmpuint(image->precision, ==, PRECISION_U16_NON_LINEAR);
+  g_assert_cmpuint(image->layers->len, ==, 1);
+  XcfLayer* layer = xcf_image_find_layer(image, "art");
+  g_assert_nonnull(layer);
+  g_assert_cmpint(layer->kind, ==, XCF_LAYER_RASTER);
+  g_assert_cmpint(layer->width, ==, 4);
+  g_assert_cmpint(layer->height, ==, 4);
+  // Layer tree is readable, pixels are not decoded
+  g_assert_null(xcf_layer_load_surface(image, layer));
+  xcf_image_free(image);
+}
+
+int main(int argc, char** argv) {
+  g_test_init(&argc, &argv, NULL);
+  g_test_add_func("/xcf-reader/open-8bit", &test_open_8bit);
+  g_test_add_func("/xcf-reader/open-high-precision", &test_open_high_precision);
+  return g_test_run();
+}
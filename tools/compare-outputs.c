@@ -0,0 +1,255 @@
+// Compares two output trees, e.g. out directory before and after a change
+// of the plugin, so changed components are found without opening them.
+// PNG files are decoded and compared on all cores. Failures are listed in
+// JSON report and optionally drawn as heatmaps.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "image-diff.h"
+
+typedef struct {
+  gchar* reference_dir;
+  gchar* candidate_dir;
+  gchar* heatmap_dir;
+  gint tolerance;
+  gdouble max_differing;
+  gdouble max_mean;
+} CompareOptions;
+
+typedef enum {
+  COMPARE_OK,
+  COMPARE_DIFFERENT,
+  COMPARE_SIZE,
+  COMPARE_MISSING,
+  COMPARE_EXTRA,
+  COMPARE_UNREADABLE
+} CompareStatus;
+
+static const gchar* str_from_compare_status(CompareStatus status) {
+  switch (status) {
+    case COMPARE_OK: return "ok";
+    case COMPARE_DIFFERENT: return "different";
+    case COMPARE_SIZE: return "size";
+    case COMPARE_MISSING: return "missing";
+    case COMPARE_EXTRA: return "extra";
+    case COMPARE_UNREADABLE: return "unreadable";
+  }
+  return "unknown";
+}
+
+typedef struct {
+  gchar* path;
+  CompareStatus status;
+  ImageDiff diff;
+} CompareEntry;
+
+CompareEntry* new_compare_entry(gchar* path, CompareStatus status) {
+  CompareEntry* ce = malloc(sizeof(CompareEntry));
+  ce->path = path;
+  ce->status = status;
+  memset(&ce->diff, 0, sizeof(ImageDiff));
+  return ce;
+}
+
+void del_compare_entry(CompareEntry* ce) {
+  if (!ce) return;
+  g_free(ce->path);
+  free(ce);
+}
+
+static gint compare_entries_by_path(gconstpointer a, gconstpointer b) {
+  return g_strcmp0((*(CompareEntry**)a)->path, (*(CompareEntry**)b)->path);
+}
+
+// Collects paths of PNG files relative to root. Hidden entries like caches
+// are skipped.
+static void collect_pngs(const gchar* root, const gchar* relative, GHashTable* paths) {
+  gchar* dir_path = relative ? g_build_filename(root, relative, NULL) : g_strdup(root);
+  GDir* dir = g_dir_open(dir_path, 0, NULL);
+  if (!dir) {
+    g_free(dir_path);
+    return;
+  }
+  const gchar* name;
+  while ((name = g_dir_read_name(dir)) != NULL) {
+    if (name[0] == '.') continue;
+    gchar* child = relative ? g_build_filename(relative, name, NULL) : g_strdup(name);
+    gchar* child_path = g_build_filename(root, child, NULL);
+    if (g_file_test(child_path, G_FILE_TEST_IS_DIR)) {
+      collect_pngs(root, child, paths);
+      g_free(child);
+    } else if (g_str_has_suffix(name, ".png")) {
+      g_hash_table_add(paths, child);
+    } else {
+      g_free(child);
+    }
+    g_free(child_path);
+  }
+  g_dir_close(dir);
+  g_free(dir_path);
+}
+
+static gboolean write_heatmap(GdkPixbuf* reference, GdkPixbuf* candidate, const gchar* path, CompareOptions* options) {
+  gchar* heatmap_path = g_build_filename(options->heatmap_dir, path, NULL);
+  gchar* heatmap_dir = g_path_get_dirname(heatmap_path);
+  gboolean ret = g_mkdir_with_parents(heatmap_dir, 0755) == 0;
+  if (ret) {
+    GdkPixbuf* heatmap = image_diff_heatmap(reference, candidate, (guint8)options->tolerance);
+    GError* error = NULL;
+    ret = gdk_pixbuf_save(heatmap, heatmap_path, "png", &error, NULL);
+    if (!ret) {
+      printf("Failed to save heatmap %s: %s\n", heatmap_path, error->message);
+      g_error_free(error);
+    }
+    g_object_unref(heatmap);
+  } else {
+    printf("Unable to create directory %s\n", heatmap_dir);
+  }
+  g_free(heatmap_dir);
+  g_free(heatmap_path);
+  return ret;
+}
+
+static void compare_entry(gpointer data, gpointer user_data) {
+  CompareEntry* entry = (CompareEntry*)data;
+  CompareOptions* options = (CompareOptions*)user_data;
+  gchar* reference_path = g_build_filename(options->reference_dir, entry->path, NULL);
+  gchar* candidate_path = g_build_filename(options->candidate_dir, entry->path, NULL);
+  GdkPixbuf* reference = image_diff_load(reference_path);
+  GdkPixbuf* candidate = reference ? image_diff_load(candidate_path) : NULL;
+  if (!reference || !candidate) {
+    entry->status = COMPARE_UNREADABLE;
+  } else if (!image_diff_pixbufs(reference, candidate, (guint8)options->tolerance, &entry->diff)) {
+    entry->status = COMPARE_SIZE;
+  } else if (image_diff_differing_percent(&entry->diff) > options->max_differing ||
+             image_diff_mean(&entry->diff) > options->max_mean) {
+    entry->status = COMPARE_DIFFERENT;
+    if (options->heatmap_dir) write_heatmap(reference, candidate, entry->path, options);
+  }
+  if (candidate) g_object_unref(candidate);
+  if (reference) g_object_unref(reference);
+  g_free(candidate_path);
+  g_free(reference_path);
+}
+
+static gboolean write_report(GPtrArray* entries, const gchar* report_path) {
+  JsonBuilder* builder = json_builder_new();
+  json_builder_begin_array(builder);
+  for (guint i = 0; i < entries->len; ++i) {
+    CompareEntry* entry = g_ptr_array_index(entries, i);
+    if (entry->status == COMPARE_OK) continue;
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "path");
+    json_builder_add_string_value(builder, entry->path);
+    json_builder_set_member_name(builder, "status");
+    json_builder_add_string_value(builder, str_from_compare_status(entry->status));
+    if (entry->status == COMPARE_DIFFERENT) {
+      json_builder_set_member_name(builder, "max_diff");
+      json_builder_add_int_value(builder, entry->diff.max_diff);
+      json_builder_set_member_name(builder, "mean_diff");
+      json_builder_add_double_value(builder, image_diff_mean(&entry->diff));
+      json_builder_set_member_name(builder, "differing_pixels");
+      json_builder_add_int_value(builder, entry->diff.differing);
+      json_builder_set_member_name(builder, "differing_percent");
+      json_builder_add_double_value(builder, image_diff_differing_percent(&entry->diff));
+    }
+    json_builder_end_object(builder);
+  }
+  json_builder_end_array(builder);
+  JsonNode* root = json_builder_get_root(builder);
+  JsonGenerator* generator = json_generator_new();
+  json_generator_set_root(generator, root);
+  json_generator_set_pretty(generator, TRUE);
+  GError* error = NULL;
+  gboolean ret = json_generator_to_file(generator, report_path, &error);
+  if (!ret) {
+    printf("Failed to write report %s: %s\n", report_path, error->message);
+    g_error_free(error);
+  }
+  g_object_unref(generator);
+  json_node_free(root);
+  g_object_unref(builder);
+  return ret;
+}
+
+int main(int argc, char** argv) {
+  CompareOptions options = {NULL, NULL, NULL, 0, 0.0, 255.0};
+  gchar* report_path = NULL;
+  gint threads = g_get_num_processors();
+  GOptionEntry entries[] = {
+    {"tolerance", 0, 0, G_OPTION_ARG_INT, &options.tolerance, "Channel difference still counted as equal, 0 by default", "N"},
+    {"max-differing", 0, 0, G_OPTION_ARG_DOUBLE, &options.max_differing, "Percent of differing pixels allowed, 0 by default", "PERCENT"},
+    {"max-mean", 0, 0, G_OPTION_ARG_DOUBLE, &options.max_mean, "Mean channel difference allowed, not limited by default", "VALUE"},
+    {"report", 'r', 0, G_OPTION_ARG_FILENAME, &report_path, "Write JSON report of failures to FILE", "FILE"},
+    {"heatmaps", 'm', 0, G_OPTION_ARG_FILENAME, &options.heatmap_dir, "Write heatmaps of different images to DIR", "DIR"},
+    {"threads", 'j', 0, G_OPTION_ARG_INT, &threads, "Number of decoding threads, number of processors by default", "N"},
+    {NULL}
+  };
+  GOptionContext* context = g_option_context_new("REFERENCE_DIR CANDIDATE_DIR - compare PNG files of two output trees");
+  g_option_context_add_main_entries(context, entries, NULL);
+  GError* error = NULL;
+  if (!g_option_context_parse(context, &argc, &argv, &error) || argc != 3) {
+    printf("%s\n", error ? error->message : "Usage: compare-outputs [OPTION...] REFERENCE_DIR CANDIDATE_DIR");
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 2;
+  }
+  g_option_context_free(context);
+  options.reference_dir = argv[1];
+  options.candidate_dir = argv[2];
+  options.tolerance = CLAMP(options.tolerance, 0, 255);
+
+  gint64 start = g_get_monotonic_time();
+  GHashTable* reference_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  GHashTable* candidate_paths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  collect_pngs(options.reference_dir, NULL, reference_paths);
+  collect_pngs(options.candidate_dir, NULL, candidate_paths);
+
+  GPtrArray* compare_entries = g_ptr_array_new_with_free_func((GDestroyNotify)&del_compare_entry);
+  GThreadPool* pool = g_thread_pool_new(&compare_entry, &options, MAX(1, threads), TRUE, NULL);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, reference_paths);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    gboolean in_candidate = g_hash_table_contains(candidate_paths, key);
+    CompareEntry* entry = new_compare_entry(g_strdup(key), in_candidate ? COMPARE_OK : COMPARE_MISSING);
+    g_ptr_array_add(compare_entries, entry);
+    if (in_candidate) g_thread_pool_push(pool, entry, NULL);
+  }
+  g_hash_table_iter_init(&iter, candidate_paths);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    if (g_hash_table_contains(reference_paths, key)) continue;
+    g_ptr_array_add(compare_entries, new_compare_entry(g_strdup(key), COMPARE_EXTRA));
+  }
+  g_thread_pool_free(pool, FALSE, TRUE);
+  g_ptr_array_sort(compare_entries, &compare_entries_by_path);
+
+  guint failed = 0;
+  for (guint i = 0; i < compare_entries->len; ++i) {
+    CompareEntry* entry = g_ptr_array_index(compare_entries, i);
+    if (entry->status == COMPARE_OK) continue;
+    ++failed;
+    if (entry->status == COMPARE_DIFFERENT) {
+      printf("FAIL %s: max diff %u, mean diff %.3f, %" G_GUINT64_FORMAT " pixels (%.3f%%) differ\n", entry->path,
+             entry->diff.max_diff, image_diff_mean(&entry->diff), entry->diff.differing, image_diff_differing_percent(&entry->diff));
+    } else {
+      printf("FAIL %s: %s\n", entry->path, str_from_compare_status(entry->status));
+    }
+  }
+  gboolean ok = failed == 0;
+  if (report_path) ok = write_report(compare_entries, report_path) && ok;
+  printf("Compared %u images in %.1f s, %u failed\n", compare_entries->len,
+         (g_get_monotonic_time() - start) / 1e6, failed);
+
+  g_ptr_array_free(compare_entries, TRUE);
+  g_hash_table_destroy(candidate_paths);
+  g_hash_table_destroy(reference_paths);
+  g_free(report_path);
+  g_free(options.heatmap_dir);
+  return ok ? 0 : 1;
+}
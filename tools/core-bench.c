@@ -0,0 +1,265 @@
+// Microbenchmarks of GIMP independent core of plugin: config parsing, keyword
+// scanning of long rules text and allocations done per data row. Runs on
+// synthetic project generated into temporary directory, so it needs neither
+// GIMP nor real project.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "boardgame-component-config.h"
+#include "boardgame-component-keywords.h"
+
+#ifdef __GLIBC__
+// Every allocation of process goes through these wrappers, GLib included, so
+// counts cover whole core code and not only direct malloc calls
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static guint64 allocations = 0;
+
+void* malloc(size_t size) {
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
+
+static guint64 allocation_count(void) {
+  return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+}
+#else
+static guint64 allocation_count(void) {
+  return 0;
+}
+#endif
+
+static const gchar* const RULES_WORDS[] = {
+  "Gain", "one", "resource", "for", "every", "adjacent", "building", "and", "then", "draw",
+  "a", "card", "if", "you", "have", "at", "least", "two", "workers", "here."
+};
+static const gchar* const KEYWORDS[] = {"coin", "wood", "stone", "worker", "missing"};
+
+// Rules text of about length bytes with keyword after every dozen or so words
+static gchar* new_rules_text(gsize length, guint32 seed) {
+  GRand* rand = g_rand_new_with_seed(seed);
+  GString* text = g_string_sized_new(length + 32);
+  while (text->len < length) {
+    if (g_rand_int_range(rand, 0, 12) == 0) {
+      g_string_append_printf(text, "<<%s>> ", KEYWORDS[g_rand_int_range(rand, 0, G_N_ELEMENTS(KEYWORDS))]);
+    } else {
+      g_string_append_printf(text, "%s ", RULES_WORDS[g_rand_int_range(rand, 0, G_N_ELEMENTS(RULES_WORDS))]);
+    }
+  }
+  g_rand_free(rand);
+  return g_string_free(text, FALSE);
+}
+
+// Config with templates of image, text and bool layers, where every row
+// has unique name used as output file name and rules text with keywords
+static gchar* new_config_json(guint templates, guint rows) {
+  GString* json = g_string_new("{\n");
+  for (guint t = 0; t < templates; ++t) {
+    g_string_append_printf(json, "  \"template_%u\": {\n    \"out\": \"name\",\n", t);
+    g_string_append(json, "    \"layers\": {\"art\": \"image\", \"icon\": \"image\", \"name\": \"text\", "
+                          "\"cost\": \"text\", \"rules\": {\"type\": \"text\", \"vcenter\": 1}, \"elite\": \"bool\"},\n");
+    g_string_append(json, "    \"data\": [\n");
+    for (guint r = 0; r < rows; ++r) {
+      gchar* rules = new_rules_text(160 + r % 5 * 60, t * rows + r);
+      g_string_append_printf(json, "      {\"art\": \"art/card_%u.png\", \"icon\": \"icons/%u.png\", \"name\": \"Card %u/%u: %s\", "
+                             "\"cost\": \"%u\", \"rules\": \"%s\", \"elite\": \"%s\"%s}%s\n",
+                             r, r % 7, t, r, RULES_WORDS[r % G_N_ELEMENTS(RULES_WORDS)], r % 10, rules,
+                             r % 3 ? "false" : "true", r % 11 ? "" : ", \"count\": 2", r + 1 < rows ? "," : "");
+      g_free(rules);
+    }
+    g_string_append_printf(json, "    ]\n  }%s\n", t + 1 < templates ? "," : "");
+  }
+  g_string_append(json, "}\n");
+  return g_string_free(json, FALSE);
+}
+
+static gdouble elapsed_ms(gint64 start) {
+  return (g_get_monotonic_time() - start) / 1000.0;
+}
+
+static gboolean bench_config(const gchar* config_path, const gchar* cache_dir, gsize config_bytes, gint iterations) {
+  gdouble mb = config_bytes / (1024.0 * 1024.0);
+  guint64 first_allocation = allocation_count();
+  gint64 start = g_get_monotonic_time();
+  for (gint i = 0; i < iterations; ++i) {
+    GHashTable* xcfs = parse_json_config(config_path);
+    if (!xcfs) return FALSE;
+    g_hash_table_destroy(xcfs);
+  }
+  gdouble parse_ms = elapsed_ms(start) / iterations;
+  guint64 parse_allocations = (allocation_count() - first_allocation) / iterations;
+  printf("config parse: %.2f MB in %.2f ms, %.2f ms per MB, %" G_GUINT64_FORMAT " allocations\n",
+         mb, parse_ms, parse_ms / mb, parse_allocations);
+
+  // First load writes cache, following ones map it
+  GHashTable* xcfs = load_config(config_path, cache_dir);
+  if (!xcfs) return FALSE;
+  g_hash_table_destroy(xcfs);
+  first_allocation = allocation_count();
+  start = g_get_monotonic_time();
+  for (gint i = 0; i < iterations; ++i) {
+    xcfs = load_config(config_path, cache_dir);
+    if (!xcfs) return FALSE;
+    g_hash_table_destroy(xcfs);
+  }
+  gdouble cached_ms = elapsed_ms(start) / iterations;
+  printf("config cached load: %.2f ms, %.2f ms per MB, %" G_GUINT64_FORMAT " allocations\n",
+         cached_ms, cached_ms / mb, (allocation_count() - first_allocation) / iterations);
+  return TRUE;
+}
+
+static void bench_keywords(gsize text_bytes, gint iterations) {
+  gchar* text = new_rules_text(text_bytes, 1);
+  gsize length = strlen(text);
+  guint keywords = 0;
+  guint64 first_allocation = allocation_count();
+  gint64 start = g_get_monotonic_time();
+  for (gint i = 0; i < iterations; ++i) {
+    GArray* spans = find_keyword_spans(text);
+    keywords = spans->len;
+    g_array_free(spans, TRUE);
+  }
+  gdouble scan_ms = elapsed_ms(start) / iterations;
+  guint64 scan_allocations = (allocation_count() - first_allocation) / iterations;
+
+  first_allocation = allocation_count();
+  start = g_get_monotonic_time();
+  for (gint i = 0; i < iterations; ++i) {
+    GArray* spans = find_keyword_spans(text);
+    g_free(replace_keyword_spans_with_spaces(text, spans));
+    g_array_free(spans, TRUE);
+  }
+  gdouble replace_ms = elapsed_ms(start) / iterations;
+  guint64 replace_allocations = (allocation_count() - first_allocation) / iterations;
+
+  gdouble mb = length / (1024.0 * 1024.0);
+  printf("keyword scan: %" G_GSIZE_FORMAT " bytes with %u keywords in %.3f ms, %.0f MB/s, %" G_GUINT64_FORMAT " allocations\n",
+         length, keywords, scan_ms, mb / (scan_ms / 1000.0), scan_allocations);
+  printf("keyword scan and replace: %.3f ms, %.0f MB/s, %" G_GUINT64_FORMAT " allocations\n",
+         replace_ms, mb / (replace_ms / 1000.0), replace_allocations);
+  g_free(text);
+}
+
+// Core work done for every data row before GIMP is involved: output file
+// names and compiling text layers against icon layers of template, which
+// plugin does once when template is loaded
+static void process_row(ComponentData* component_data, gint index, gchar* out_dir, gchar* out_key, GHashTable* icon_layers) {
+  for (gint copy = 1; copy <= component_data->count; ++copy) {
+    g_free(new_component_out_file(index, component_data->layers, out_dir, out_key, NULL, copy));
+  }
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, component_data->layers);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    LayerData* layer_data = (LayerData*)value;
+    if (layer_data->config->type != LAYER_TYPE_TEXT || !layer_data->value) continue;
+    layer_data_set_compiled(layer_data, 0, compile_text(layer_data->value, layer_data->keywords, icon_layers, NULL));
+  }
+}
+
+static gboolean bench_rows(const gchar* config_path, gint iterations) {
+  GHashTable* xcfs = parse_json_config(config_path);
+  if (!xcfs) return FALSE;
+  gchar* out_dir = "out";
+  // Last keyword is missing in template, so it stays in text
+  GHashTable* icon_layers = g_hash_table_new(g_str_hash, g_str_equal);
+  for (guint i = 0; i + 1 < G_N_ELEMENTS(KEYWORDS); ++i) {
+    g_hash_table_add(icon_layers, (gpointer)KEYWORDS[i]);
+  }
+  guint rows = 0;
+  guint64 first_allocation = allocation_count();
+  gint64 start = g_get_monotonic_time();
+  for (gint it = 0; it < iterations; ++it) {
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, xcfs);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      ComponentTemplate* ct = (ComponentTemplate*)value;
+      for (guint i = 0; i < ct->data->len; ++i) {
+        process_row(g_ptr_array_index(ct->data, i), i, out_dir, ct->out_key, icon_layers);
+        ++rows;
+      }
+    }
+  }
+  gdouble row_us = elapsed_ms(start) * 1000.0 / rows;
+  printf("row processing: %.2f us, %.1f allocations per row\n", row_us,
+         (gdouble)(allocation_count() - first_allocation) / rows);
+  g_hash_table_destroy(icon_layers);
+  g_hash_table_destroy(xcfs);
+  return TRUE;
+}
+
+int main(int argc, char** argv) {
+  gint templates = 4;
+  gint rows = 2000;
+  gint text_kb = 256;
+  gint iterations = 10;
+  GOptionEntry entries[] = {
+    {"templates", 't', 0, G_OPTION_ARG_INT, &templates, "Templates of generated config, 4 by default", "N"},
+    {"rows", 'r', 0, G_OPTION_ARG_INT, &rows, "Data rows of every template, 2000 by default", "N"},
+    {"text-kb", 0, 0, G_OPTION_ARG_INT, &text_kb, "Size of rules text scanned for keywords, 256 by default", "KB"},
+    {"iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Repetitions averaged by every benchmark, 10 by default", "N"},
+    {NULL}
+  };
+  GOptionContext* context = g_option_context_new("- benchmark GIMP independent core of plugin");
+  g_option_context_add_main_entries(context, entries, NULL);
+  GError* error = NULL;
+  if (!g_option_context_parse(context, &argc, &argv, &error) || templates < 1 || rows < 1 || text_kb < 1 || iterations < 1) {
+    printf("%s\n", error ? error->message : "Usage: core-bench [OPTION...]");
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 2;
+  }
+  g_option_context_free(context);
+
+  gchar* tmp_dir = g_dir_make_tmp("core-bench-XXXXXX", &error);
+  if (!tmp_dir) {
+    printf("Unable to create temporary directory: %s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+  gchar* config_path = g_build_filename(tmp_dir, "config.json", NULL);
+  gchar* cache_dir = g_build_filename(tmp_dir, "cache", NULL);
+  gchar* config_json = new_config_json(templates, rows);
+  gsize config_bytes = strlen(config_json);
+  gboolean ok = g_file_set_contents(config_path, config_json, config_bytes, &error) &&
+                g_mkdir_with_parents(cache_dir, 0755) == 0;
+  if (!ok) {
+    printf("Unable to write %s: %s\n", config_path, error ? error->message : "");
+    g_clear_error(&error);
+  }
+  g_free(config_json);
+
+#ifndef __GLIBC__
+  printf("Allocation counting needs glibc, counts are reported as 0\n");
+#endif
+  ok = ok && bench_config(config_path, cache_dir, config_bytes, iterations);
+  if (ok) bench_keywords((gsize)text_kb * 1024, iterations);
+  ok = ok && bench_rows(config_path, iterations);
+
+  gchar* cache_path = config_cache_path(cache_dir, config_path);
+  g_unlink(cache_path);
+  g_free(cache_path);
+  g_rmdir(cache_dir);
+  g_unlink(config_path);
+  g_rmdir(tmp_dir);
+  g_free(cache_dir);
+  g_free(config_path);
+  g_free(tmp_dir);
+  return ok ? 0 : 1;
+}
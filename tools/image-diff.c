@@ -0,0 +1,135 @@
+#include "image-diff.h"
+
+#include <stdio.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static guint pixel_diff(const guint8* pa, const guint8* pb) {
+  // Color of fully transparent pixels does not matter
+  if (pa[3] == 0 && pb[3] == 0) return 0;
+  guint max = 0;
+  for (gint c = 0; c < 4; ++c) {
+    max = MAX(max, (guint)ABS((gint)pa[c] - (gint)pb[c]));
+  }
+  return max;
+}
+
+static void scalar_diff_row(const guint8* a, const guint8* b, gint width, guint8 tolerance, ImageDiff* diff) {
+  for (gint x = 0; x < width; ++x, a += 4, b += 4) {
+    if (a[3] == 0 && b[3] == 0) continue;
+    guint max = 0;
+    for (gint c = 0; c < 4; ++c) {
+      guint d = ABS((gint)a[c] - (gint)b[c]);
+      diff->sum_diff += d;
+      max = MAX(max, d);
+    }
+    diff->max_diff = MAX(diff->max_diff, max);
+    if (max > tolerance) ++diff->differing;
+  }
+}
+
+#ifdef __SSE2__
+static void sse2_diff_row(const guint8* a, const guint8* b, gint width, guint8 tolerance, ImageDiff* diff) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha_mask = _mm_set1_epi32((gint)0xff000000);
+  const __m128i tolerance_v = _mm_set1_epi8((gchar)tolerance);
+  __m128i max_v = zero;
+  __m128i sum_v = zero;
+  guint64 differing = 0;
+  gint x = 0;
+  for (; x + 4 <= width; x += 4) {
+    __m128i va = _mm_loadu_si128((const __m128i*)(a + x * 4));
+    __m128i vb = _mm_loadu_si128((const __m128i*)(b + x * 4));
+    // Pixels transparent in both images are masked out
+    __m128i transparent = _mm_cmpeq_epi32(_mm_and_si128(_mm_or_si128(va, vb), alpha_mask), zero);
+    __m128i d = _mm_andnot_si128(transparent, _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va)));
+    max_v = _mm_max_epu8(max_v, d);
+    sum_v = _mm_add_epi64(sum_v, _mm_sad_epu8(d, zero));
+    // Pixel differs when any of its channels exceeds tolerance
+    __m128i equal = _mm_cmpeq_epi32(_mm_subs_epu8(d, tolerance_v), zero);
+    differing += 4 - __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(equal)));
+  }
+  guint8 max_bytes[16];
+  guint64 sums[2];
+  _mm_storeu_si128((__m128i*)max_bytes, max_v);
+  _mm_storeu_si128((__m128i*)sums, sum_v);
+  for (gint i = 0; i < 16; ++i) diff->max_diff = MAX(diff->max_diff, max_bytes[i]);
+  diff->sum_diff += sums[0] + sums[1];
+  diff->differing += differing;
+  scalar_diff_row(a + x * 4, b + x * 4, width - x, tolerance, diff);
+}
+#endif
+
+void image_diff_row(const guint8* a, const guint8* b, gint width, guint8 tolerance, ImageDiff* diff) {
+#ifdef __SSE2__
+  sse2_diff_row(a, b, width, tolerance, diff);
+#else
+  scalar_diff_row(a, b, width, tolerance, diff);
+#endif
+  diff->pixels += width;
+}
+
+gboolean image_diff_pixbufs(GdkPixbuf* a, GdkPixbuf* b, guint8 tolerance, ImageDiff* diff) {
+  gint width = gdk_pixbuf_get_width(a);
+  gint height = gdk_pixbuf_get_height(a);
+  if (width != gdk_pixbuf_get_width(b) || height != gdk_pixbuf_get_height(b)) return FALSE;
+  const guint8* pa = gdk_pixbuf_read_pixels(a);
+  const guint8* pb = gdk_pixbuf_read_pixels(b);
+  gint a_stride = gdk_pixbuf_get_rowstride(a);
+  gint b_stride = gdk_pixbuf_get_rowstride(b);
+  for (gint y = 0; y < height; ++y) {
+    image_diff_row(pa + (gsize)y * a_stride, pb + (gsize)y * b_stride, width, tolerance, diff);
+  }
+  return TRUE;
+}
+
+gdouble image_diff_mean(const ImageDiff* diff) {
+  return diff->pixels ? (gdouble)diff->sum_diff / ((gdouble)diff->pixels * 4) : 0.0;
+}
+
+gdouble image_diff_differing_percent(const ImageDiff* diff) {
+  return diff->pixels ? 100.0 * diff->differing / (gdouble)diff->pixels : 0.0;
+}
+
+GdkPixbuf* image_diff_heatmap(GdkPixbuf* a, GdkPixbuf* b, guint8 tolerance) {
+  gint width = gdk_pixbuf_get_width(b);
+  gint height = gdk_pixbuf_get_height(b);
+  GdkPixbuf* heatmap = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+  const guint8* pa = gdk_pixbuf_read_pixels(a);
+  const guint8* pb = gdk_pixbuf_read_pixels(b);
+  guint8* out = gdk_pixbuf_get_pixels(heatmap);
+  gint a_stride = gdk_pixbuf_get_rowstride(a);
+  gint b_stride = gdk_pixbuf_get_rowstride(b);
+  gint out_stride = gdk_pixbuf_get_rowstride(heatmap);
+  for (gint y = 0; y < height; ++y) {
+    const guint8* ra = pa + (gsize)y * a_stride;
+    const guint8* rb = pb + (gsize)y * b_stride;
+    guint8* ro = out + (gsize)y * out_stride;
+    for (gint x = 0; x < width; ++x, ra += 4, rb += 4, ro += 3) {
+      guint luma = (rb[0] * 77 + rb[1] * 150 + rb[2] * 29) >> 8;
+      guint gray = (luma * rb[3] / 255 + 255 - rb[3]) / 3;
+      guint d = pixel_diff(ra, rb);
+      if (d > tolerance) {
+        ro[0] = (guint8)MIN(255u, 128 + d * 2);
+        ro[1] = ro[2] = 0;
+      } else {
+        ro[0] = ro[1] = ro[2] = (guint8)gray;
+      }
+    }
+  }
+  return heatmap;
+}
+
+GdkPixbuf* image_diff_load(const gchar* path) {
+  GError* error = NULL;
+  GdkPixbuf* loaded = gdk_pixbuf_new_from_file(path, &error);
+  if (!loaded) {
+    printf("%s: unable to load: %s\n", path, error->message);
+    g_error_free(error);
+    return NULL;
+  }
+  GdkPixbuf* pixbuf = gdk_pixbuf_get_has_alpha(loaded) ? g_object_ref(loaded) : gdk_pixbuf_add_alpha(loaded, FALSE, 0, 0, 0);
+  g_object_unref(loaded);
+  return pixbuf;
+}
@@ -0,0 +1,37 @@
+// Pixel comparison of RGBA8 images shared by tools verifying outputs.
+// Kernels process 4 pixels at once with SSE2 where available.
+#ifndef IMAGE_DIFF_H
+#define IMAGE_DIFF_H
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+typedef struct {
+  guint max_diff;
+  guint64 sum_diff;
+  guint64 differing;
+  guint64 pixels;
+} ImageDiff;
+
+// Accumulates difference of single row of width pixels. Pixels with
+// channels differing by no more than tolerance count as equal, color of
+// pixels fully transparent in both images does not matter.
+void image_diff_row(const guint8* a, const guint8* b, gint width, guint8 tolerance, ImageDiff* diff);
+
+// Compares images with alpha channel. Returns FALSE when sizes differ.
+gboolean image_diff_pixbufs(GdkPixbuf* a, GdkPixbuf* b, guint8 tolerance, ImageDiff* diff);
+
+// Mean difference of all channels
+gdouble image_diff_mean(const ImageDiff* diff);
+
+// Percent of pixels differing beyond tolerance
+gdouble image_diff_differing_percent(const ImageDiff* diff);
+
+// Image of b dimmed to gray with pixels differing beyond tolerance in red,
+// brighter for larger difference
+GdkPixbuf* image_diff_heatmap(GdkPixbuf* a, GdkPixbuf* b, guint8 tolerance);
+
+// Loads image converted to RGBA8, NULL with message printed on failure
+GdkPixbuf* image_diff_load(const gchar* path);
+
+#endif // IMAGE_DIFF_H
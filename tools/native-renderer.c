@@ -0,0 +1,746 @@
+// Renders component templates without GIMP. Reads same project layout and
+// config.json as the plugin, composites XCF layers with Cairo and writes PNG
+// files named like plugin outputs. With --compare it renders in memory and
+// checks the result against outputs of the plugin instead.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <cairo.h>
+#include <pango/pangocairo.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "boardgame-component-config.h"
+#include "xcf-reader.h"
+#include "xcf-config.h"
+#include "image-diff.h"
+
+typedef struct {
+  gchar* out_dir;
+  gchar* compare_dir;
+  gchar* template_name;
+  gint tolerance;
+  gdouble max_differing;
+} RendererOptions;
+
+// Text layer properties as stored in gimp-text-layer parasite
+typedef struct {
+  gchar* font;
+  gdouble font_size;
+  gdouble unit_pixels;
+  gdouble line_spacing;
+  gdouble letter_spacing;
+  PangoAlignment alignment;
+  gboolean justify;
+  gdouble color[4];
+} TextStyle;
+
+// Keyword icon copied from template layer and placed over text
+typedef struct {
+  XcfLayer* source;
+  gdouble x;
+  gdouble y;
+  gint width;
+  gint height;
+} IconPlacement;
+
+// Changes of data row to template layer. Image assets are drawn right above
+// their placeholder, which stays hidden, like the plugin inserts them.
+typedef struct {
+  gboolean visible;
+  gdouble rotate;
+  cairo_surface_t* asset;
+  gchar* text;
+  TextStyle* style;
+  gdouble font_size;
+  gint offset_y;
+} LayerOverride;
+
+typedef struct {
+  XcfImage* xcf;
+  gchar* assets_dir;
+  PangoContext* pango;
+  // XcfLayer* -> decoded cairo_surface_t*, filled on first use
+  GHashTable* surfaces;
+  // XcfLayer* -> TextStyle*
+  GHashTable* styles;
+} TemplateRenderer;
+
+typedef struct {
+  GHashTable* overrides;
+  // Parent XcfLayer* or XcfImage* for top level -> GPtrArray of IconPlacement*
+  GHashTable* icons;
+} RowRender;
+
+typedef struct {
+  guint rendered;
+  guint compared;
+  guint mismatched;
+  guint failed;
+} RenderStats;
+
+static void del_text_style(TextStyle* ts) {
+  if (!ts) return;
+  g_free(ts->font);
+  g_free(ts);
+}
+
+static gdouble parse_double(const gchar* str, gdouble fallback) {
+  if (!str) return fallback;
+  gchar* end = NULL;
+  gdouble value = g_ascii_strtod(str, &end);
+  return end == str ? fallback : value;
+}
+
+// Colors are stored as (color-rgb r g b) or (color-rgba r g b a) in 0..1
+static void parse_text_color(const gchar* value, gdouble color[4]) {
+  color[0] = color[1] = color[2] = 0.0;
+  color[3] = 1.0;
+  if (!value) return;
+  const gchar* p = NULL;
+  if (g_str_has_prefix(value, "(color-rgba ")) p = value + strlen("(color-rgba ");
+  else if (g_str_has_prefix(value, "(color-rgb ")) p = value + strlen("(color-rgb ");
+  if (!p) return;
+  for (gint i = 0; i < 4; ++i) {
+    gchar* end = NULL;
+    gdouble c = g_ascii_strtod(p, &end);
+    if (end == p) break;
+    color[i] = CLAMP(c, 0.0, 1.0);
+    p = end;
+  }
+}
+
+static gdouble unit_to_pixels(const gchar* unit, gdouble resolution) {
+  if (!unit || 0 == g_strcmp0(unit, "pixels")) return 1.0;
+  if (0 == g_strcmp0(unit, "points")) return resolution / 72.0;
+  if (0 == g_strcmp0(unit, "inches")) return resolution;
+  if (0 == g_strcmp0(unit, "millimeters")) return resolution / 25.4;
+  if (0 == g_strcmp0(unit, "picas")) return resolution / 6.0;
+  return 1.0;
+}
+
+static TextStyle* new_text_style(XcfImage* xcf, XcfLayer* layer) {
+  TextStyle* ts = g_malloc0(sizeof(TextStyle));
+  ts->font = xcf_text_property(layer->text_parasite, "font");
+  if (!ts->font) ts->font = g_strdup("Sans-serif");
+  gchar* value = xcf_text_property(layer->text_parasite, "font-size");
+  ts->font_size = parse_double(value, 18.0);
+  g_free(value);
+  value = xcf_text_property(layer->text_parasite, "font-size-unit");
+  ts->unit_pixels = unit_to_pixels(value, xcf->yres);
+  g_free(value);
+  value = xcf_text_property(layer->text_parasite, "line-spacing");
+  ts->line_spacing = parse_double(value, 0.0);
+  g_free(value);
+  value = xcf_text_property(layer->text_parasite, "letter-spacing");
+  ts->letter_spacing = parse_double(value, 0.0);
+  g_free(value);
+  value = xcf_text_property(layer->text_parasite, "justify");
+  ts->alignment = PANGO_ALIGN_LEFT;
+  if (0 == g_strcmp0(value, "right")) ts->alignment = PANGO_ALIGN_RIGHT;
+  else if (0 == g_strcmp0(value, "center")) ts->alignment = PANGO_ALIGN_CENTER;
+  ts->justify = 0 == g_strcmp0(value, "fill");
+  g_free(value);
+  value = xcf_text_property(layer->text_parasite, "color");
+  parse_text_color(value, ts->color);
+  g_free(value);
+  return ts;
+}
+
+static PangoLayout* new_text_style_layout(PangoContext* context, TextStyle* ts, gdouble font_size, gint width, const gchar* text) {
+  PangoLayout* layout = pango_layout_new(context);
+  PangoFontDescription* font_desc = pango_font_description_from_string(ts->font);
+  pango_font_description_set_absolute_size(font_desc, font_size * ts->unit_pixels * PANGO_SCALE);
+  pango_layout_set_font_description(layout, font_desc);
+  pango_font_description_free(font_desc);
+  if (ts->line_spacing != 0.0) {
+    pango_layout_set_spacing(layout, (int)(ts->line_spacing * PANGO_SCALE));
+  }
+  if (ts->letter_spacing != 0.0) {
+    PangoAttrList* attrs = pango_attr_list_new();
+    pango_attr_list_insert(attrs, pango_attr_letter_spacing_new((int)(ts->letter_spacing * PANGO_SCALE)));
+    pango_layout_set_attributes(layout, attrs);
+    pango_attr_list_unref(attrs);
+  }
+  pango_layout_set_width(layout, width * PANGO_SCALE);
+  pango_layout_set_wrap(layout, PANGO_WRAP_WORD_CHAR);
+  pango_layout_set_alignment(layout, ts->alignment);
+  pango_layout_set_justify(layout, ts->justify);
+  pango_layout_set_text(layout, text, -1);
+  return layout;
+}
+
+static TemplateRenderer* new_template_renderer(XcfImage* xcf, gchar* assets_dir) {
+  TemplateRenderer* tr = g_malloc(sizeof(TemplateRenderer));
+  tr->xcf = xcf;
+  tr->assets_dir = assets_dir;
+  PangoFontMap* font_map = pango_cairo_font_map_new();
+  tr->pango = pango_font_map_create_context(font_map);
+  g_object_unref(font_map);
+  tr->surfaces = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)&cairo_surface_destroy);
+  tr->styles = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)&del_text_style);
+  return tr;
+}
+
+static void del_template_renderer(TemplateRenderer* tr) {
+  if (!tr) return;
+  g_hash_table_destroy(tr->surfaces);
+  g_hash_table_destroy(tr->styles);
+  g_object_unref(tr->pango);
+  xcf_image_free(tr->xcf);
+  g_free(tr->assets_dir);
+  g_free(tr);
+}
+
+static cairo_surface_t* template_layer_surface(TemplateRenderer* tr, XcfLayer* layer) {
+  cairo_surface_t* surface = g_hash_table_lookup(tr->surfaces, layer);
+  if (!surface) {
+    surface = xcf_layer_load_surface(tr->xcf, layer);
+    if (surface) g_hash_table_insert(tr->surfaces, layer, surface);
+  }
+  return surface;
+}
+
+static TextStyle* template_text_style(TemplateRenderer* tr, XcfLayer* layer) {
+  TextStyle* ts = g_hash_table_lookup(tr->styles, layer);
+  if (!ts) {
+    ts = new_text_style(tr->xcf, layer);
+    g_hash_table_insert(tr->styles, layer, ts);
+  }
+  return ts;
+}
+
+static void del_layer_override(LayerOverride* lo) {
+  if (!lo) return;
+  if (lo->asset) cairo_surface_destroy(lo->asset);
+  g_free(lo->text);
+  g_free(lo);
+}
+
+static RowRender* new_row_render(void) {
+  RowRender* rr = g_malloc(sizeof(RowRender));
+  rr->overrides = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)&del_layer_override);
+  rr->icons = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)&g_ptr_array_unref);
+  return rr;
+}
+
+static void del_row_render(RowRender* rr) {
+  if (!rr) return;
+  g_hash_table_destroy(rr->overrides);
+  g_hash_table_destroy(rr->icons);
+  g_free(rr);
+}
+
+static LayerOverride* row_override(RowRender* rr, XcfLayer* layer) {
+  LayerOverride* lo = g_hash_table_lookup(rr->overrides, layer);
+  if (!lo) {
+    lo = g_malloc0(sizeof(LayerOverride));
+    lo->visible = layer->visible;
+    g_hash_table_insert(rr->overrides, layer, lo);
+  }
+  return lo;
+}
+
+static void row_add_icon(RowRender* rr, gpointer parent, IconPlacement* icon) {
+  GPtrArray* icons = g_hash_table_lookup(rr->icons, parent);
+  if (!icons) {
+    icons = g_ptr_array_new_with_free_func(g_free);
+    g_hash_table_insert(rr->icons, parent, icons);
+  }
+  g_ptr_array_add(icons, icon);
+}
+
+static cairo_surface_t* surface_from_pixbuf(GdkPixbuf* pixbuf) {
+  gint width = gdk_pixbuf_get_width(pixbuf);
+  gint height = gdk_pixbuf_get_height(pixbuf);
+  gint channels = gdk_pixbuf_get_n_channels(pixbuf);
+  gint src_stride = gdk_pixbuf_get_rowstride(pixbuf);
+  const guint8* src = gdk_pixbuf_read_pixels(pixbuf);
+  cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  guint8* dst = cairo_image_surface_get_data(surface);
+  gint dst_stride = cairo_image_surface_get_stride(surface);
+  for (gint y = 0; y < height; ++y) {
+    const guint8* p = src + y * src_stride;
+    guint32* row = (guint32*)(dst + y * dst_stride);
+    for (gint x = 0; x < width; ++x, p += channels) {
+      guint a = channels == 4 ? p[3] : 255;
+      row[x] = (a << 24) | (((p[0] * a + 127) / 255) << 16) | (((p[1] * a + 127) / 255) << 8) | ((p[2] * a + 127) / 255);
+    }
+  }
+  cairo_surface_mark_dirty(surface);
+  return surface;
+}
+
+static GdkPixbuf* pixbuf_from_surface(cairo_surface_t* surface) {
+  cairo_surface_flush(surface);
+  gint width = cairo_image_surface_get_width(surface);
+  gint height = cairo_image_surface_get_height(surface);
+  const guint8* src = cairo_image_surface_get_data(surface);
+  gint src_stride = cairo_image_surface_get_stride(surface);
+  GdkPixbuf* pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+  guint8* dst = gdk_pixbuf_get_pixels(pixbuf);
+  gint dst_stride = gdk_pixbuf_get_rowstride(pixbuf);
+  for (gint y = 0; y < height; ++y) {
+    const guint32* row = (const guint32*)(src + y * src_stride);
+    guint8* p = dst + y * dst_stride;
+    for (gint x = 0; x < width; ++x, p += 4) {
+      guint32 argb = row[x];
+      guint a = argb >> 24;
+      if (a == 0) {
+        p[0] = p[1] = p[2] = p[3] = 0;
+        continue;
+      }
+      p[0] = (((argb >> 16) & 0xff) * 255 + a / 2) / a;
+      p[1] = (((argb >> 8) & 0xff) * 255 + a / 2) / a;
+      p[2] = ((argb & 0xff) * 255 + a / 2) / a;
+      p[3] = a;
+    }
+  }
+  return pixbuf;
+}
+
+// Blend modes map to Cairo operators, which pixman runs with SIMD kernels.
+// Modes without counterpart fall back to normal.
+static cairo_operator_t operator_from_layer_mode(gint mode) {
+  switch (mode) {
+    case XCF_MODE_MULTIPLY_LEGACY:
+    case XCF_MODE_MULTIPLY: return CAIRO_OPERATOR_MULTIPLY;
+    case XCF_MODE_SCREEN_LEGACY:
+    case XCF_MODE_SCREEN: return CAIRO_OPERATOR_SCREEN;
+    // Legacy overlay of GIMP is soft light in fact
+    case XCF_MODE_OVERLAY_LEGACY:
+    case XCF_MODE_SOFTLIGHT_LEGACY:
+    case XCF_MODE_SOFTLIGHT: return CAIRO_OPERATOR_SOFT_LIGHT;
+    case XCF_MODE_OVERLAY: return CAIRO_OPERATOR_OVERLAY;
+    case XCF_MODE_DIFFERENCE_LEGACY:
+    case XCF_MODE_DIFFERENCE: return CAIRO_OPERATOR_DIFFERENCE;
+    case XCF_MODE_ADDITION_LEGACY:
+    case XCF_MODE_ADDITION: return CAIRO_OPERATOR_ADD;
+    case XCF_MODE_DARKEN_ONLY_LEGACY:
+    case XCF_MODE_DARKEN_ONLY: return CAIRO_OPERATOR_DARKEN;
+    case XCF_MODE_LIGHTEN_ONLY_LEGACY:
+    case XCF_MODE_LIGHTEN_ONLY: return CAIRO_OPERATOR_LIGHTEN;
+    case XCF_MODE_DODGE_LEGACY:
+    case XCF_MODE_DODGE: return CAIRO_OPERATOR_COLOR_DODGE;
+    case XCF_MODE_BURN_LEGACY:
+    case XCF_MODE_BURN: return CAIRO_OPERATOR_COLOR_BURN;
+    case XCF_MODE_HARDLIGHT_LEGACY:
+    case XCF_MODE_HARDLIGHT: return CAIRO_OPERATOR_HARD_LIGHT;
+    case XCF_MODE_EXCLUSION: return CAIRO_OPERATOR_EXCLUSION;
+    case XCF_MODE_HSV_HUE_LEGACY:
+    case XCF_MODE_HSV_HUE: return CAIRO_OPERATOR_HSL_HUE;
+    case XCF_MODE_HSV_SATURATION_LEGACY:
+    case XCF_MODE_HSV_SATURATION: return CAIRO_OPERATOR_HSL_SATURATION;
+    case XCF_MODE_HSL_COLOR_LEGACY:
+    case XCF_MODE_HSL_COLOR: return CAIRO_OPERATOR_HSL_COLOR;
+    case XCF_MODE_HSV_VALUE_LEGACY:
+    case XCF_MODE_HSV_VALUE: return CAIRO_OPERATOR_HSL_LUMINOSITY;
+    default: return CAIRO_OPERATOR_OVER;
+  }
+}
+
+// Rotates around center of box like gimp_item_transform_rotate with auto
+// center does
+static void rotate_around_center(cairo_t* cr, gdouble x, gdouble y, gint width, gint height, gdouble degrees) {
+  if (degrees == 0.0) return;
+  cairo_translate(cr, x + width / 2.0, y + height / 2.0);
+  cairo_rotate(cr, degrees * G_PI / 180.0);
+  cairo_translate(cr, -(x + width / 2.0), -(y + height / 2.0));
+}
+
+static void paint_surface(cairo_t* cr, cairo_surface_t* surface, gdouble x, gdouble y, gdouble opacity, gint mode) {
+  cairo_save(cr);
+  cairo_set_operator(cr, operator_from_layer_mode(mode));
+  cairo_set_source_surface(cr, surface, x, y);
+  cairo_rectangle(cr, x, y, cairo_image_surface_get_width(surface), cairo_image_surface_get_height(surface));
+  cairo_clip(cr);
+  cairo_paint_with_alpha(cr, opacity);
+  cairo_restore(cr);
+}
+
+static void paint_text(cairo_t* cr, TemplateRenderer* tr, XcfLayer* layer, LayerOverride* lo) {
+  gdouble y = layer->offset_y + lo->offset_y;
+  PangoLayout* layout = new_text_style_layout(tr->pango, lo->style, lo->font_size, layer->width, lo->text);
+  pango_cairo_update_context(cr, tr->pango);
+  pango_layout_context_changed(layout);
+  cairo_save(cr);
+  cairo_rectangle(cr, layer->offset_x, y, layer->width, layer->height);
+  cairo_clip(cr);
+  cairo_push_group(cr);
+  cairo_set_source_rgba(cr, lo->style->color[0], lo->style->color[1], lo->style->color[2], lo->style->color[3]);
+  cairo_move_to(cr, layer->offset_x, y);
+  pango_cairo_show_layout(cr, layout);
+  cairo_pop_group_to_source(cr);
+  cairo_set_operator(cr, operator_from_layer_mode(layer->mode));
+  cairo_paint_with_alpha(cr, layer->opacity);
+  cairo_restore(cr);
+  g_object_unref(layout);
+}
+
+static void composite_layers(cairo_t* cr, TemplateRenderer* tr, RowRender* rr, GPtrArray* layers, gpointer parent);
+
+static void composite_layer(cairo_t* cr, TemplateRenderer* tr, RowRender* rr, XcfLayer* layer) {
+  LayerOverride* lo = g_hash_table_lookup(rr->overrides, layer);
+  gboolean visible = lo ? lo->visible : layer->visible;
+  gdouble rotate = lo ? lo->rotate : 0.0;
+  if (visible) {
+    cairo_save(cr);
+    gint y = layer->offset_y + (lo ? lo->offset_y : 0);
+    rotate_around_center(cr, layer->offset_x, y, layer->width, layer->height, rotate);
+    if (layer->kind == XCF_LAYER_GROUP) {
+      if (layer->mode == XCF_MODE_PASS_THROUGH) {
+        composite_layers(cr, tr, rr, layer->children, layer);
+      } else {
+        cairo_push_group(cr);
+        composite_layers(cr, tr, rr, layer->children, layer);
+        cairo_pop_group_to_source(cr);
+        cairo_set_operator(cr, operator_from_layer_mode(layer->mode));
+        cairo_paint_with_alpha(cr, layer->opacity);
+      }
+    } else if (lo && lo->text) {
+      paint_text(cr, tr, layer, lo);
+    } else {
+      cairo_surface_t* surface = template_layer_surface(tr, layer);
+      if (surface) paint_surface(cr, surface, layer->offset_x, y, layer->opacity, layer->mode);
+    }
+    cairo_restore(cr);
+  }
+  if (lo && lo->asset) {
+    cairo_save(cr);
+    gint width = cairo_image_surface_get_width(lo->asset);
+    gint height = cairo_image_surface_get_height(lo->asset);
+    rotate_around_center(cr, layer->offset_x, layer->offset_y, width, height, lo->rotate);
+    paint_surface(cr, lo->asset, layer->offset_x, layer->offset_y, 1.0, XCF_MODE_NORMAL);
+    cairo_restore(cr);
+  }
+}
+
+// Layers are listed top to bottom, so they are painted in reverse. Keyword
+// icons were inserted at top of parent of their text layer.
+static void composite_layers(cairo_t* cr, TemplateRenderer* tr, RowRender* rr, GPtrArray* layers, gpointer parent) {
+  for (guint i = layers->len; i-- > 0;) {
+    composite_layer(cr, tr, rr, g_ptr_array_index(layers, i));
+  }
+  GPtrArray* icons = g_hash_table_lookup(rr->icons, parent);
+  for (guint i = 0; icons && i < icons->len; ++i) {
+    IconPlacement* icon = g_ptr_array_index(icons, i);
+    cairo_surface_t* surface = template_layer_surface(tr, icon->source);
+    if (!surface || icon->width <= 0 || icon->height <= 0) continue;
+    cairo_save(cr);
+    cairo_translate(cr, icon->x, icon->y);
+    cairo_scale(cr, (gdouble)icon->width / icon->source->width, (gdouble)icon->height / icon->source->height);
+    cairo_set_operator(cr, operator_from_layer_mode(icon->source->mode));
+    cairo_set_source_surface(cr, surface, 0, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+    cairo_rectangle(cr, 0, 0, icon->source->width, icon->source->height);
+    cairo_clip(cr);
+    cairo_paint_with_alpha(cr, icon->source->opacity);
+    cairo_restore(cr);
+  }
+}
+
+// Same as plugin: <<name>> of non text template layer is replaced by two
+// spaces and icon is centered at cursor after first of them
+static gchar* replace_keywords(const gchar* text, XcfImage* xcf, GPtrArray* sources, GArray* positions) {
+  GString* result = g_string_new(NULL);
+  const gchar* current = text;
+  const gchar* start;
+  while ((start = strstr(current, "<<")) != NULL) {
+    const gchar* end = strstr(start + 2, ">>");
+    if (!end) break;
+    gchar* name = g_strndup(start + 2, end - start - 2);
+    XcfLayer* source = xcf_image_find_layer(xcf, name);
+    g_free(name);
+    if (!source || source->kind != XCF_LAYER_RASTER) {
+      g_string_append_len(result, current, start + 2 - current);
+      current = start + 2;
+      continue;
+    }
+    g_string_append_len(result, current, start - current);
+    gsize position = result->len;
+    g_array_append_val(positions, position);
+    g_ptr_array_add(sources, source);
+    g_string_append(result, "  ");
+    current = end + 2;
+  }
+  g_string_append(result, current);
+  return g_string_free(result, FALSE);
+}
+
+static gboolean apply_text(TemplateRenderer* tr, RowRender* rr, XcfLayer* layer, LayerData* layer_data) {
+  LayerOverride* lo = row_override(rr, layer);
+  lo->visible = TRUE;
+  if (!layer_data->value || !*layer_data->value) return TRUE;
+
+  TextStyle* ts = template_text_style(tr, layer);
+  GPtrArray* sources = g_ptr_array_new();
+  GArray* positions = g_array_new(FALSE, FALSE, sizeof(gsize));
+  lo->text = replace_keywords(layer_data->value, tr->xcf, sources, positions);
+  lo->style = ts;
+
+  // Shrink by 1 unit until ink ends within layer height, like the plugin
+  gint ink_top = 0, ink_bottom = 0;
+  for (lo->font_size = ts->font_size; lo->font_size >= 1.0; lo->font_size -= 1.0) {
+    PangoLayout* layout = new_text_style_layout(tr->pango, ts, lo->font_size, layer->width, lo->text);
+    PangoRectangle ink;
+    pango_layout_get_pixel_extents(layout, &ink, NULL);
+    g_object_unref(layout);
+    ink_top = ink.y;
+    ink_bottom = ink.y + ink.height;
+    if (ink.height == 0 || ink_bottom <= layer->height) break;
+  }
+  if (lo->font_size < 1.0) {
+    printf("Could not fit text within bounds: %s\n", lo->text);
+    g_ptr_array_free(sources, TRUE);
+    g_array_free(positions, TRUE);
+    return FALSE;
+  }
+  if (layer_data->config->vcenter) {
+    lo->offset_y = -ink_top + (layer->height - (ink_bottom - ink_top)) / 2;
+  }
+
+  for (guint i = 0; i < sources->len; ++i) {
+    XcfLayer* source = g_ptr_array_index(sources, i);
+    gchar* prefix = g_strndup(lo->text, g_array_index(positions, gsize, i) + 1);
+    PangoLayout* layout = new_text_style_layout(tr->pango, ts, lo->font_size, layer->width, prefix);
+    PangoRectangle strong_pos, weak_pos;
+    pango_layout_get_cursor_pos(layout, strlen(prefix), &strong_pos, &weak_pos);
+    g_object_unref(layout);
+    g_free(prefix);
+
+    // Icon is 90% of font size in font unit with aspect ratio kept
+    gint image_size = (gint)(lo->font_size * 0.9);
+    gdouble aspect_ratio = (gdouble)source->width / source->height;
+    IconPlacement* icon = g_malloc(sizeof(IconPlacement));
+    icon->source = source;
+    icon->width = aspect_ratio > 1.0 ? image_size : (gint)(image_size * aspect_ratio);
+    icon->height = aspect_ratio > 1.0 ? (gint)(image_size / aspect_ratio) : image_size;
+    icon->x = layer->offset_x + PANGO_PIXELS(strong_pos.x + strong_pos.width / 2) - icon->width / 2;
+    icon->y = layer->offset_y + lo->offset_y + PANGO_PIXELS(strong_pos.y + strong_pos.height / 2) - icon->height / 2;
+    row_add_icon(rr, layer->parent ? (gpointer)layer->parent : (gpointer)tr->xcf, icon);
+  }
+  g_ptr_array_free(sources, TRUE);
+  g_array_free(positions, TRUE);
+  return TRUE;
+}
+
+static gboolean apply_image(TemplateRenderer* tr, RowRender* rr, XcfLayer* layer, LayerData* layer_data) {
+  gchar* asset_file = g_build_filename(tr->assets_dir, layer_data->value, NULL);
+  GError* error = NULL;
+  GdkPixbuf* pixbuf = gdk_pixbuf_new_from_file_at_scale(asset_file, layer->width, layer->height, FALSE, &error);
+  if (!pixbuf) {
+    printf("Unable to load %s: %s\n", asset_file, error->message);
+    g_error_free(error);
+    g_free(asset_file);
+    return FALSE;
+  }
+  g_free(asset_file);
+  LayerOverride* lo = row_override(rr, layer);
+  lo->visible = FALSE;
+  lo->asset = surface_from_pixbuf(pixbuf);
+  g_object_unref(pixbuf);
+  return TRUE;
+}
+
+static cairo_surface_t* render_component(TemplateRenderer* tr, GHashTable* config_layers, GHashTable* component_layers) {
+  RowRender* rr = new_row_render();
+  // Config layers are hidden unless row shows them
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, config_layers);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    row_override(rr, xcf_image_find_layer(tr->xcf, key))->visible = FALSE;
+  }
+
+  gboolean ok = TRUE;
+  g_hash_table_iter_init(&iter, component_layers);
+  while (ok && g_hash_table_iter_next(&iter, &key, &value)) {
+    // Layer of other XCF of template
+    if (!g_hash_table_contains(config_layers, key)) continue;
+    LayerData* layer_data = (LayerData*)value;
+    XcfLayer* layer = xcf_image_find_layer(tr->xcf, key);
+    switch (layer_data->config->type) {
+      case LAYER_TYPE_IMAGE:
+        ok = apply_image(tr, rr, layer, layer_data);
+        break;
+      case LAYER_TYPE_TEXT:
+        ok = apply_text(tr, rr, layer, layer_data);
+        break;
+      case LAYER_TYPE_BOOL:
+        row_override(rr, layer)->visible = TRUE;
+        break;
+      default:
+        ok = FALSE;
+        break;
+    }
+    if (ok) row_override(rr, layer)->rotate = layer_data->config->rotate;
+  }
+  if (!ok) {
+    del_row_render(rr);
+    return NULL;
+  }
+
+  cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, tr->xcf->width, tr->xcf->height);
+  cairo_t* cr = cairo_create(surface);
+  composite_layers(cr, tr, rr, tr->xcf->layers, tr->xcf);
+  cairo_destroy(cr);
+  del_row_render(rr);
+  return surface;
+}
+
+// Compares render with plugin output. Channels differing by no more than
+// tolerance count as equal.
+static gboolean compare_with_reference(GdkPixbuf* pixbuf, const gchar* reference_file, RendererOptions* options) {
+  GdkPixbuf* reference = image_diff_load(reference_file);
+  if (!reference) return FALSE;
+  ImageDiff diff = {0, 0, 0, 0};
+  if (!image_diff_pixbufs(pixbuf, reference, (guint8)CLAMP(options->tolerance, 0, 255), &diff)) {
+    printf("%s: size %dx%d differs from render %dx%d\n", reference_file,
+           gdk_pixbuf_get_width(reference), gdk_pixbuf_get_height(reference),
+           gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf));
+    g_object_unref(reference);
+    return FALSE;
+  }
+  g_object_unref(reference);
+  gdouble differing_percent = image_diff_differing_percent(&diff);
+  gboolean ok = differing_percent <= options->max_differing;
+  printf("%s %s: max diff %u, mean diff %.3f, %.3f%% pixels differ\n", ok ? "OK  " : "FAIL", reference_file,
+         diff.max_diff, image_diff_mean(&diff), differing_percent);
+  return ok;
+}
+
+static void render_template_xcf(gchar* name, ComponentTemplate* ct, TemplateXcf* template_xcf, gchar* xcfs_dir, gchar* assets_dir, RendererOptions* options, RenderStats* stats) {
+  gchar* xcf_filename = g_strconcat(template_xcf->name, ".xcf", NULL);
+  gchar* xcf_path = g_build_filename(xcfs_dir, xcf_filename, NULL);
+  g_free(xcf_filename);
+  XcfImage* xcf = xcf_image_open(xcf_path);
+  if (xcf && !xcf_image_pixels_supported(xcf)) {
+    printf("%s: only 8 bit precision is supported\n", xcf_path);
+    g_clear_pointer(&xcf, xcf_image_free);
+  }
+  g_free(xcf_path);
+  if (!xcf) {
+    ++stats->failed;
+    return;
+  }
+  GHashTable* layers = new_template_xcf_layers(ct, &xcf_has_layer, xcf);
+  if (xcf_check_config_layers(xcf, layers) > 0) {
+    g_hash_table_unref(layers);
+    xcf_image_free(xcf);
+    ++stats->failed;
+    return;
+  }
+  TemplateRenderer* tr = new_template_renderer(xcf, g_strdup(assets_dir));
+  gchar* out_dir = options->out_dir ? g_build_filename(options->out_dir, name, NULL) : NULL;
+  gchar* compare_dir = options->compare_dir ? g_build_filename(options->compare_dir, name, NULL) : NULL;
+  if (out_dir) g_mkdir_with_parents(out_dir, 0755);
+
+  for (guint i = 0; i < ct->data->len; ++i) {
+    ComponentData* component_data = (ComponentData*)g_ptr_array_index(ct->data, i);
+    cairo_surface_t* surface = render_component(tr, layers, component_data->layers);
+    if (!surface) {
+      printf("%s: unable to render row %u\n", name, i);
+      ++stats->failed;
+      continue;
+    }
+    ++stats->rendered;
+    GdkPixbuf* pixbuf = pixbuf_from_surface(surface);
+    cairo_surface_destroy(surface);
+    gchar* buffer = NULL;
+    gsize buffer_size = 0;
+    GError* error = NULL;
+    if (out_dir && !gdk_pixbuf_save_to_buffer(pixbuf, &buffer, &buffer_size, OUT_EXTENSION, &error, NULL)) {
+      printf("%s: unable to encode row %u: %s\n", name, i, error->message);
+      g_clear_error(&error);
+      ++stats->failed;
+    }
+    for (gint copy = 1; copy <= component_data->count; ++copy) {
+      if (buffer) {
+        gchar* out_file = new_component_out_file(i, component_data->layers, out_dir, ct->out_key, template_xcf->suffix, copy);
+        if (!g_file_set_contents(out_file, buffer, buffer_size, &error)) {
+          printf("Unable to write %s: %s\n", out_file, error->message);
+          g_clear_error(&error);
+          ++stats->failed;
+        }
+        g_free(out_file);
+      }
+      if (compare_dir) {
+        gchar* reference_file = new_component_out_file(i, component_data->layers, compare_dir, ct->out_key, template_xcf->suffix, copy);
+        ++stats->compared;
+        if (!compare_with_reference(pixbuf, reference_file, options)) ++stats->mismatched;
+        g_free(reference_file);
+      }
+    }
+    g_free(buffer);
+    g_object_unref(pixbuf);
+  }
+  g_free(compare_dir);
+  g_free(out_dir);
+  del_template_renderer(tr);
+  g_hash_table_unref(layers);
+}
+
+// XCFs of template share its rows and are rendered one after another
+static void render_template(gchar* name, ComponentTemplate* ct, gchar* xcfs_dir, gchar* assets_dir, RendererOptions* options, RenderStats* stats) {
+  for (guint i = 0; i < ct->xcfs->len; ++i) {
+    render_template_xcf(name, ct, (TemplateXcf*)g_ptr_array_index(ct->xcfs, i), xcfs_dir, assets_dir, options, stats);
+  }
+}
+
+int main(int argc, char** argv) {
+  RendererOptions options = {NULL, NULL, NULL, 16, 0.5};
+  GOptionEntry entries[] = {
+    {"out", 'o', 0, G_OPTION_ARG_FILENAME, &options.out_dir, "Output directory, <project>/out by default", "DIR"},
+    {"compare", 'c', 0, G_OPTION_ARG_FILENAME, &options.compare_dir, "Compare renders with plugin outputs in DIR instead of writing them", "DIR"},
+    {"template", 't', 0, G_OPTION_ARG_STRING, &options.template_name, "Render only this template", "NAME"},
+    {"tolerance", 0, 0, G_OPTION_ARG_INT, &options.tolerance, "Channel difference still counted as equal, 16 by default", "N"},
+    {"max-differing", 0, 0, G_OPTION_ARG_DOUBLE, &options.max_differing, "Percent of differing pixels allowed, 0.5 by default", "PERCENT"},
+    {NULL}
+  };
+  GOptionContext* context = g_option_context_new("PROJECT_DIR - render components without GIMP");
+  g_option_context_add_main_entries(context, entries, NULL);
+  GError* error = NULL;
+  if (!g_option_context_parse(context, &argc, &argv, &error) || argc != 2) {
+    printf("%s\n", error ? error->message : "Usage: native-renderer [OPTION...] PROJECT_DIR");
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 2;
+  }
+  g_option_context_free(context);
+
+  gchar* project_dir = argv[1];
+  gchar* config_path = g_build_filename(project_dir, "config.json", NULL);
+  gchar* xcfs_dir = g_build_filename(project_dir, "xcfs", NULL);
+  gchar* assets_dir = g_build_filename(project_dir, "assets", NULL);
+  if (!options.out_dir && !options.compare_dir) {
+    options.out_dir = g_build_filename(project_dir, "out", NULL);
+  }
+
+  GHashTable* xcfs = parse_json_config(config_path);
+  if (!xcfs) {
+    printf("Failed to parse %s\n", config_path);
+    return 1;
+  }
+  RenderStats stats = {0, 0, 0, 0};
+  GList* names = g_list_sort(g_hash_table_get_keys(xcfs), (GCompareFunc)&g_strcmp0);
+  for (GList* n = names; n != NULL; n = n->next) {
+    if (options.template_name && 0 != g_strcmp0(options.template_name, n->data)) continue;
+    printf("Rendering %s\n", (gchar*)n->data);
+    render_template(n->data, g_hash_table_lookup(xcfs, n->data), xcfs_dir, assets_dir, &options, &stats);
+  }
+  g_list_free(names);
+
+  printf("Rendered %u components, %u failed\n", stats.rendered, stats.failed);
+  if (options.compare_dir) {
+    printf("Compared %u outputs, %u differ beyond tolerance\n", stats.compared, stats.mismatched);
+  }
+  g_hash_table_destroy(xcfs);
+  g_free(config_path);
+  g_free(xcfs_dir);
+  g_free(assets_dir);
+  g_free(options.out_dir);
+  g_free(options.compare_dir);
+  g_free(options.template_name);
+  return stats.failed > 0 || stats.mismatched > 0 ? 1 : 0;
+}
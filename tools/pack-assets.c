@@ -0,0 +1,161 @@
+// Builds asset pack from assets directory of project, so plugin maps one file
+// instead of opening every asset. Pack is written to temporary file and
+// renamed over the old one, so running generator never sees partial pack.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "boardgame-component-pack.h"
+
+// Paths of all files under root relative to it, with '/' separators as
+// stored in pack. Hidden files and directories are skipped.
+static void collect_assets(const gchar* root, const gchar* relative, GPtrArray* names) {
+  gchar* dir_path = relative ? g_build_filename(root, relative, NULL) : g_strdup(root);
+  GDir* dir = g_dir_open(dir_path, 0, NULL);
+  if (!dir) {
+    g_free(dir_path);
+    return;
+  }
+  const gchar* name;
+  while ((name = g_dir_read_name(dir)) != NULL) {
+    if (name[0] == '.') continue;
+    gchar* child = relative ? g_strconcat(relative, "/", name, NULL) : g_strdup(name);
+    gchar* child_path = g_build_filename(dir_path, name, NULL);
+    if (g_file_test(child_path, G_FILE_TEST_IS_DIR)) {
+      collect_assets(root, child, names);
+      g_free(child);
+    } else if (g_file_test(child_path, G_FILE_TEST_IS_REGULAR)) {
+      g_ptr_array_add(names, child);
+    } else {
+      g_free(child);
+    }
+    g_free(child_path);
+  }
+  g_dir_close(dir);
+  g_free(dir_path);
+}
+
+static gint compare_names(gconstpointer a, gconstpointer b) {
+  return strcmp(*(const gchar**)a, *(const gchar**)b);
+}
+
+static gboolean write_all(FILE* file, gconstpointer data, gsize length) {
+  return length == 0 || fwrite(data, 1, length, file) == length;
+}
+
+// Writes assets in order of names, returns number of data bytes or -1
+static gint64 write_asset_pack(const gchar* assets_dir, GPtrArray* names, const gchar* pack_path) {
+  // Lengths are taken up front, as index precedes data
+  GArray* lengths = g_array_sized_new(FALSE, FALSE, sizeof(guint64), names->len);
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE(ASSET_PACK_INDEX_TYPE));
+  guint64 offset = 0;
+  for (guint i = 0; i < names->len; ++i) {
+    const gchar* name = (const gchar*)g_ptr_array_index(names, i);
+    gchar* path = g_build_filename(assets_dir, name, NULL);
+    GStatBuf st;
+    gboolean exists = g_stat(path, &st) == 0;
+    guint64 length = exists ? (guint64)st.st_size : 0;
+    gint64 mtime_ns = exists ? asset_pack_mtime_ns(&st) : 0;
+    g_free(path);
+    g_array_append_val(lengths, length);
+    g_variant_builder_add(&builder, "{s(ttx)}", name, offset, length, mtime_ns);
+    offset += length;
+  }
+  GVariant* index = g_variant_ref_sink(g_variant_builder_end(&builder));
+  if (G_BYTE_ORDER == G_BIG_ENDIAN) {
+    GVariant* swapped = g_variant_ref_sink(g_variant_byteswap(index));
+    g_variant_unref(index);
+    index = swapped;
+  }
+  guint64 index_size = g_variant_get_size(index);
+  guint64 index_size_le = GUINT64_TO_LE(index_size);
+  static const gchar padding[8] = {0};
+  gsize padding_size = asset_pack_data_offset(index_size) - ASSET_PACK_HEADER_SIZE - index_size;
+
+  gchar* tmp_path = g_strdup_printf("%s.%u.tmp", pack_path, g_random_int());
+  FILE* file = g_fopen(tmp_path, "wb");
+  gboolean ret = file != NULL;
+  if (!ret) {
+    printf("Unable to create %s\n", tmp_path);
+  }
+  ret = ret && write_all(file, ASSET_PACK_MAGIC, 8);
+  ret = ret && write_all(file, &index_size_le, sizeof(index_size_le));
+  ret = ret && write_all(file, g_variant_get_data(index), index_size);
+  ret = ret && write_all(file, padding, padding_size);
+  for (guint i = 0; ret && i < names->len; ++i) {
+    const gchar* name = (const gchar*)g_ptr_array_index(names, i);
+    gchar* path = g_build_filename(assets_dir, name, NULL);
+    GMappedFile* mapped_file = g_mapped_file_new(path, FALSE, NULL);
+    if (!mapped_file || g_mapped_file_get_length(mapped_file) != g_array_index(lengths, guint64, i)) {
+      printf("Unable to read %s or it changed while packing\n", path);
+      ret = FALSE;
+    } else {
+      ret = write_all(file, g_mapped_file_get_contents(mapped_file), g_mapped_file_get_length(mapped_file));
+    }
+    if (mapped_file) g_mapped_file_unref(mapped_file);
+    g_free(path);
+  }
+  if (file && fclose(file) != 0) ret = FALSE;
+  if (ret && g_rename(tmp_path, pack_path) != 0) {
+    printf("Unable to rename %s to %s\n", tmp_path, pack_path);
+    ret = FALSE;
+  }
+  if (!ret) g_unlink(tmp_path);
+  g_free(tmp_path);
+  g_variant_unref(index);
+  g_array_free(lengths, TRUE);
+  return ret ? (gint64)offset : -1;
+}
+
+int main(int argc, char** argv) {
+  gboolean list = FALSE;
+  GOptionEntry entries[] = {
+    {"list", 'l', 0, G_OPTION_ARG_NONE, &list, "List assets of existing PACK_FILE with their sizes", NULL},
+    {NULL}
+  };
+  GOptionContext* context = g_option_context_new("ASSETS_DIR PACK_FILE - pack all assets into single file");
+  g_option_context_add_main_entries(context, entries, NULL);
+  GError* error = NULL;
+  if (!g_option_context_parse(context, &argc, &argv, &error) || argc != 3) {
+    printf("%s\n", error ? error->message : "Usage: pack-assets [OPTION...] ASSETS_DIR PACK_FILE");
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 2;
+  }
+  g_option_context_free(context);
+  const gchar* assets_dir = argv[1];
+  const gchar* pack_path = argv[2];
+
+  gint64 start = g_get_monotonic_time();
+  if (!list) {
+    GPtrArray* names = g_ptr_array_new_with_free_func(g_free);
+    collect_assets(assets_dir, NULL, names);
+    g_ptr_array_sort(names, &compare_names);
+    gint64 data_size = write_asset_pack(assets_dir, names, pack_path);
+    guint count = names->len;
+    g_ptr_array_free(names, TRUE);
+    if (data_size < 0) return 1;
+    printf("Packed %u assets, %.1f MiB, in %.2f s\n", count, data_size / 1048576.0, (g_get_monotonic_time() - start) / 1e6);
+  }
+
+  // Pack is read back the way plugin reads it
+  AssetPack* pack = new_asset_pack(pack_path, assets_dir);
+  if (!pack) return 1;
+  if (list) {
+    GVariantIter iter;
+    const gchar* name;
+    guint64 offset, length;
+    gint64 mtime_ns;
+    g_variant_iter_init(&iter, pack->index);
+    while (g_variant_iter_next(&iter, "{&s(ttx)}", &name, &offset, &length, &mtime_ns)) {
+      printf("%12" G_GUINT64_FORMAT " %s\n", length, name);
+    }
+  }
+  guint count = g_hash_table_size(pack->names);
+  gboolean ret = count == g_variant_n_children(pack->index);
+  del_asset_pack(pack);
+  return ret ? 0 : 1;
+}
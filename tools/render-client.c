@@ -0,0 +1,141 @@
+// Sends render job to job server of plugin and prints its status lines until
+// job finishes. Exits with non-zero status when job fails.
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <json-glib/json-glib.h>
+
+static const gchar* const DEFAULT_SOCKET_PATH = "/tmp/boardgame-component-generator.sock";
+
+static gchar* new_job_request(const gchar* project_dir, gchar** templates, gint first_row, gint last_row, gboolean dry_run, JsonNode* options, gboolean shutdown) {
+  JsonBuilder* builder = json_builder_new();
+  json_builder_begin_object(builder);
+  if (shutdown) {
+    json_builder_set_member_name(builder, "shutdown");
+    json_builder_add_boolean_value(builder, TRUE);
+  } else {
+    json_builder_set_member_name(builder, "project_dir");
+    json_builder_add_string_value(builder, project_dir);
+    if (templates) {
+      json_builder_set_member_name(builder, "templates");
+      json_builder_begin_array(builder);
+      for (gchar** t = templates; *t; ++t) {
+        json_builder_add_string_value(builder, *t);
+      }
+      json_builder_end_array(builder);
+    }
+    json_builder_set_member_name(builder, "first_row");
+    json_builder_add_int_value(builder, first_row);
+    json_builder_set_member_name(builder, "last_row");
+    json_builder_add_int_value(builder, last_row);
+    json_builder_set_member_name(builder, "dry_run");
+    json_builder_add_boolean_value(builder, dry_run);
+    if (options) {
+      json_builder_set_member_name(builder, "options");
+      json_builder_add_value(builder, json_node_copy(options));
+    }
+  }
+  json_builder_end_object(builder);
+  JsonNode* root = json_builder_get_root(builder);
+  JsonGenerator* generator = json_generator_new();
+  json_generator_set_root(generator, root);
+  gchar* json = json_generator_to_data(generator, NULL);
+  gchar* line = g_strconcat(json, "\n", NULL);
+  g_free(json);
+  g_object_unref(generator);
+  json_node_free(root);
+  g_object_unref(builder);
+  return line;
+}
+
+static gchar* read_status(const gchar* line) {
+  JsonParser* parser = json_parser_new();
+  gchar* status = NULL;
+  if (json_parser_load_from_data(parser, line, -1, NULL)) {
+    JsonReader* reader = json_reader_new(json_parser_get_root(parser));
+    if (json_reader_read_member(reader, "status")) {
+      status = g_strdup(json_reader_get_string_value(reader));
+    }
+    json_reader_end_member(reader);
+    g_object_unref(reader);
+  }
+  g_object_unref(parser);
+  return status;
+}
+
+int main(int argc, char** argv) {
+  gchar* socket_path = NULL;
+  gchar** templates = NULL;
+  gint first_row = 0;
+  gint last_row = -1;
+  gboolean dry_run = FALSE;
+  gboolean shutdown = FALSE;
+  gchar* options_json = NULL;
+  GOptionEntry entries[] = {
+    {"socket", 's', 0, G_OPTION_ARG_FILENAME, &socket_path, "Socket of job server", "PATH"},
+    {"template", 't', 0, G_OPTION_ARG_STRING_ARRAY, &templates, "Render only this template, may be repeated", "NAME"},
+    {"first-row", 0, 0, G_OPTION_ARG_INT, &first_row, "First data row to render", "N"},
+    {"last-row", 0, 0, G_OPTION_ARG_INT, &last_row, "Last data row to render", "N"},
+    {"dry-run", 0, 0, G_OPTION_ARG_NONE, &dry_run, "Only validate project", NULL},
+    {"options", 'o', 0, G_OPTION_ARG_STRING, &options_json, "JSON object of output options overriding options.json, e.g. {\"archive\": \"zip\"}", "JSON"},
+    {"shutdown", 0, 0, G_OPTION_ARG_NONE, &shutdown, "Stop job server after queued jobs", NULL},
+    {NULL}
+  };
+  GOptionContext* context = g_option_context_new("PROJECT_DIR - render project with job server");
+  g_option_context_add_main_entries(context, entries, NULL);
+  GError* error = NULL;
+  if (!g_option_context_parse(context, &argc, &argv, &error) || (!shutdown && argc != 2)) {
+    printf("%s\n", error ? error->message : "Usage: render-client [OPTION...] PROJECT_DIR");
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 2;
+  }
+  g_option_context_free(context);
+  JsonNode* options = options_json ? json_from_string(options_json, &error) : NULL;
+  if (options_json && (!options || !JSON_NODE_HOLDS_OBJECT(options))) {
+    printf("Options are not JSON object: %s\n", error ? error->message : options_json);
+    g_clear_error(&error);
+    if (options) json_node_free(options);
+    g_free(options_json);
+    return 2;
+  }
+
+  gchar* project_dir = shutdown ? NULL : g_canonicalize_filename(argv[1], NULL);
+  gchar* request = new_job_request(project_dir, templates, first_row, last_row, dry_run, options, shutdown);
+  GSocketAddress* address = g_unix_socket_address_new(socket_path ? socket_path : DEFAULT_SOCKET_PATH);
+  GSocketClient* client = g_socket_client_new();
+  GSocketConnection* connection = g_socket_client_connect(client, G_SOCKET_CONNECTABLE(address), NULL, &error);
+  gboolean ok = FALSE;
+  if (!connection) {
+    printf("Unable to connect to job server: %s\n", error->message);
+    g_error_free(error);
+  } else if (g_output_stream_write_all(g_io_stream_get_output_stream(G_IO_STREAM(connection)), request, strlen(request), NULL, NULL, &error)) {
+    GDataInputStream* input = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+    gchar* line;
+    while ((line = g_data_input_stream_read_line(input, NULL, NULL, NULL)) != NULL) {
+      printf("%s\n", line);
+      fflush(stdout);
+      gchar* status = read_status(line);
+      ok = g_strcmp0(status, "done") == 0;
+      g_free(status);
+      g_free(line);
+    }
+    g_object_unref(input);
+  } else {
+    printf("Unable to send job: %s\n", error->message);
+    g_error_free(error);
+  }
+
+  if (connection) g_object_unref(connection);
+  g_object_unref(client);
+  g_object_unref(address);
+  g_free(request);
+  g_free(project_dir);
+  g_free(socket_path);
+  g_strfreev(templates);
+  if (options) json_node_free(options);
+  g_free(options_json);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+// Checks of config against template layers read with xcf-reader, shared by
+// standalone tools. Include after boardgame-component-config.h.
+#ifndef XCF_CONFIG_H
+#define XCF_CONFIG_H
+
+#include "xcf-reader.h"
+
+static inline const gchar* xcf_layer_kind_str(XcfLayerKind kind) {
+  switch (kind) {
+    case XCF_LAYER_TEXT: return "text";
+    case XCF_LAYER_GROUP: return "group";
+    default: return "image";
+  }
+}
+
+static inline gboolean xcf_has_layer(gpointer image, const gchar* name) {
+  return xcf_image_find_layer((XcfImage*)image, name) != NULL;
+}
+
+// Same checks as plugin does before rendering: every configured layer
+// exists and text layers are configured as text. Returns number of problems.
+static inline guint xcf_check_config_layers(XcfImage* xcf, GHashTable* layers) {
+  guint problems = 0;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, layers);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    XcfLayer* layer = xcf_image_find_layer(xcf, key);
+    if (!layer) {
+      printf("Failed to find %s layer in image\n", (gchar*)key);
+      ++problems;
+      continue;
+    }
+    LayerType layer_type = ((LayerConfig*)value)->type;
+    gboolean is_text_layer = layer->kind == XCF_LAYER_TEXT;
+    if (!((layer_type == LAYER_TYPE_IMAGE && !is_text_layer)
+        || (layer_type == LAYER_TYPE_TEXT && is_text_layer)
+        || layer_type == LAYER_TYPE_BOOL)) {
+      printf("Layer %s type missmatch\n", (gchar*)key);
+      printf("  Config: %s\n", str_from_layer_type(layer_type));
+      printf("  Image: %s\n", xcf_layer_kind_str(layer->kind));
+      ++problems;
+    } else if (layer->has_mask) {
+      printf("Layer %s has mask, which native renderer ignores\n", (gchar*)key);
+    }
+  }
+  return problems;
+}
+
+#endif // XCF_CONFIG_H
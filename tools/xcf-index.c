@@ -0,0 +1,113 @@
+// Prints layer tree of XCF templates or checks project config against them
+// without GIMP. Only header and layer property records are read, tile data
+// is never touched.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "boardgame-component-config.h"
+#include "xcf-reader.h"
+#include "xcf-config.h"
+
+static void print_layers(GPtrArray* layers, gint depth) {
+  for (guint i = 0; i < layers->len; ++i) {
+    XcfLayer* layer = g_ptr_array_index(layers, i);
+    printf("%*s%s [%s] %dx%d%+d%+d opacity %.0f%% mode %d%s%s\n", depth * 2, "", layer->name,
+           xcf_layer_kind_str(layer->kind), layer->width, layer->height, layer->offset_x, layer->offset_y,
+           layer->opacity * 100.0, layer->mode, layer->visible ? "" : " hidden", layer->has_mask ? " masked" : "");
+    if (layer->children) print_layers(layer->children, depth + 1);
+  }
+}
+
+static gboolean print_xcf(const gchar* path) {
+  XcfImage* xcf = xcf_image_open(path);
+  if (!xcf) return FALSE;
+  printf("%s: %dx%d, XCF version %d, %u layers\n", path, xcf->width, xcf->height, xcf->version, xcf->all_layers->len);
+  print_layers(xcf->layers, 1);
+  xcf_image_free(xcf);
+  return TRUE;
+}
+
+// Checks every template of project like plugin does before rendering.
+// Returns number of problems found.
+static guint check_project(const gchar* project_dir) {
+  gchar* config_path = g_build_filename(project_dir, "config.json", NULL);
+  gchar* xcfs_dir = g_build_filename(project_dir, "xcfs", NULL);
+  GHashTable* xcfs = parse_json_config(config_path);
+  guint problems = 0;
+  if (!xcfs) {
+    printf("Failed to parse %s\n", config_path);
+    ++problems;
+  } else {
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, xcfs);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+      ComponentTemplate* ct = (ComponentTemplate*)value;
+      if (ct->out_key && !g_hash_table_contains(ct->layers, ct->out_key)) {
+        printf("%s: out layer %s is not configured\n", (gchar*)key, ct->out_key);
+        ++problems;
+      }
+      GPtrArray* xcf_layers = g_ptr_array_new_with_free_func((GDestroyNotify)&g_hash_table_unref);
+      for (guint i = 0; i < ct->xcfs->len; ++i) {
+        TemplateXcf* template_xcf = (TemplateXcf*)g_ptr_array_index(ct->xcfs, i);
+        gchar* xcf_filename = g_strconcat(template_xcf->name, ".xcf", NULL);
+        gchar* xcf_path = g_build_filename(xcfs_dir, xcf_filename, NULL);
+        XcfImage* xcf = xcf_image_open(xcf_path);
+        if (!xcf) {
+          ++problems;
+        } else {
+          GHashTable* layers = new_template_xcf_layers(ct, &xcf_has_layer, xcf);
+          guint template_problems = xcf_check_config_layers(xcf, layers);
+          printf("%s: %u problems\n", xcf_filename, template_problems);
+          problems += template_problems;
+          g_ptr_array_add(xcf_layers, layers);
+          xcf_image_free(xcf);
+        }
+        g_free(xcf_path);
+        g_free(xcf_filename);
+      }
+      if (xcf_layers->len == ct->xcfs->len) {
+        problems += check_template_layers_covered(key, ct, xcf_layers);
+      }
+      g_ptr_array_free(xcf_layers, TRUE);
+    }
+    g_hash_table_destroy(xcfs);
+  }
+  g_free(xcfs_dir);
+  g_free(config_path);
+  return problems;
+}
+
+int main(int argc, char** argv) {
+  gchar* project_dir = NULL;
+  GOptionEntry entries[] = {
+    {"check", 'c', 0, G_OPTION_ARG_FILENAME, &project_dir, "Check config of project against its templates", "PROJECT_DIR"},
+    {NULL}
+  };
+  GOptionContext* context = g_option_context_new("[FILE.xcf...] - print layer tree of XCF files");
+  g_option_context_add_main_entries(context, entries, NULL);
+  GError* error = NULL;
+  if (!g_option_context_parse(context, &argc, &argv, &error) || (!project_dir && argc < 2)) {
+    printf("%s\n", error ? error->message : "Usage: xcf-index [--check PROJECT_DIR] [FILE.xcf...]");
+    g_clear_error(&error);
+    g_option_context_free(context);
+    return 2;
+  }
+  g_option_context_free(context);
+
+  gint64 start = g_get_monotonic_time();
+  gboolean ok = TRUE;
+  for (gint i = 1; i < argc; ++i) {
+    ok = print_xcf(argv[i]) && ok;
+  }
+  if (project_dir) {
+    guint problems = check_project(project_dir);
+    printf("Check found %u problems\n", problems);
+    ok = ok && problems == 0;
+    g_free(project_dir);
+  }
+  printf("Done in %.1f ms\n", (g_get_monotonic_time() - start) / 1000.0);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,521 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "xcf-reader.h"
+
+static const gint XCF_TILE_SIZE = 64;
+
+typedef enum {
+  PROP_END = 0,
+  PROP_COLORMAP = 1,
+  PROP_OPACITY = 6,
+  PROP_MODE = 7,
+  PROP_VISIBLE = 8,
+  PROP_OFFSETS = 15,
+  PROP_COMPRESSION = 17,
+  PROP_RESOLUTION = 19,
+  PROP_PARASITES = 21,
+  PROP_GROUP_ITEM = 29,
+  PROP_ITEM_PATH = 30,
+  PROP_FLOAT_OPACITY = 33
+} XcfProperty;
+
+typedef enum {
+  COMPRESS_NONE = 0,
+  COMPRESS_RLE = 1,
+  COMPRESS_ZLIB = 2
+} XcfCompression;
+
+typedef enum {
+  IMAGE_RGB = 0,
+  IMAGE_GRAY = 1,
+  IMAGE_INDEXED = 2
+} XcfBaseType;
+
+// Bounds checked big endian reader over mapped file. Reads past end return
+// zero and set error, so callers check error once after group of reads.
+typedef struct {
+  const guint8* data;
+  gsize size;
+  gsize pos;
+  gboolean error;
+} XcfCursor;
+
+static gboolean cursor_has(XcfCursor* c, gsize n) {
+  if (c->error || c->pos > c->size || c->size - c->pos < n) {
+    c->error = TRUE;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static guint8 read_u8(XcfCursor* c) {
+  if (!cursor_has(c, 1)) return 0;
+  return c->data[c->pos++];
+}
+
+static guint32 read_u32(XcfCursor* c) {
+  if (!cursor_has(c, 4)) return 0;
+  const guint8* p = c->data + c->pos;
+  c->pos += 4;
+  return ((guint32)p[0] << 24) | ((guint32)p[1] << 16) | ((guint32)p[2] << 8) | p[3];
+}
+
+static gint32 read_i32(XcfCursor* c) {
+  return (gint32)read_u32(c);
+}
+
+static gfloat read_f32(XcfCursor* c) {
+  union { guint32 u; gfloat f; } v;
+  v.u = read_u32(c);
+  return v.f;
+}
+
+// Pointers are 64 bit since version 11
+static guint64 read_pointer(XcfCursor* c, gint version) {
+  if (version < 11) return read_u32(c);
+  guint64 high = read_u32(c);
+  return (high << 32) | read_u32(c);
+}
+
+static gchar* read_string(XcfCursor* c) {
+  guint32 len = read_u32(c);
+  if (len == 0 || !cursor_has(c, len)) return NULL;
+  gchar* str = g_strndup((const gchar*)c->data + c->pos, len);
+  c->pos += len;
+  return str;
+}
+
+static XcfLayer* new_xcf_layer(void) {
+  XcfLayer* layer = g_malloc0(sizeof(XcfLayer));
+  layer->visible = TRUE;
+  layer->opacity = 1.0;
+  layer->mode = XCF_MODE_NORMAL_LEGACY;
+  return layer;
+}
+
+static void del_xcf_layer(XcfLayer* layer) {
+  if (!layer) return;
+  g_free(layer->name);
+  g_free(layer->text_parasite);
+  if (layer->children) g_ptr_array_free(layer->children, TRUE);
+  g_free(layer);
+}
+
+static void read_parasites(XcfCursor* c, gsize end, XcfLayer* layer) {
+  while (!c->error && c->pos < end) {
+    gchar* name = read_string(c);
+    read_u32(c); // flags
+    guint32 size = read_u32(c);
+    if (!cursor_has(c, size)) {
+      g_free(name);
+      return;
+    }
+    if (0 == g_strcmp0(name, "gimp-text-layer")) {
+      g_free(layer->text_parasite);
+      layer->text_parasite = g_strndup((const gchar*)c->data + c->pos, size);
+    }
+    c->pos += size;
+    g_free(name);
+  }
+}
+
+static gboolean read_image_properties(XcfCursor* c, XcfImage* image) {
+  while (!c->error) {
+    guint32 type = read_u32(c);
+    guint32 len = read_u32(c);
+    gsize start = c->pos;
+    switch (type) {
+      case PROP_END:
+        return TRUE;
+      case PROP_COLORMAP:
+        image->colormap_len = read_u32(c);
+        // Length of colormap payload was written wrong by old GIMP versions
+        len = 4 + 3 * image->colormap_len;
+        if (!cursor_has(c, 3 * image->colormap_len)) return FALSE;
+        g_free(image->colormap);
+        image->colormap = g_memdup2(c->data + c->pos, 3 * image->colormap_len);
+        break;
+      case PROP_COMPRESSION:
+        image->compression = read_u8(c);
+        break;
+      case PROP_RESOLUTION:
+        image->xres = read_f32(c);
+        image->yres = read_f32(c);
+        break;
+      default:
+        break;
+    }
+    c->pos = start + len;
+  }
+  return FALSE;
+}
+
+static gboolean read_layer_properties(XcfCursor* c, XcfLayer* layer, GArray* path) {
+  while (!c->error) {
+    guint32 type = read_u32(c);
+    guint32 len = read_u32(c);
+    gsize start = c->pos;
+    switch (type) {
+      case PROP_END:
+        // GIMP itself tells text layers apart by their parasite
+        if (layer->kind != XCF_LAYER_GROUP && layer->text_parasite) {
+          layer->kind = XCF_LAYER_TEXT;
+        }
+        return TRUE;
+      case PROP_OPACITY:
+        layer->opacity = read_u32(c) / 255.0;
+        break;
+      case PROP_FLOAT_OPACITY:
+        layer->opacity = read_f32(c);
+        break;
+      case PROP_MODE:
+        layer->mode = read_i32(c);
+        break;
+      case PROP_VISIBLE:
+        layer->visible = read_u32(c) != 0;
+        break;
+      case PROP_OFFSETS:
+        layer->offset_x = read_i32(c);
+        layer->offset_y = read_i32(c);
+        break;
+      case PROP_PARASITES:
+        read_parasites(c, start + len, layer);
+        break;
+      case PROP_GROUP_ITEM:
+        layer->kind = XCF_LAYER_GROUP;
+        break;
+      case PROP_ITEM_PATH:
+        for (guint32 i = 0; i < len / 4; ++i) {
+          guint32 index = read_u32(c);
+          g_array_append_val(path, index);
+        }
+        break;
+      default:
+        break;
+    }
+    c->pos = start + len;
+  }
+  return FALSE;
+}
+
+// Supports only 8 bit gamma and linear precisions, which all templates
+// saved by GIMP 2 and default GIMP 3 images use
+gboolean xcf_image_pixels_supported(XcfImage* image) {
+  if (image->version < 4) return TRUE;
+  if (image->version == 4) return image->precision == 0;
+  if (image->version < 7) return image->precision == 0 || image->precision == 1;
+  return image->precision == 100 || image->precision == 150 || image->precision == 175;
+}
+
+static XcfLayer* read_layer(XcfCursor* c, XcfImage* image, GArray* path) {
+  XcfLayer* layer = new_xcf_layer();
+  layer->width = read_u32(c);
+  layer->height = read_u32(c);
+  layer->type = read_u32(c);
+  layer->name = read_string(c);
+  if (!read_layer_properties(c, layer, path)) {
+    del_xcf_layer(layer);
+    return NULL;
+  }
+  layer->hierarchy = read_pointer(c, image->version);
+  layer->has_mask = read_pointer(c, image->version) != 0;
+  if (c->error || !layer->name) {
+    del_xcf_layer(layer);
+    return NULL;
+  }
+  if (layer->kind == XCF_LAYER_GROUP) {
+    layer->children = g_ptr_array_new();
+  }
+  return layer;
+}
+
+// Layers are stored flat in stacking order with item path telling position
+// in tree. Parent of layer is last group seen one level up.
+static void add_layer_to_tree(XcfImage* image, XcfLayer* layer, GArray* path, GPtrArray* groups) {
+  guint depth = MAX(path->len, 1);
+  g_ptr_array_set_size(groups, depth);
+  XcfLayer* parent = depth > 1 ? g_ptr_array_index(groups, depth - 2) : NULL;
+  layer->parent = parent;
+  g_ptr_array_add(parent ? parent->children : image->layers, layer);
+  g_ptr_array_index(groups, depth - 1) = layer->kind == XCF_LAYER_GROUP ? layer : NULL;
+}
+
+XcfImage* xcf_image_open(const gchar* path) {
+  GError* error = NULL;
+  GMappedFile* file = g_mapped_file_new(path, FALSE, &error);
+  if (!file) {
+    printf("Unable to open %s: %s\n", path, error->message);
+    g_error_free(error);
+    return NULL;
+  }
+  XcfCursor c = {(const guint8*)g_mapped_file_get_contents(file), g_mapped_file_get_length(file), 0, FALSE};
+  if (c.size < 14 || memcmp(c.data, "gimp xcf ", 9) != 0) {
+    printf("%s is not an XCF file\n", path);
+    g_mapped_file_unref(file);
+    return NULL;
+  }
+
+  XcfImage* image = g_malloc0(sizeof(XcfImage));
+  image->file = file;
+  image->xres = image->yres = 72.0;
+  image->layers = g_ptr_array_new();
+  image->all_layers = g_ptr_array_new_with_free_func((GDestroyNotify)&del_xcf_layer);
+  if (memcmp(c.data + 9, "file", 4) != 0) {
+    image->version = atoi((const gchar*)c.data + 10);
+  }
+  c.pos = 14;
+  image->width = read_u32(&c);
+  image->height = read_u32(&c);
+  image->base_type = read_u32(&c);
+  image->precision = image->version >= 4 ? read_u32(&c) : 0;
+  if (!read_image_properties(&c, image)) {
+    printf("%s: corrupt image properties\n", path);
+    xcf_image_free(image);
+    return NULL;
+  }
+
+  GArray* offsets = g_array_new(FALSE, FALSE, sizeof(guint64));
+  for (guint64 offset = read_pointer(&c, image->version); offset != 0 && !c.error; offset = read_pointer(&c, image->version)) {
+    g_array_append_val(offsets, offset);
+  }
+
+  GArray* item_path = g_array_new(FALSE, FALSE, sizeof(guint32));
+  GPtrArray* groups = g_ptr_array_new();
+  gboolean ok = !c.error;
+  for (guint i = 0; ok && i < offsets->len; ++i) {
+    XcfCursor lc = {c.data, c.size, g_array_index(offsets, guint64, i), FALSE};
+    g_array_set_size(item_path, 0);
+    XcfLayer* layer = read_layer(&lc, image, item_path);
+    if (!layer) {
+      printf("%s: corrupt layer %u\n", path, i);
+      ok = FALSE;
+      break;
+    }
+    g_ptr_array_add(image->all_layers, layer);
+    add_layer_to_tree(image, layer, item_path, groups);
+  }
+  g_ptr_array_free(groups, TRUE);
+  g_array_free(item_path, TRUE);
+  g_array_free(offsets, TRUE);
+  if (!ok) {
+    xcf_image_free(image);
+    return NULL;
+  }
+  return image;
+}
+
+void xcf_image_free(XcfImage* image) {
+  if (!image) return;
+  g_ptr_array_free(image->layers, TRUE);
+  g_ptr_array_free(image->all_layers, TRUE);
+  g_free(image->colormap);
+  g_mapped_file_unref(image->file);
+  g_free(image);
+}
+
+XcfLayer* xcf_image_find_layer(XcfImage* image, const gchar* name) {
+  for (guint i = 0; i < image->all_layers->len; ++i) {
+    XcfLayer* layer = g_ptr_array_index(image->all_layers, i);
+    if (0 == g_strcmp0(layer->name, name)) return layer;
+  }
+  return NULL;
+}
+
+// Channels of RLE tile are stored one after another, each as runs of
+// identical bytes and literal spans
+static gboolean decode_rle_tile(const guint8* src, gsize src_len, guint8* dst, gint pixels, gint bpp) {
+  const guint8* end = src + src_len;
+  for (gint ch = 0; ch < bpp; ++ch) {
+    gint n = 0;
+    while (n < pixels) {
+      if (src >= end) return FALSE;
+      guint8 op = *src++;
+      gint len;
+      if (op >= 128) {
+        if (op == 128) {
+          if (end - src < 2) return FALSE;
+          len = (src[0] << 8) | src[1];
+          src += 2;
+        } else {
+          len = 256 - op;
+        }
+        if (n + len > pixels || end - src < len) return FALSE;
+        for (gint k = 0; k < len; ++k) {
+          dst[(n + k) * bpp + ch] = src[k];
+        }
+        src += len;
+      } else {
+        if (op == 127) {
+          if (end - src < 2) return FALSE;
+          len = (src[0] << 8) | src[1];
+          src += 2;
+        } else {
+          len = op + 1;
+        }
+        if (n + len > pixels || src >= end) return FALSE;
+        guint8 value = *src++;
+        for (gint k = 0; k < len; ++k) {
+          dst[(n + k) * bpp + ch] = value;
+        }
+      }
+      n += len;
+    }
+  }
+  return TRUE;
+}
+
+static gboolean decode_zlib_tile(const guint8* src, gsize src_len, guint8* dst, gsize dst_len) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit(&stream) != Z_OK) return FALSE;
+  stream.next_in = (Bytef*)src;
+  stream.avail_in = src_len;
+  stream.next_out = dst;
+  stream.avail_out = dst_len;
+  int ret = inflate(&stream, Z_FINISH);
+  inflateEnd(&stream);
+  return (ret == Z_STREAM_END || ret == Z_BUF_ERROR) && stream.avail_out == 0;
+}
+
+static inline guint32 premultiplied_argb(guint8 r, guint8 g, guint8 b, guint8 a) {
+  if (a == 0) return 0;
+  if (a != 255) {
+    r = (r * a + 127) / 255;
+    g = (g * a + 127) / 255;
+    b = (b * a + 127) / 255;
+  }
+  return ((guint32)a << 24) | ((guint32)r << 16) | ((guint32)g << 8) | b;
+}
+
+static void tile_to_surface(XcfImage* image, const guint8* tile, gint bpp, gint tw, gint th, guint8* dst, gint stride) {
+  gboolean alpha = bpp == 2 || bpp == 4;
+  for (gint y = 0; y < th; ++y) {
+    guint32* row = (guint32*)(dst + y * stride);
+    const guint8* p = tile + y * tw * bpp;
+    for (gint x = 0; x < tw; ++x, p += bpp) {
+      guint8 a = alpha ? p[bpp - 1] : 255;
+      switch (image->base_type) {
+        case IMAGE_GRAY:
+          row[x] = premultiplied_argb(p[0], p[0], p[0], a);
+          break;
+        case IMAGE_INDEXED: {
+          gint i = MIN(p[0], MAX(image->colormap_len - 1, 0));
+          const guint8* color = image->colormap ? image->colormap + 3 * i : (const guint8*)"\0\0\0";
+          row[x] = premultiplied_argb(color[0], color[1], color[2], a);
+          break;
+        }
+        default:
+          row[x] = premultiplied_argb(p[0], p[1], p[2], a);
+          break;
+      }
+    }
+  }
+}
+
+cairo_surface_t* xcf_layer_load_surface(XcfImage* image, XcfLayer* layer) {
+  if (layer->kind == XCF_LAYER_GROUP || layer->hierarchy == 0) return NULL;
+  if (!xcf_image_pixels_supported(image)) {
+    printf("Layer %s has pixels of unsupported precision %u, only 8 bit precision is supported\n", layer->name, image->precision);
+    return NULL;
+  }
+  XcfCursor c = {(const guint8*)g_mapped_file_get_contents(image->file), g_mapped_file_get_length(image->file), layer->hierarchy, FALSE};
+  gint width = read_u32(&c);
+  gint height = read_u32(&c);
+  gint bpp = read_u32(&c);
+  // First level is full size, rest are unused mipmaps
+  c.pos = read_pointer(&c, image->version);
+  gint level_width = read_u32(&c);
+  gint level_height = read_u32(&c);
+  if (c.error || bpp < 1 || bpp > 4 || width != layer->width || height != layer->height
+      || level_width != width || level_height != height) {
+    printf("Layer %s has unsupported pixel data\n", layer->name);
+    return NULL;
+  }
+
+  cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  guint8* data = cairo_image_surface_get_data(surface);
+  gint stride = cairo_image_surface_get_stride(surface);
+  guint8* tile = g_malloc(XCF_TILE_SIZE * XCF_TILE_SIZE * bpp);
+  gint tiles_x = (width + XCF_TILE_SIZE - 1) / XCF_TILE_SIZE;
+  gint tiles_y = (height + XCF_TILE_SIZE - 1) / XCF_TILE_SIZE;
+  guint64 offset = read_pointer(&c, image->version);
+  gboolean ok = !c.error;
+  for (gint t = 0; ok && t < tiles_x * tiles_y; ++t) {
+    guint64 next = read_pointer(&c, image->version);
+    gint tx = t % tiles_x;
+    gint ty = t / tiles_x;
+    gint tw = MIN(XCF_TILE_SIZE, width - tx * XCF_TILE_SIZE);
+    gint th = MIN(XCF_TILE_SIZE, height - ty * XCF_TILE_SIZE);
+    gsize raw_len = (gsize)tw * th * bpp;
+    // Size of last tile is not stored, compressed data is bounded by file
+    gsize src_len = next > offset ? next - offset : c.size - MIN(offset, c.size);
+    if (c.error || offset >= c.size) {
+      ok = FALSE;
+      break;
+    }
+    src_len = MIN(src_len, c.size - offset);
+    const guint8* src = c.data + offset;
+    switch (image->compression) {
+      case COMPRESS_NONE:
+        ok = src_len >= raw_len;
+        if (ok) memcpy(tile, src, raw_len);
+        break;
+      case COMPRESS_RLE:
+        ok = decode_rle_tile(src, src_len, tile, tw * th, bpp);
+        break;
+      case COMPRESS_ZLIB:
+        ok = decode_zlib_tile(src, src_len, tile, raw_len);
+        break;
+      default:
+        ok = FALSE;
+        break;
+    }
+    if (ok) {
+      tile_to_surface(image, tile, bpp, tw, th, data + ty * XCF_TILE_SIZE * stride + tx * XCF_TILE_SIZE * 4, stride);
+    }
+    offset = next;
+  }
+  g_free(tile);
+  if (!ok) {
+    printf("Unable to decode pixels of layer %s\n", layer->name);
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+  cairo_surface_mark_dirty(surface);
+  return surface;
+}
+
+// Parasite is list of s-expressions like (font "Sans") or (font-size 24)
+gchar* xcf_text_property(const gchar* text_parasite, const gchar* name) {
+  if (!text_parasite) return NULL;
+  gchar* pattern = g_strdup_printf("(%s ", name);
+  const gchar* found = text_parasite;
+  // Property must start expression, not be part of nested value
+  while ((found = strstr(found, pattern)) != NULL) {
+    if (found == text_parasite || found[-1] == '\n' || found[-1] == ' ') break;
+    found++;
+  }
+  const gchar* value = found ? found + strlen(pattern) : NULL;
+  g_free(pattern);
+  if (!value) return NULL;
+
+  if (*value == '"') {
+    GString* str = g_string_new(NULL);
+    for (const gchar* p = value + 1; *p && *p != '"'; ++p) {
+      if (*p == '\\' && p[1]) ++p;
+      g_string_append_c(str, *p);
+    }
+    return g_string_free(str, FALSE);
+  }
+  // Nested expression is returned whole, e.g. (color-rgb 0 0 0)
+  gint depth = 0;
+  const gchar* end = value;
+  for (; *end; ++end) {
+    if (*end == '(') ++depth;
+    else if (*end == ')' && depth-- == 0) break;
+  }
+  return g_strstrip(g_strndup(value, end - value));
+}
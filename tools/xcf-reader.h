@@ -0,0 +1,109 @@
+// Reader of the XCF subset used by component templates: 8-bit raster, text
+// and group layers with offsets, opacity, blend mode and visibility. Layer
+// properties are read on open, pixel tiles only when a layer is decoded, so
+// inspecting layer tree does not touch tile data. Layer tree of images of any
+// precision can be inspected, only pixels of 8-bit images can be decoded.
+#ifndef XCF_READER_H
+#define XCF_READER_H
+
+#include <glib.h>
+#include <cairo.h>
+
+typedef enum {
+  XCF_LAYER_RASTER = 0,
+  XCF_LAYER_TEXT = 1,
+  XCF_LAYER_GROUP = 2
+} XcfLayerKind;
+
+// GIMP layer modes the renderer distinguishes, values as stored in XCF
+typedef enum {
+  XCF_MODE_NORMAL_LEGACY = 0,
+  XCF_MODE_MULTIPLY_LEGACY = 3,
+  XCF_MODE_SCREEN_LEGACY = 4,
+  XCF_MODE_OVERLAY_LEGACY = 5,
+  XCF_MODE_DIFFERENCE_LEGACY = 6,
+  XCF_MODE_ADDITION_LEGACY = 7,
+  XCF_MODE_DARKEN_ONLY_LEGACY = 9,
+  XCF_MODE_LIGHTEN_ONLY_LEGACY = 10,
+  XCF_MODE_HSV_HUE_LEGACY = 11,
+  XCF_MODE_HSV_SATURATION_LEGACY = 12,
+  XCF_MODE_HSL_COLOR_LEGACY = 13,
+  XCF_MODE_HSV_VALUE_LEGACY = 14,
+  XCF_MODE_DODGE_LEGACY = 16,
+  XCF_MODE_BURN_LEGACY = 17,
+  XCF_MODE_HARDLIGHT_LEGACY = 18,
+  XCF_MODE_SOFTLIGHT_LEGACY = 19,
+  XCF_MODE_OVERLAY = 23,
+  XCF_MODE_NORMAL = 28,
+  XCF_MODE_MULTIPLY = 30,
+  XCF_MODE_SCREEN = 31,
+  XCF_MODE_DIFFERENCE = 32,
+  XCF_MODE_ADDITION = 33,
+  XCF_MODE_DARKEN_ONLY = 35,
+  XCF_MODE_LIGHTEN_ONLY = 36,
+  XCF_MODE_HSV_HUE = 37,
+  XCF_MODE_HSV_SATURATION = 38,
+  XCF_MODE_HSL_COLOR = 39,
+  XCF_MODE_HSV_VALUE = 40,
+  XCF_MODE_DODGE = 42,
+  XCF_MODE_BURN = 43,
+  XCF_MODE_HARDLIGHT = 44,
+  XCF_MODE_SOFTLIGHT = 45,
+  XCF_MODE_EXCLUSION = 52,
+  XCF_MODE_PASS_THROUGH = 61
+} XcfLayerMode;
+
+typedef struct XcfLayer {
+  gchar* name;
+  XcfLayerKind kind;
+  gint width;
+  gint height;
+  gint offset_x;
+  gint offset_y;
+  gboolean visible;
+  gdouble opacity;
+  gint mode;
+  gint type;
+  gboolean has_mask;
+  guint64 hierarchy;
+  // Properties of text layer as GIMP stores them, NULL for other layers
+  gchar* text_parasite;
+  // Children of group layer from top to bottom, NULL for other layers
+  GPtrArray* children;
+  struct XcfLayer* parent;
+} XcfLayer;
+
+typedef struct {
+  gint version;
+  gint width;
+  gint height;
+  gint base_type;
+  // Precision as stored in file, 0 for versions which have none
+  guint32 precision;
+  gint compression;
+  gdouble xres;
+  gdouble yres;
+  guint8* colormap;
+  gint colormap_len;
+  // Top level layers from top to bottom
+  GPtrArray* layers;
+  // All layers in file order, owns them
+  GPtrArray* all_layers;
+  GMappedFile* file;
+} XcfImage;
+
+XcfImage* xcf_image_open(const gchar* path);
+void xcf_image_free(XcfImage* image);
+XcfLayer* xcf_image_find_layer(XcfImage* image, const gchar* name);
+// Whether pixels of layers of image can be decoded, i.e. it has 8 bit precision
+gboolean xcf_image_pixels_supported(XcfImage* image);
+
+// Decodes pixels of raster or text layer into premultiplied ARGB32 surface
+// of layer size. Returns NULL for images with other than 8 bit precision.
+cairo_surface_t* xcf_layer_load_surface(XcfImage* image, XcfLayer* layer);
+
+// Value of property of gimp-text-layer parasite, e.g. "font" or
+// "font-size". Strings are unquoted. Returns NULL when missing.
+gchar* xcf_text_property(const gchar* text_parasite, const gchar* name);
+
+#endif // XCF_READER_H